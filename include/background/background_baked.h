@@ -0,0 +1,80 @@
+#pragma once
+/****************************************************************************
+ *      background_baked.h: a background tabulated from another background
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_BACKGROUND_BAKED_H
+#define YAFARAY_BACKGROUND_BAKED_H
+
+#include "background.h"
+#include "common/color.h"
+#include <memory>
+#include <vector>
+
+BEGIN_YAFARAY
+
+class ParamMap;
+class Vec3;
+
+/*! Background that evaluates an analytic background once into lat-long tables (using the same
+	spherical mapping as BackgroundLight) and afterwards answers every lookup with a bilinear fetch.
+	Camera lookups (operator()) and light lookups (eval()) can differ, for example by the IBL power,
+	so each kind of lookup and each from_postprocessed value gets its own table. Identical tables are
+	shared. Each table resolution is doubled until the interpolation error measured between the table
+	samples is below the requested relative error, or until the maximum resolution is reached.
+	Backgrounds with a discontinuity at the horizon are baked as two hemispheres that are never
+	interpolated across the horizon.
+*/
+
+class BakedBackground final : public Background
+{
+	public:
+		//! Returns a baked background owning "background" if the "bake" parameter is enabled, or "background" itself otherwise
+		static Background *bakeIfEnabled(Background *background, const ParamMap &params, bool horizon_discontinuity = false);
+
+	private:
+		struct Table
+		{
+			bool operator==(const Table &table) const;
+			std::vector<Rgb> texels_;
+			int width_ = 0, height_ = 0;
+		};
+		enum Query : int { CameraQuery = 0, CameraPostprocessedQuery, LightQuery, LightPostprocessedQuery, NumQueries };
+
+		BakedBackground(Background *background, int resolution, float max_error, bool horizon_discontinuity);
+		virtual Rgb operator()(const Ray &ray, RenderState &state, bool from_postprocessed = false) const override;
+		virtual Rgb eval(const Ray &ray, bool from_postprocessed = false) const override;
+		virtual ~BakedBackground() override = default;
+		virtual bool hasIbl() const override { return background_->hasIbl(); }
+		virtual bool shootsCaustic() const override { return background_->shootsCaustic(); }
+		void bake(Table &table, int width, int query) const;
+		float maxInterpolationError(const Table &table, int query) const;
+		Rgb lookup(const Table &table, const Vec3 &dir) const;
+		Rgb lookup(const Table &table, float u, float v, bool upper_hemisphere) const;
+		Rgb evalAnalytic(const Vec3 &dir, int query) const;
+
+		std::unique_ptr<Background> background_;
+		std::vector<std::unique_ptr<Table>> tables_;
+		const Table *query_tables_[NumQueries];
+		bool horizon_discontinuity_ = false;
+		static constexpr int max_resolution_ = 4096;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_BACKGROUND_BAKED_H
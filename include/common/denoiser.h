@@ -0,0 +1,69 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_DENOISER_H
+#define YAFARAY_DENOISER_H
+
+#include "constants.h"
+#include "common/color.h"
+#include <atomic>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Feature guided denoiser of HDR images: a cross bilateral filter whose weights combine the distance between the pixels,
+	the relative distance between their prefiltered colors and the distances between their normals, depths and albedos
+	(diffuse colors). The albedo is divided out before filtering and multiplied back afterwards, so that the textures
+	stay sharp while the lighting is smoothed. Works in linear float color, before any color space or tone mapping */
+class FeatureDenoiser final
+{
+	public:
+		FeatureDenoiser(int radius, float color_sigma, float normal_sigma, float depth_sigma, float albedo_sigma);
+		/*! Denoises the color image in place, keeping its alpha. The images are stored by rows, and each feature image can
+			be empty when not rendered. The normals are the unit vectors mapped to [0,1] by the normal render passes.
+			The image is split in square tiles of the given size, filtered in parallel by the given number of threads */
+		void denoise(std::vector<Rgba> &color, const std::vector<Rgb> &normal, const std::vector<float> &depth, const std::vector<Rgb> &albedo, int width, int height, int tile_size, int num_threads) const;
+
+	private:
+		struct Features
+		{
+			Rgb normal_;
+			float depth_;
+			Rgb albedo_;
+		};
+		struct Image
+		{
+			const std::vector<Rgba> *color_;
+			std::vector<Features> features_; //!< zero for the features not rendered
+			std::vector<Rgb> guide_; //!< colors box filtered over 3x3 pixels, for less noisy color distances
+			std::vector<Rgb> reflectance_; //!< colors divided by the albedos
+			std::vector<Rgba> result_;
+			int width_, height_, tile_size_, tiles_x_, num_tiles_;
+			std::atomic<int> next_tile_;
+		};
+		void denoiseWorker(Image &image) const;
+		void denoiseTile(Image &image, int x_0, int y_0, int x_1, int y_1) const;
+		static Rgb albedoDivisor(const Rgb &albedo);
+		int radius_;
+		float inv_spatial_, inv_color_, inv_normal_, inv_depth_, inv_albedo_; //!< inverses of twice the squared sigmas
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_DENOISER_H
@@ -81,6 +81,27 @@ class File final
 		FILE *fp_ = nullptr;
 };
 
+/*! Read-only access to the whole contents of a file. The file is memory mapped where the
+	platform supports it, otherwise it is read into memory. */
+class MappedFile final
+{
+	public:
+		MappedFile(const std::string &path);
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		bool isValid() const { return valid_; }
+		const char *data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+		const char *data_ = nullptr;
+		size_t size_ = 0;
+		bool valid_ = false;
+		bool mapped_ = false;
+		std::vector<char> buffer_; //!< Contents of the file when it could not be mapped
+};
+
 template <typename T> bool File::read(T &value) const
 {
 	static_assert(std::is_pod<T>::value, "T must be a plain old data (POD) type like char, int32_t, float, etc");
@@ -26,6 +26,7 @@
 
 #include "constants.h"
 #include "imagesplitter.h"
+#include "common/imagefilm_pass.h"
 #include "utility/util_image_buffers.h"
 #include "utility/util_tiled_array.h"
 #include "utility/util_thread.h"
@@ -103,6 +104,12 @@ class ImageFilm final
 		void setPremult2(bool premult);
 		/*! Sets the adaptative AA sampling threshold */
 		void setAaThreshold(float thresh) { aa_thesh_ = thresh; }
+		/*! Sets the target relative error of noise-budgeted renders (0 to disable). When set, the film estimates the variance
+			of the pixels from their samples and the adaptive AA passes resample the pixels above the target, instead of the
+			pixels differing from their neighbours by more than the AA threshold. Must be set before init() */
+		void setAaNoiseTarget(float noise_target) { aa_noise_target_ = noise_target; }
+		/*! Root mean square of the estimated relative errors of the pixels, or -1 if the variances are not estimated */
+		float getRelativeError() const;
 		/*! Sets a custom progress bar in the image film */
 		void setProgressBar(ProgressBar *pb);
 		/*! The following methods set the strings used for the parameters badge rendering */
@@ -147,14 +154,31 @@ class ImageFilm final
 		void generateDebugFacesEdges(int num_view, int idx_pass, int xstart, int width, int ystart, int height, bool drawborder, ColorOutput *out_1, int out_1_displacement = 0, ColorOutput *out_2 = nullptr, int out_2_displacement = 0);
 		void generateToonAndDebugObjectEdges(int num_view, int idx_pass, int xstart, int width, int ystart, int height, bool drawborder, ColorOutput *out_1, int out_1_displacement = 0, ColorOutput *out_2 = nullptr, int out_2_displacement = 0);
 
-		Rgba2DImageWeighed_t *getImagePassFromIntPassType(int int_pass_type);
+		FilmPass *getImagePassFromIntPassType(int int_pass_type);
 		int getImagePassIndexFromIntPassType(int int_pass_type);
 		int getAuxImagePassIndexFromIntPassType(int int_pass_type);
 
 	private:
-		std::vector<Rgba2DImageWeighed_t *> image_passes_; //!< rgba color buffers for the render passes
-		std::vector<Rgba2DImageWeighed_t *> aux_image_passes_; //!< rgba color buffers for the auxiliary image passes
+		float pixelRelativeVariance(int x, int y) const;
+		std::vector<Rgba> featureDenoisedCombined(); //!< Combined pass denoised with the guide of the normal, depth and diffuse color passes, by rows
+		struct SamplePass //!< film pass updated by the samples
+		{
+			FilmPass *image_pass_;
+			int color_index_; //!< index of the color of the pass in the color passes of the samples
+			bool aa_samples_; //!< the AA samples pass only adds to its weight
+		};
+		static constexpr int max_sample_passes_ = 128; //!< more than all the external and auxiliary passes that can be enabled
+		template <int num_passes> void splatSample(const Rgba *colors, int x_0, int x_1, int y_0, int y_1, const int *x_index, const int *y_index, float aa_samples_weight, float sample_bri); //!< adds the sample to the pixels of its filter footprint, with the loop over the passes unrolled for the given number of passes (0 for any)
+		FilmPass *createImagePass(int int_pass_type, bool half_float) const;
+		//! Rounds the samples accumulated in floats by the half float passes in the area into their means, before reading them (see FilmPass::fold())
+		void foldHalfFloatPasses(int x_0, int x_1, int y_0, int y_1);
+		void foldHalfFloatPasses() { foldHalfFloatPasses(0, w_, 0, h_); }
+		size_t imagePassesMemoryUsed() const;
+		std::vector<FilmPass *> image_passes_; //!< rgba color buffers for the render passes
+		std::vector<FilmPass *> aux_image_passes_; //!< rgba color buffers for the auxiliary image passes
+		std::vector<SamplePass> sample_passes_; //!< image and auxiliary passes updated by the samples, precomputed from the render passes
 		Rgb2DImage_t *density_image_; //!< storage for z-buffer channel
+		Moments2DImage_t *moments_image_ = nullptr; //!< brightness moments of the combined pass samples, for noise-budgeted renders
 		Rgba2DImage_t *dp_image_; //!< render parameters badge image
 		TiledBitArray2D<3> *flags_ = nullptr; //!< flags for adaptive AA sampling;
 		int dp_height_; //!< height of the rendering parameters badge;
@@ -166,6 +190,7 @@ class ImageFilm final
 		ColorSpace color_space_2_ = RawManualGamma;	//For optional secondary file output
 		float gamma_2_ = 1.f;				//For optional secondary file output
 		float aa_thesh_;
+		float aa_noise_target_ = 0.f;
 		bool aa_detect_color_noise_;
 		DarkDetectionType aa_dark_detection_type_;
 		float aa_dark_threshold_factor_;
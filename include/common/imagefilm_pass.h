@@ -0,0 +1,113 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_IMAGEFILM_PASS_H
+#define YAFARAY_IMAGEFILM_PASS_H
+
+#include "constants.h"
+#include "common/color.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Weighted RGBA image of a render pass of the film, stored in blocks of 32x32 pixels. By default the colors are stored as their
+	weighted sums in floats, with these storage options:
+	- half floats: the colors are stored as their weighted means in half floats, which keeps their magnitude bounded while the
+	samples accumulate (8 instead of 16 bytes per pixel). The samples are summed in floats in a temporary accumulator of their
+	block, which fold() rounds into the means with stochastic rounding, so that the updates smaller than half a half float unit
+	of the mean are not lost at high sample counts. The reads do not see the samples added since the last fold
+	- shared weights: the weights are read from another pass getting the same filter weights instead of being stored
+	(4 bytes per pixel less). That pass must get the weight of each sample before this one
+	- sparse: only with shared weights, the blocks are only allocated when they get the first sample with a color different
+	from the background color, which the pixels of the blocks not allocated have. The colors are stored as weighted means,
+	so that the pixels of a new block can start from the background color whatever their weights */
+class FilmPass final
+{
+	public:
+		FilmPass(int width, int height, bool half_float = false, const FilmPass *weights = nullptr, bool sparse = false, const Rgba &background = Rgba(0.f));
+		~FilmPass();
+		//! Adds a sample of the given color and weight. With shared weights the weight must have already been added to the weights pass
+		void addSample(int x, int y, const Rgba &col, float weight);
+		//! Adds the weighted sum of the colors of several samples and their total weight, for merging films
+		void addWeighted(int x, int y, const Rgba &weighted_col, float weight) { add(x, y, weighted_col, weight, sparse_ && equal(weighted_col, background_ * weight)); }
+		void addWeight(int x, int y, float weight); //!< Adds to the weight only, as for the AA samples pass
+		Rgba normalized(int x, int y) const;
+		Rgba weightedColor(int x, int y) const; //!< Weighted sum of the colors
+		float weight(int x, int y) const;
+		void clear(); //!< Sets all the pixels to zero, or releases all the blocks of sparse passes
+		/*! Rounds the samples accumulated in floats by the half float blocks overlapping the area into their means and releases
+			their accumulators. It must not run concurrently with the additions */
+		void fold(int x_0, int x_1, int y_0, int y_1);
+		void fold() { fold(0, width_, 0, height_); }
+		int getWidth() const { return width_; }
+		int getHeight() const { return height_; }
+		size_t memoryUsed() const; //!< bytes used by the allocated blocks
+
+	private:
+		struct Block
+		{
+			std::vector<float> col_; //!< weighted sums of the colors as floats, or weighted means in sparse passes
+			std::vector<uint16_t> half_col_; //!< weighted means of the colors as half floats
+			std::vector<float> weight_; //!< empty with shared weights
+			std::vector<float> pending_; //!< half floats: weighted sums of the colors and weight sums (5 floats per pixel) of the samples added since the last fold, empty without them
+		};
+		static constexpr int block_shift_ = 5;
+		static constexpr int block_size_ = 1 << block_shift_;
+		static constexpr int block_mask_ = block_size_ - 1;
+		void add(int x, int y, const Rgba &weighted_col, float weight, bool is_background);
+		void addSum(int x, int y, const Rgba &weighted_col, float weight); //!< for the passes storing weighted sums, which are never sparse
+		static bool equal(const Rgba &a, const Rgba &b) { return a.r_ == b.r_ && a.g_ == b.g_ && a.b_ == b.b_ && a.a_ == b.a_; }
+		Block *getBlock(int x, int y) const { return blocks_[(y >> block_shift_) * blocks_x_ + (x >> block_shift_)].load(std::memory_order_acquire); }
+		static int pixelIndex(int x, int y) { return ((y & block_mask_) << block_shift_) + (x & block_mask_); }
+		Block *allocateBlock(int x, int y);
+		Rgba getColor(const Block *block, int index) const;
+		void setColor(Block *block, int index, const Rgba &col);
+		void foldBlock(int block_index);
+		int width_, height_, blocks_x_, num_blocks_;
+		bool half_float_, sparse_, means_; //!< the colors are stored as weighted means instead of sums
+		const FilmPass *weights_;
+		Rgba background_;
+		std::unique_ptr<std::atomic<Block *>[]> blocks_;
+		unsigned int folds_ = 0; //!< number of folds, decorrelating the stochastic rounding of successive folds
+};
+
+inline void FilmPass::addSample(int x, int y, const Rgba &col, float weight)
+{
+	if(means_) add(x, y, col * weight, weight, sparse_ && equal(col, background_));
+	else addSum(x, y, col * weight, weight);
+}
+
+inline void FilmPass::addSum(int x, int y, const Rgba &weighted_col, float weight)
+{
+	Block *block = getBlock(x, y);
+	const int index = pixelIndex(x, y);
+	float *col = &block->col_[4 * index];
+	col[0] += weighted_col.r_;
+	col[1] += weighted_col.g_;
+	col[2] += weighted_col.b_;
+	col[3] += weighted_col.a_;
+	if(!weights_) block->weight_[index] += weight;
+}
+
+END_YAFARAY
+
+#endif // YAFARAY_IMAGEFILM_PASS_H
@@ -0,0 +1,51 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_IMPORT_BINARY_H
+#define YAFARAY_IMPORT_BINARY_H
+
+#include "constants.h"
+#include "common/param.h"
+#include <string>
+
+BEGIN_YAFARAY
+
+class Scene;
+class RenderEnvironment;
+
+/*! Binary scene format, carrying the same information as the XML scene format.
+	The file is a sequence of chunks, each one starting at an 8 byte aligned offset, with all values little-endian:
+		char tag[4], uint32 reserved, uint64 payload size, payload, zero padding up to a multiple of 8 bytes
+	Chunk types:
+		"YAFB": file header, always the first chunk: uint32 format version
+		"ELEM": start of an XML element: name, uint32 number of attributes, attribute names and values.
+		        Strings are stored as uint32 length followed by the characters, without terminator
+		"ENDE": end of an XML element: name
+		"MESH": a whole <mesh> element with its contents as raw arrays, aligned to 8 bytes so they can be
+		        read with a single copy each from the memory mapped file. See parseBinaryFile__ for the layout
+	Unknown chunks are skipped, so new chunk types can be added without breaking older loaders.
+*/
+
+bool isBinarySceneFile__(const char *filename);
+bool parseBinaryFile__(const char *filename, Scene *scene, RenderEnvironment *env, ParamMap &render, std::string color_space_string, float input_gamma);
+bool convertXmlToBinary__(const char *xml_filename, const char *binary_filename);
+
+END_YAFARAY
+
+#endif // YAFARAY_IMPORT_BINARY_H
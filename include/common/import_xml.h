@@ -25,15 +25,22 @@
 #include <list>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 BEGIN_YAFARAY
 
 class Scene;
 class RenderEnvironment;
 class XmlParser;
+class XmlMeshLoader;
 enum ColorSpace : int;
 
-bool parseXmlFile__(const char *filename, Scene *scene, RenderEnvironment *env, ParamMap &render, std::string color_space_string, float input_gamma);
+/*! parse_threads: 1 parses the whole file serially. Any other value decodes the meshes in parallel with that many
+	threads (or one per core if <= 0) while the rest of the scene is parsed and built in file order */
+bool parseXmlFile__(const char *filename, Scene *scene, RenderEnvironment *env, ParamMap &render, std::string color_space_string, float input_gamma, int parse_threads = 1);
 
 typedef void (*StartElementCb_t)(XmlParser &p, const char *element, const char **attrs);
 typedef void (*EndElementCb_t)(XmlParser &p, const char *element);
@@ -76,6 +83,7 @@ class XmlParser
 		ParamMap params_, &render_;
 		std::list<ParamMap> eparams_; //! for materials that need to define a whole shader tree etc.
 		ParamMap *cparams_; //! just a pointer to the current paramMap, either params or a eparams element
+		XmlMeshLoader *mesh_loader_ = nullptr; //! set when the meshes are decoded in parallel, see parseXmlFile__
 	protected:
 		std::vector<ParserStateT> state_stack_;
 		ParserStateT *current_;
@@ -84,6 +92,67 @@ class XmlParser
 		ColorSpace input_color_space_;
 };
 
+//! A <mesh> element decoded into arrays, as read from an XML or a binary scene file
+struct MeshData
+{
+	struct FaceGroup
+	{
+		std::string material_; //!< empty for faces without material
+		std::vector<int> indices_, uv_indices_;
+	};
+	int id_ = -1, vertices_ = 0, faces_ = 0, type_ = 0, obj_pass_index_ = 0;
+	bool has_orco_ = false, has_uv_ = false, has_normals_ = false;
+	std::vector<double> points_, orcos_, normals_; //!< normals_ has one normal per point when has_normals_ is set
+	std::vector<float> uvs_;
+	std::vector<FaceGroup> face_groups_;
+};
+
+//! Adds a decoded mesh to the scene through the bulk Scene functions. parser_name prefixes the log messages
+void addMeshData__(Scene *scene, RenderEnvironment *env, const MeshData &mesh, const char *parser_name);
+
+/*! Splits an XML document at its <mesh> elements, which are decoded by worker threads while the rest of the
+	document (the "skeleton", where each mesh is replaced by a <yafaray_mesh_block index="n"/> element)
+	is parsed by libXML. The decoded meshes are added to the scene when their placeholder is reached, so
+	the scene is built in the same order as when parsing serially. The workers only run a few meshes ahead
+	of the placeholder reached by libXML, so the decoded meshes of the whole file are never in memory at once */
+class XmlMeshLoader final
+{
+	public:
+		XmlMeshLoader(const char *data, size_t size, int num_threads);
+		~XmlMeshLoader();
+		const std::string &getSkeleton() const { return skeleton_; }
+		size_t numMeshes() const { return blocks_.size(); }
+		//! Waits until the mesh is decoded and logs its warnings. Returns nullptr if the mesh is malformed
+		const MeshData *getMesh(int index);
+		//! Frees the arrays of a mesh that is no longer needed and lets the workers decode further ahead
+		void releaseMesh(int index);
+		bool addMesh(XmlParser &parser, int index);
+		bool isOk() const { return ok_; }
+
+	private:
+		struct MeshBlock
+		{
+			const char *begin_ = nullptr, *end_ = nullptr;
+			MeshData mesh_;
+			std::vector<std::string> warnings_; //!< Logged by the main thread, to keep the log in file order
+			bool decoded_ = false, valid_ = false;
+		};
+		void decodeWorker();
+		static bool decodeMesh(MeshBlock &block);
+
+		std::vector<MeshBlock> blocks_;
+		std::string skeleton_;
+		std::atomic<size_t> next_block_;
+		std::mutex mutx_;
+		std::condition_variable block_decoded_;
+		std::condition_variable window_moved_;
+		size_t consumed_ = 0; //!< Meshes before this index have been released
+		size_t window_ = 0; //!< At most this many meshes after consumed_ are decoded or being decoded, to bound the memory used
+		std::atomic<bool> stop_ {false}; //!< Set by the destructor, so the workers do not decode the rest of the file after an error
+		std::vector<std::thread> threads_;
+		bool ok_ = true;
+};
+
 // state callbacks:
 void startElDocument__(XmlParser &p, const char *element, const char **attrs);
 void endElDocument__(XmlParser &p, const char *element);
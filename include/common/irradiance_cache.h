@@ -0,0 +1,76 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_IRRADIANCE_CACHE_H
+#define YAFARAY_IRRADIANCE_CACHE_H
+
+#include "constants.h"
+#include "common/vector.h"
+#include "common/color.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+BEGIN_YAFARAY
+
+/*! World-space cache of irradiance records with translational gradients, interpolated with Ward's
+	error metric. Records are kept in a spatial hash of lock-free lists, so they can be added lazily
+	by any render thread while other threads are interpolating from it. */
+class IrradianceCache final
+{
+	public:
+		struct Record
+		{
+			Point3 p_;
+			Vec3 n_;
+			Rgb irradiance_; //!< cosine weighted average of the incoming radiance
+			Vec3 gradient_[3]; //!< translational gradient of each color component of the irradiance
+			float radius_; //!< harmonic mean distance to the surfaces seen from the record, clamped
+			Record *next_ = nullptr;
+		};
+		/*! \param max_radius largest record radius that can be inserted
+			\param accuracy maximum allowed value of the interpolation error metric, lower values need more records */
+		IrradianceCache(float max_radius, float accuracy);
+		~IrradianceCache();
+		IrradianceCache(const IrradianceCache &) = delete;
+		IrradianceCache &operator=(const IrradianceCache &) = delete;
+		//! interpolates the irradiance at p with normal n from the records valid there; returns false if there is none
+		bool interpolate(const Point3 &p, const Vec3 &n, Rgb &irradiance) const;
+		//! adds a copy of the record, can be called concurrently with insert() and interpolate()
+		void insert(const Record &record);
+		size_t size() const { return num_records_.load(std::memory_order_relaxed); }
+		float getAccuracy() const { return accuracy_; }
+
+	private:
+		void cell(const Point3 &p, int &x, int &y, int &z) const;
+		unsigned int hash(int x, int y, int z) const
+		{
+			return (((uint32_t) x * 73856093u) ^ ((uint32_t) y * 19349663u) ^ ((uint32_t) z * 83492791u)) & (num_buckets_ - 1);
+		}
+
+		static constexpr unsigned int num_buckets_ = 1 << 18;
+		float accuracy_;
+		float inv_cell_size_;
+		std::unique_ptr<std::atomic<Record *>[]> buckets_;
+		std::atomic<size_t> num_records_;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_IRRADIANCE_CACHE_H
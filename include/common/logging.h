@@ -27,7 +27,9 @@
 
 #include "constants.h"
 #include "utility/util_thread.h"
+#include <atomic>
 #include <ctime>
+#include <memory>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -43,6 +45,8 @@
 BEGIN_YAFARAY
 
 class PhotonMap;
+struct LogRecord;
+class LogRecordQueue;
 
 class LogEntry
 {
@@ -88,6 +92,11 @@ class Logger
 		void setDrawAaNoiseSettings(bool draw_noise_settings) { draw_aa_noise_settings_ = draw_noise_settings; }
 		void setDrawRenderSettings(bool draw_render_settings) { draw_render_settings_ = draw_render_settings; }
 		void setConsoleLogColorsEnabled(bool console_log_colors_enabled) { console_log_colors_enabled_ = console_log_colors_enabled; }
+		/*! In asynchronous mode each thread builds its log records on its own, up to the YENDL, and pushes them to a lock-free
+			queue. A background thread writes them, ordered by time, to the console and the memory log used for the log/HTML files */
+		void setAsyncLogging(bool async_logging);
+		bool getAsyncLogging() const { return async_logging_.load(std::memory_order_relaxed); }
+		void flush(); //!< In asynchronous mode, waits until all the records already finished have been written
 
 		bool getSaveLog() const { return save_log_; }
 		bool getSaveHtml() const { return save_html_; }
@@ -142,6 +151,13 @@ class Logger
 		template <typename T>
 		Logger &operator << (const T &obj)
 		{
+			if(async_logging_.load(std::memory_order_relaxed))
+			{
+				std::ostream *record_stream = asyncRecordStream();
+				if(record_stream) *record_stream << obj;
+				return *this;
+			}
+			if(verbosity_level_ > console_master_verbosity_level_ && verbosity_level_ > log_master_verbosity_level_) return *this;
 			std::ostringstream tmp_stream;
 			tmp_stream << obj;
 
@@ -152,6 +168,12 @@ class Logger
 
 		Logger &operator << (std::ostream & (obj)(std::ostream &))
 		{
+			if(async_logging_.load(std::memory_order_relaxed))
+			{
+				asyncRecordManipulator(obj);
+				return *this;
+			}
+			if(verbosity_level_ > console_master_verbosity_level_ && verbosity_level_ > log_master_verbosity_level_) return *this;
 			std::ostringstream tmp_stream;
 			tmp_stream << obj;
 
@@ -161,6 +183,18 @@ class Logger
 		}
 
 	protected:
+		struct AsyncRecord;
+		static AsyncRecord &threadAsyncRecord();
+		std::ostream *asyncRecordStream();
+		void asyncRecordManipulator(std::ostream & (manipulator)(std::ostream &));
+		void asyncRecordCommit(AsyncRecord &record);
+		void asyncWriterThread();
+		void stopAsyncWriter();
+		void waitAsyncWritten(); //!< Waits until the writer thread has written all the records pushed so far
+		void writeLogRecord(const LogRecord &log_record);
+		void printConsoleHeader(int verbosity_level, std::time_t datetime);
+		void addMemoryLogEntry(int verbosity_level, std::time_t datetime, const std::string &description);
+
 		int verbosity_level_ = VlInfo;
 		int console_master_verbosity_level_ = VlInfo;
 		int log_master_verbosity_level_ = VlVerbose;
@@ -186,6 +220,17 @@ class Logger
 		std::time_t previous_console_event_date_time_ = 0;
 		std::time_t previous_log_event_date_time_ = 0;
 		std::unordered_map <std::string, double> diagnostics_stats_;
+		std::atomic<bool> async_logging_ {false};
+		std::unique_ptr<LogRecordQueue> async_queue_;
+		std::thread async_writer_;
+		std::mutex async_state_mutex_; //!< serializes switching asynchronous logging on and off
+		std::atomic<int> async_producers_ {0}; //!< threads pushing a record to async_queue_ right now
+		std::mutex async_wake_mutex_;
+		std::condition_variable async_wake_;
+		std::condition_variable async_written_cond_; //!< notified by the writer thread after each batch, see flush()
+		std::atomic<bool> async_stop_ {false};
+		std::atomic<uint64_t> async_pushed_ {0};
+		std::atomic<uint64_t> async_written_ {0};
 };
 
 extern Logger logger__;
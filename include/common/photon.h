@@ -164,6 +164,7 @@ class PhotonMap
 		void reserveMemory(size_t num_photons) { photons_.reserve(num_photons); }
 		void updateTree();
 		void clear() { photons_.clear(); delete tree_; tree_ = nullptr; updated_ = false; }
+		void swap(PhotonMap &map); //!< swaps the photons and kd-tree with the ones of the other map, keeping the names and settings
 		bool ready() const { return updated_; }
 		//	void gather(const point3d_t &P, std::vector< foundPhoton_t > &found, unsigned int K, float &sqRadius) const;
 		int gather(const Point3 &p, FoundPhoton *found, unsigned int k, float &sq_radius) const;
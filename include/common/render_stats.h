@@ -0,0 +1,117 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_RENDER_STATS_H
+#define YAFARAY_RENDER_STATS_H
+
+#include "constants.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Counters of the work done while rendering. Each thread counts in its own RenderStats (see RenderStats::thread()),
+	without any atomic operations or locks, and the counters of the render threads are merged when they finish.
+	Hot paths should get the thread counters once (for example from RenderState::stats_) rather than per increment.
+*/
+class RenderStats
+{
+	public:
+		enum Counter : int { CameraRays = 0, ShadowRays, BsdfSamples, TracedRays, TraversalSteps, TriangleTests, PhotonLookups, TextureFetches, NumCounters };
+		static RenderStats &thread();
+		/*! Returns the merged counters of the threads finished since the previous call and of the calling thread,
+			which are reset. If per_thread is given, it receives the counters of each of those threads */
+		static RenderStats collect(std::vector<RenderStats> *per_thread = nullptr);
+		static const char *counterName(int counter);
+		void add(Counter counter, uint64_t amount = 1) { counters_[counter] += amount; }
+		uint64_t get(Counter counter) const { return counters_[counter]; }
+		void merge(const RenderStats &stats) { for(int i = 0; i < NumCounters; ++i) counters_[i] += stats.counters_[i]; }
+		void reset() { for(int i = 0; i < NumCounters; ++i) counters_[i] = 0; }
+		bool empty() const;
+		std::string print() const; //!< Non-zero counters in a single line, for the log
+		std::string toJson() const;
+
+	protected:
+		uint64_t counters_[NumCounters] = {};
+};
+
+//! Counters of a thread, merged into the pending totals returned by RenderStats::collect() when the thread finishes
+class ThreadRenderStats final : public RenderStats
+{
+	public:
+		~ThreadRenderStats();
+};
+
+inline RenderStats &RenderStats::thread()
+{
+	static thread_local ThreadRenderStats stats;
+	return stats;
+}
+
+//! Counts the nodes and primitives visited by one kd-tree traversal in local variables, adding them to the stats (as one traced ray) when going out of scope
+class TraversalCounter final
+{
+	public:
+		explicit TraversalCounter(RenderStats &stats) : stats_(stats) { }
+		~TraversalCounter()
+		{
+			stats_.add(RenderStats::TracedRays);
+			stats_.add(RenderStats::TraversalSteps, steps_);
+			stats_.add(RenderStats::TriangleTests, primitive_tests_);
+		}
+		void node() { ++steps_; }
+		void leaf(uint32_t n_primitives) { ++steps_; primitive_tests_ += n_primitives; }
+
+	private:
+		RenderStats &stats_;
+		uint64_t steps_ = 0;
+		uint64_t primitive_tests_ = 0;
+};
+
+//! Render statistics of a whole render, pass by pass
+class RenderStatsReport final
+{
+	public:
+		struct Pass
+		{
+			std::string name_;
+			double seconds_ = 0.0; //!< Wall time since the end of the previous pass (or since clear() for the first one)
+			RenderStats totals_;
+			std::vector<RenderStats> threads_;
+		};
+		void clear();
+		/*! Collects the counters of the threads that took part in the pass just finished, logging them.
+			Scene::render() ends a "setup" pass after building the acceleration structures and running the integrator preprocess */
+		void endPass(const std::string &pass_name);
+		const RenderStats &getTotals() const { return totals_; }
+		const std::vector<Pass> &getPasses() const { return passes_; }
+		std::string toJson() const;
+		bool saveJson(const std::string &file_path) const;
+
+	private:
+		std::vector<Pass> passes_;
+		RenderStats totals_;
+		std::chrono::steady_clock::time_point pass_start_ = std::chrono::steady_clock::now();
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_RENDER_STATS_H
@@ -196,6 +196,7 @@ class ExtPass  //Render pass to be exported, for example, to Blender, and mappin
 		ExtPassTypes ext_pass_type_;
 		ExternalPassTileTypes tile_type_;
 		IntPassTypes int_pass_type_;
+		bool half_float_ = false;	//The film stores the colors of the pass as half floats
 };
 
 
@@ -235,6 +236,8 @@ class RenderPasses
 		IntPassTypes intPassTypeFromExtPassIndex(int ext_pass_index) const;
 		IntPassTypes intPassTypeFromAuxPassIndex(int aux_pass_index) const;
 		ExternalPassTileTypes tileType(int ext_pass_index) const;
+		bool extPassHalfFloat(int ext_pass_index) const;
+		void setExtPassHalfFloat(int ext_pass_index, bool half_float);
 
 		void setPassMaskObjIndex(float new_obj_index);	//Object Index used for masking in/out in the Mask Render Passes
 		void setPassMaskMatIndex(float new_mat_index);	//Material Index used for masking in/out in the Mask Render Passes
@@ -260,6 +263,19 @@ class RenderPasses
 		float faces_edge_threshold_ = 0.01f;	//Threshold for the edge detection process used in the Faces Edge Render Pass
 		float faces_edge_smoothness_ = 0.5f;	//Smoothness (blur) of the edges used in the Faces Edge Render Pass
 
+		//Options for the feature guided denoiser of the Combined pass, which uses auxiliary normal, depth and diffuse color passes
+		bool feature_denoise_ = false;		//Denoise the Combined pass of the output images
+		int feature_denoise_radius_ = 5;	//Radius in pixels of the denoise filter
+		float feature_denoise_color_sigma_ = 0.5f;	//Tolerance of the relative differences between the (prefiltered) colors of the pixels averaged by the denoiser
+		float feature_denoise_normal_sigma_ = 0.3f;	//Tolerance of the differences between the normals of the pixels averaged by the denoiser
+		float feature_denoise_depth_sigma_ = 0.02f;	//Tolerance of the differences between the normalized depths of the pixels averaged by the denoiser
+		float feature_denoise_albedo_sigma_ = 0.1f;	//Tolerance of the differences between the diffuse colors of the pixels averaged by the denoiser
+
+		//Options for the storage of the render passes in the film
+		bool film_shared_weights_ = true;	//The passes getting the same filter weights as the Combined pass read its weights instead of storing their own
+		bool film_sparse_passes_ = true;	//The index, mask and debug passes only store the film tiles with samples different from their default color
+		bool film_half_float_aux_ = false;	//The film stores the colors of the auxiliary passes as half floats
+
 	protected:
 		std::vector<ExtPass> ext_passes_;		//List of the external Render passes to be exported
 		std::vector<AuxPass> aux_passes_;		//List of the intermediate auxiliary Render passes used for other operations
@@ -286,7 +302,7 @@ class ColorPasses  //Internal YafaRay color passes generated in different points
 		Rgba &operator()(int int_pass_index);
 		Rgba &operator()(IntPassTypes int_pass_type);
 		void resetColors();
-		Rgba initColor(IntPassTypes int_pass_type);
+		static Rgba initColor(IntPassTypes int_pass_type);
 		void multiplyColors(float factor);
 		Rgba probeSet(const IntPassTypes &int_pass_type, const Rgba &rendered_color, const bool &condition = true);
 		Rgba probeSet(const IntPassTypes &int_pass_type, const ColorPasses &color_passes, const bool &condition = true);
@@ -0,0 +1,64 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SAMPLER_H
+#define YAFARAY_SAMPLER_H
+
+#include "constants.h"
+#include <cstdint>
+#include <string>
+
+BEGIN_YAFARAY
+
+/*! Low discrepancy sampler for the camera samples and the path bounces, selected with the "sampler" render parameter.
+	The samples only depend on the sample index, the dimension and a seed made from the pixel coordinates, so they need
+	no global state and are the same whatever thread renders the pixel. Without a sampler ("halton", the default) the
+	integrators keep using their scrambled Halton and (0,2) sequences */
+class Sampler
+{
+	public:
+		//! Dimensions of the camera samples, and first dimension of the path bounces, which take 4 dimensions each
+		enum Dimension : int { DimPixelX = 0, DimPixelY, DimLensU, DimLensV, DimTime, DimBounces = 8 };
+		static Sampler *factory(const std::string &name); //!< nullptr for "halton"
+		static int bounceDimension(int depth) { return DimBounces + 4 * depth; }
+		virtual ~Sampler() = default;
+		//! Sample in [0,1) of the dimension for the sample index of the pixel with the given seed
+		virtual float get(uint32_t index, int dimension, uint32_t seed) const = 0;
+		virtual std::string getName() const = 0;
+};
+
+/*! Sobol sequence with hash-based Owen scrambling ("Practical Hash-based Owen Scrambling", Burley 2020).
+	The dimensions are padded in groups of 4 Sobol dimensions, each group shuffling the sample index with its own
+	seed, so that the camera sample and each path bounce are decorrelated from each other */
+class OwenSobolSampler final : public Sampler
+{
+	public:
+		virtual float get(uint32_t index, int dimension, uint32_t seed) const override;
+		virtual std::string getName() const override { return "sobol"; }
+
+	private:
+		static uint32_t sobol(uint32_t index, int dimension);
+		static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed);
+		static uint32_t hashCombine(uint32_t seed, uint32_t value);
+		static const uint32_t directions_[4][32]; //!< generator matrices of the first 4 Sobol dimensions
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_SAMPLER_H
@@ -22,8 +22,9 @@
 
 #include "constants.h"
 #include "utility/util_thread.h"
-
-#define USER_DATA_SIZE 1024
+#include "utility/util_aligned_alloc.h"
+#include "common/render_stats.h"
+#include "common/sampler.h"
 
 // Object flags
 
@@ -74,9 +75,9 @@ typedef unsigned int ObjId_t;
 struct RenderState
 {
 	RenderState(): raylevel_(0), current_pass_(0), pixel_sample_(0), ray_division_(1), ray_offset_(0), dc_1_(0), dc_2_(0),
-				   traveled_(0.0), chromatic_(true), include_lights_(false), userdata_(nullptr), lightdata_(nullptr), prng_(nullptr) {};
+				   traveled_(0.0), chromatic_(true), include_lights_(false), userdata_(nullptr), lightdata_(nullptr), prng_(nullptr), stats_(&RenderStats::thread()) {};
 	RenderState(Random *rand): raylevel_(0), current_pass_(0), pixel_sample_(0), ray_division_(1), ray_offset_(0), dc_1_(0), dc_2_(0),
-							   traveled_(0.0), chromatic_(true), include_lights_(false), userdata_(nullptr), lightdata_(nullptr), prng_(rand) {};
+							   traveled_(0.0), chromatic_(true), include_lights_(false), userdata_(nullptr), lightdata_(nullptr), prng_(rand), stats_(&RenderStats::thread()) {};
 	~RenderState() {};
 
 	int raylevel_;
@@ -98,9 +99,11 @@ struct RenderState
 	bool include_lights_; //!< indicate that emission of materials assiciated to lights shall be included, for correctly visible lights etc.
 	float wavelength_; //!< the (normalized) wavelength being used when chromatic is false.
 	float time_; //!< the current (normalized) frame time
-	mutable void *userdata_; //!< a fixed amount of memory where materials may keep data to avoid recalculations...really need better memory management :(
+	mutable void *userdata_; //!< memory where materials may keep data to avoid recalculations, allocated from arena_ with Scene::getUserDataSize() bytes
+	ScratchArena arena_; //!< per-thread scratch memory, released per bounce with ScratchArena::Scope
 	void *lightdata_; //!< reserved; non-dirac lights may do some surface-point dependant initializations in the future to reduce redundancy...
 	Random *const prng_; //!< a pseudorandom number generator
+	RenderStats *const stats_; //!< render counters of the thread that created this state
 
 	//! set some initial values that are always the same before integrating a primary ray
 	void setDefaults()
@@ -114,7 +117,7 @@ struct RenderState
 	}
 
 	//	protected:
-	explicit RenderState(const RenderState &r): prng_(r.prng_) {} //forbiden
+	explicit RenderState(const RenderState &r): prng_(r.prng_), stats_(r.stats_) {} //forbiden
 };
 
 END_YAFARAY
@@ -123,6 +126,8 @@ END_YAFARAY
 #include <vector>
 #include <map>
 #include <list>
+#include <chrono>
+#include <memory>
 
 #define Y_SIG_ABORT 1
 #define Y_SIG_PAUSE 1<<1
@@ -178,6 +183,12 @@ class Scene
 		bool addTriangle(int a, int b, int c, const Material *mat);
 		bool addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, const Material *mat);
 		int  addUv(float u, float v);
+		/*! Bulk versions of the functions above, taking contiguous arrays of coordinate triplets (pairs for uvs).
+			Optional orcos and uv_indices can be nullptr. */
+		int  addVertices(const double *vertices, const double *orcos, int num_vertices);
+		void addNormals(const double *normals, int num_normals);
+		bool addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat);
+		int  addUvs(const float *uvs, int num_uvs);
 		bool startVmap(int id, int type, int dimensions);
 		bool endVmap();
 		bool addVmapValues(float *val);
@@ -189,7 +200,7 @@ class Scene
 		ObjId_t getNextFreeId();
 		bool addObject(ObjectGeometric *obj, ObjId_t &id);
 		bool addInstance(ObjId_t base_object_id, const Matrix4 &obj_to_world);
-		void addVolumeRegion(VolumeRegion *vr) { volumes_.push_back(vr); }
+		void addVolumeRegion(VolumeRegion *vr) { volumes_.push_back(vr); state_.changes_ |= CMaterial; }
 		void setCamera(Camera *cam);
 		void setImageFilm(ImageFilm *film);
 		void setBackground(Background *bg);
@@ -197,6 +208,8 @@ class Scene
 		SurfaceIntegrator *getSurfIntegrator() const { return surf_integrator_; }
 		void setVolIntegrator(VolumeIntegrator *v);
 		void setAntialiasing(int num_samples, int num_passes, int inc_samples, double threshold, float resampled_floor, float sample_multiplier_factor, float light_sample_multiplier_factor, float indirect_sample_multiplier_factor, bool detect_color_noise, const DarkDetectionType &dark_detection_type, float dark_threshold_factor, int variance_edge_size, int variance_pixels, float clamp_samples, float clamp_indirect);
+		void setRenderBudget(float time_budget, float noise_target) { aa_time_budget_ = time_budget; aa_noise_target_ = noise_target; }
+		void setSampler(Sampler *sampler) { sampler_.reset(sampler); } //!< takes ownership, nullptr for the default scrambled Halton sampling
 		void setNumThreads(int threads);
 		void setNumThreadsPhotons(int threads_photons);
 		void setMode(int m) { mode_ = m; }
@@ -212,17 +225,32 @@ class Scene
 		int getSignals() const;
 		//! only for backward compatibility!
 		void getAaParameters(int &samples, int &passes, int &inc_samples, float &threshold, float &resampled_floor, float &sample_multiplier_factor, float &light_sample_multiplier_factor, float &indirect_sample_multiplier_factor, bool &detect_color_noise, DarkDetectionType &dark_detection_type, float &dark_threshold_factor, int &variance_edge_size, int &variance_pixels, float &clamp_samples, float &clamp_indirect) const;
+		void getRenderBudget(float &time_budget, float &noise_target) const { time_budget = aa_time_budget_; noise_target = aa_noise_target_; }
+		const Sampler *getSampler() const { return sampler_.get(); }
+		double getRenderTime() const; //!< seconds since the render of the current view started, including the scene update
 		bool intersect(const Ray &ray, SurfacePoint &sp) const;
 		bool intersect(const DiffRay &ray, SurfacePoint &sp) const;
 		bool isShadowed(RenderState &state, const Ray &ray, float &obj_index, float &mat_index) const;
 		bool isShadowed(RenderState &state, const Ray &ray, int max_depth, Rgb &filt, float &obj_index, float &mat_index) const;
 		const RenderPasses *getRenderPasses() const;
 		bool passEnabled(IntPassTypes int_pass_type) const;
+		void setUserDataSize(size_t user_data_size) { user_data_size_ = user_data_size; }
+		size_t getUserDataSize() const { return user_data_size_; } //!< the amount of RenderState::userdata_ memory required by the most demanding material
+		RenderStatsReport &getRenderStats() { return render_stats_; } //!< work counters of the last render, collected at the end of each pass
+		const RenderStatsReport &getRenderStats() const { return render_stats_; }
 
 		enum SceneState { Ready, Geometry, Object, Vmap };
-		enum ChangeFlags { CNone = 0, CGeom = 1, CLight = 1 << 1, COther = 1 << 2,
-		                   CAll = CGeom | CLight | COther
+		/*! What changed since the last update: the geometry requires new kd-trees, the geometry, lights and materials
+			(with textures, background and volumes) new light distributions and photon maps, while nothing cached depends
+			on the integrators, camera and film alone */
+		enum ChangeFlags { CNone = 0, CGeom = 1, CLight = 1 << 1, CIntegrator = 1 << 2, CMaterial = 1 << 3, CCamera = 1 << 4, CFilm = 1 << 5,
+		                   CContent = CGeom | CLight | CMaterial,
+		                   CAll = CContent | CIntegrator | CCamera | CFilm
 		                 };
+		void addChanges(unsigned int changes) { state_.changes_ |= changes; }
+		/*! Identifies the scene contents (geometry, lights and materials) used by the last update, and changes with them.
+			Unique across all the scenes, so that data computed from the contents (such as photon maps) can be kept and reused */
+		unsigned int getContentRevision() const { return content_revision_; }
 
 		std::vector<Light *> lights_;
 		VolumeIntegrator *vol_integrator_;
@@ -262,10 +290,17 @@ class Scene
 		int aa_variance_pixels_;
 		float aa_clamp_samples_;
 		float aa_clamp_indirect_;
+		float aa_time_budget_ = 0.f; //!< wall clock seconds after which no new AA pass is started, 0 for no limit
+		float aa_noise_target_ = 0.f; //!< relative error of the image at which the render stops, 0 for no target
+		std::unique_ptr<Sampler> sampler_;
+		std::chrono::steady_clock::time_point render_start_;
+		unsigned int content_revision_ = 0;
 		int nthreads_;
 		int nthreads_photons_;
 		int mode_; //!< sets the scene mode (triangle-only, virtual primitives)
 		int signals_;
+		size_t user_data_size_ = 0;
+		RenderStatsReport render_stats_;
 		const RenderEnvironment *env_;	//!< reference to the environment to which this scene belongs to
 		mutable std::mutex sig_mutex_;
 };
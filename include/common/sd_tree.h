@@ -0,0 +1,118 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SD_TREE_H
+#define YAFARAY_SD_TREE_H
+
+#include "constants.h"
+#include "common/bound.h"
+#include "common/vector.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+BEGIN_YAFARAY
+
+//! Float that several threads can add to at the same time
+class AtomicFloat final
+{
+	public:
+		AtomicFloat(float value = 0.f) : value_(value) { }
+		AtomicFloat(const AtomicFloat &value) : value_(value.get()) { }
+		AtomicFloat &operator=(const AtomicFloat &value) { value_.store(value.get(), std::memory_order_relaxed); return *this; }
+		float get() const { return value_.load(std::memory_order_relaxed); }
+		void add(float amount)
+		{
+			float current = value_.load(std::memory_order_relaxed);
+			while(!value_.compare_exchange_weak(current, current + amount, std::memory_order_relaxed)) { }
+		}
+
+	private:
+		std::atomic<float> value_;
+};
+
+/*! Directional distribution stored as a quadtree over the square [0,1)^2, which maps the sphere of directions with
+	the equal area cylindrical projection (cos(theta), phi), so the densities in the square and in solid angle only differ
+	by the constant 4*pi. Each node stores the energy of its 4 quadrants. The render threads record concurrently into the
+	deepest quadrants only, and propagate() sums them up into the upper nodes once the recording is done */
+class DirectionalQuadTree final
+{
+	public:
+		DirectionalQuadTree() : nodes_(1) { }
+		void record(const Vec3 &dir, float value);
+		Vec3 sample(float s_1, float s_2) const;
+		float pdf(const Vec3 &dir) const; //!< solid angle density
+		float getEnergy() const;
+		void propagate(); //!< updates the energy of the upper nodes after recording
+		/*! Rebuilds the tree structure, with no energy, subdividing the quadrants with more than the threshold fraction
+			of the energy recorded in the recorded tree, up to the max depth */
+		void rebuild(const DirectionalQuadTree &recorded, float threshold, int max_depth);
+		size_t size() const { return nodes_.size(); }
+
+	private:
+		struct Node
+		{
+			float energy() const { return sums_[0].get() + sums_[1].get() + sums_[2].get() + sums_[3].get(); }
+			AtomicFloat sums_[4];
+			uint32_t children_[4] = { 0, 0, 0, 0 }; //!< 0 for the quadrants without children, as the root is never a child
+		};
+		static int quadrant(float &x, float &y); //!< quadrant of the point, which is changed to the coordinates within the quadrant
+		static void rebuildNode(std::vector<Node> &nodes, uint32_t node_id, const DirectionalQuadTree &recorded, int recorded_id, const float sums[4], float total, float threshold, int depth, int max_depth);
+		std::vector<Node> nodes_;
+};
+
+/*! Spatial-directional tree for path guiding ("Practical Path Guiding for Efficient Light-Transport Simulation", Müller et al. 2017):
+	a binary tree splitting the scene bound along alternating axes, with a pair of directional quadtrees in each leaf,
+	one sampled while the other one records the incident radiance of the current training iteration */
+class SdTree final
+{
+	public:
+		struct Leaf
+		{
+			Leaf() = default;
+			Leaf(const Leaf &leaf) : sampling_(leaf.sampling_), recording_(leaf.recording_), samples_(leaf.samples_.load(std::memory_order_relaxed)) { }
+			void record(const Vec3 &dir, float value) { recording_.record(dir, value); samples_.fetch_add(1, std::memory_order_relaxed); }
+			DirectionalQuadTree sampling_;
+			DirectionalQuadTree recording_;
+			std::atomic<uint32_t> samples_ { 0 };
+		};
+		explicit SdTree(const Bound &bound);
+		Leaf &lookup(const Point3 &p);
+		/*! Ends a training iteration of pass_samples samples per pixel: splits the leaves that recorded enough samples, makes the recorded distributions
+			the sampled ones and starts recording into new trees refined where the recorded energy is */
+		void update(int pass_samples);
+		size_t numLeaves() const { return leaves_.size(); }
+
+	private:
+		struct Node
+		{
+			int axis_ = 0;
+			uint32_t children_[2] = { 0, 0 };
+			uint32_t leaf_ = 0;
+		};
+		void split(uint32_t node_id, uint32_t max_samples, int depth);
+		Point3 origin_;
+		Vec3 inv_size_;
+		std::vector<Node> nodes_;
+		std::vector<Leaf> leaves_;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_SD_TREE_H
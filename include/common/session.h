@@ -66,6 +66,7 @@ class Session
 		PhotonMap *caustic_map_ = nullptr;
 		PhotonMap *diffuse_map_ = nullptr;
 		PhotonMap *radiance_map_ = nullptr;
+		std::string photon_maps_key_; //!< scene contents and photon settings the photon maps in memory were generated with, empty if unknown
 
 		std::mutex mutx_;
 
@@ -0,0 +1,122 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_TRACE_H
+#define YAFARAY_TRACE_H
+
+#include "constants.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Optional recorder of a timeline of the render phases (scene update, tree builds, photon shooting, tiles, film flushes...)
+	per thread, saved in the Chrome trace event JSON format that can be opened in chrome://tracing or https://ui.perfetto.dev
+	When disabled (the default) recording costs a single relaxed atomic load per traced span. Events are stored under a mutex,
+	so they are meant for phases and tiles, not for per ray or per sample work.
+*/
+class TraceRecorder final
+{
+	public:
+		//! Enabling the recorder discards any previous events and restarts the trace time origin
+		void setEnabled(bool enabled);
+		bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+		int64_t now() const; //!< Microseconds since the trace time origin
+		/*! Adds a complete event. The name and category must be string literals (they are stored as pointers).
+			worker_thread is the thread_id of the render or photon worker, so that the spans of all the passes share
+			one row per worker even though the integrators start new threads on every pass, or -1 to use a number
+			identifying the calling thread */
+		void addEvent(const char *name, const char *category, int64_t start, int64_t end, std::string &&args, int worker_thread = -1);
+		void clear();
+		std::string toJson() const;
+		static std::string jsonString(const std::string &value); //!< Quoted JSON string, with the quotes, backslashes and control characters escaped
+		bool saveJson(const std::string &file_path) const;
+
+	private:
+		struct Event
+		{
+			const char *name_;
+			const char *category_;
+			int64_t start_;
+			int64_t duration_;
+			int thread_;
+			std::string args_; //!< Comma separated JSON members of the event "args" object
+		};
+		static int threadIndex(); //!< Small sequential number identifying the calling thread in the trace
+		static int64_t clockMicroseconds();
+		static constexpr int worker_thread_tid_base_ = 10000; //!< Worker threads are shown after the other threads
+		std::atomic<bool> enabled_ { false };
+		std::atomic<int64_t> origin_ { clockMicroseconds() }; //!< Trace time origin, in clockMicroseconds() units
+		mutable std::mutex mutex_;
+		std::vector<Event> events_;
+};
+
+// global trace recorder object, defined in trace.cc
+extern TraceRecorder trace_recorder__;
+
+//! Records the time span from its construction to its destruction as a trace event, if the trace recorder is enabled
+class TraceScope final
+{
+	public:
+		//! worker_thread: thread_id of the render or photon worker recording the span, see TraceRecorder::addEvent()
+		TraceScope(const char *name, const char *category, int worker_thread = -1) : name_(name), category_(category), worker_thread_(worker_thread), active_(trace_recorder__.isEnabled())
+		{
+			if(active_) start_ = trace_recorder__.now();
+		}
+		~TraceScope()
+		{
+			if(active_) trace_recorder__.addEvent(name_, category_, start_, trace_recorder__.now(), std::move(args_), worker_thread_);
+		}
+		TraceScope(const TraceScope &) = delete;
+		TraceScope &operator=(const TraceScope &) = delete;
+		//! Adds an argument shown with the event in the trace viewer
+		TraceScope &arg(const char *key, int64_t value)
+		{
+			if(active_) appendArg(key, std::to_string(value));
+			return *this;
+		}
+		TraceScope &arg(const char *key, const std::string &value)
+		{
+			if(active_) appendArg(key, TraceRecorder::jsonString(value));
+			return *this;
+		}
+
+	private:
+		void appendArg(const char *key, const std::string &json_value)
+		{
+			if(!args_.empty()) args_ += ", ";
+			args_ += "\"";
+			args_ += key;
+			args_ += "\": " + json_value;
+		}
+		const char *name_;
+		const char *category_;
+		const int worker_thread_;
+		const bool active_;
+		int64_t start_ = 0;
+		std::string args_;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_TRACE_H
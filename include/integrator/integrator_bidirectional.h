@@ -59,7 +59,6 @@ class BidirectionalIntegrator final : public TiledIntegrator
 		float pathWeight0T(RenderState &state, int t, PathData &pd) const;
 
 		Background *background_ = nullptr;
-		const Camera *cam_ = nullptr;
 		bool tr_shad_;        //!< calculate transparent shadows for transparent objects
 		bool use_bg_;        //!< configuration; include background for GI
 		bool ibl_;           //!< configuration; use background light, if available
@@ -70,7 +69,7 @@ class BidirectionalIntegrator final : public TiledIntegrator
 		//mutable int nPaths;
 		//mutable pathData_t pathData;
 		mutable std::vector<PathData> thread_data_;
-		Pdf1D *light_power_d_ = nullptr;
+		AliasPdf1D *light_power_d_ = nullptr;
 		float f_num_lights_;
 		std::map <const Light *, float> inv_light_power_d_;
 		ImageFilm *light_image_ = nullptr;
@@ -24,6 +24,8 @@
 
 #include "integrator_tiled.h"
 #include "common/color.h"
+#include <algorithm>
+#include <string>
 
 
 BEGIN_YAFARAY
@@ -57,13 +59,18 @@ class MonteCarloIntegrator: public TiledIntegrator
 		virtual void recursiveRaytrace(RenderState &state, DiffRay &ray, Bsdf_t bsdfs, SurfacePoint &sp, Vec3 &wo, Rgb &col, float &alpha, ColorPasses &color_passes, int additional_depth) const;
 		/*! Creates and prepares the caustic photon map */
 		virtual bool createCausticMap();
+		/*! Identifies the scene contents and the settings the photon maps are generated from: the maps in memory are reused
+			while it does not change, so that renders changing only the camera, film or render settings skip the photon shooting */
+		virtual std::string photonMapsKey() const;
+		//! number of photons rounded to a multiple of the number of threads, to distribute them evenly, with at least 1 photon per thread
+		static unsigned int roundPhotonsToThreads(unsigned int n_photons, int n_threads) { return std::max((unsigned int) n_threads, (n_photons / n_threads) * n_threads); }
 		/*! Estimates caustic photons for a given surface point */
 		virtual Rgb estimateCausticPhotons(RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const;
 		/*! Samples ambient occlusion for a given surface point */
 		virtual Rgb sampleAmbientOcclusion(RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const;
 		virtual Rgb sampleAmbientOcclusionPass(RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const;
 		virtual Rgb sampleAmbientOcclusionPassClay(RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const;
-		virtual void causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, Pdf1D *light_power_d, int num_lights, const std::string &integrator_name, const std::vector<Light *> &caus_lights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot);
+		virtual void causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, AliasPdf1D *light_power_d, int num_lights, const std::string &integrator_name, const std::vector<Light *> &caus_lights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot);
 
 		int r_depth_; //! Ray depth
 		bool tr_shad_; //! Use transparent shadows
@@ -74,7 +81,7 @@ class MonteCarloIntegrator: public TiledIntegrator
 		int n_caus_search_; //! Amount of caustic photons to be gathered in estimation
 		float caus_radius_; //! Caustic search radius for estimation
 		int caus_depth_; //! Caustic photons max path depth
-		Pdf1D *light_power_d_;
+		AliasPdf1D *light_power_d_;
 
 		bool use_ambient_occlusion_; //! Use ambient occlusion
 		int ao_samples_; //! Ambient occlusion samples
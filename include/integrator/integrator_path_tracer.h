@@ -26,6 +26,7 @@
 #include "common/photon.h"
 #include "common/spectrum.h"
 #include "common/scr_halton.h"
+#include "common/sd_tree.h"
 
 #include "integrator/integrator_montecarlo.h"
 #include "common/environment.h"
@@ -38,6 +39,7 @@
 
 #include <sstream>
 #include <iomanip>
+#include <memory>
 
 BEGIN_YAFARAY
 
@@ -49,12 +51,47 @@ class PathIntegrator: public MonteCarloIntegrator
 		virtual Rgba integrate(RenderState &state, DiffRay &ray, ColorPasses &color_passes, int additional_depth = 0) const;
 		static Integrator *factory(ParamMap &params, RenderEnvironment &render);
 		enum { None, Path, Photon, Both };
+		virtual void preRender();
+		virtual void prePass(int samples, int offset, bool adaptive);
 	protected:
+		//! Path vertex whose sampled direction receives the radiance gathered further along the path, for training the path guiding
+		struct GuidingVertex
+		{
+			SdTree::Leaf *leaf_;
+			Vec3 wi_;
+			Rgb inv_throughput_; //!< inverse of the path throughput after scattering at the vertex
+			Rgb radiance_;
+			float pdf_; //!< solid angle density of wi_
+		};
+		void setParams(ParamMap &params); //!< reads the "pathtracing" parameters, shared with the derived integrators
+		/*! Samples the next direction at sp returning the throughput weight of the bounce. At the diffuse vertices, when path guiding is
+			enabled, the BSDF sampling is mixed with the distribution learned in the SD-tree by one-sample MIS and guiding_leaf and pdf
+			(solid angle density) are returned for recording, otherwise guiding_leaf is null */
+		Rgb sampleDirection(RenderState &state, const SurfacePoint &sp, Bsdf_t bsdfs, const Vec3 &wo, Vec3 &wi, Sample &s, SdTree::Leaf *&guiding_leaf, float &pdf) const;
+		static void addGuidingRadiance(GuidingVertex *vertices, int n_vertices, const Rgb &contribution);
+		/*! Samples for the BSDF of the bounce at the given depth (0 at the camera hit) of the path with sample number offs, from the
+			scene sampler if any, otherwise from the scrambled Halton sequences. Not rotated by the ray division offsets */
+		void bounceSamples(const RenderState &state, unsigned int offs, int depth, float &s_1, float &s_2) const;
+		float wavelengthSample(const RenderState &state, unsigned int offs) const; //!< wavelength of the path with sample number offs
+		static void recordGuidingVertices(const GuidingVertex *vertices, int n_vertices);
+		/*! Traces the indirect paths starting at the camera hit sp (with its BSDF already initialized in state.userdata_),
+			returning their averaged contribution */
+		virtual Rgb samplePaths(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t path_flags, ColorPasses &color_passes, ColorPasses &tmp_color_passes) const;
+		//! Called by integrate() with the volume transmittance along the camera ray, which scales the light returned by samplePaths() for the camera hit
+		virtual void cameraRayTransmittance(RenderState &state, const Rgb &transmittance) const { }
 		bool trace_caustics_; //!< use path tracing for caustics (determined by causticType)
 		bool no_recursive_;
 		float inv_n_paths_;
 		int caustic_type_;
 		int russian_roulette_min_bounces_;  //!< minimum number of bounces where russian roulette is not applied. Afterwards russian roulette will be used until the maximum selected bounces. If min_bounces >= max_bounces, then no russian roulette takes place
+		bool guiding_ = false; //!< path guiding, learning the incident radiance in the first AA passes to sample the diffuse bounces
+		int guiding_training_passes_ = 4;
+		float guiding_bsdf_fraction_ = 0.5f; //!< probability of sampling the BSDF instead of the learned distribution
+		std::unique_ptr<SdTree> sd_tree_;
+		int guiding_pass_ = 0;
+		int guiding_pass_samples_ = 0; //!< AA samples of the last training pass
+		bool guiding_record_ = false;
+		bool guiding_sample_ = false;
 };
 
 END_YAFARAY
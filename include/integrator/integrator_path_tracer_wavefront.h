@@ -0,0 +1,107 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_INTEGRATOR_PATH_TRACER_WAVEFRONT_H
+#define YAFARAY_INTEGRATOR_PATH_TRACER_WAVEFRONT_H
+
+#include "integrator/integrator_path_tracer.h"
+#include "common/surface.h"
+#include "common/renderpasses.h"
+#include "utility/util_aligned_alloc.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Path tracer with the same parameters and result as PathIntegrator ("pathtracing"), but tracing the indirect paths
+	of all the camera samples of a tile as one batch, stage by stage: extend all the paths (kd-tree traversal), sort the
+	hits by material, shade them (BSDF initialization, volumes, russian roulette, emission), connect them to the lights
+	and sample the next bounce. Each stage runs over the whole batch, so the same material and light code runs many times
+	in a row. The camera samples are kept until the paths started at their hits are traced, and then added to the film.
+	The paths of the hits of the recursive raytracing (reflections and refractions) are traced right away, in a batch
+	per hit
+*/
+class WavefrontPathIntegrator final : public PathIntegrator
+{
+	public:
+		WavefrontPathIntegrator();
+		static Integrator *factory(ParamMap &params, RenderEnvironment &render);
+		virtual void prePass(int samples, int offset, bool adaptive) override;
+
+	protected:
+		virtual Rgb samplePaths(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t path_flags, ColorPasses &color_passes, ColorPasses &tmp_color_passes) const override;
+		virtual void cameraRayTransmittance(RenderState &state, const Rgb &transmittance) const override;
+		virtual void addCameraSample(RenderState &state, ColorPasses &color_passes, const CameraSample &camera_sample, const SamplePassesProcessing &sample_passes_processing) const override;
+		virtual void flushCameraSamples(RenderState &state, const SamplePassesProcessing &sample_passes_processing) const override;
+
+	private:
+		struct Path
+		{
+			SurfacePoint hit_;
+			Ray ray_;
+			Rgb throughput_;
+			Rgb lcol_; //!< light gathered at the current hit, before the throughput
+			Rgb *col_; //!< sum of the light gathered by the paths of the camera hit
+			ColorPasses *color_passes_; //!< color passes of the camera sample
+			Vec3 pwo_;
+			void *userdata_; //!< BSDF data of the material at the current hit
+			unsigned int offs_;
+			unsigned int sampling_offs_; //!< RenderState values of the camera sample
+			int pixel_sample_;
+			float time_;
+			float wavelength_;
+			Bsdf_t bsdfs_;
+			bool chromatic_;
+			bool caustic_;
+			bool sampled_; //!< the sample at the camera hit returned a direction
+		};
+		//! Camera sample waiting for the paths started at its hit to be traced
+		struct DeferredSample
+		{
+			ColorPasses color_passes_;
+			CameraSample camera_sample_;
+			Rgb col_;
+			Rgb transmittance_; //!< volume transmittance along the camera ray
+			int n_paths_;
+		};
+		//! Paths of the camera samples of the tile being rendered by a thread
+		struct TileBatch
+		{
+			std::deque<DeferredSample> samples_; //!< a deque, as the paths point to the samples while more samples are added
+			std::vector<Path> paths_;
+			MemoryArena userdata_arena_; //!< BSDF data of the paths
+			bool sample_open_ = false; //!< the last sample is waiting for its camera ray transmittance and color passes
+		};
+		static constexpr size_t max_batch_paths_ = 32768; //!< the batch is traced before it grows over this, a 32x32 tile with 32 paths per pixel
+		static void loadPathState(RenderState &state, const Path &path);
+		static void storePathState(const RenderState &state, Path &path);
+		void startPath(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t path_flags, void *first_udat, bool was_chromatic, int i, Path &path) const;
+		void tracePaths(RenderState &state, Path *paths, int *queue, int n_queue, ColorPasses &tmp_color_passes) const;
+		void traceBatch(RenderState &state, TileBatch &batch, const SamplePassesProcessing &sample_passes_processing) const;
+		int extend(RenderState &state, Path *paths, int *queue, int n_queue, int depth) const;
+		int shade(RenderState &state, Path *paths, int *queue, int n_queue, int depth) const;
+		void connect(RenderState &state, Path *paths, const int *queue, int n_queue, int depth, ColorPasses &tmp_color_passes) const;
+		int sampleBounce(RenderState &state, Path *paths, int *queue, int n_queue, int depth) const;
+		std::vector<std::unique_ptr<TileBatch>> tile_batches_; //!< one per render thread
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_INTEGRATOR_PATH_TRACER_WAVEFRONT_H
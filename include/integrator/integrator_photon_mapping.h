@@ -27,10 +27,12 @@
 #include "common/spectrum.h"
 #include "common/scr_halton.h"
 #include "common/monitor.h"
+#include "common/irradiance_cache.h"
 
 #include "integrator/integrator_montecarlo.h"
 #include "common/environment.h"
 #include "material/material.h"
+#include <atomic>
 #include "background/background.h"
 #include "light/light.h"
 #include "common/imagefilm.h"
@@ -52,7 +54,8 @@ struct PreGatherData
 	std::vector<RadData> rad_points_;
 	std::vector<Photon> radiance_vec_;
 	ProgressBar *pbar_;
-	volatile int fetched_;
+	std::atomic<unsigned int> fetched_; //!< Next radiance point to be claimed by a pre-gather worker
+	int n_threads_ = 1; //!< Number of pre-gather workers, used to size the scheduled chunks
 	std::mutex mutx_;
 };
 
@@ -65,12 +68,20 @@ class PhotonIntegrator: public MonteCarloIntegrator
 		virtual Rgba integrate(RenderState &state, DiffRay &ray, ColorPasses &color_passes, int additional_depth = 0) const;
 		static Integrator *factory(ParamMap &params, RenderEnvironment &render);
 		virtual void preGatherWorker(PreGatherData *gdata, float ds_rad, int n_search);
-		virtual void causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, const Pdf1D *light_power_d, int num_c_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces);
-		virtual void diffuseWorker(PhotonMap *diffuse_map, int thread_id, const Scene *scene, unsigned int n_diffuse_photons, const Pdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, bool final_gather, PreGatherData &pgdat);
+		virtual void causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, const AliasPdf1D *light_power_d, int num_c_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces);
+		virtual void diffuseWorker(PhotonMap *diffuse_map, int thread_id, const Scene *scene, unsigned int n_diffuse_photons, const AliasPdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, bool final_gather, PreGatherData &pgdat);
 		virtual void photonMapKdTreeWorker(PhotonMap *photon_map);
 
 	protected:
+		virtual std::string photonMapsKey() const;
 		Rgb finalGathering(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, ColorPasses &color_passes) const;
+		/*! final gathering through the irradiance cache when it is enabled and can be used for the material,
+			adding a new record when no existing one is valid at sp during the first AA pass */
+		Rgb finalGatheringCached(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t bsdfs, ColorPasses &color_passes) const;
+		//! computes the irradiance at sp with its gradient and adds it to the irradiance cache
+		Rgb irradianceRecord(RenderState &state, const SurfacePoint &sp, const Vec3 &n) const;
+		//! traces a final gather path from its first ray on and returns the light it brings back, without the throughput of the gather point
+		Rgb traceGatherPath(RenderState &state, Ray &p_ray, Rgb throughput, unsigned int offs, ColorPasses &tmp_color_passes, SurfacePoint &hit, bool &did_hit) const;
 
 		void enableCaustics(const bool caustics) { use_photon_caustics_ = caustics; }
 		void enableDiffuse(const bool diffuse) { use_photon_diffuse_ = diffuse; }
@@ -84,6 +95,10 @@ class PhotonIntegrator: public MonteCarloIntegrator
 		float ds_radius_; //!< diffuse search radius
 		float lookup_rad_; //!< square radius to lookup radiance photons, as infinity is no such good idea ;)
 		float gather_dist_; //!< minimum distance to terminate path tracing (unless gatherBounces is reached)
+		bool use_irradiance_cache_ = false;
+		float irradiance_cache_accuracy_ = 0.25f;
+		float min_record_radius_, max_record_radius_;
+		std::unique_ptr<IrradianceCache> irradiance_cache_;
 		friend class PrepassWorkerT;
 };
 
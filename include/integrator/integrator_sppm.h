@@ -41,20 +41,48 @@
 #include "common/scr_halton.h"
 #include "common/hashgrid.h"
 #include <stdint.h>
+#include <vector>
 #include <cmath>
 #include <algorithm>
+#include <thread>
 
 BEGIN_YAFARAY
 
-typedef struct HitPoint // actually are per-pixel variable, use to record the sppm's shared statistics
+/*! Per-pixel SPPM statistics, refined along the passes. Stored as structure of arrays, in blocks of the size of the
+	render tiles, so that the samples of each tile read and write contiguous memory */
+class HitPoints
 {
-	float radius_2_; // square search-radius, shrink during the passes
-	int64_t acc_photon_count_; // record the total photon this pixel gathered
-	Rgba acc_photon_flux_; // accumulated flux
-	Rgba constant_randiance_; // record the direct light for this pixel
-
-	bool radius_setted_; // used by IRE to direct whether the initial radius is set or not.
-} HitPoint_t;
+	public:
+		void init(int width, int height, int block_size, float radius_2, bool radius_estimate);
+		size_t index(int x, int y) const //!< index of the hit point of the pixel, in coordinates relative to the film start
+		{
+			const int block_x = x / block_size_, block_y = y / block_size_;
+			return ((size_t)(block_y * blocks_x_ + block_x) * block_size_ + (y - block_y * block_size_)) * block_size_ + (x - block_x * block_size_);
+		}
+		//! Progressive refinement of the radius and flux with the photons gathered by a new sample
+		void refine(size_t i, int64_t photon_count, const Rgb &photon_flux)
+		{
+			const float alpha = 0.7f; // another common choice is 0.8, seems not changed much.
+			// The author's refine formular
+			const float g = std::min((acc_photon_count_[i] + alpha * photon_count) / (acc_photon_count_[i] + photon_count), 1.0f);
+			radius_2_[i] *= g;
+			acc_photon_count_[i] += photon_count * alpha;
+			acc_photon_flux_r_[i] = (acc_photon_flux_r_[i] + photon_flux.r_) * g;
+			acc_photon_flux_g_[i] = (acc_photon_flux_g_[i] + photon_flux.g_) * g;
+			acc_photon_flux_b_[i] = (acc_photon_flux_b_[i] + photon_flux.b_) * g;
+		}
+		Rgba accPhotonFlux(size_t i) const { return Rgba(acc_photon_flux_r_[i], acc_photon_flux_g_[i], acc_photon_flux_b_[i], 1.f); }
+		size_t bytesPerPixel() const { return sizeof(float) * 4 + sizeof(int64_t) + (radius_setted_.empty() ? 0 : 1); }
+
+		std::vector<float> radius_2_; // square search-radius, shrink during the passes
+		std::vector<int64_t> acc_photon_count_; // record the total photon this pixel gathered
+		std::vector<float> acc_photon_flux_r_, acc_photon_flux_g_, acc_photon_flux_b_; // accumulated flux
+		std::vector<uint8_t> radius_setted_; // used by IRE to direct whether the initial radius is set or not, empty without IRE
+
+	private:
+		int block_size_ = 1;
+		int blocks_x_ = 0;
+};
 
 //used for gather ray to collect photon information
 typedef struct GatherInfo
@@ -84,20 +112,25 @@ class SppmIntegrator: public MonteCarloIntegrator
 		/*! render a tile; only required by default implementation of render() */
 		virtual bool renderTile(int num_view, RenderArea &a, int n_samples, int offset, bool adaptive, int thread_id, int aa_pass_number = 0);
 		virtual bool preprocess(); //not used for now
-		// not used now
+		/*! Makes the photon maps of the pass ready, and starts tracing the ones of the next pass in the background when pipelined */
 		virtual void prePass(int samples, int offset, bool adaptive);
+		/*! Traces the photons of a pass into the given maps and builds their kd-trees, showing the progress if requested */
+		void photonPass(PhotonMap *diffuse_map, PhotonMap *caustic_map, int offset, bool show_progress);
 		/*! not used now, use traceGatherRay instead*/
 		virtual Rgba integrate(RenderState &state, DiffRay &ray, ColorPasses &color_passes, int additional_depth = 0) const;
 		static Integrator *factory(ParamMap &params, RenderEnvironment &render);
 		/*! initializing the things that PPM uses such as initial radius */
 		void initializePpm();
 		/*! based on integrate method to do the gatering trace, need double-check deadly. */
-		GatherInfo_t traceGatherRay(RenderState &state, DiffRay &ray, HitPoint_t &hp, ColorPasses &color_passes);
-		void photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_photons, const Pdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, Random &prng);
+		GatherInfo_t traceGatherRay(RenderState &state, DiffRay &ray, size_t hp_index, ColorPasses &color_passes);
+		void photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_photons, const AliasPdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, Random &prng, int trace_thread);
 
 	protected:
 		HashGrid  photon_grid_; // the hashgrid for holding photons
-		PhotonMap diffuse_map_, caustic_map_; // photonmap
+		PhotonMap diffuse_map_, caustic_map_; // photon maps of the next pass, traced in the background while the current pass gathers from the session ones
+		std::thread photon_thread_; // background tracing of the photons of the next pass
+		bool pipelined_; // flag to trace the photons of the next pass while the current one is rendered
+		bool trace_next_photons_ = false; // set by render() when the next pass will follow the one being started
 		unsigned int n_photons_; //photon number to scatter
 		float ds_radius_; // used to do initial radius estimate
 		int n_search_;// now used to do initial radius estimate
@@ -109,7 +142,7 @@ class SppmIntegrator: public MonteCarloIntegrator
 
 		Halton hal_1_, hal_2_, hal_3_, hal_4_, hal_7_, hal_8_, hal_9_, hal_10_; // halton sequence to do
 
-		std::vector<HitPoint_t>hit_points_; // per-pixel refine data
+		HitPoints hit_points_; // per-pixel refine data
 
 		unsigned int n_refined_; // Debug info: Refined pixel per pass
 };
@@ -32,7 +32,7 @@ class SurfacePoint;
 class ImageFilm;
 typedef unsigned int Bsdf_t;
 class PhotonMap;
-class Pdf1D;
+class AliasPdf1D;
 enum class DarkDetectionType : int;
 
 class ThreadControl
@@ -45,6 +45,16 @@ class ThreadControl
 		volatile int finished_threads_; //!< number of finished threads, lock countCV when increasing/reading!
 };
 
+class SamplePassesProcessing //!< Post-processing of the color passes of each camera sample, decided from the enabled passes before the samples are taken
+{
+	public:
+		SamplePassesProcessing(const ColorPasses &color_passes);
+		void apply(ColorPasses &color_passes, float wt) const; //!< Clamps the alpha of the passes, scales them by the camera ray weight and applies the masks
+	private:
+		std::vector<int> weighted_passes_; //!< indices of the passes scaled by the camera ray weight
+		std::vector<int> mask_passes_; //!< indices of the object and material mask passes
+};
+
 class TiledIntegrator: public SurfaceIntegrator
 {
 	public:
@@ -67,6 +77,23 @@ class TiledIntegrator: public SurfaceIntegrator
 		virtual void generateCommonRenderPasses(ColorPasses &color_passes, RenderState &state, const SurfacePoint &sp, const DiffRay &ray) const; //!< Generates render passes common to all integrators
 
 	protected:
+		//! Camera sample of renderTile() whose color passes have been integrated, with what is needed to add it to the film
+		struct CameraSample
+		{
+			int x_, y_;
+			float dx_, dy_;
+			int sample_;
+			float wt_; //!< camera ray weight
+			float depth_; //!< distance to the camera hit along the camera ray, <= 0 if nothing was hit
+			RenderArea *area_;
+			int aa_pass_number_;
+			float inv_aa_max_possible_samples_;
+		};
+		/*! Generates the depth passes of a camera sample, post-processes its color passes and adds them to the film.
+			Integrators can keep the sample to add it later, before the end of the tile (see flushCameraSamples()) */
+		virtual void addCameraSample(RenderState &state, ColorPasses &color_passes, const CameraSample &camera_sample, const SamplePassesProcessing &sample_passes_processing) const;
+		//! Called at the end of renderTile() to add to the film the camera samples kept by addCameraSample(), if any
+		virtual void flushCameraSamples(RenderState &state, const SamplePassesProcessing &sample_passes_processing) const { }
 		int aa_samples_, aa_passes_, aa_inc_samples_;
 		float i_aa_passes_; //!< Inverse of AA_passes used for depth map
 		float aa_threshold_;
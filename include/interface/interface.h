@@ -69,6 +69,12 @@ class Interface
 		virtual bool addTriangle(int a, int b, int c, const Material *mat); //!< add a triangle given vertex indices and material pointer
 		virtual bool addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, const Material *mat); //!< add a triangle given vertex and uv indices and material pointer
 		virtual int  addUv(float u, float v); //!< add a UV coordinate pair; returns index to be used for addTriangle
+		virtual int  addVertices(const double *vertices, int num_vertices); //!< add vertices from an array of x,y,z triplets; returns index of the first one added
+		virtual int  addVertices(const double *vertices, const double *orcos, int num_vertices); //!< add vertices with Orco from two arrays of x,y,z triplets; returns index of the first one added
+		virtual void addNormals(const double *normals, int num_normals); //!< add vertex normals from an array of x,y,z triplets; they are attached to the last num_normals vertices inserted
+		virtual bool addTriangles(const int *indices, int num_triangles, const Material *mat); //!< add triangles from an array of vertex index triplets, all with the same material
+		virtual bool addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat); //!< add triangles from arrays of vertex and uv index triplets, all with the same material
+		virtual int  addUvs(const float *uvs, int num_uvs); //!< add UV coordinates from an array of u,v pairs; returns index of the first one added
 		virtual bool smoothMesh(unsigned int id, double angle); //!< smooth vertex normals of mesh with given ID and angle (in degrees)
 		virtual bool addInstance(unsigned int base_object_id, Matrix4 obj_to_world);
 		// functions to build paramMaps instead of passing them from Blender
@@ -107,9 +113,14 @@ class Interface
 		virtual void abort();
 		virtual ParamMap *getRenderParameters() { return params_; }
 		virtual bool getRenderedImage(int num_view, ColorOutput &output); //!< put the rendered image to output
+		std::string getRenderStats() const; //!< work counters of the last render (rays, traversal steps, etc.) per pass and thread, in JSON format
+		bool saveRenderStats(const std::string &file_path) const; //!< saves getRenderStats() to a file
+		void enableTrace(bool enable); //!< records a timeline of the render phases from now on, see TraceRecorder
+		bool saveTrace(const std::string &file_path) const; //!< saves the recorded timeline in Chrome trace JSON format
 
 		void setConsoleVerbosityLevel(const std::string &str_v_level);
 		void setLogVerbosityLevel(const std::string &str_v_level);
+		void setAsyncLogging(bool async_logging); //!< Log records are written by a background thread, see Logger::setAsyncLogging
 
 		virtual void setParamsBadgePosition(const std::string &badge_position = "none");
 		virtual bool getDrawParams();
@@ -24,6 +24,7 @@
 #include <map>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 BEGIN_YAFARAY
 
@@ -49,6 +50,12 @@ class XmlInterface: public Interface
 		virtual bool addTriangle(int a, int b, int c, const Material *mat);
 		virtual bool addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, const Material *mat);
 		virtual int  addUv(float u, float v);
+		virtual int  addVertices(const double *vertices, int num_vertices);
+		virtual int  addVertices(const double *vertices, const double *orcos, int num_vertices);
+		virtual void addNormals(const double *normals, int num_normals);
+		virtual bool addTriangles(const int *indices, int num_triangles, const Material *mat);
+		virtual bool addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat);
+		virtual int  addUvs(const float *uvs, int num_uvs);
 		virtual bool smoothMesh(unsigned int id, double angle);
 
 		// functions directly related to renderEnvironment_t
@@ -71,6 +78,8 @@ class XmlInterface: public Interface
 	protected:
 		void writeParamMap(const ParamMap &pmap, int indent = 1);
 		void writeParamList(int indent);
+		void writePendingVertices(const double *normals = nullptr);
+		bool setMaterial(const Material *mat);
 
 		std::map<const Material *, std::string> materials_;
 		std::ofstream xml_file_;
@@ -78,6 +87,8 @@ class XmlInterface: public Interface
 		const Material *last_mat_;
 		size_t nmat_;
 		int n_uvs_;
+		//! Last block of vertices given by addVertices, kept until we know if its normals follow, as each normal must be written right after its vertex
+		std::vector<double> pending_vertices_, pending_orcos_;
 		unsigned int next_obj_;
 		float xml_gamma_;
 		ColorSpace xml_color_space_;
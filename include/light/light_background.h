@@ -28,7 +28,7 @@
 BEGIN_YAFARAY
 
 class Background;
-class Pdf1D;
+class AliasPdf1D;
 class RenderEnvironment;
 class ParamMap;
 
@@ -57,7 +57,7 @@ class BackgroundLight final : public Light
 		float calcFromSample(float s_1, float s_2, float &u, float &v, bool inv = false) const;
 		float calcFromDir(const Vec3 &dir, float &u, float &v, bool inv = false) const;
 
-		Pdf1D **u_dist_ = nullptr, *v_dist_ = nullptr;
+		AliasPdf1D **u_dist_ = nullptr, *v_dist_ = nullptr;
 		int samples_;
 		Point3 world_center_;
 		float world_radius_;
@@ -29,7 +29,7 @@ BEGIN_YAFARAY
 
 class TriangleObject;
 class Triangle;
-class Pdf1D;
+class AliasPdf1D;
 class ParamMap;
 class RenderEnvironment;
 class TriKdTree;
@@ -60,7 +60,7 @@ class BackgroundPortalLight final : public Light
 		void sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const;
 
 		unsigned int object_id_;
-		Pdf1D *area_dist_ = nullptr;
+		AliasPdf1D *area_dist_ = nullptr;
 		const Triangle **tris_ = nullptr;
 		int samples_;
 		int n_tris_; //!< gives the array size of uDist
@@ -28,7 +28,7 @@ BEGIN_YAFARAY
 
 class TriangleObject;
 class Triangle;
-class Pdf1D;
+class AliasPdf1D;
 class ParamMap;
 class RenderEnvironment;
 class TriKdTree;
@@ -59,7 +59,7 @@ class MeshLight final : public Light
 		unsigned int obj_id_;
 		bool double_sided_;
 		Rgb color_;
-		Pdf1D *area_dist_;
+		AliasPdf1D *area_dist_;
 		const Triangle **tris_;
 		int samples_;
 		int n_tris_; //!< gives the array size of uDist
@@ -128,6 +128,9 @@ class Material
 		/*! return the pdf for sampling the BSDF with wi and wo
 		*/
 		virtual float pdf(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, Bsdf_t bsdfs) const {return 0.f;}
+		/*! indicate whether eval() and pdf() return exactly the color and density of the directions given by sample(), so that
+			sample() can be mixed with other sampling strategies (e.g. path guiding) by multiple importance sampling */
+		virtual bool hasExactPdf() const { return false; }
 
 
 		/*! indicate whether light can (partially) pass the material without getting refracted,
@@ -62,6 +62,7 @@ class BlendMaterial final : public NodeMaterial
 		float min_thres_;
 		float max_thres_;
 		size_t mmem_1_;
+		size_t blend_mem_ = 0; //!< memory used by the blend material itself, the memory of both blended materials follows it
 		bool recalc_blend_;
 		float blended_ior_;
 		mutable Bsdf_t mat_1_flags_, mat_2_flags_;
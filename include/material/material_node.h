@@ -21,14 +21,13 @@
 #define YAFARAY_MATERIAL_NODE_H
 
 #include "material/material.h"
+#include "shader/shader_node.h"
 #include <map>
 #include <vector>
 
 BEGIN_YAFARAY
 
 class RenderEnvironment;
-class ShaderNode;
-class NodeStack;
 
 enum NodeTypeE { ViewDep = 1, ViewIndep = 1 << 1 };
 
@@ -45,13 +44,18 @@ class NodeMaterial: public Material
 		   sets reqNodeMem to the amount of memory the node stack requires for evaluation of all nodes */
 		void solveNodesOrder(const std::vector<ShaderNode *> &roots);
 		void getNodeList(const ShaderNode *root, std::vector<ShaderNode *> &nodes);
-		void evalNodes(const RenderState &state, const SurfacePoint &sp, const std::vector<ShaderNode *> &nodes, NodeStack &stack) const;
+		/*! compile a list of nodes in evaluation order into a program, folding the nodes that only depend on constant inputs.
+			Only the folded results read by the remaining nodes or by the material (root nodes) are kept. Nodes missing
+			from the list are never evaluated, so a material can compile only the nodes needed by one of its BSDF components */
+		void compileNodes(const std::vector<ShaderNode *> &nodes, NodeProgram &program) const;
+		void evalNodes(const RenderState &state, const SurfacePoint &sp, const NodeProgram &program, NodeStack &stack) const { program.eval(stack, state, sp); }
 		void evalBump(NodeStack &stack, const RenderState &state, SurfacePoint &sp, const ShaderNode *bump_s) const;
 		/*! filter out nodes with specific properties */
 		void filterNodes(const std::vector<ShaderNode *> &input, std::vector<ShaderNode *> &output, int flags);
 		virtual ~NodeMaterial();
 
-		std::vector<ShaderNode *> all_nodes_, all_sorted_, all_viewdep_, all_viewindep_, bump_nodes_;
+		std::vector<ShaderNode *> all_nodes_, all_sorted_, all_viewdep_, all_viewindep_, bump_nodes_, root_nodes_;
+		NodeProgram all_sorted_program_, viewindep_program_;
 		std::map<std::string, ShaderNode *> m_shaders_table_;
 		size_t req_node_mem_;
 };
@@ -50,6 +50,7 @@ class ShinyDiffuseMaterial: public NodeMaterial
 		virtual Rgb eval(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wl, Bsdf_t bsdfs, bool force_eval = false) const;
 		virtual Rgb sample(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const;
 		virtual float pdf(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, Bsdf_t bsdfs) const;
+		virtual bool hasExactPdf() const { return true; }
 		virtual bool isTransparent() const { return m_is_transparent_; }
 		virtual Rgb getTransparency(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const;
 		virtual Rgb emit(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const; // { return emitCol; }
@@ -132,6 +133,7 @@ class ShinyDiffuseMaterial: public NodeMaterial
 		ShaderNode *diffuse_refl_shader_ = nullptr;   //!< Shader node for diffuse reflection strength (float)
 		ShaderNode *ior_s_ = nullptr;                 //!< Shader node for IOR value (float)
 		ShaderNode *wireframe_shader_ = nullptr;     //!< Shader node for wireframe shading (float)
+		NodeProgram transparency_program_;             //!< Nodes evaluated by getTransparency() for shadow rays
 
 		Rgb diffuse_color_;              //!< BSDF Diffuse component color
 		Rgb emit_color_;                 //!< Emit color
@@ -121,7 +121,7 @@ class TriangleObjectInstance: public TriangleObject
 		/*! the number of primitives the object holds. Primitive is an element
 			that by definition can perform ray-triangle intersection */
 		virtual int numPrimitives() const { return triangles_.size(); }
-		virtual int getPrimitives(const Triangle **prims);
+		virtual int getPrimitives(const Triangle **prims) const override;
 
 		virtual void finish();
 
@@ -25,6 +25,7 @@
 #include "common/color.h"
 #include <list>
 #include <map>
+#include <vector>
 
 BEGIN_YAFARAY
 
@@ -56,6 +57,55 @@ class NodeStack
 		NodeResult *dat_;
 };
 
+enum MixModes { MnMix = 0, MnAdd, MnMult, MnSub, MnScreen, MnDiv, MnDiff, MnDark, MnLight, MnOverlay };
+
+//! description of a mix node, so that NodeProgram can run it inline (see ShaderNode::getMixOperation())
+struct NodeMixOperation
+{
+	MixModes mode_;
+	const ShaderNode *input_1_, *input_2_, *factor_; //!< nullptr when the constant value below is used instead
+	NodeResult value_1_, value_2_;
+	float factor_value_;
+};
+
+/*! flat evaluation program for a list of shader nodes, built by NodeMaterial::compileNodes().
+	Nodes whose result does not depend on the surface point are folded into constants at
+	compile time. The remaining nodes become a flat stream of instructions: mix nodes are run
+	inline by the program, with their folded inputs as immediate operands, and only the other
+	nodes (texture mappers, layers) still go through the virtual ShaderNode::eval() */
+class NodeProgram final
+{
+	public:
+		struct Operand
+		{
+			int id_; //!< stack index of the input node, or -1 to use value_ instead
+			NodeResult value_;
+		};
+		void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const;
+		void clear() { instructions_.clear(); num_constants_ = num_mix_ = 0; }
+		//! constants are loaded before any other instruction runs, so they can be added in any order
+		void addConstant(unsigned int id, const NodeResult &result);
+		void addNode(const ShaderNode *node);
+		void addMix(unsigned int id, MixModes mode, const Operand &input_1, const Operand &input_2, const Operand &factor);
+		size_t numConstants() const { return num_constants_; }
+		size_t numMixInstructions() const { return num_mix_; }
+		size_t numInstructions() const { return instructions_.size(); }
+
+	private:
+		enum Opcode : int { LoadConstant, EvalNode, EvalMix };
+		struct Instruction
+		{
+			Opcode opcode_;
+			MixModes mode_;
+			unsigned int id_;
+			const ShaderNode *node_;
+			Operand input_1_, input_2_, factor_; //!< LoadConstant keeps its result in input_1_
+		};
+		static const NodeResult &operand(const NodeStack &stack, const Operand &operand) { return operand.id_ < 0 ? operand.value_ : stack(operand.id_); }
+		std::vector<Instruction> instructions_;
+		size_t num_constants_ = 0, num_mix_ = 0;
+};
+
 class NodeFinder
 {
 	public:
@@ -63,8 +113,6 @@ class NodeFinder
 		virtual ~NodeFinder() {};
 };
 
-enum MixModes { MnMix = 0, MnAdd, MnMult, MnSub, MnScreen, MnDiv, MnDiff, MnDark, MnLight, MnOverlay };
-
 /*!	shader nodes are as the name implies elements of a node based shading tree.
 	Note that a "shader" only associates a color or scalar with a surface point,
 	nothing more and nothing less. The material behaviour is implemented in the
@@ -88,6 +136,12 @@ class ShaderNode
 		{stack[this->id_] = NodeResult(Rgba(0.f), 0.f);}
 		/*! indicate whether the shader value depends on wi and wo */
 		virtual bool isViewDependant() const { return false; }
+		/*! indicate whether the shader value only depends on its input nodes and not on the surface point or render state,
+			so it can be folded into a constant when all its inputs are constant */
+		virtual bool isSurfaceIndependent() const { return false; }
+		/*! describe the node as a mix of two inputs, so that a NodeProgram can run it inline instead of calling eval().
+			\return false if the node is not a mix node */
+		virtual bool getMixOperation(NodeMixOperation &operation) const { return false; }
 		/*! configure the inputs. gets the same paramMap the factory functions get, but shader nodes
 			may be created in any order and linked afterwards, so inputs may not exist yet on instantiation */
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) = 0;
@@ -222,6 +276,97 @@ inline float textureValueBlend__(float tex, float out, float fact, float facg, M
 	}
 }
 
+//! result of a mix node in the given mode, f_2 being the factor of the second input
+inline NodeResult mixNodeResults__(MixModes mode, Rgba cin_1, float fin_1, Rgba cin_2, float fin_2, float f_2)
+{
+	const float f_1 = 1.f - f_2;
+	switch(mode)
+	{
+		case MnAdd:
+			cin_1 += f_2 * cin_2;
+			fin_1 += f_2 * fin_2;
+			return NodeResult(cin_1, fin_1);
+
+		case MnMult:
+			cin_1 *= Rgba(f_1) + f_2 * cin_2;
+			fin_2 *= f_1 + f_2 * fin_2;
+			return NodeResult(cin_1, fin_1);
+
+		case MnSub:
+			cin_1 -= f_2 * cin_2;
+			fin_1 -= f_2 * fin_2;
+			return NodeResult(cin_1, fin_1);
+
+		case MnScreen:
+		{
+			Rgba color = Rgba(1.f) - (Rgba(f_1) + f_2 * (1.f - cin_2)) * (1.f - cin_1);
+			float scalar   = 1.0 - (f_1 + f_2 * (1.f - fin_2)) * (1.f - fin_1);
+			return NodeResult(color, scalar);
+		}
+
+		case MnDiff:
+			cin_1.r_ = f_1 * cin_1.r_ + f_2 * std::fabs(cin_1.r_ - cin_2.r_);
+			cin_1.g_ = f_1 * cin_1.g_ + f_2 * std::fabs(cin_1.g_ - cin_2.g_);
+			cin_1.b_ = f_1 * cin_1.b_ + f_2 * std::fabs(cin_1.b_ - cin_2.b_);
+			cin_1.a_ = f_1 * cin_1.a_ + f_2 * std::fabs(cin_1.a_ - cin_2.a_);
+			fin_1   = f_1 * fin_1 + f_2 * std::fabs(fin_1 - fin_2);
+			return NodeResult(cin_1, fin_1);
+
+		case MnDark:
+			cin_2 *= f_2;
+			if(cin_2.r_ < cin_1.r_) cin_1.r_ = cin_2.r_;
+			if(cin_2.g_ < cin_1.g_) cin_1.g_ = cin_2.g_;
+			if(cin_2.b_ < cin_1.b_) cin_1.b_ = cin_2.b_;
+			if(cin_2.a_ < cin_1.a_) cin_1.a_ = cin_2.a_;
+			fin_2 *= f_2;
+			if(fin_2 < fin_1) fin_1 = fin_2;
+			return NodeResult(cin_1, fin_1);
+
+		case MnLight:
+			cin_2 *= f_2;
+			if(cin_2.r_ > cin_1.r_) cin_1.r_ = cin_2.r_;
+			if(cin_2.g_ > cin_1.g_) cin_1.g_ = cin_2.g_;
+			if(cin_2.b_ > cin_1.b_) cin_1.b_ = cin_2.b_;
+			if(cin_2.a_ > cin_1.a_) cin_1.a_ = cin_2.a_;
+			fin_2 *= f_2;
+			if(fin_2 > fin_1) fin_1 = fin_2;
+			return NodeResult(cin_1, fin_1);
+
+		case MnOverlay:
+		{
+			Rgba color;
+			color.r_ = (cin_1.r_ < 0.5f) ? cin_1.r_ * (f_1 + 2.0f * f_2 * cin_2.r_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.r_)) * (1.0 - cin_1.r_);
+			color.g_ = (cin_1.g_ < 0.5f) ? cin_1.g_ * (f_1 + 2.0f * f_2 * cin_2.g_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.g_)) * (1.0 - cin_1.g_);
+			color.b_ = (cin_1.b_ < 0.5f) ? cin_1.b_ * (f_1 + 2.0f * f_2 * cin_2.b_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.b_)) * (1.0 - cin_1.b_);
+			color.a_ = (cin_1.a_ < 0.5f) ? cin_1.a_ * (f_1 + 2.0f * f_2 * cin_2.a_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.a_)) * (1.0 - cin_1.a_);
+			float scalar = (fin_1 < 0.5f) ? fin_1 * (f_1 + 2.0f * f_2 * fin_2) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - fin_2)) * (1.0 - fin_1);
+			return NodeResult(color, scalar);
+		}
+
+		default:
+		case MnMix:
+			return NodeResult(f_1 * cin_1 + f_2 * cin_2, f_1 * fin_1 + f_2 * fin_2);
+	}
+}
+
+inline void NodeProgram::eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
+{
+	for(const auto &instruction : instructions_)
+	{
+		switch(instruction.opcode_)
+		{
+			case LoadConstant: stack[instruction.id_] = instruction.input_1_.value_; break;
+			case EvalMix:
+			{
+				const NodeResult &input_1 = operand(stack, instruction.input_1_);
+				const NodeResult &input_2 = operand(stack, instruction.input_2_);
+				stack[instruction.id_] = mixNodeResults__(instruction.mode_, input_1.col_, input_1.f_, input_2.col_, input_2.f_, operand(stack, instruction.factor_).f_);
+				break;
+			}
+			default: instruction.node_->eval(stack, state, sp); break;
+		}
+	}
+}
 
 END_YAFARAY
 
@@ -69,33 +69,34 @@ class ValueNode final : public ShaderNode
 		ValueNode(Rgba col, float val): color_(col), value_(val) {}
 		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const override;
 		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi) const override;
+		virtual bool isSurfaceIndependent() const override { return true; }
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override { return true; };
 
 		Rgba color_;
 		float value_;
 };
 
-class MixNode : public ShaderNode
+class MixNode final : public ShaderNode
 {
 	public:
 		static ShaderNode *factory(const ParamMap &params, RenderEnvironment &render);
 
-	protected:
-		MixNode();
-		void getInputs(NodeStack &stack, Rgba &cin_1, Rgba &cin_2, float &fin_1, float &fin_2, float &f_2) const;
-
 	private:
-		MixNode(float val);
+		MixNode(float val, MixModes mode);
+		void getInputs(NodeStack &stack, Rgba &cin_1, Rgba &cin_2, float &fin_1, float &fin_2, float &f_2) const;
 		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const override;
 		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi) const override;
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override;
 		virtual bool getDependencies(std::vector<const ShaderNode *> &dep) const override;
+		virtual bool isSurfaceIndependent() const override { return true; }
+		virtual bool getMixOperation(NodeMixOperation &operation) const override;
 
 		Rgba col_1_, col_2_;
 		float val_1_, val_2_, cfactor_;
 		const ShaderNode *input_1_ = nullptr;
 		const ShaderNode *input_2_ = nullptr;
 		const ShaderNode *factor_ = nullptr;
+		MixModes mode_;
 };
 
 inline void MixNode::getInputs(NodeStack &stack, Rgba &cin_1, Rgba &cin_2, float &fin_1, float &fin_2, float &f_2) const
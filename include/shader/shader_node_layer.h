@@ -36,13 +36,14 @@ class LayerNode: public ShaderNode
 {
 	public:
 		LayerNode(unsigned tflag, float col_fac, float var_fac, float def_val, Rgba def_col, MixModes mmod);
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const;
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi) const;
-		virtual void evalDerivative(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const;
-		virtual bool isViewDependant() const;
-		virtual bool configInputs(const ParamMap &params, const NodeFinder &find);
+		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const override;
+		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi) const override;
+		virtual void evalDerivative(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const override;
+		virtual bool isViewDependant() const override;
+		virtual bool isSurfaceIndependent() const override { return true; }
+		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override;
 		//virtual void getDerivative(const surfacePoint_t &sp, float &du, float &dv) const;
-		virtual bool getDependencies(std::vector<const ShaderNode *> &dep) const;
+		virtual bool getDependencies(std::vector<const ShaderNode *> &dep) const override;
 		static ShaderNode *factory(const ParamMap &params, RenderEnvironment &render);
 	protected:
 		const ShaderNode *input_, *upper_layer_;
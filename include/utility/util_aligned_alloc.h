@@ -21,9 +21,11 @@
 #define YAFARAY_UTIL_ALIGNED_ALLOC_H
 
 #include "constants.h"
+#include "common/logging.h"
 #include <vector>
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 #if defined(__FreeBSD__)
 #include <stdlib.h>
@@ -166,5 +168,100 @@ class MemoryArena
 		std::vector<char *> used_blocks_, available_blocks_;
 };
 
+/*! Bump-pointer arena for per-thread scratch memory. Memory is given back in LIFO order by releasing
+	to a previously taken marker (see ScratchArena::Scope), so the blocks are reused for the whole
+	lifetime of the arena and an allocation bigger than the block size just gets its own block.
+	Every allocation is followed by a canary word that is checked when the allocation is released, so a write
+	past the requested size (for example a material writing more userdata than its getReqMem()) is reported
+	as an error instead of silently corrupting the next allocation.
+*/
+class ScratchArena final
+{
+	public:
+		struct Marker
+		{
+			size_t block_;
+			size_t position_;
+		};
+		//! Releases on destruction everything allocated in the arena since the Scope was created
+		class Scope final
+		{
+			public:
+				explicit Scope(ScratchArena &arena) : arena_(arena), marker_(arena.mark()) { }
+				~Scope() { arena_.release(marker_); }
+				Scope(const Scope &) = delete;
+				Scope &operator=(const Scope &) = delete;
+
+			private:
+				ScratchArena &arena_;
+				const Marker marker_;
+		};
+
+		explicit ScratchArena(size_t block_size = 16384) : block_size_(block_size) { }
+		ScratchArena(const ScratchArena &) = delete;
+		ScratchArena &operator=(const ScratchArena &) = delete;
+		~ScratchArena()
+		{
+			for(const auto &block : blocks_) yFree__(block.data_);
+		}
+		void *alloc(size_t sz)
+		{
+			const size_t requested_size = sz;
+			sz = (sz + sizeof(canary_) + alignment_ - 1) & (~(alignment_ - 1));
+			while(current_block_ < blocks_.size() && current_pos_ + sz > blocks_[current_block_].size_)
+			{
+				++current_block_;
+				current_pos_ = 0;
+			}
+			if(current_block_ == blocks_.size())
+			{
+				const size_t block_size = std::max(sz, block_size_);
+				blocks_.push_back({(char *) yMemalign__(64, block_size), block_size});
+			}
+			char *ret = blocks_[current_block_].data_ + current_pos_;
+			const uint64_t canary = canary_;
+			std::memcpy(ret + requested_size, &canary, sizeof(canary));
+			canaries_.push_back({current_block_, current_pos_ + requested_size});
+			current_pos_ += sz;
+			return ret;
+		}
+		Marker mark() const { return {current_block_, current_pos_}; }
+		void release(const Marker &marker)
+		{
+			//The canaries of the allocations made after the marker are the ones at or after it
+			while(!canaries_.empty() && (canaries_.back().block_ > marker.block_ || (canaries_.back().block_ == marker.block_ && canaries_.back().position_ >= marker.position_)))
+			{
+				const Marker &position = canaries_.back();
+				uint64_t canary;
+				std::memcpy(&canary, blocks_[position.block_].data_ + position.position_, sizeof(canary));
+				if(canary != canary_) reportOverflow();
+				canaries_.pop_back();
+			}
+			current_block_ = marker.block_;
+			current_pos_ = marker.position_;
+		}
+
+	private:
+		struct Block
+		{
+			char *data_;
+			size_t size_;
+		};
+		void reportOverflow()
+		{
+			if(overflow_reported_) return;
+			Y_ERROR << "ScratchArena: memory written past the end of an allocation, probably a material using more userdata than its getReqMem()" << YENDL;
+			overflow_reported_ = true;
+		}
+		static constexpr size_t alignment_ = 16;
+		static constexpr uint64_t canary_ = 0xA5A5A5A5DEADBEEFull;
+		std::vector<Block> blocks_;
+		std::vector<Marker> canaries_; //!< positions of the canaries of the allocations not released yet, in allocation order
+		size_t block_size_;
+		size_t current_block_ = 0;
+		size_t current_pos_ = 0;
+		bool overflow_reported_ = false;
+};
+
 END_YAFARAY
 #endif // YAFARAY_UTIL_ALIGNED_ALLOC_H
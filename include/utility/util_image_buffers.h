@@ -28,6 +28,7 @@
 #include "constants.h"
 #include "common/color.h"
 #include <vector>
+#include <algorithm>
 #include <stdint.h>
 
 BEGIN_YAFARAY
@@ -59,6 +60,34 @@ class PixelGray final
 		float weight_ = 0.f;
 };
 
+/*! Weighted moments of the brightness of the samples of a pixel, for estimating its variance */
+class PixelMoments final
+{
+	public:
+		void add(float value, float weight)
+		{
+			sum_ += value * weight;
+			sum_2_ += value * value * weight;
+			weight_ += weight;
+			weight_2_ += weight * weight;
+		}
+		float mean() const { return (weight_ > 0.f) ? sum_ / weight_ : 0.f; }
+		/*! Estimated variance of the weighted mean of the samples, or -1 with less than two samples. The weights
+			of the filter make the effective number of samples (sum of the weights)^2 / (sum of the squared weights) */
+		float meanVariance() const
+		{
+			const float weight_squared = weight_ * weight_;
+			if(!(weight_ > 0.f) || weight_2_ >= 0.999f * weight_squared) return -1.f;
+			const float mean = sum_ / weight_;
+			const float variance = std::max(0.f, sum_2_ / weight_ - mean * mean) / (1.f - weight_2_ / weight_squared);
+			return variance * weight_2_ / weight_squared;
+		}
+		float sum_ = 0.f;
+		float sum_2_ = 0.f;
+		float weight_ = 0.f;
+		float weight_2_ = 0.f;
+};
+
 class Rgba8888 final
 {
 	public:
@@ -351,6 +380,7 @@ typedef Generic2DBuffer<PixelGray> 	Gray2DImageWeighed_t; //!< Weighted monochro
 typedef Generic2DBuffer<Rgb> 		Rgb2DImage_t; //!< Non-weighted RGB (96bit/pixel) image buffer typedef
 typedef Generic2DBuffer<Rgba> 	Rgba2DImage_t; //!< Non-weighted RGBA (128bit/pixel) image buffer typedef
 typedef Generic2DBuffer<float> 		Gray2DImage_t; //!< Non-weighted gray scale (32bit/gray pixel) image buffer typedef
+typedef Generic2DBuffer<PixelMoments> 	Moments2DImage_t; //!< Brightness moments image buffer typedef
 typedef Generic2DBuffer<Rgb101010>		RgbOptimizedImage_t; //!< Non-weighted optimized (32bit/pixel) without alpha image buffer typedef
 typedef Generic2DBuffer<Rgb565>		RgbCompressedImage_t; //!< Non-weighted compressed (16bit/pixel) LOSSY image buffer typedef
 typedef Generic2DBuffer<Rgba1010108>	RgbaOptimizedImage_t; //!< Non-weighted optimized (40bit/pixel) with alpha buffer typedef
@@ -23,6 +23,7 @@
 #include "common/logging.h"
 #include "common/ray.h"
 #include <algorithm>
+#include <vector>
 #include <string.h>
 
 BEGIN_YAFARAY
@@ -164,6 +165,99 @@ class Pdf1D
 		int count_;
 };
 
+/*! class that holds a 1D probability distribution function (pdf) with the same semantics as Pdf1D,
+	but that takes samples in constant time using Walker's alias method instead of a binary search over the cdf.
+	The sample mapping is not monotonic, but the sampled distribution and the returned pdf values are the same.
+*/
+
+class AliasPdf1D final
+{
+	public:
+		AliasPdf1D(const float *f, int n) : func_(f, f + n), count_(n), table_(n)
+		{
+			double sum = 0.0;
+			for(int i = 0; i < n; ++i) sum += (double)f[i];
+			integral_ = (float)(sum / (double)n);
+			inv_integral_ = 1.f / integral_;
+			inv_count_ = 1.f / count_;
+			buildTable(sum);
+		}
+		//! Returns a continuous sample in [0, count_), the integer part being the sampled index
+		float sample(float u, float *pdf) const
+		{
+			float remapped;
+			const int index = dSample(u, pdf, remapped);
+			return index + remapped;
+		}
+		int dSample(float u, float *pdf) const
+		{
+			float remapped;
+			return dSample(u, pdf, remapped);
+		}
+		//! Takes a discrete sample and also returns in u_remapped the sample offset within the chosen index, in [0, 1)
+		int dSample(float u, float *pdf, float &u_remapped) const
+		{
+			const float position = u * count_;
+			int index = std::max(0, std::min((int) position, count_ - 1));
+			const float remainder = std::max(0.f, std::min(position - index, 1.f));
+			const AliasEntry &entry = table_[index];
+			if(entry.probability_ >= 1.f || remainder < entry.probability_)
+			{
+				u_remapped = entry.probability_ > 0.f ? remainder / entry.probability_ : 0.f;
+			}
+			else
+			{
+				u_remapped = (remainder - entry.probability_) / (1.f - entry.probability_);
+				index = entry.alias_;
+			}
+			if(u_remapped >= 1.f) u_remapped = 0.99999994f;
+			if(pdf) *pdf = func_[index] * inv_integral_;
+			return index;
+		}
+		std::vector<float> func_;
+		float integral_, inv_integral_, inv_count_;
+		int count_;
+
+	private:
+		struct AliasEntry
+		{
+			float probability_ = 1.f;
+			int alias_ = 0;
+		};
+		void buildTable(double sum)
+		{
+			if(count_ <= 0) return;
+			for(int i = 0; i < count_; ++i) table_[i].alias_ = i;
+			if(sum <= 0.0) return;
+			std::vector<double> scaled(count_);
+			std::vector<int> small, large;
+			small.reserve(count_);
+			large.reserve(count_);
+			for(int i = 0; i < count_; ++i)
+			{
+				scaled[i] = (double)func_[i] * (double)count_ / sum;
+				if(scaled[i] < 1.0) small.push_back(i);
+				else large.push_back(i);
+			}
+			while(!small.empty() && !large.empty())
+			{
+				const int small_index = small.back();
+				small.pop_back();
+				const int large_index = large.back();
+				table_[small_index].probability_ = (float)scaled[small_index];
+				table_[small_index].alias_ = large_index;
+				scaled[large_index] = (scaled[large_index] + scaled[small_index]) - 1.0;
+				if(scaled[large_index] < 1.0)
+				{
+					large.pop_back();
+					small.push_back(large_index);
+				}
+			}
+			//Any remaining entries are (up to rounding errors) exactly full, so they keep probability 1 and alias themselves
+		}
+		std::vector<AliasEntry> table_;
+};
+
 // rotate the coord-system D, U, V with minimum rotation so that D gets
 // mapped to D2, i.e. rotate around D^D2.
 // V is assumed to be D^U, accordingly V2 is D2^U2; all input vectors must be normalized!
@@ -0,0 +1,172 @@
+/****************************************************************************
+ *      background_baked.cc: a background tabulated from another background
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "background/background_baked.h"
+#include "common/logging.h"
+#include "common/param.h"
+#include "common/ray.h"
+#include "common/scene.h"
+#include "texture/texture.h"
+
+BEGIN_YAFARAY
+
+constexpr int BakedBackground::max_resolution_;
+
+bool BakedBackground::Table::operator==(const Table &table) const
+{
+	if(width_ != table.width_ || height_ != table.height_) return false;
+	for(size_t i = 0; i < texels_.size(); ++i)
+	{
+		const Rgb &col = texels_[i];
+		const Rgb &other = table.texels_[i];
+		if(col.r_ != other.r_ || col.g_ != other.g_ || col.b_ != other.b_) return false;
+	}
+	return true;
+}
+
+BakedBackground::BakedBackground(Background *background, int resolution, float max_error, bool horizon_discontinuity) : background_(background), horizon_discontinuity_(horizon_discontinuity)
+{
+	static const char *query_names[NumQueries] = { "camera", "camera postprocessed", "light", "light postprocessed" };
+	for(int query = 0; query < NumQueries; ++query)
+	{
+		std::unique_ptr<Table> table(new Table);
+		bake(*table, std::max(8, std::min(resolution, max_resolution_)), query);
+		float error = maxInterpolationError(*table, query);
+		while(error > max_error && table->width_ < max_resolution_)
+		{
+			bake(*table, std::min(2 * table->width_, max_resolution_), query);
+			error = maxInterpolationError(*table, query);
+		}
+		query_tables_[query] = nullptr;
+		for(const auto &baked_table : tables_) if(*baked_table == *table) query_tables_[query] = baked_table.get();
+		if(query_tables_[query]) continue;
+		Y_VERBOSE << "BakedBackground: " << query_names[query] << " table " << table->width_ << "x" << table->height_ << ", max relative interpolation error: " << error << " (requested: " << max_error << ")" << YENDL;
+		if(error > max_error) Y_WARNING << "BakedBackground: maximum table resolution reached without meeting the requested error bound for the " << query_names[query] << " table" << YENDL;
+		query_tables_[query] = table.get();
+		tables_.push_back(std::move(table));
+	}
+}
+
+Rgb BakedBackground::evalAnalytic(const Vec3 &dir, int query) const
+{
+	const Ray ray(Point3(0.f), dir);
+	const bool from_postprocessed = (query == CameraPostprocessedQuery || query == LightPostprocessedQuery);
+	if(query >= LightQuery) return background_->eval(ray, from_postprocessed);
+	RenderState state;
+	return (*background_)(ray, state, from_postprocessed);
+}
+
+void BakedBackground::bake(Table &table, int width, int query) const
+{
+	table.width_ = width;
+	table.height_ = width / 2;
+	//Both hemispheres need the same number of rows so that the horizon falls on a row boundary
+	if(horizon_discontinuity_) table.height_ += table.height_ % 2;
+	table.texels_.resize(table.width_ * table.height_);
+	const float inv_width = 1.f / table.width_;
+	const float inv_height = 1.f / table.height_;
+	Vec3 dir;
+	for(int y = 0; y < table.height_; ++y)
+	{
+		const float v = (y + 0.5f) * inv_height;
+		for(int x = 0; x < table.width_; ++x)
+		{
+			invSpheremap__((x + 0.5f) * inv_width, v, dir);
+			table.texels_[y * table.width_ + x] = evalAnalytic(dir, query);
+		}
+	}
+}
+
+float BakedBackground::maxInterpolationError(const Table &table, int query) const
+{
+	//The bilinear interpolation error is largest halfway between the table samples, so the analytic background is checked at the texel corners
+	float max_error = 0.f;
+	Vec3 dir;
+	for(int y = 1; y < table.height_; ++y)
+	{
+		const float v = (float) y / table.height_;
+		for(int x = 0; x < table.width_; ++x)
+		{
+			invSpheremap__((float) x / table.width_, v, dir);
+			const Rgb exact = evalAnalytic(dir, query);
+			const float error = (lookup(table, dir) - exact).absmax() / std::max(exact.maximum(), 1e-3f);
+			max_error = std::max(max_error, error);
+		}
+	}
+	return max_error;
+}
+
+Rgb BakedBackground::lookup(const Table &table, const Vec3 &dir) const
+{
+	float u = 0.f, v = 0.f;
+	spheremap__(dir, u, v);
+	//The hemisphere is chosen from the direction itself, the same test the analytic backgrounds use at the horizon
+	return lookup(table, u, v, dir.z_ >= 0.f);
+}
+
+Rgb BakedBackground::lookup(const Table &table, float u, float v, bool upper_hemisphere) const
+{
+	const int width = table.width_;
+	int y_min = 0, y_max = table.height_ - 1;
+	if(horizon_discontinuity_)
+	{
+		//The lower hemisphere (v < 0.5) is stored in the first half of the rows, the upper one in the second half
+		if(upper_hemisphere) y_min = table.height_ / 2;
+		else y_max = table.height_ / 2 - 1;
+	}
+	const float fx = u * width - 0.5f;
+	const float fy = std::max((float) y_min, std::min(v * table.height_ - 0.5f, (float) y_max));
+	const int x_floor = (int) std::floor(fx);
+	const int y_0 = (int) fy;
+	const int y_1 = std::min(y_0 + 1, y_max);
+	const float dx = fx - x_floor;
+	const float dy = fy - y_0;
+	const int x_0 = (x_floor % width + width) % width;
+	const int x_1 = (x_0 + 1) % width;
+	const Rgb *texels = table.texels_.data();
+	const Rgb top = (1.f - dx) * texels[y_0 * width + x_0] + dx * texels[y_0 * width + x_1];
+	const Rgb bottom = (1.f - dx) * texels[y_1 * width + x_0] + dx * texels[y_1 * width + x_1];
+	return (1.f - dy) * top + dy * bottom;
+}
+
+Rgb BakedBackground::operator()(const Ray &ray, RenderState &state, bool from_postprocessed) const
+{
+	return lookup(*query_tables_[from_postprocessed ? CameraPostprocessedQuery : CameraQuery], ray.dir_);
+}
+
+Rgb BakedBackground::eval(const Ray &ray, bool from_postprocessed) const
+{
+	return lookup(*query_tables_[from_postprocessed ? LightPostprocessedQuery : LightQuery], ray.dir_);
+}
+
+Background *BakedBackground::bakeIfEnabled(Background *background, const ParamMap &params, bool horizon_discontinuity)
+{
+	bool bake = false;
+	int resolution = 512;
+	float max_error = 0.01f;
+
+	params.getParam("bake", bake);
+	params.getParam("bake_resolution", resolution);
+	params.getParam("bake_max_error", max_error);
+
+	if(!background || !bake) return background;
+	return new BakedBackground(background, resolution, max_error, horizon_discontinuity);
+}
+
+END_YAFARAY
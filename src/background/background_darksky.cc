@@ -27,6 +27,7 @@
  */
 
 #include "background/background_darksky.h"
+#include "background/background_baked.h"
 #include "common/logging.h"
 #include "common/environment.h"
 #include "common/param.h"
@@ -317,6 +318,8 @@ Background *DarkSkyBackground::factory(ParamMap &params, RenderEnvironment &rend
 		if(light) render.getScene()->addLight(light);
 	}
 
+	Background *background = BakedBackground::bakeIfEnabled(dark_sky, params);
+
 	if(bgl)
 	{
 		ParamMap bgp;
@@ -330,14 +333,14 @@ Background *DarkSkyBackground::factory(ParamMap &params, RenderEnvironment &rend
 
 		Light *bglight = render.createLight("DarkSky_bgLight", bgp);
 
-		bglight->setBackground(dark_sky);
+		bglight->setBackground(background);
 
 		if(bglight) render.getScene()->addLight(bglight);
 	}
 
 	Y_VERBOSE << "DarkSky: End" << YENDL;
 
-	return dark_sky;
+	return background;
 }
 
 END_YAFARAY
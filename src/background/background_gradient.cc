@@ -19,6 +19,7 @@
  */
 
 #include "background/background_gradient.h"
+#include "background/background_baked.h"
 #include "common/environment.h"
 #include "common/param.h"
 #include "common/scene.h"
@@ -81,7 +82,7 @@ Background *GradientBackground::factory(ParamMap &params, RenderEnvironment &ren
 	params.getParam("with_caustic", caus);
 	params.getParam("with_diffuse", diff);
 
-	Background *grad_bg = new GradientBackground(gzenith * p, ghoriz * p, szenith * p, shoriz * p, bgl, true);
+	Background *grad_bg = BakedBackground::bakeIfEnabled(new GradientBackground(gzenith * p, ghoriz * p, szenith * p, shoriz * p, bgl, true), params, true);
 
 	if(bgl)
 	{
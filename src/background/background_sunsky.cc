@@ -19,6 +19,7 @@
  */
 
 #include "background/background_sunsky.h"
+#include "background/background_baked.h"
 #include "background/background_util_sunspectrum.h"
 #include "common/logging.h"
 #include "common/environment.h"
@@ -217,7 +218,7 @@ Background *SunSkyBackground::factory(ParamMap &params, RenderEnvironment &rende
 	params.getParam("with_caustic", caus);
 	params.getParam("with_diffuse", diff);
 
-	Background *new_sunsky = new SunSkyBackground(dir, turb, av, bv, cv, dv, ev, power, bgl, true);
+	Background *new_sunsky = BakedBackground::bakeIfEnabled(new SunSkyBackground(dir, turb, av, bv, cv, dv, ev, power, bgl, true), params);
 
 	if(bgl)
 	{
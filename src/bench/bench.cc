@@ -0,0 +1,802 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*! yafaray-bench: renders procedurally generated scenes, built through the Interface without any file I/O,
+	with each of the main surface integrators at fixed seeds and thread counts. Every run is reported as one
+	line of JSON, so the results can be collected and compared between versions. */
+
+#include "constants.h"
+#include "yafaray_config.h"
+#include "interface/interface.h"
+#include "common/logging.h"
+#include "common/matrix4.h"
+#include "common/monitor.h"
+#include "common/render_stats.h"
+#include "common/scene.h"
+#include "output/output_memory.h"
+#include "shader/shader_node.h"
+#include "texture/noise_generator.h"
+#include "utility/util_console.h"
+#include "utility/util_sample.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#if !defined(__linux__) && !defined(WIN32)
+#include <sys/resource.h>
+#endif
+
+using namespace::yafaray4;
+
+//! Interface giving access to the render stats of the scene, including the per pass timings
+class BenchInterface final : public Interface
+{
+	public:
+		const RenderStatsReport *getRenderStatsReport() const { return scene_ ? &scene_->getRenderStats() : nullptr; }
+};
+
+//! Progress bar that does not print anything, so the console output is only the results
+class SilentProgressBar final : public ProgressBar
+{
+	public:
+		virtual void init(int total_steps = 100) override { total_steps_ = total_steps; done_steps_ = 0; }
+		virtual void update(int steps = 1) override { done_steps_ += steps; }
+		virtual void done() override { done_steps_ = total_steps_; }
+		virtual void setTag(const char *text) override { tag_ = text; }
+		virtual void setTag(std::string text) override { tag_ = text; }
+		virtual std::string getTag() const override { return tag_; }
+		virtual float getPercent() const override { return total_steps_ > 0 ? 100.f * done_steps_ / total_steps_ : 0.f; }
+		virtual float getTotalSteps() const override { return total_steps_; }
+
+	private:
+		int total_steps_ = 0;
+		int done_steps_ = 0;
+		std::string tag_;
+};
+
+struct BenchOptions
+{
+	int width_ = 320;
+	int height_ = 240;
+	int aa_passes_ = 2;
+	int aa_samples_ = 1;
+	int scale_ = 1; //!< Multiplies the amount of procedural content: triangles, instances, lights and photons
+	unsigned int seed_ = 1234;
+};
+
+typedef void (*BuildSceneFunction_t)(BenchInterface &yi, const BenchOptions &options);
+
+struct BenchScene
+{
+	const char *name_;
+	BuildSceneFunction_t build_;
+	bool volumes_;
+};
+
+static double secondsSince__(const std::chrono::steady_clock::time_point &start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<std::string> splitList__(const std::string &list)
+{
+	std::vector<std::string> items;
+	std::stringstream ss(list);
+	std::string item;
+	while(std::getline(ss, item, ',')) if(!item.empty()) items.push_back(item);
+	return items;
+}
+
+//! Resets the peak resident set size of the process, so it can be measured for each run (Linux only)
+static void resetPeakRss__()
+{
+#if defined(__linux__)
+	std::ofstream clear_refs("/proc/self/clear_refs");
+	if(clear_refs) clear_refs << "5";
+#endif
+}
+
+//! Peak resident set size of the process in KiB, or -1 if not available
+static long peakRssKb__()
+{
+#if defined(__linux__)
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while(std::getline(status, line))
+	{
+		if(line.compare(0, 6, "VmHWM:") == 0) return std::atol(line.c_str() + 6);
+	}
+	return -1;
+#elif !defined(WIN32)
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return -1;
+#endif
+}
+
+static Material *createDiffuseMaterial__(BenchInterface &yi, const char *name, float r, float g, float b)
+{
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "shinydiffusemat");
+	yi.paramsSetColor("color", r, g, b);
+	return yi.createMaterial(name);
+}
+
+static Material *createGlassMaterial__(BenchInterface &yi, const char *name)
+{
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "glass");
+	yi.paramsSetFloat("IOR", 1.5);
+	yi.paramsSetColor("filter_color", 1.f, 1.f, 1.f);
+	yi.paramsSetColor("mirror_color", 1.f, 1.f, 1.f);
+	yi.paramsSetFloat("transmit_filter", 1.0);
+	return yi.createMaterial(name);
+}
+
+static void createPointLight__(BenchInterface &yi, const char *name, double x, double y, double z, float power)
+{
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "pointlight");
+	yi.paramsSetPoint("from", x, y, z);
+	yi.paramsSetColor("color", 1.f, 1.f, 1.f);
+	yi.paramsSetFloat("power", power);
+	yi.createLight(name);
+}
+
+//! Camera "cam" looking at the origin and background "world", shared by all the scenes
+static void createCameraAndBackground__(BenchInterface &yi, const BenchOptions &options)
+{
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "perspective");
+	yi.paramsSetPoint("from", 0.0, -9.0, 5.0);
+	yi.paramsSetPoint("to", 0.0, 0.0, 0.5);
+	yi.paramsSetPoint("up", 0.0, -9.0, 6.0);
+	yi.paramsSetInt("resx", options.width_);
+	yi.paramsSetInt("resy", options.height_);
+	yi.paramsSetFloat("focal", 1.2);
+	yi.createCamera("cam");
+
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "constant");
+	yi.paramsSetColor("color", 0.05f, 0.06f, 0.08f);
+	yi.paramsSetFloat("power", 1.0);
+	yi.createBackground("world");
+}
+
+//! Square grid of n x n quads centered at the origin, optionally displaced by a wave pattern. Returns the mesh id
+static unsigned int addGrid__(BenchInterface &yi, const Material *mat, int n, double size, bool displaced)
+{
+	std::vector<double> vertices;
+	std::vector<int> indices;
+	vertices.reserve(3 * (n + 1) * (n + 1));
+	indices.reserve(6 * n * n);
+	for(int j = 0; j <= n; ++j)
+	{
+		for(int i = 0; i <= n; ++i)
+		{
+			const double x = size * ((double) i / n - 0.5);
+			const double y = size * ((double) j / n - 0.5);
+			const double z = displaced ? 0.4 * std::sin(2.0 * x) * std::cos(1.5 * y) + 0.4 : 0.0;
+			vertices.push_back(x);
+			vertices.push_back(y);
+			vertices.push_back(z);
+		}
+	}
+	for(int j = 0; j < n; ++j)
+	{
+		for(int i = 0; i < n; ++i)
+		{
+			const int a = j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+			indices.insert(indices.end(), {a, b, d, a, d, c});
+		}
+	}
+	const unsigned int id = yi.getNextFreeId();
+	yi.startTriMesh(id, (n + 1) * (n + 1), 2 * n * n, false);
+	yi.addVertices(vertices.data(), (n + 1) * (n + 1));
+	yi.addTriangles(indices.data(), 2 * n * n, mat);
+	yi.endTriMesh();
+	if(displaced) yi.smoothMesh(id, 181.0);
+	return id;
+}
+
+//! UV sphere with smoothed normals. Returns the mesh id
+static unsigned int addSphere__(BenchInterface &yi, const Material *mat, double cx, double cy, double cz, double radius, int rings, int segments, bool base_mesh = false)
+{
+	std::vector<double> vertices;
+	std::vector<int> indices;
+	vertices.insert(vertices.end(), {cx, cy, cz + radius});
+	for(int r = 1; r < rings; ++r)
+	{
+		const double theta = M_PI * r / rings;
+		for(int s = 0; s < segments; ++s)
+		{
+			const double phi = 2.0 * M_PI * s / segments;
+			vertices.insert(vertices.end(), {cx + radius * std::sin(theta) * std::cos(phi), cy + radius * std::sin(theta) * std::sin(phi), cz + radius * std::cos(theta)});
+		}
+	}
+	vertices.insert(vertices.end(), {cx, cy, cz - radius});
+	const int num_vertices = (int) vertices.size() / 3;
+	for(int s = 0; s < segments; ++s) indices.insert(indices.end(), {0, 1 + s, 1 + (s + 1) % segments});
+	for(int r = 0; r < rings - 2; ++r)
+	{
+		for(int s = 0; s < segments; ++s)
+		{
+			const int a = 1 + r * segments + s, b = 1 + r * segments + (s + 1) % segments, c = a + segments, d = b + segments;
+			indices.insert(indices.end(), {a, c, d, a, d, b});
+		}
+	}
+	const int last_ring = 1 + (rings - 2) * segments;
+	for(int s = 0; s < segments; ++s) indices.insert(indices.end(), {last_ring + s, num_vertices - 1, last_ring + (s + 1) % segments});
+	const int num_triangles = (int) indices.size() / 3;
+	const unsigned int id = yi.getNextFreeId();
+	yi.startTriMesh(id, num_vertices, num_triangles, false, false, base_mesh ? BASEMESH : 0);
+	yi.addVertices(vertices.data(), num_vertices);
+	yi.addTriangles(indices.data(), num_triangles, mat);
+	yi.endTriMesh();
+	yi.smoothMesh(id, 181.0);
+	return id;
+}
+
+//! A single finely tessellated displaced mesh, about 130000 triangles per scale unit
+static void buildTrianglesScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	const Material *mat = createDiffuseMaterial__(yi, "surface", 0.7f, 0.6f, 0.5f);
+	createPointLight__(yi, "key", 3.0, -4.0, 6.0, 60.f);
+	createPointLight__(yi, "fill", -5.0, -2.0, 4.0, 20.f);
+	yi.startGeometry();
+	addGrid__(yi, mat, (int) std::lround(256.0 * std::sqrt((double) options.scale_)), 12.0, true);
+	yi.endGeometry();
+}
+
+//! A grid of instances of the same sphere, 256 instances per scale unit
+static void buildInstancesScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	const Material *floor_mat = createDiffuseMaterial__(yi, "floor", 0.6f, 0.6f, 0.6f);
+	const Material *mat = createDiffuseMaterial__(yi, "instances", 0.2f, 0.4f, 0.8f);
+	createPointLight__(yi, "key", 3.0, -4.0, 8.0, 80.f);
+	yi.startGeometry();
+	addGrid__(yi, floor_mat, 1, 30.0, false);
+	const unsigned int base_id = addSphere__(yi, mat, 0.0, 0.0, 0.0, 0.25, 16, 32, true);
+	const int rows = 16 * options.scale_, columns = 16;
+	for(int j = 0; j < rows; ++j)
+	{
+		for(int i = 0; i < columns; ++i)
+		{
+			Matrix4 obj_to_world(1.f);
+			obj_to_world.translate(0.6f * (i - columns / 2), 0.6f * (j - 4), 0.25f + 0.1f * ((i + j) % 3));
+			yi.addInstance(base_id, obj_to_world);
+		}
+	}
+	yi.endGeometry();
+}
+
+//! Simple geometry lit by a grid of dim point lights, 32 lights per scale unit
+static void buildLightsScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	const Material *floor_mat = createDiffuseMaterial__(yi, "floor", 0.6f, 0.6f, 0.6f);
+	const Material *mat = createDiffuseMaterial__(yi, "spheres", 0.8f, 0.5f, 0.3f);
+	const int num_lights = 32 * options.scale_;
+	for(int i = 0; i < num_lights; ++i)
+	{
+		const std::string name = "light" + std::to_string(i);
+		createPointLight__(yi, name.c_str(), 8.0 * std::cos(i * 2.4) * std::sqrt((i + 0.5) / num_lights), 8.0 * std::sin(i * 2.4) * std::sqrt((i + 0.5) / num_lights), 3.0 + (i % 4), 120.f / num_lights);
+	}
+	yi.startGeometry();
+	addGrid__(yi, floor_mat, 1, 30.0, false);
+	for(int i = 0; i < 5; ++i) addSphere__(yi, mat, 2.0 * (i - 2), 0.0, 0.8, 0.8, 24, 48);
+	yi.endGeometry();
+}
+
+//! Materials with shader node trees layering several procedural textures
+static void buildTexturesScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	const char *texture_types[] = { "clouds", "marble", "wood", "voronoi" };
+	for(int i = 0; i < 4; ++i)
+	{
+		yi.paramsClearAll();
+		yi.paramsSetString("type", texture_types[i]);
+		yi.paramsSetColor("color1", 0.1f * i, 0.2f, 0.3f);
+		yi.paramsSetColor("color2", 0.9f, 0.8f - 0.1f * i, 0.6f);
+		yi.paramsSetInt("depth", 4);
+		yi.paramsSetFloat("size", 0.5 + 0.25 * i);
+		yi.paramsSetFloat("turbulence", 4.0);
+		yi.paramsSetBool("hard", false);
+		yi.createTexture(("tex" + std::to_string(i)).c_str());
+	}
+	const Material *materials[3];
+	for(int m = 0; m < 3; ++m)
+	{
+		yi.paramsClearAll();
+		yi.paramsSetString("type", "shinydiffusemat");
+		yi.paramsSetColor("color", 0.8f, 0.8f, 0.8f);
+		yi.paramsSetString("diffuse_shader", "layer3");
+		for(int i = 0; i < 4; ++i)
+		{
+			yi.paramsPushList();
+			yi.paramsSetString("element", "shader_node");
+			yi.paramsSetString("type", "texture_mapper");
+			yi.paramsSetString("name", ("map" + std::to_string(i)).c_str());
+			yi.paramsSetString("texture", ("tex" + std::to_string((i + m) % 4)).c_str());
+			yi.paramsSetString("texco", "global");
+			yi.paramsSetPoint("scale", 1.0 + m, 1.0 + m, 1.0 + m);
+			yi.paramsPushList();
+			yi.paramsSetString("element", "shader_node");
+			yi.paramsSetString("type", "layer");
+			yi.paramsSetString("name", ("layer" + std::to_string(i)).c_str());
+			yi.paramsSetString("input", ("map" + std::to_string(i)).c_str());
+			if(i > 0) yi.paramsSetString("upper_layer", ("layer" + std::to_string(i - 1)).c_str());
+			else yi.paramsSetColor("upper_color", 0.5f, 0.5f, 0.5f);
+			yi.paramsSetInt("mode", i % 3);
+			yi.paramsSetFloat("colfac", 0.6);
+			yi.paramsSetBool("do_color", true);
+			yi.paramsSetBool("color_input", true);
+		}
+		yi.paramsEndList();
+		materials[m] = yi.createMaterial(("textured" + std::to_string(m)).c_str());
+	}
+	createPointLight__(yi, "key", 3.0, -4.0, 6.0, 60.f);
+	createPointLight__(yi, "fill", -5.0, -2.0, 4.0, 20.f);
+	yi.startGeometry();
+	addGrid__(yi, materials[0], 1, 30.0, false);
+	for(int i = 0; i < 3; ++i) addSphere__(yi, materials[(i + 1) % 3], 2.5 * (i - 1), 0.0, 1.0, 1.0, 32, 64);
+	yi.endGeometry();
+}
+
+//! Sets the parameters of a mix shader node, in the params list of the material being created
+static void setMixNode__(BenchInterface &yi, const std::string &name, const std::string &input_1, const std::string &input_2, const std::string &factor, int mode)
+{
+	yi.paramsPushList();
+	yi.paramsSetString("element", "shader_node");
+	yi.paramsSetString("type", "mix");
+	yi.paramsSetString("name", name.c_str());
+	yi.paramsSetString("input1", input_1.c_str());
+	yi.paramsSetString("input2", input_2.c_str());
+	if(factor.empty()) yi.paramsSetFloat("value", 0.35f);
+	else yi.paramsSetString("factor", factor.c_str());
+	yi.paramsSetInt("mode", mode);
+}
+
+//! Materials with large trees of mix and value nodes around a single texture, some of them only used by disabled BSDF components
+static void buildNodesScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "clouds");
+	yi.paramsSetInt("depth", 2);
+	yi.paramsSetFloat("size", 0.5);
+	yi.createTexture("noise");
+	const int chain_length = 24;
+	const Material *materials[2];
+	for(int m = 0; m < 2; ++m)
+	{
+		const bool transparent = (m == 1);
+		yi.paramsClearAll();
+		yi.paramsSetString("type", "shinydiffusemat");
+		yi.paramsSetColor("color", 0.8f, 0.8f, 0.8f);
+		yi.paramsSetString("diffuse_shader", ("mix" + std::to_string(chain_length - 1)).c_str());
+		//mirror_color_shader is dead: the material has no mirror component
+		yi.paramsSetString("mirror_color_shader", "dead_mix");
+		if(transparent)
+		{
+			yi.paramsSetFloat("transparency", 0.5f);
+			yi.paramsSetString("transparency_shader", "alpha_mix");
+		}
+		yi.paramsPushList();
+		yi.paramsSetString("element", "shader_node");
+		yi.paramsSetString("type", "texture_mapper");
+		yi.paramsSetString("name", "map");
+		yi.paramsSetString("texture", "noise");
+		yi.paramsSetString("texco", "global");
+		for(int i = 0; i < chain_length; ++i)
+		{
+			yi.paramsPushList();
+			yi.paramsSetString("element", "shader_node");
+			yi.paramsSetString("type", "value");
+			yi.paramsSetString("name", ("value" + std::to_string(i)).c_str());
+			yi.paramsSetColor("color", 0.1f + 0.03f * i, 0.9f - 0.03f * i, 0.5f);
+			yi.paramsSetFloat("scalar", 0.04f * i);
+			//constant subtrees like the ones Blender exports for unconnected sockets, folded at load time
+			setMixNode__(yi, "const" + std::to_string(i), "value" + std::to_string(i), i > 0 ? "const" + std::to_string(i - 1) : "value0", "", i % 9);
+			setMixNode__(yi, "mix" + std::to_string(i), i > 0 ? "mix" + std::to_string(i - 1) : "map", "const" + std::to_string(i), i % 2 ? "map" : "", i % 9);
+		}
+		setMixNode__(yi, "dead_mix", "map", "mix" + std::to_string(chain_length / 2), "", MnMult);
+		if(transparent) setMixNode__(yi, "alpha_mix", "map", "value1", "", MnMix);
+		yi.paramsEndList();
+		materials[m] = yi.createMaterial(("nodes" + std::to_string(m)).c_str());
+	}
+	createPointLight__(yi, "key", 3.0, -4.0, 6.0, 60.f);
+	createPointLight__(yi, "fill", -5.0, -2.0, 4.0, 20.f);
+	yi.startGeometry();
+	addGrid__(yi, materials[0], 1, 30.0, false);
+	for(int i = 0; i < 3; ++i) addSphere__(yi, materials[i % 2], 2.5 * (i - 1), 0.0, 1.0, 1.0, 32, 64);
+	yi.endGeometry();
+}
+
+//! A noise volume over simple geometry, rendered with the single scattering volume integrator
+static void buildVolumesScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	const Material *floor_mat = createDiffuseMaterial__(yi, "floor", 0.6f, 0.6f, 0.6f);
+	const Material *mat = createDiffuseMaterial__(yi, "sphere", 0.8f, 0.3f, 0.2f);
+	createPointLight__(yi, "key", 2.0, -3.0, 6.0, 60.f);
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "clouds");
+	yi.paramsSetInt("depth", 3);
+	yi.paramsSetFloat("size", 1.0);
+	yi.createTexture("density");
+	yi.paramsClearAll();
+	yi.paramsSetString("type", "NoiseVolume");
+	yi.paramsSetString("texture", "density");
+	yi.paramsSetFloat("sigma_s", 0.4);
+	yi.paramsSetFloat("sigma_a", 0.1);
+	yi.paramsSetFloat("g", 0.2);
+	yi.paramsSetFloat("density", 1.0);
+	yi.paramsSetFloat("sharpness", 2.0);
+	yi.paramsSetFloat("cover", 0.6);
+	yi.paramsSetFloat("minX", -4.0);
+	yi.paramsSetFloat("minY", -3.0);
+	yi.paramsSetFloat("minZ", 0.0);
+	yi.paramsSetFloat("maxX", 4.0);
+	yi.paramsSetFloat("maxY", 3.0);
+	yi.paramsSetFloat("maxZ", 3.0);
+	yi.createVolumeRegion("fog");
+	yi.startGeometry();
+	addGrid__(yi, floor_mat, 1, 30.0, false);
+	addSphere__(yi, mat, 0.0, 0.0, 1.0, 1.0, 24, 48);
+	yi.endGeometry();
+}
+
+//! Glass spheres over a floor, lit by a point light casting caustics
+static void buildCausticsScene__(BenchInterface &yi, const BenchOptions &options)
+{
+	createCameraAndBackground__(yi, options);
+	const Material *floor_mat = createDiffuseMaterial__(yi, "floor", 0.7f, 0.7f, 0.7f);
+	const Material *glass = createGlassMaterial__(yi, "glass");
+	createPointLight__(yi, "key", 1.0, 2.0, 7.0, 80.f);
+	yi.startGeometry();
+	addGrid__(yi, floor_mat, 1, 30.0, false);
+	for(int i = 0; i < 3; ++i) addSphere__(yi, glass, 2.5 * (i - 1), 0.0, 1.0, 1.0, 32, 64);
+	yi.endGeometry();
+}
+
+static const BenchScene bench_scenes__[] =
+{
+	{ "triangles", buildTrianglesScene__, false },
+	{ "instances", buildInstancesScene__, false },
+	{ "lights", buildLightsScene__, false },
+	{ "textures", buildTexturesScene__, false },
+	{ "nodes", buildNodesScene__, false },
+	{ "volumes", buildVolumesScene__, true },
+	{ "caustics", buildCausticsScene__, false },
+};
+
+static const char *bench_integrators__[] = { "directlighting", "pathtracing", "wavefront_pathtracing", "photonmapping", "SPPM", "bidirectional" };
+
+static void createIntegrators__(BenchInterface &yi, const std::string &integrator_type, bool volumes, const BenchOptions &options)
+{
+	const int photons = 100000 * options.scale_;
+	yi.paramsClearAll();
+	yi.paramsSetString("type", integrator_type.c_str());
+	yi.paramsSetInt("raydepth", 5);
+	yi.paramsSetInt("shadowDepth", 2);
+	if(integrator_type == "directlighting")
+	{
+		yi.paramsSetBool("caustics", false);
+	}
+	else if(integrator_type == "pathtracing" || integrator_type == "wavefront_pathtracing")
+	{
+		yi.paramsSetInt("bounces", 4);
+		yi.paramsSetInt("path_samples", 16);
+		yi.paramsSetString("caustic_type", "path");
+	}
+	else if(integrator_type == "photonmapping")
+	{
+		yi.paramsSetInt("bounces", 4);
+		yi.paramsSetInt("photons", photons);
+		yi.paramsSetInt("search", 100);
+		yi.paramsSetFloat("diffuseRadius", 0.5);
+		yi.paramsSetBool("caustics", true);
+		yi.paramsSetInt("cPhotons", photons);
+		yi.paramsSetFloat("causticRadius", 0.2);
+		yi.paramsSetBool("finalGather", true);
+		yi.paramsSetInt("fg_samples", 8);
+		yi.paramsSetInt("fg_bounces", 2);
+	}
+	else if(integrator_type == "SPPM")
+	{
+		yi.paramsSetInt("bounces", 4);
+		yi.paramsSetInt("photons", photons);
+		yi.paramsSetInt("passNums", options.aa_passes_);
+		yi.paramsSetInt("searchNum", 100);
+		yi.paramsSetFloat("photonRadius", 0.5);
+	}
+	yi.createIntegrator("surface_integrator");
+
+	yi.paramsClearAll();
+	if(volumes)
+	{
+		yi.paramsSetString("type", "SingleScatterIntegrator");
+		yi.paramsSetFloat("stepSize", 0.2);
+		yi.paramsSetBool("adaptive", false);
+		yi.paramsSetBool("optimize", true);
+	}
+	else yi.paramsSetString("type", "none");
+	yi.createIntegrator("volume_integrator");
+}
+
+static void setRenderParams__(BenchInterface &yi, int threads, const BenchOptions &options)
+{
+	yi.paramsClearAll();
+	yi.setupRenderPasses();
+	yi.paramsSetString("camera_name", "cam");
+	yi.paramsSetString("integrator_name", "surface_integrator");
+	yi.paramsSetString("volintegrator_name", "volume_integrator");
+	yi.paramsSetString("background_name", "world");
+	yi.paramsSetInt("width", options.width_);
+	yi.paramsSetInt("height", options.height_);
+	yi.paramsSetInt("AA_passes", options.aa_passes_);
+	yi.paramsSetInt("AA_minsamples", options.aa_samples_);
+	yi.paramsSetInt("AA_inc_samples", options.aa_samples_);
+	yi.paramsSetFloat("AA_threshold", 0.0);
+	yi.paramsSetInt("threads", threads);
+	yi.paramsSetInt("threads_photons", threads);
+}
+
+//! Builds and renders one scene with one integrator, writing the results as a line of JSON
+static bool runBenchmark__(const BenchScene &scene, const std::string &integrator_type, int threads, const BenchOptions &options, std::ostream &out)
+{
+	BenchInterface yi;
+	resetPeakRss__();
+
+	const auto build_start = std::chrono::steady_clock::now();
+	yi.startScene(0);
+	scene.build_(yi, options);
+	const double build_seconds = secondsSince__(build_start);
+
+	createIntegrators__(yi, integrator_type, scene.volumes_, options);
+	setRenderParams__(yi, threads, options);
+	std::vector<float> image(4 * options.width_ * options.height_);
+	MemoryInputOutput output(options.width_, options.height_, image.data());
+	srand(options.seed_); //the SPPM integrator still seeds its random number generators with rand(), the tiles of the other integrators do not
+	yi.render(output, new SilentProgressBar()); //the image film takes ownership of the progress bar
+
+	const RenderStatsReport *report = yi.getRenderStatsReport();
+	if(!report || report->getPasses().empty())
+	{
+		Y_ERROR << "Bench: render of scene \"" << scene.name_ << "\" with integrator \"" << integrator_type << "\" failed" << YENDL;
+		return false;
+	}
+	double setup_seconds = 0.0, render_seconds = 0.0;
+	uint64_t render_rays = 0;
+	std::stringstream pass_seconds;
+	for(const auto &pass : report->getPasses())
+	{
+		if(pass.name_ == "setup")
+		{
+			setup_seconds += pass.seconds_;
+			continue;
+		}
+		if(pass_seconds.tellp() > 0) pass_seconds << ", ";
+		pass_seconds << pass.seconds_;
+		render_seconds += pass.seconds_;
+		render_rays += pass.totals_.get(RenderStats::TracedRays);
+	}
+
+	out << "{\"version\": \"" << YAFARAY_BUILD_VERSION << "\", \"scene\": \"" << scene.name_ << "\", \"integrator\": \"" << integrator_type << "\"";
+	out << ", \"threads\": " << threads << ", \"seed\": " << options.seed_ << ", \"scale\": " << options.scale_;
+	out << ", \"width\": " << options.width_ << ", \"height\": " << options.height_ << ", \"aa_passes\": " << options.aa_passes_;
+	out << ", \"build_seconds\": " << build_seconds << ", \"setup_seconds\": " << setup_seconds << ", \"render_seconds\": " << render_seconds;
+	out << ", \"pass_seconds\": [" << pass_seconds.str() << "]";
+	out << ", \"mrays_per_second\": " << (render_seconds > 0.0 ? render_rays / render_seconds / 1.0e6 : 0.0);
+	out << ", \"peak_rss_kb\": " << peakRssKb__();
+	out << ", \"counters\": " << report->getTotals().toJson() << "}" << std::endl;
+
+	yi.clearAll();
+	return true;
+}
+
+//! Sampling a 1D distribution with a binary search over the cdf (Pdf1D) and with the alias method (AliasPdf1D)
+static void runSamplingMicroBenchmarks__(const BenchOptions &options, std::ostream &out)
+{
+	const int num_entries = 4096;
+	const int num_samples = 10000000;
+	std::vector<float> function(num_entries);
+	for(int i = 0; i < num_entries; ++i) function[i] = 1.f + std::sin(0.01f * i) * std::sin(0.01f * i) * (i % 7);
+	const Pdf1D pdf(function.data(), num_entries);
+	const AliasPdf1D alias_pdf(function.data(), num_entries);
+
+	for(int method = 0; method < 2; ++method)
+	{
+		unsigned int random = options.seed_;
+		float pdf_sum = 0.f;
+		const auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < num_samples; ++i)
+		{
+			random = random * 1664525u + 1013904223u;
+			const float u = (random >> 8) * (1.f / 16777216.f);
+			float sample_pdf;
+			if(method == 0) pdf.dSample(u, &sample_pdf);
+			else alias_pdf.dSample(u, &sample_pdf);
+			pdf_sum += sample_pdf;
+		}
+		const double seconds = secondsSince__(start);
+		out << "{\"version\": \"" << YAFARAY_BUILD_VERSION << "\", \"benchmark\": \"" << (method == 0 ? "pdf1d_sample" : "alias_pdf1d_sample") << "\"";
+		out << ", \"entries\": " << num_entries << ", \"samples\": " << num_samples << ", \"ns_per_sample\": " << seconds * 1.0e9 / num_samples;
+		out << ", \"checksum\": " << pdf_sum << "}" << std::endl;
+	}
+}
+
+/*! Noise generators evaluated one point per call (operator()) and in batches (evalBatch), as done by the fractal
+	noise functions. Also reports the largest difference between both results, which must be 0 */
+static void runNoiseMicroBenchmarks__(const BenchOptions &options, std::ostream &out)
+{
+	const int num_points = 1 << 20;
+	std::vector<Point3> points(num_points);
+	unsigned int random = options.seed_;
+	for(auto &point : points)
+	{
+		float coordinates[3];
+		for(float &coordinate : coordinates)
+		{
+			random = random * 1664525u + 1013904223u;
+			coordinate = (random >> 8) * (100.f / 16777216.f) - 50.f;
+		}
+		point.set(coordinates[0], coordinates[1], coordinates[2]);
+	}
+	const NewPerlinNoiseGenerator new_perlin;
+	const StdPerlinNoiseGenerator std_perlin;
+	const BlenderNoiseGenerator blender;
+	const VoronoiNoiseGenerator voronoi_f1(VoronoiNoiseGenerator::Vf1, VoronoiNoiseGenerator::DistReal);
+	const VoronoiNoiseGenerator voronoi_crackle(VoronoiNoiseGenerator::VCrackle, VoronoiNoiseGenerator::DistMinkovskyFour);
+	const CellNoiseGenerator cell;
+	const std::pair<const char *, const NoiseGenerator *> generators[] =
+	{
+		{"newperlin", &new_perlin}, {"stdperlin", &std_perlin}, {"blender", &blender},
+		{"voronoi_f1", &voronoi_f1}, {"voronoi_crackle", &voronoi_crackle}, {"cellnoise", &cell},
+	};
+
+	std::vector<float> scalar_values(num_points), batch_values(num_points);
+	for(const auto &generator : generators)
+	{
+		// untimed first run of both paths, so the results do not depend on the order of the measurements
+		for(int i = 0; i < num_points; ++i) scalar_values[i] = (*generator.second)(points[i]);
+		generator.second->evalBatch(points.data(), batch_values.data(), num_points);
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < num_points; ++i) scalar_values[i] = (*generator.second)(points[i]);
+		const double scalar_seconds = secondsSince__(start);
+		start = std::chrono::steady_clock::now();
+		generator.second->evalBatch(points.data(), batch_values.data(), num_points);
+		const double batch_seconds = secondsSince__(start);
+		float max_difference = 0.f;
+		for(int i = 0; i < num_points; ++i) max_difference = std::max(max_difference, std::fabs(batch_values[i] - scalar_values[i]));
+		out << "{\"version\": \"" << YAFARAY_BUILD_VERSION << "\", \"benchmark\": \"noise_" << generator.first << "\"";
+		out << ", \"points\": " << num_points << ", \"scalar_ns_per_point\": " << scalar_seconds * 1.0e9 / num_points;
+		out << ", \"batch_ns_per_point\": " << batch_seconds * 1.0e9 / num_points << ", \"max_difference\": " << max_difference << "}" << std::endl;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	CliParser parse(argc, argv, 0, 0, "");
+
+	parse.setAppName("YafaRay benchmark",
+	                 "[OPTIONS]...\nRenders procedurally generated scenes with each integrator and writes the results, one line of JSON per run.");
+	parse.setOption("s", "scenes", false, "Comma separated list of scenes to render. Default: all of them\n                                       (triangles,instances,lights,textures,nodes,volumes,caustics).");
+	parse.setOption("i", "integrators", false, "Comma separated list of integrators to use. Default: all of them\n                                       (directlighting,pathtracing,wavefront_pathtracing,photonmapping,SPPM,bidirectional).");
+	parse.setOption("t", "threads", false, "Comma separated list of thread counts to run each benchmark with.\n                                       Default: the number of hardware threads.");
+	parse.setOption("r", "resolution", false, "Image width in pixels, the height being 3/4 of it. Default: 320.");
+	parse.setOption("p", "passes", false, "Number of AA passes. Default: 2.");
+	parse.setOption("sc", "scale", false, "Multiplies the amount of triangles, instances, lights and photons. Default: 1.");
+	parse.setOption("sd", "seed", false, "Seed for the random number generators. Default: 1234.");
+	parse.setOption("o", "output", false, "Appends the results to the file <value> instead of writing them to the console.");
+	parse.setOption("mb", "micro-benchmarks", true, "Also runs the micro-benchmarks of the sampling functions and of the noise\n                                       generators (one point per call versus batches).");
+	parse.setOption("vl", "verbosity-level", false, "Set console verbosity level (\"mute\", \"error\", \"warning\", \"info\", \"verbose\"...). Default: \"error\".");
+	parse.setOption("h", "help", true, "Displays this help text.");
+
+	const bool parse_ok = parse.parseCommandLine();
+
+	if(parse.getFlag("h"))
+	{
+		parse.printUsage();
+		return 0;
+	}
+
+	if(!parse_ok)
+	{
+		parse.printError();
+		parse.printUsage();
+		return 1;
+	}
+
+	const std::string verb_level = parse.getOptionString("vl");
+	logger__.setConsoleMasterVerbosity(verb_level.empty() ? "error" : verb_level);
+	logger__.setLogMasterVerbosity("mute");
+
+	BenchOptions options;
+	const int resolution = parse.getOptionInteger("r");
+	if(resolution > 0)
+	{
+		options.width_ = resolution;
+		options.height_ = std::max(1, resolution * 3 / 4);
+	}
+	const int passes = parse.getOptionInteger("p");
+	if(passes > 0) options.aa_passes_ = passes;
+	const int scale = parse.getOptionInteger("sc");
+	if(scale > 0) options.scale_ = scale;
+	const int seed = parse.getOptionInteger("sd");
+	if(seed >= 0) options.seed_ = seed;
+
+	std::vector<std::string> scene_names = splitList__(parse.getOptionString("s"));
+	if(scene_names.empty()) for(const auto &scene : bench_scenes__) scene_names.push_back(scene.name_);
+	std::vector<std::string> integrators = splitList__(parse.getOptionString("i"));
+	if(integrators.empty()) integrators.assign(std::begin(bench_integrators__), std::end(bench_integrators__));
+	std::vector<int> thread_counts;
+	for(const auto &threads : splitList__(parse.getOptionString("t"))) thread_counts.push_back(std::max(1, std::atoi(threads.c_str())));
+	if(thread_counts.empty()) thread_counts.push_back(std::max(1U, std::thread::hardware_concurrency()));
+
+	std::ofstream output_file;
+	const std::string output_file_path = parse.getOptionString("o");
+	if(!output_file_path.empty())
+	{
+		output_file.open(output_file_path, std::ios::app);
+		if(!output_file)
+		{
+			Y_ERROR << "Bench: could not open the output file " << output_file_path << YENDL;
+			return 1;
+		}
+	}
+	std::ostream &out = output_file_path.empty() ? std::cout : output_file;
+
+	bool success = true;
+	for(const auto &scene_name : scene_names)
+	{
+		const BenchScene *scene = nullptr;
+		for(const auto &bench_scene : bench_scenes__) if(scene_name == bench_scene.name_) scene = &bench_scene;
+		if(!scene)
+		{
+			Y_ERROR << "Bench: unknown scene \"" << scene_name << "\"" << YENDL;
+			success = false;
+			continue;
+		}
+		for(const auto &integrator : integrators)
+		{
+			for(const int threads : thread_counts) success = runBenchmark__(*scene, integrator, threads, options, out) && success;
+		}
+	}
+	if(parse.getFlag("mb"))
+	{
+		runSamplingMicroBenchmarks__(options, out);
+		runNoiseMicroBenchmarks__(options, out);
+	}
+
+	return success ? 0 : 1;
+}
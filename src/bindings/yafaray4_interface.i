@@ -32,6 +32,8 @@
 %include "std_vector.i"
 
 %array_functions(float, floatArray);
+%array_functions(double, doubleArray);
+%array_functions(int, intArray);
 
 #ifdef SWIGPYTHON  // Begining of python specific code
 
@@ -136,9 +138,59 @@ static PyObject *yaf_tile_subscript_int(YafTileObject *self, int keynum)
 	}
 }
 
+// Buffer protocol: exposes the tile region of the tile pixel buffer to Python without copying it again, as read-only float32 RGBA
+// with shape (h, w, 4) and rows ordered bottom to top like the sequence protocol above (Blender convention), so the row stride is negative.
+// For example numpy.asarray(tile).reshape(-1, 4) or memoryview(tile). The film still copies its pixels into this buffer in putPixel.
+// The view holds a reference to the tile object, which owns the buffer, so the view stays valid after the render. However the buffer
+// is overwritten by the next tiles, so the views are only meaningful during the draw area / flush callbacks, the data must be copied to be kept.
+// Grayscale and RGB tiles are exposed as RGBA too, with the grayscale value in the first component.
+static int yafTileGetBuffer__(YafTileObject *self, Py_buffer *view, int flags)
+{
+	if((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "yaf_tile: the tile buffer is read-only");
+		view->obj = nullptr;
+		return -1;
+	}
+	if((flags & PyBUF_STRIDES) != PyBUF_STRIDES)
+	{
+		PyErr_SetString(PyExc_BufferError, "yaf_tile: the tile buffer is strided, it must be requested with strides (for example through memoryview or numpy)");
+		view->obj = nullptr;
+		return -1;
+	}
+	yaf_tile_length(self);
+	const bool empty = (self->w <= 0 || self->h <= 0);
+	Py_ssize_t *dims = new Py_ssize_t[6]; //shape and strides, freed in yafTileReleaseBuffer__
+	dims[0] = empty ? 0 : self->h;
+	dims[1] = empty ? 0 : self->w;
+	dims[2] = 4;
+	dims[3] = -(Py_ssize_t) (self->resx * sizeof(YafTilePixel));
+	dims[4] = sizeof(YafTilePixel);
+	dims[5] = sizeof(float);
+	view->buf = empty ? (void *) self->mem : (void *) &self->mem[self->resx * (self->y1 - 1) + self->x0];
+	view->obj = (PyObject *) self;
+	Py_INCREF(self);
+	view->len = dims[0] * dims[1] * dims[2] * sizeof(float);
+	view->itemsize = sizeof(float);
+	view->readonly = 1;
+	view->format = ((flags & PyBUF_FORMAT) == PyBUF_FORMAT) ? (char *) "f" : nullptr;
+	view->ndim = 3;
+	view->shape = dims;
+	view->strides = dims + 3;
+	view->suboffsets = nullptr;
+	view->internal = dims;
+	return 0;
+}
+
+static void yafTileReleaseBuffer__(YafTileObject *self, Py_buffer *view)
+{
+	delete [] (Py_ssize_t *) view->internal;
+}
+
 static void yafTileDealloc__(YafTileObject *self)
 {
 	SWIG_PYTHON_THREAD_BEGIN_BLOCK; 
+	delete [] self->mem; //The tile owns its pixel buffer, so that buffer views holding a reference to the tile keep it alive
 	PyObject_Del(self);
 	SWIG_PYTHON_THREAD_END_BLOCK; 
 }
@@ -151,6 +203,12 @@ PySequenceMethods sequence_methods =
 	( ssizeargfunc ) yaf_tile_subscript_int
 };
 
+PyBufferProcs buffer_methods =
+{
+	( getbufferproc ) yafTileGetBuffer__,
+	( releasebufferproc ) yafTileReleaseBuffer__
+};
+
 PyTypeObject yaf_tile_type =
 {
 	PyVarObject_HEAD_INIT(nullptr, 0)
@@ -171,7 +229,7 @@ PyTypeObject yaf_tile_type =
 	nullptr,                       		/* reprfunc tp_str; */
 	nullptr,								/* getattrofunc tp_getattro; */
 	nullptr,								/* setattrofunc tp_setattro; */
-	nullptr,                       		/* PyBufferProcs *tp_as_buffer; */
+	&buffer_methods,					/* PyBufferProcs *tp_as_buffer; */
 	Py_TPFLAGS_DEFAULT,         		/* long tp_flags; */
 };
 
@@ -198,7 +256,10 @@ public:
 		PyGILState_STATE gstate;
 		gstate = PyGILState_Ensure();
 
+		clearPassGroups();
+		clearTilesPasses();
 		tiles_passes.resize(totalViews);
+		pass_groups.resize(totalViews, nullptr);
     
         for(size_t view = 0; view < tiles_passes.size(); ++view)
 		{
@@ -222,16 +283,8 @@ public:
 		PyGILState_STATE gstate;
 		gstate = PyGILState_Ensure();
 
-		for(size_t view = 0; view < tiles_passes.size(); ++view)
-		{
-			for(size_t idx = 0; idx < tiles_passes.at(view).size(); ++idx)
-			{
-				if(tiles_passes.at(view)[idx]->mem) delete [] tiles_passes.at(view)[idx]->mem;
-				//Py_XDECREF(tiles_passes.at(view)[idx]);
-			}
-			tiles_passes.at(view).clear();
-		}
-		tiles_passes.clear();
+		clearPassGroups();
+		clearTilesPasses();
 		
 		PyGILState_Release(gstate);
 		SWIG_PYTHON_THREAD_END_BLOCK; 
@@ -322,31 +375,19 @@ public:
 		PyGILState_STATE gstate;
 		gstate = PyGILState_Ensure();
 
-		PyObject* groupTile = PyTuple_New(tiles_passes.at(numView).size());
-
 		for(size_t idx = 0; idx < tiles_passes.at(numView).size(); ++idx)
 		{
 			tiles_passes.at(numView)[idx]->x0 = x0 - bsX;
 			tiles_passes.at(numView)[idx]->x1 = x1 - bsX;
 			tiles_passes.at(numView)[idx]->y0 = y0 - bsY;
 			tiles_passes.at(numView)[idx]->y1 = y1 - bsY;
-			
 			tiles_passes.at(numView)[idx]->tileType = render_passes->tileType(idx);
-			
-			std::stringstream extPassName;
-			extPassName << render_passes->extPassTypeStringFromIndex(idx);
-			PyObject* groupItem = Py_BuildValue("ssO", view_name.c_str(), extPassName.str().c_str(), tiles_passes.at(numView)[idx]);
-			PyTuple_SET_ITEM(groupTile, idx, (PyObject*) groupItem);
-
-			//std::cout << "flushArea: groupItem->ob_refcnt=" << groupItem->ob_refcnt << std::endl;
 		}
 
-		PyObject* result = PyObject_CallFunction(mDrawArea, "iiiiiO", tiles_passes.at(numView)[0]->x0, resy - tiles_passes.at(numView)[0]->y1, w, h, numView, groupTile);
+		// One callback per tile, reusing the (view, pass, tile) tuples: the tile objects expose the pixels through the buffer protocol
+		PyObject* result = PyObject_CallFunction(mDrawArea, "iiiiiO", tiles_passes.at(numView)[0]->x0, resy - tiles_passes.at(numView)[0]->y1, w, h, numView, passGroup(numView, view_name, render_passes));
 		
 		Py_XDECREF(result);
-		Py_XDECREF(groupTile);
-		//std::cout << "flushArea: result->ob_refcnt=" << result->ob_refcnt << std::endl;
-		//std::cout << "flushArea: groupTile->ob_refcnt=" << groupTile->ob_refcnt << std::endl;
 		
 		PyGILState_Release(gstate);
 		SWIG_PYTHON_THREAD_END_BLOCK; 
@@ -401,6 +442,38 @@ public:
 
 private:
 
+	//! Tuple of (view name, pass name, tile object) for each pass of a view, built the first time it is needed and reused for every tile of the view
+	PyObject *passGroup(int numView, const std::string &view_name, const yafaray4::RenderPasses *render_passes)
+	{
+		PyObject *&groupTile = pass_groups.at(numView);
+		if(!groupTile)
+		{
+			groupTile = PyTuple_New(tiles_passes.at(numView).size());
+			for(size_t idx = 0; idx < tiles_passes.at(numView).size(); ++idx)
+			{
+				PyObject* groupItem = Py_BuildValue("ssO", view_name.c_str(), render_passes->extPassTypeStringFromIndex(idx).c_str(), tiles_passes.at(numView)[idx]);
+				PyTuple_SET_ITEM(groupTile, idx, groupItem);
+			}
+		}
+		return groupTile;
+	}
+
+	void clearPassGroups()
+	{
+		for(auto &groupTile : pass_groups) Py_XDECREF(groupTile);
+		pass_groups.clear();
+	}
+
+	//Only releases our references: the pixel buffers are freed with the tile objects, once Python does not use them either
+	void clearTilesPasses()
+	{
+		for(auto &tiles : tiles_passes)
+		{
+			for(auto &tile : tiles) Py_XDECREF((PyObject *) tile);
+		}
+		tiles_passes.clear();
+	}
+
 	enum corner
 	{
 		TL_CORNER,
@@ -476,6 +549,7 @@ private:
 	PyObject *mDrawArea;
 	PyObject *mFlush;
 	std::vector< std::vector<YafTileObject*> > tiles_passes;
+	std::vector<PyObject*> pass_groups;
 };
 
 class YafPyProgress : public yafaray4::ProgressBar
@@ -552,6 +626,43 @@ private:
 	std::string tag;
 };
 
+// Read-only access to a contiguous Python buffer (NumPy array, array.array, memoryview...) of tuples with "components" items each.
+// Used to hand mesh data to the Interface bulk functions without copying it. A Python exception is set if the buffer is not valid.
+class YafPyArray
+{
+public:
+	YafPyArray(PyObject *obj, char format, size_t item_size, int components)
+	{
+		if(PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) return;
+		valid = true;
+		const char *f = view.format ? view.format : "B";
+		if(*f == '@' || *f == '=' || *f == '<') ++f;
+		const bool int_format = (format == 'i' && (*f == 'i' || *f == 'l'));
+		if((*f != format && !int_format) || f[1] != '\0' || (size_t) view.itemsize != item_size)
+		{
+			PyErr_Format(PyExc_TypeError, "Expected a contiguous buffer of '%c' items of %d bytes, got format '%s'", format, (int) item_size, view.format ? view.format : "B");
+			return;
+		}
+		const Py_ssize_t num_items = view.len / view.itemsize;
+		if(num_items % components != 0)
+		{
+			PyErr_Format(PyExc_ValueError, "Buffer size must be a multiple of %d", components);
+			return;
+		}
+		count = (int) (num_items / components);
+		ok = true;
+	}
+	~YafPyArray() { if(valid) PyBuffer_Release(&view); }
+	YafPyArray(const YafPyArray &) = delete;
+	YafPyArray &operator=(const YafPyArray &) = delete;
+	template <typename T> const T *data() const { return static_cast<const T *>(view.buf); }
+
+	Py_buffer view;
+	bool valid = false;
+	bool ok = false;
+	int count = 0;
+};
+
 %}
 
 %init %{
@@ -569,8 +680,64 @@ private:
 	$1 = $input;
 }
 
+// The pointer based bulk mesh functions are replaced in Python by versions taking objects supporting the buffer protocol
+%ignore addVertices(const double *, int);
+%ignore addVertices(const double *, const double *, int);
+%ignore addNormals(const double *, int);
+%ignore addTriangles(const int *, int, const yafaray4::Material *);
+%ignore addTriangles(const int *, const int *, int, const yafaray4::Material *);
+%ignore addUvs(const float *, int);
+
+%exception addVertices { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception addNormals { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception addTriangles { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception addUvs { $action if(PyErr_Occurred()) SWIG_fail; }
+
 %extend yafaray4::Interface
 {
+	int addVertices(PyObject *vertices, PyObject *orcos = nullptr)
+	{
+		YafPyArray vertex_array(vertices, 'd', sizeof(double), 3);
+		if(!vertex_array.ok) return -1;
+		if(!orcos || orcos == Py_None) return self->addVertices(vertex_array.data<double>(), vertex_array.count);
+		YafPyArray orco_array(orcos, 'd', sizeof(double), 3);
+		if(!orco_array.ok) return -1;
+		if(orco_array.count != vertex_array.count)
+		{
+			PyErr_SetString(PyExc_ValueError, "Vertices and orcos must have the same size");
+			return -1;
+		}
+		return self->addVertices(vertex_array.data<double>(), orco_array.data<double>(), vertex_array.count);
+	}
+
+	void addNormals(PyObject *normals)
+	{
+		YafPyArray normal_array(normals, 'd', sizeof(double), 3);
+		if(normal_array.ok) self->addNormals(normal_array.data<double>(), normal_array.count);
+	}
+
+	bool addTriangles(PyObject *indices, const yafaray4::Material *mat, PyObject *uv_indices = nullptr)
+	{
+		YafPyArray index_array(indices, 'i', sizeof(int), 3);
+		if(!index_array.ok) return false;
+		if(!uv_indices || uv_indices == Py_None) return self->addTriangles(index_array.data<int>(), index_array.count, mat);
+		YafPyArray uv_array(uv_indices, 'i', sizeof(int), 3);
+		if(!uv_array.ok) return false;
+		if(uv_array.count != index_array.count)
+		{
+			PyErr_SetString(PyExc_ValueError, "Vertex and uv indices must have the same size");
+			return false;
+		}
+		return self->addTriangles(index_array.data<int>(), uv_array.data<int>(), index_array.count, mat);
+	}
+
+	int addUvs(PyObject *uvs)
+	{
+		YafPyArray uv_array(uvs, 'f', sizeof(float), 2);
+		if(!uv_array.ok) return -1;
+		return self->addUvs(uv_array.data<float>(), uv_array.count);
+	}
+
 	void render(int x, int y, int borderStartX, int borderStartY, bool prev, PyObject *drawAreaCallBack, PyObject *flushCallBack, PyObject *progressCallback)
 	{
 		YafPyOutput output_wrap(x, y, borderStartX, borderStartY, prev, drawAreaCallBack, flushCallBack);
@@ -738,6 +905,12 @@ namespace yafaray4
 		virtual bool addTriangle(int a, int b, int c, const Material *mat); //!< add a triangle given vertex indices and material pointer
 		virtual bool addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, const Material *mat); //!< add a triangle given vertex and uv indices and material pointer
 		virtual int  addUv(float u, float v); //!< add a UV coordinate pair; returns index to be used for addTriangle
+		virtual int  addVertices(const double *vertices, int num_vertices); //!< add vertices from an array of x,y,z triplets; returns index of the first one added
+		virtual int  addVertices(const double *vertices, const double *orcos, int num_vertices); //!< add vertices with Orco from two arrays of x,y,z triplets; returns index of the first one added
+		virtual void addNormals(const double *normals, int num_normals); //!< add vertex normals from an array of x,y,z triplets; they are attached to the last num_normals vertices inserted
+		virtual bool addTriangles(const int *indices, int num_triangles, const Material *mat); //!< add triangles from an array of vertex index triplets, all with the same material
+		virtual bool addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat); //!< add triangles from arrays of vertex and uv index triplets, all with the same material
+		virtual int  addUvs(const float *uvs, int num_uvs); //!< add UV coordinates from an array of u,v pairs; returns index of the first one added
 		virtual bool smoothMesh(unsigned int id, double angle); //!< smooth vertex normals of mesh with given ID and angle (in degrees)
 		virtual bool addInstance(unsigned int base_object_id, Matrix4 obj_to_world);
 		// functions to build paramMaps instead of passing them from Blender
@@ -776,8 +949,13 @@ namespace yafaray4
 		virtual void abort();
 		virtual ParamMap *getRenderParameters() { return params_; }
 		virtual bool getRenderedImage(int num_view, ColorOutput &output); //!< put the rendered image to output
+		std::string getRenderStats() const;
+		bool saveRenderStats(const std::string &file_path) const;
+		void enableTrace(bool enable);
+		bool saveTrace(const std::string &file_path) const;
 		void setConsoleVerbosityLevel(const std::string &str_v_level);
 		void setLogVerbosityLevel(const std::string &str_v_level);
+		void setAsyncLogging(bool async_logging);
 
 		virtual void setParamsBadgePosition(const std::string &badge_position = "none");
 		virtual bool getDrawParams();
@@ -818,6 +996,12 @@ namespace yafaray4
 		virtual bool addTriangle(int a, int b, int c, const Material *mat);
 		virtual bool addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, const Material *mat);
 		virtual int  addUv(float u, float v);
+		virtual int  addVertices(const double *vertices, int num_vertices);
+		virtual int  addVertices(const double *vertices, const double *orcos, int num_vertices);
+		virtual void addNormals(const double *normals, int num_normals);
+		virtual bool addTriangles(const int *indices, int num_triangles, const Material *mat);
+		virtual bool addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat);
+		virtual int  addUvs(const float *uvs, int num_uvs);
 		virtual bool smoothMesh(unsigned int id, double angle);
 
 		// functions directly related to renderEnvironment_t
@@ -0,0 +1,163 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/denoiser.h"
+#include "utility/util_math_optimizations.h"
+#include "utility/util_thread.h"
+#include <algorithm>
+#include <cmath>
+
+BEGIN_YAFARAY
+
+static constexpr float min_albedo__ = 0.02f; //!< lower albedos are clamped when dividing them out, to avoid amplifying the noise of black and specular surfaces
+static constexpr float max_distance__ = 12.f; //!< neighbours with a larger weight exponent are skipped, as their weight is below 1e-5
+static constexpr float color_epsilon__ = 0.01f; //!< offset of the squared color magnitudes, so that the color distances of the darkest pixels become absolute
+
+static inline float squaredDistance__(const Rgb &a, const Rgb &b)
+{
+	const float d_r = a.r_ - b.r_, d_g = a.g_ - b.g_, d_b = a.b_ - b.b_;
+	return d_r * d_r + d_g * d_g + d_b * d_b;
+}
+
+static inline float squaredMagnitude__(const Rgb &a)
+{
+	return a.r_ * a.r_ + a.g_ * a.g_ + a.b_ * a.b_;
+}
+
+FeatureDenoiser::FeatureDenoiser(int radius, float color_sigma, float normal_sigma, float depth_sigma, float albedo_sigma) : radius_(std::max(1, radius))
+{
+	const float spatial_sigma = 0.5f * radius_;
+	inv_spatial_ = 0.5f / (spatial_sigma * spatial_sigma);
+	inv_color_ = 0.5f / (color_sigma * color_sigma);
+	// the normals are mapped to [0,1], so their distances are half of the distances of the unit vectors
+	inv_normal_ = 2.f / (normal_sigma * normal_sigma);
+	inv_depth_ = 0.5f / (depth_sigma * depth_sigma);
+	inv_albedo_ = 0.5f / (albedo_sigma * albedo_sigma);
+}
+
+Rgb FeatureDenoiser::albedoDivisor(const Rgb &a)
+{
+	return Rgb(std::max(a.r_, min_albedo__), std::max(a.g_, min_albedo__), std::max(a.b_, min_albedo__));
+}
+
+void FeatureDenoiser::denoise(std::vector<Rgba> &color, const std::vector<Rgb> &normal, const std::vector<float> &depth, const std::vector<Rgb> &albedo, int width, int height, int tile_size, int num_threads) const
+{
+	const int num_pixels = width * height;
+	if(num_pixels <= 0) return;
+
+	Image image;
+	image.color_ = &color;
+	image.width_ = width;
+	image.height_ = height;
+	image.tile_size_ = std::max(8, tile_size);
+	image.tiles_x_ = (width + image.tile_size_ - 1) / image.tile_size_;
+	image.num_tiles_ = image.tiles_x_ * ((height + image.tile_size_ - 1) / image.tile_size_);
+	image.next_tile_ = 0;
+	image.features_.resize(num_pixels);
+	image.reflectance_.resize(num_pixels);
+	image.guide_.resize(num_pixels);
+	image.result_.resize(num_pixels);
+
+	for(int i = 0; i < num_pixels; ++i)
+	{
+		Features &features = image.features_[i];
+		features.normal_ = normal.empty() ? Rgb(0.f) : normal[i];
+		features.depth_ = depth.empty() ? 0.f : depth[i];
+		features.albedo_ = albedo.empty() ? Rgb(0.f) : albedo[i];
+		const Rgb divisor = albedoDivisor(features.albedo_); //a constant without albedos, which cancels out
+		image.reflectance_[i] = Rgb(color[i].r_ / divisor.r_, color[i].g_ / divisor.g_, color[i].b_ / divisor.b_);
+	}
+	for(int y = 0; y < height; ++y)
+	{
+		for(int x = 0; x < width; ++x)
+		{
+			Rgb sum(0.f);
+			int count = 0;
+			for(int j = std::max(0, y - 1); j <= std::min(height - 1, y + 1); ++j)
+			{
+				for(int i = std::max(0, x - 1); i <= std::min(width - 1, x + 1); ++i)
+				{
+					sum += color[j * width + i];
+					++count;
+				}
+			}
+			image.guide_[y * width + x] = sum / (float) count;
+		}
+	}
+
+	num_threads = std::max(1, std::min(num_threads, image.num_tiles_));
+	if(num_threads == 1) denoiseWorker(image);
+	else
+	{
+		std::vector<std::thread> threads;
+		for(int i = 0; i < num_threads; ++i) threads.push_back(std::thread(&FeatureDenoiser::denoiseWorker, this, std::ref(image)));
+		for(auto &t : threads) t.join();
+	}
+	color.swap(image.result_);
+}
+
+void FeatureDenoiser::denoiseWorker(Image &image) const
+{
+	for(int tile = image.next_tile_++; tile < image.num_tiles_; tile = image.next_tile_++)
+	{
+		const int x_0 = (tile % image.tiles_x_) * image.tile_size_;
+		const int y_0 = (tile / image.tiles_x_) * image.tile_size_;
+		denoiseTile(image, x_0, y_0, std::min(x_0 + image.tile_size_, image.width_), std::min(y_0 + image.tile_size_, image.height_));
+	}
+}
+
+void FeatureDenoiser::denoiseTile(Image &image, int x_0, int y_0, int x_1, int y_1) const
+{
+	const int width = image.width_, height = image.height_;
+	for(int y = y_0; y < y_1; ++y)
+	{
+		for(int x = x_0; x < x_1; ++x)
+		{
+			const int p = y * width + x;
+			const Features &features_p = image.features_[p];
+			const Rgb &guide_p = image.guide_[p];
+			const float magnitude_p = squaredMagnitude__(guide_p) + color_epsilon__;
+			Rgb sum(0.f);
+			float weight_sum = 0.f;
+			for(int j = std::max(0, y - radius_); j <= std::min(height - 1, y + radius_); ++j)
+			{
+				for(int i = std::max(0, x - radius_); i <= std::min(width - 1, x + radius_); ++i)
+				{
+					const int q = j * width + i;
+					const Features &features_q = image.features_[q];
+					float distance = ((i - x) * (i - x) + (j - y) * (j - y)) * inv_spatial_;
+					distance += squaredDistance__(features_p.normal_, features_q.normal_) * inv_normal_;
+					distance += (features_p.depth_ - features_q.depth_) * (features_p.depth_ - features_q.depth_) * inv_depth_;
+					distance += squaredDistance__(features_p.albedo_, features_q.albedo_) * inv_albedo_;
+					if(distance > max_distance__) continue; //Skipped before the more expensive color distance
+					distance += squaredDistance__(guide_p, image.guide_[q]) / (magnitude_p + squaredMagnitude__(image.guide_[q])) * inv_color_;
+					if(distance > max_distance__) continue;
+					const float weight = fExp__(-distance);
+					sum += weight * image.reflectance_[q];
+					weight_sum += weight;
+				}
+			}
+			// the pixel itself always has weight 1, so weight_sum is never 0
+			Rgb result = sum / weight_sum;
+			result *= albedoDivisor(features_p.albedo_);
+			image.result_[p] = Rgba(result, (*image.color_)[p].a_);
+		}
+	}
+}
+
+END_YAFARAY
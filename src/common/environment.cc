@@ -404,6 +404,15 @@ void RenderEnvironment::setupRenderPasses(const ParamMap &params)
 	int faces_edge_thickness = 1;
 	float faces_edge_threshold = 0.01f;
 	float faces_edge_smoothness = 0.5f;
+	bool feature_denoise = false;
+	int feature_denoise_radius = 5;
+	float feature_denoise_color_sigma = 0.5f;
+	float feature_denoise_normal_sigma = 0.3f;
+	float feature_denoise_depth_sigma = 0.02f;
+	float feature_denoise_albedo_sigma = 0.1f;
+	bool film_half_float = false;
+	bool film_shared_weights = true;
+	bool film_sparse_passes = true;
 
 	params.getParam("pass_mask_obj_index", pass_mask_obj_index);
 	params.getParam("pass_mask_mat_index", pass_mask_mat_index);
@@ -420,6 +429,15 @@ void RenderEnvironment::setupRenderPasses(const ParamMap &params)
 	params.getParam("facesEdgeThickness", faces_edge_thickness);
 	params.getParam("facesEdgeThreshold", faces_edge_threshold);
 	params.getParam("facesEdgeSmoothness", faces_edge_smoothness);
+	params.getParam("featureDenoiseEnabled", feature_denoise);
+	params.getParam("featureDenoiseRadius", feature_denoise_radius);
+	params.getParam("featureDenoiseColorSigma", feature_denoise_color_sigma);
+	params.getParam("featureDenoiseNormalSigma", feature_denoise_normal_sigma);
+	params.getParam("featureDenoiseDepthSigma", feature_denoise_depth_sigma);
+	params.getParam("featureDenoiseAlbedoSigma", feature_denoise_albedo_sigma);
+	params.getParam("filmHalfFloat", film_half_float);
+	params.getParam("filmSharedWeights", film_shared_weights);
+	params.getParam("filmSparsePasses", film_sparse_passes);
 
 	//Adding the render passes and associating them to the internal YafaRay pass defined in the Blender Exporter "pass_xxx" parameters.
 	for(auto it = render_passes_.ext_pass_map_int_string_.begin(); it != render_passes_.ext_pass_map_int_string_.end(); ++it)
@@ -430,7 +448,19 @@ void RenderEnvironment::setupRenderPasses(const ParamMap &params)
 		if(internal_pass != "disabled" && internal_pass != "") render_passes_.extPassAdd(external_pass, internal_pass);
 	}
 
+	//Film storage of each render pass, in half floats when "filmHalfFloat" is set unless overriden by its "pass_xxx_half" parameter
+	for(int idx = 0; idx < render_passes_.extPassesSize(); ++idx)
+	{
+		bool half_float = film_half_float;
+		params.getParam("pass_" + render_passes_.extPassTypeStringFromIndex(idx) + "_half", half_float);
+		render_passes_.setExtPassHalfFloat(idx, half_float);
+	}
+	render_passes_.film_half_float_aux_ = film_half_float;
+	render_passes_.film_shared_weights_ = film_shared_weights;
+	render_passes_.film_sparse_passes_ = film_sparse_passes;
+
 	//Generate any necessary auxiliar render passes
+	render_passes_.feature_denoise_ = feature_denoise;
 	render_passes_.auxPassesGenerate();
 
 	render_passes_.setPassMaskObjIndex((float) pass_mask_obj_index);
@@ -447,6 +477,11 @@ void RenderEnvironment::setupRenderPasses(const ParamMap &params)
 	render_passes_.faces_edge_thickness_ = faces_edge_thickness;
 	render_passes_.faces_edge_threshold_ = faces_edge_threshold;
 	render_passes_.faces_edge_smoothness_ = faces_edge_smoothness;
+	render_passes_.feature_denoise_radius_ = feature_denoise_radius;
+	render_passes_.feature_denoise_color_sigma_ = feature_denoise_color_sigma;
+	render_passes_.feature_denoise_normal_sigma_ = feature_denoise_normal_sigma;
+	render_passes_.feature_denoise_depth_sigma_ = feature_denoise_depth_sigma;
+	render_passes_.feature_denoise_albedo_sigma_ = feature_denoise_albedo_sigma;
 
 	render_passes_.toon_edge_color_[0] = toon_edge_color.r_;
 	render_passes_.toon_edge_color_[1] = toon_edge_color.g_;
@@ -693,6 +728,9 @@ bool RenderEnvironment::setupScene(Scene &scene, const ParamMap &params, ColorOu
 	int aa_variance_pixels = 0;
 	float aa_clamp_samples = 0.f;
 	float aa_clamp_indirect = 0.f;
+	float aa_time_budget = 0.f;
+	float aa_noise_target = 0.f;
+	std::string sampler_name = "halton";
 
 	bool adv_auto_shadow_bias_enabled = true;
 	float adv_shadow_bias_value = YAF_SHADOW_BIAS;
@@ -760,6 +798,9 @@ bool RenderEnvironment::setupScene(Scene &scene, const ParamMap &params, ColorOu
 	params.getParam("AA_variance_pixels", aa_variance_pixels);
 	params.getParam("AA_clamp_samples", aa_clamp_samples);
 	params.getParam("AA_clamp_indirect", aa_clamp_indirect);
+	params.getParam("AA_time_budget", aa_time_budget); //Wall clock seconds per view after which no more AA passes are started (0 = unlimited)
+	params.getParam("AA_noise_target", aa_noise_target); //Estimated relative error of the image at which no more AA passes are started (0 = disabled)
+	params.getParam("sampler", sampler_name); //Sequence of the camera samples and path bounces: "halton" (scrambled Halton and (0,2) sequences) or "sobol" (Owen scrambled Sobol)
 	params.getParam("threads", nthreads); // number of threads, -1 = auto detection
 	params.getParam("background_resampling", background_resampling);
 
@@ -783,7 +824,9 @@ bool RenderEnvironment::setupScene(Scene &scene, const ParamMap &params, ColorOu
 	params.getParam("filter_type", name); // AA filter type
 
 	std::stringstream aa_settings;
+	Sampler *sampler = Sampler::factory(sampler_name);
 	aa_settings << "AA Settings (" << ((!name.empty()) ? name : "box") << "): Tile size=" << film->getTileSize();
+	if(sampler) aa_settings << " sampler=" << sampler->getName();
 	logger__.appendAaNoiseSettings(aa_settings.str());
 
 	if(aa_dark_detection_type_string == "linear") aa_dark_detection_type = DarkDetectionType::Linear;
@@ -795,9 +838,14 @@ bool RenderEnvironment::setupScene(Scene &scene, const ParamMap &params, ColorOu
 	scene.setSurfIntegrator((SurfaceIntegrator *)inte);
 	scene.setVolIntegrator((VolumeIntegrator *)vol_inte);
 	scene.setAntialiasing(aa_samples, aa_passes, aa_inc_samples, aa_threshold, aa_resampled_floor, aa_sample_multiplier_factor, aa_light_sample_multiplier_factor, aa_indirect_sample_multiplier_factor, aa_detect_color_noise, aa_dark_detection_type, aa_dark_threshold_factor, aa_variance_edge_size, aa_variance_pixels, aa_clamp_samples, aa_clamp_indirect);
+	scene.setRenderBudget(aa_time_budget, aa_noise_target);
+	scene.setSampler(sampler);
 	scene.setNumThreads(nthreads);
 	scene.setNumThreadsPhotons(nthreads_photons);
 	if(backg) scene.setBackground(backg);
+	size_t user_data_size = 0;
+	for(const auto &material : materials_) user_data_size = std::max(user_data_size, material.second->getReqMem());
+	scene.setUserDataSize(user_data_size);
 	scene.shadow_bias_auto_ = adv_auto_shadow_bias_enabled;
 	scene.shadow_bias_ = adv_shadow_bias_value;
 	scene.ray_min_dist_auto_ = adv_auto_min_raydist_enabled;
@@ -29,6 +29,9 @@
 #include <windows.h>
 #else //defined(_WIN32)
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #endif //defined(_WIN32)
 #include <iostream>
 #include <ctime>
@@ -298,4 +301,47 @@ std::vector<std::string> File::listFiles(const std::string &directory)
 	return files;
 }
 
+MappedFile::MappedFile(const std::string &path)
+{
+#if !defined(_WIN32)
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0) return;
+	struct ::stat buf;
+	if(::fstat(fd, &buf) == 0 && (buf.st_mode & S_IFMT) == S_IFREG)
+	{
+		size_ = (size_t) buf.st_size;
+		if(size_ == 0) valid_ = true;
+		else
+		{
+			void *map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(map != MAP_FAILED)
+			{
+				::madvise(map, size_, MADV_SEQUENTIAL);
+				data_ = static_cast<const char *>(map);
+				mapped_ = valid_ = true;
+			}
+		}
+	}
+	::close(fd);
+	if(valid_) return;
+	size_ = 0;
+#endif //!defined(_WIN32)
+	FILE *fp = File::open(path, "rb");
+	if(!fp) return;
+	char chunk[65536];
+	size_t read_size;
+	while((read_size = ::fread(chunk, 1, sizeof(chunk), fp)) > 0) buffer_.insert(buffer_.end(), chunk, chunk + read_size);
+	File::close(fp);
+	data_ = buffer_.data();
+	size_ = buffer_.size();
+	valid_ = true;
+}
+
+MappedFile::~MappedFile()
+{
+#if !defined(_WIN32)
+	if(mapped_) ::munmap(const_cast<char *>(data_), size_);
+#endif //!defined(_WIN32)
+}
+
 END_YAFARAY
@@ -18,6 +18,7 @@
 
 #include "common/hashgrid.h"
 #include "common/photon.h"
+#include "common/render_stats.h"
 
 BEGIN_YAFARAY
 
@@ -95,6 +96,7 @@ void HashGrid::updateGrid()
 
 unsigned int HashGrid::gather(const Point3 &p, FoundPhoton *found, unsigned int k, float sq_radius)
 {
+	RenderStats::thread().add(RenderStats::PhotonLookups);
 	unsigned int count = 0;
 	float radius = sqrt(sq_radius);
 
@@ -32,6 +32,8 @@
 #include "common/param.h"
 #include "common/monitor.h"
 #include "common/timer.h"
+#include "common/trace.h"
+#include "common/denoiser.h"
 #include "utility/util_math.h"
 #include "resource/yafLogoTiny.h"
 #include <iomanip>
@@ -135,13 +137,27 @@ ImageFilm::ImageFilm (int width, int height, int xstart, int ystart, ColorOutput
 	//Creation of the image buffers for the render passes
 	for(int idx = 0; idx < render_passes->extPassesSize(); ++idx)
 	{
-		image_passes_.push_back(new Rgba2DImageWeighed_t(width, height));
+		image_passes_.push_back(createImagePass(render_passes->intPassTypeFromExtPassIndex(idx), render_passes->extPassHalfFloat(idx)));
 	}
 
 	//Creation of the image buffers for the auxiliary render passes
 	for(int idx = 0; idx < render_passes->auxPassesSize(); ++idx)
 	{
-		aux_image_passes_.push_back(new Rgba2DImageWeighed_t(width, height));
+		aux_image_passes_.push_back(createImagePass(render_passes->intPassTypeFromAuxPassIndex(idx), render_passes->film_half_float_aux_));
+	}
+
+	//The passes updated by each sample, in the order of the image passes and then the auxiliary passes, with the indices of their colors in the samples
+	int num_sample_passes = render_passes->extPassesSize() + render_passes->auxPassesSize();
+	if(num_sample_passes > max_sample_passes_) num_sample_passes = max_sample_passes_;
+	for(int idx = 0; idx < num_sample_passes; ++idx)
+	{
+		const bool aux = idx >= render_passes->extPassesSize();
+		const IntPassTypes int_pass_type = aux ? render_passes->intPassTypeFromAuxPassIndex(idx - render_passes->extPassesSize()) : render_passes->intPassTypeFromExtPassIndex(idx);
+		SamplePass sample_pass;
+		sample_pass.image_pass_ = aux ? aux_image_passes_[idx - render_passes->extPassesSize()] : image_passes_[idx];
+		sample_pass.color_index_ = render_passes->intPassIndexFromType(int_pass_type);
+		sample_pass.aa_samples_ = (int_pass_type == PassIntAaSamples);
+		sample_passes_.push_back(sample_pass);
 	}
 
 	density_image_ = nullptr;
@@ -196,12 +212,6 @@ ImageFilm::~ImageFilm ()
 	}
 	image_passes_.clear();
 
-	for(size_t idx = 0; idx < aux_image_passes_.size(); ++idx)
-	{
-		delete(aux_image_passes_[idx]);
-	}
-	aux_image_passes_.clear();
-
 	//Deletion of the auxiliary image buffers
 	for(size_t idx = 0; idx < aux_image_passes_.size(); ++idx)
 	{
@@ -210,6 +220,7 @@ ImageFilm::~ImageFilm ()
 	aux_image_passes_.clear();
 
 	if(density_image_) delete density_image_;
+	if(moments_image_) delete moments_image_;
 	delete[] filter_table_;
 	if(splitter_) delete splitter_;
 	if(dp_image_) delete dp_image_;
@@ -223,6 +234,10 @@ void ImageFilm::init(int num_passes)
 	{
 		image_passes_[idx]->clear();
 	}
+	for(size_t idx = 0; idx < aux_image_passes_.size(); ++idx)
+	{
+		aux_image_passes_[idx]->clear();
+	}
 
 	// Clear density image
 	if(estimate_density_)
@@ -231,6 +246,18 @@ void ImageFilm::init(int num_passes)
 		else density_image_->clear();
 	}
 
+	// Clear the pixel moments of noise-budgeted renders
+	if(aa_noise_target_ > 0.f)
+	{
+		if(!moments_image_) moments_image_ = new Moments2DImage_t(w_, h_);
+		else moments_image_->clear();
+	}
+	else if(moments_image_)
+	{
+		delete moments_image_;
+		moments_image_ = nullptr;
+	}
+
 	// Setup the bucket splitter
 	if(split_)
 	{
@@ -269,6 +296,8 @@ void ImageFilm::init(int num_passes)
 
 int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_name, bool skip_next_pass)
 {
+	TraceScope trace_scope("film next pass", "film");
+	trace_scope.arg("pass", n_pass_ + 1);
 	splitter_mutex_.lock();
 	next_area_ = 0;
 	splitter_mutex_.unlock();
@@ -278,6 +307,8 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 
 	if(skip_next_pass) return 0;
 
+	foldHalfFloatPasses();
+
 	std::stringstream pass_string;
 
 	Y_DEBUG << "nPass=" << n_pass_ << " imagesAutoSavePassCounter=" << images_auto_save_pass_counter_ << " filmAutoSavePassCounter=" << film_auto_save_pass_counter_ << YENDL;
@@ -305,7 +336,7 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 
 	const RenderPasses *render_passes = env_->getRenderPasses();
 
-	Rgba2DImageWeighed_t *sampling_factor_image_pass = getImagePassFromIntPassType(PassIntDebugSamplingFactor);
+	FilmPass *sampling_factor_image_pass = getImagePassFromIntPassType(PassIntDebugSamplingFactor);
 
 	if(flags_) flags_->clear();
 	else flags_ = new TiledBitArray2D<3>(w_, h_, true);
@@ -316,7 +347,28 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 
 	int n_resample = 0;
 
-	if(adaptive_aa && aa_thesh_ > 0.f)
+	if(adaptive_aa && moments_image_)
+	{
+		//With a noise target, the pixels are resampled when the estimated relative error of their samples or of the samples of any of their neighbours is above the target.
+		//Looking at the neighbours avoids stopping the pixels whose few samples missed by chance the rare bright paths seen by their neighbours, which would darken the image
+		const float target_variance = aa_noise_target_ * aa_noise_target_;
+		for(int y = 0; y < h_; ++y)
+		{
+			for(int x = 0; x < w_; ++x)
+			{
+				if(pixelRelativeVariance(x, y) <= target_variance) continue;
+				for(int yi = std::max(0, y - 1); yi <= std::min(h_ - 1, y + 1); ++yi)
+				{
+					for(int xi = std::max(0, x - 1); xi <= std::min(w_ - 1, x + 1); ++xi)
+					{
+						if(!background_resampling_ && sampling_factor_image_pass && sampling_factor_image_pass->normalized(xi, yi).r_ == 0.f) continue;
+						flags_->setBit(xi, yi);
+					}
+				}
+			}
+		}
+	}
+	else if(adaptive_aa && aa_thesh_ > 0.f)
 	{
 		for(int y = 0; y < h_ - 1; ++y)
 		{
@@ -332,16 +384,16 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 			{
 				//We will only consider the Combined Pass (pass 0) for the AA additional sampling calculations.
 
-				if((*image_passes_.at(0))(x, y).weight_ <= 0.f) flags_->setBit(x, y);	//If after reloading ImageFiles there are pixels that were not yet rendered at all, make sure they are marked to be rendered in the next AA pass
+				if(image_passes_.at(0)->weight(x, y) <= 0.f) flags_->setBit(x, y);	//If after reloading ImageFiles there are pixels that were not yet rendered at all, make sure they are marked to be rendered in the next AA pass
 
 				float mat_sample_factor = 1.f;
 				if(sampling_factor_image_pass)
 				{
-					mat_sample_factor = (*sampling_factor_image_pass)(x, y).normalized().r_;
+					mat_sample_factor = sampling_factor_image_pass->normalized(x, y).r_;
 					if(!background_resampling_ && mat_sample_factor == 0.f) continue;
 				}
 
-				Rgba pix_col = (*image_passes_.at(0))(x, y).normalized();
+				Rgba pix_col = image_passes_.at(0)->normalized(x, y);
 				float pix_col_bri = pix_col.abscol2Bri();
 
 				if(aa_dark_detection_type_ == DarkDetectionType::Linear && aa_dark_threshold_factor_ > 0.f)
@@ -353,19 +405,19 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 					aa_thresh_scaled = darkThresholdCurveInterpolate(pix_col_bri);
 				}
 
-				if(pix_col.colorDifference((*image_passes_.at(0))(x + 1, y).normalized(), aa_detect_color_noise_) >= aa_thresh_scaled)
+				if(pix_col.colorDifference(image_passes_.at(0)->normalized(x + 1, y), aa_detect_color_noise_) >= aa_thresh_scaled)
 				{
 					flags_->setBit(x, y); flags_->setBit(x + 1, y);
 				}
-				if(pix_col.colorDifference((*image_passes_.at(0))(x, y + 1).normalized(), aa_detect_color_noise_) >= aa_thresh_scaled)
+				if(pix_col.colorDifference(image_passes_.at(0)->normalized(x, y + 1), aa_detect_color_noise_) >= aa_thresh_scaled)
 				{
 					flags_->setBit(x, y); flags_->setBit(x, y + 1);
 				}
-				if(pix_col.colorDifference((*image_passes_.at(0))(x + 1, y + 1).normalized(), aa_detect_color_noise_) >= aa_thresh_scaled)
+				if(pix_col.colorDifference(image_passes_.at(0)->normalized(x + 1, y + 1), aa_detect_color_noise_) >= aa_thresh_scaled)
 				{
 					flags_->setBit(x, y); flags_->setBit(x + 1, y + 1);
 				}
-				if(x > 0 && pix_col.colorDifference((*image_passes_.at(0))(x - 1, y + 1).normalized(), aa_detect_color_noise_) >= aa_thresh_scaled)
+				if(x > 0 && pix_col.colorDifference(image_passes_.at(0)->normalized(x - 1, y + 1), aa_detect_color_noise_) >= aa_thresh_scaled)
 				{
 					flags_->setBit(x, y); flags_->setBit(x - 1, y + 1);
 				}
@@ -382,8 +434,8 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 						if(xi < 0) xi = 0;
 						else if(xi >= w_ - 1) xi = w_ - 2;
 
-						Rgba cx_0 = (*image_passes_.at(0))(xi, y).normalized();
-						Rgba cx_1 = (*image_passes_.at(0))(xi + 1, y).normalized();
+						Rgba cx_0 = image_passes_.at(0)->normalized(xi, y);
+						Rgba cx_1 = image_passes_.at(0)->normalized(xi + 1, y);
 
 						if(cx_0.colorDifference(cx_1, aa_detect_color_noise_) >= aa_thresh_scaled) ++variance_x;
 					}
@@ -394,8 +446,8 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 						if(yi < 0) yi = 0;
 						else if(yi >= h_ - 1) yi = h_ - 2;
 
-						Rgba cy_0 = (*image_passes_.at(0))(x, yi).normalized();
-						Rgba cy_1 = (*image_passes_.at(0))(x, yi + 1).normalized();
+						Rgba cy_0 = image_passes_.at(0)->normalized(x, yi);
+						Rgba cy_1 = image_passes_.at(0)->normalized(x, yi + 1);
 
 						if(cy_0.colorDifference(cy_1, aa_detect_color_noise_) >= aa_thresh_scaled) ++variance_y;
 					}
@@ -421,7 +473,10 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 				}
 			}
 		}
+	}
 
+	if(adaptive_aa && (aa_thesh_ > 0.f || moments_image_))
+	{
 		for(int y = 0; y < h_; ++y)
 		{
 			for(int x = 0; x < w_; ++x)
@@ -435,13 +490,13 @@ int ImageFilm::nextPass(int num_view, bool adaptive_aa, std::string integrator_n
 						float mat_sample_factor = 1.f;
 						if(sampling_factor_image_pass)
 						{
-							mat_sample_factor = (*sampling_factor_image_pass)(x, y).normalized().r_;
+							mat_sample_factor = sampling_factor_image_pass->normalized(x, y).r_;
 							if(!background_resampling_ && mat_sample_factor == 0.f) continue;
 						}
 
 						for(size_t idx = 0; idx < image_passes_.size(); ++idx)
 						{
-							Rgb pix = (*image_passes_[idx])(x, y).normalized();
+							Rgb pix = image_passes_[idx]->normalized(x, y);
 							float pix_col_bri = pix.abscol2Bri();
 
 							if(pix.r_ < pix.g_ && pix.r_ < pix.b_)
@@ -529,12 +584,16 @@ bool ImageFilm::nextArea(int num_view, RenderArea &a)
 
 void ImageFilm::finishArea(int num_view, RenderArea &a)
 {
+	TraceScope trace_scope("film finish tile", "film");
+	trace_scope.arg("x", a.x_).arg("y", a.y_);
 	out_mutex_.lock();
 
 	const RenderPasses *render_passes = env_->getRenderPasses();
 
 	int end_x = a.x_ + a.w_ - cx_0_, end_y = a.y_ + a.h_ - cy_0_;
 
+	foldHalfFloatPasses(a.x_ - cx_0_, end_x, a.y_ - cy_0_, end_y);
+
 	std::vector<Rgba> col_ext_passes(image_passes_.size(), Rgba(0.f));
 
 	for(int j = a.y_ - cy_0_; j < end_y; ++j)
@@ -545,7 +604,7 @@ void ImageFilm::finishArea(int num_view, RenderArea &a)
 			{
 				if(render_passes->intPassTypeFromExtPassIndex(idx) == PassIntAaSamples)
 				{
-					col_ext_passes[idx] = (*image_passes_[idx])(i, j).weight_;
+					col_ext_passes[idx] = image_passes_[idx]->weight(i, j);
 				}
 				else if(render_passes->intPassTypeFromExtPassIndex(idx) == PassIntObjIndexAbs ||
 						render_passes->intPassTypeFromExtPassIndex(idx) == PassIntObjIndexAutoAbs ||
@@ -553,12 +612,12 @@ void ImageFilm::finishArea(int num_view, RenderArea &a)
 						render_passes->intPassTypeFromExtPassIndex(idx) == PassIntMatIndexAutoAbs
 				       )
 				{
-					col_ext_passes[idx] = (*image_passes_[idx])(i, j).normalized();
+					col_ext_passes[idx] = image_passes_[idx]->normalized(i, j);
 					col_ext_passes[idx].ceil(); //To correct the antialiasing and ceil the "mixed" values to the upper integer
 				}
 				else
 				{
-					col_ext_passes[idx] = (*image_passes_[idx])(i, j).normalized();
+					col_ext_passes[idx] = image_passes_[idx]->normalized(i, j);
 				}
 
 				col_ext_passes[idx].clampRgb0();
@@ -634,8 +693,12 @@ void ImageFilm::finishArea(int num_view, RenderArea &a)
 
 void ImageFilm::flush(int num_view, int flags, ColorOutput *out)
 {
+	TraceScope trace_scope("film flush", "film");
+	trace_scope.arg("view", num_view);
 	const RenderPasses *render_passes = env_->getRenderPasses();
 
+	foldHalfFloatPasses();
+
 	if(session__.renderFinished())
 	{
 		out_mutex_.lock();
@@ -725,6 +788,9 @@ void ImageFilm::flush(int num_view, int flags, ColorOutput *out)
 
 	if(estimate_density_ && num_density_samples_ > 0) density_factor = (float)(w_ * h_) / (float) num_density_samples_;
 
+	std::vector<Rgba> denoised_combined;
+	if(render_passes->feature_denoise_ && (flags & IF_IMAGE)) denoised_combined = featureDenoisedCombined();
+
 	std::vector<Rgba> col_ext_passes(image_passes_.size(), Rgba(0.f));
 
 	std::vector<Rgba> col_ext_passes_2;	//For secondary file output (when enabled)
@@ -744,7 +810,7 @@ void ImageFilm::flush(int num_view, int flags, ColorOutput *out)
 			{
 				if(render_passes->intPassTypeFromExtPassIndex(idx) == PassIntAaSamples)
 				{
-					col_ext_passes[idx] = (*image_passes_[idx])(i, j).weight_;
+					col_ext_passes[idx] = image_passes_[idx]->weight(i, j);
 				}
 				else if(render_passes->intPassTypeFromExtPassIndex(idx) == PassIntObjIndexAbs ||
 						render_passes->intPassTypeFromExtPassIndex(idx) == PassIntObjIndexAutoAbs ||
@@ -752,12 +818,12 @@ void ImageFilm::flush(int num_view, int flags, ColorOutput *out)
 						render_passes->intPassTypeFromExtPassIndex(idx) == PassIntMatIndexAutoAbs
 				       )
 				{
-					col_ext_passes[idx] = (*image_passes_[idx])(i, j).normalized();
+					col_ext_passes[idx] = image_passes_[idx]->normalized(i, j);
 					col_ext_passes[idx].ceil(); //To correct the antialiasing and ceil the "mixed" values to the upper integer
 				}
 				else
 				{
-					if(flags & IF_IMAGE) col_ext_passes[idx] = (*image_passes_[idx])(i, j).normalized();
+					if(flags & IF_IMAGE) col_ext_passes[idx] = (idx == 0 && !denoised_combined.empty()) ? denoised_combined[j * w_ + i] : image_passes_[idx]->normalized(i, j);
 					else col_ext_passes[idx] = Rgba(0.f);
 				}
 
@@ -910,13 +976,14 @@ void ImageFilm::flush(int num_view, int flags, ColorOutput *out)
 
 		logger__.clearMemoryLog();
 		out_mutex_.unlock();
+		Y_VERBOSE << "imageFilm: render passes buffers use " << std::fixed << std::setprecision(1) << imagePassesMemoryUsed() / (1024.0 * 1024.0) << " MB" << YENDL;
 		Y_VERBOSE << "imageFilm: Done." << YENDL;
 	}
 }
 
 bool ImageFilm::doMoreSamples(int x, int y) const
 {
-	return (aa_thesh_ > 0.f) ? flags_->getBit(x - cx_0_, y - cy_0_) : true;
+	return (aa_thesh_ > 0.f || moments_image_) ? flags_->getBit(x - cx_0_, y - cy_0_) : true;
 }
 
 /* CAUTION! Implemantation of this function needs to be thread safe for samples that
@@ -924,8 +991,6 @@ bool ImageFilm::doMoreSamples(int x, int y) const
 	contributions from outside area a! (yes, really!) */
 void ImageFilm::addSample(ColorPasses &color_passes, int x, int y, float dx, float dy, const RenderArea *a, int num_sample, int aa_pass_number, float inv_aa_max_possible_samples)
 {
-	const RenderPasses *render_passes = env_->getRenderPasses();
-
 	int dx_0, dx_1, dy_0, dy_1, x_0, x_1, y_0, y_1;
 
 	// get filter extent and make sure we don't leave image area:
@@ -957,61 +1022,124 @@ void ImageFilm::addSample(ColorPasses &color_passes, int x, int y, float dx, flo
 	x_0 = x + dx_0; x_1 = x + dx_1;
 	y_0 = y + dy_0; y_1 = y + dy_1;
 
+	//The colors of the sample are clamped and premultiplied once for all the pixels of its filter footprint
+	const int num_sample_passes = (int) sample_passes_.size();
+	Rgba colors[max_sample_passes_];
+	for(int idx = 0; idx < num_sample_passes; ++idx)
+	{
+		colors[idx] = color_passes(sample_passes_[idx].color_index_);
+		colors[idx].clampProportionalRgb(aa_clamp_samples_);
+		if(premult_alpha_) colors[idx].alphaPremultiply();
+	}
+
+	float sample_bri = 0.f;
+	if(moments_image_)
+	{
+		Rgba col = color_passes(PassIntCombined);
+		col.clampProportionalRgb(aa_clamp_samples_);
+		sample_bri = col.col2Bri();
+	}
+
+	const float aa_samples_weight = inv_aa_max_possible_samples / ((x_1 - x_0 + 1) * (y_1 - y_0 + 1));
+
 	image_mutex_.lock();
 
+	switch(num_sample_passes) //The loop over the passes is unrolled for the Combined pass alone or with a few more, such as the auxiliary sampling factor pass
+	{
+		case 1: splatSample<1>(colors, x_0, x_1, y_0, y_1, x_index, y_index, aa_samples_weight, sample_bri); break;
+		case 2: splatSample<2>(colors, x_0, x_1, y_0, y_1, x_index, y_index, aa_samples_weight, sample_bri); break;
+		case 3: splatSample<3>(colors, x_0, x_1, y_0, y_1, x_index, y_index, aa_samples_weight, sample_bri); break;
+		case 4: splatSample<4>(colors, x_0, x_1, y_0, y_1, x_index, y_index, aa_samples_weight, sample_bri); break;
+		default: splatSample<0>(colors, x_0, x_1, y_0, y_1, x_index, y_index, aa_samples_weight, sample_bri); break;
+	}
+
+	image_mutex_.unlock();
+}
+
+template <int num_passes>
+void ImageFilm::splatSample(const Rgba *colors, int x_0, int x_1, int y_0, int y_1, const int *x_index, const int *y_index, float aa_samples_weight, float sample_bri)
+{
+	const int num_sample_passes = (num_passes > 0) ? num_passes : (int) sample_passes_.size();
+	const SamplePass *sample_passes = sample_passes_.data();
+
 	for(int j = y_0; j <= y_1; ++j)
 	{
 		for(int i = x_0; i <= x_1; ++i)
 		{
 			// get filter value at pixel (x,y)
-			int offset = y_index[j - y_0] * FILTER_TABLE_SIZE + x_index[i - x_0];
-			float filter_wt = filter_table_[offset];
+			const float filter_wt = filter_table_[y_index[j - y_0] * FILTER_TABLE_SIZE + x_index[i - x_0]];
 
-			// update pixel values with filtered sample contribution
-			for(size_t idx = 0; idx < image_passes_.size(); ++idx)
+			// update pixel values with filtered sample contribution. The Combined pass goes first, as the passes sharing its weights need them updated
+			for(int idx = 0; idx < num_sample_passes; ++idx)
 			{
-				Rgba col = color_passes(render_passes->intPassTypeFromExtPassIndex(idx));
-
-				col.clampProportionalRgb(aa_clamp_samples_);
-
-				Pixel &pixel = (*image_passes_[idx])(i - cx_0_, j - cy_0_);
-
-				if(premult_alpha_) col.alphaPremultiply();
-
-				if(render_passes->intPassTypeFromExtPassIndex(idx) == PassIntAaSamples)
-				{
-					pixel.weight_ += inv_aa_max_possible_samples / ((x_1 - x_0 + 1) * (y_1 - y_0 + 1));
-				}
-				else
-				{
-					pixel.col_ += (col * filter_wt);
-					pixel.weight_ += filter_wt;
-				}
+				if(sample_passes[idx].aa_samples_) sample_passes[idx].image_pass_->addWeight(i - cx_0_, j - cy_0_, aa_samples_weight);
+				else sample_passes[idx].image_pass_->addSample(i - cx_0_, j - cy_0_, colors[idx], filter_wt);
 			}
-			for(size_t idx = 0; idx < aux_image_passes_.size(); ++idx)
-			{
-				Rgba col = color_passes(render_passes->intPassTypeFromAuxPassIndex(idx));
-
-				col.clampProportionalRgb(aa_clamp_samples_);
+			if(moments_image_) (*moments_image_)(i - cx_0_, j - cy_0_).add(sample_bri, filter_wt);
+		}
+	}
+}
 
-				Pixel &pixel = (*aux_image_passes_[idx])(i - cx_0_, j - cy_0_);
+void ImageFilm::foldHalfFloatPasses(int x_0, int x_1, int y_0, int y_1)
+{
+	image_mutex_.lock();
+	for(auto img : image_passes_) img->fold(x_0, x_1, y_0, y_1);
+	for(auto img : aux_image_passes_) img->fold(x_0, x_1, y_0, y_1);
+	image_mutex_.unlock();
+}
 
-				if(premult_alpha_) col.alphaPremultiply();
+float ImageFilm::pixelRelativeVariance(int x, int y) const
+{
+	//Relative variance with the usual 0.01 offset of the squared mean, so that the error of the darkest pixels becomes absolute. Pixels with less than 2 samples are taken as 100% error
+	const PixelMoments &moments = (*moments_image_)(x, y);
+	const float variance = moments.meanVariance();
+	if(variance < 0.f) return 1.f;
+	const float mean = moments.mean();
+	return std::min(1.f, variance / (mean * mean + 0.01f));
+}
 
-				if(render_passes->intPassTypeFromAuxPassIndex(idx) == PassIntAaSamples)
-				{
-					pixel.weight_ += inv_aa_max_possible_samples / ((x_1 - x_0 + 1) * (y_1 - y_0 + 1));
-				}
-				else
-				{
-					pixel.col_ += (col * filter_wt);
-					pixel.weight_ += filter_wt;
-				}
-			}
+std::vector<Rgba> ImageFilm::featureDenoisedCombined()
+{
+	TraceScope trace_scope("film feature denoise", "film");
+	const RenderPasses *render_passes = env_->getRenderPasses();
+	const FilmPass *normal_pass = getImagePassFromIntPassType(PassIntNormalSmooth);
+	const FilmPass *depth_pass = getImagePassFromIntPassType(PassIntZDepthNorm);
+	const FilmPass *albedo_pass = getImagePassFromIntPassType(PassIntDiffuseColor);
+	const int num_pixels = w_ * h_;
+	std::vector<Rgba> combined(num_pixels);
+	std::vector<Rgb> normal(normal_pass ? num_pixels : 0), albedo(albedo_pass ? num_pixels : 0);
+	std::vector<float> depth(depth_pass ? num_pixels : 0);
+	for(int j = 0; j < h_; ++j)
+	{
+		for(int i = 0; i < w_; ++i)
+		{
+			const int index = j * w_ + i;
+			combined[index] = image_passes_[0]->normalized(i, j);
+			if(normal_pass) normal[index] = normal_pass->normalized(i, j);
+			if(depth_pass) depth[index] = depth_pass->normalized(i, j).a_;
+			if(albedo_pass) albedo[index] = albedo_pass->normalized(i, j);
 		}
 	}
 
-	image_mutex_.unlock();
+	const int num_threads = env_->getScene() ? env_->getScene()->getNumThreads() : 1;
+	g_timer__.addEvent("featureDenoise");
+	g_timer__.start("featureDenoise");
+	const FeatureDenoiser denoiser(render_passes->feature_denoise_radius_, render_passes->feature_denoise_color_sigma_, render_passes->feature_denoise_normal_sigma_, render_passes->feature_denoise_depth_sigma_, render_passes->feature_denoise_albedo_sigma_);
+	denoiser.denoise(combined, normal, depth, albedo, w_, h_, tile_size_, num_threads);
+	g_timer__.stop("featureDenoise");
+	Y_VERBOSE << "imageFilm: Combined pass denoised in " << g_timer__.getTime("featureDenoise") << "s with " << num_threads << " threads" << YENDL;
+	return combined;
+}
+
+float ImageFilm::getRelativeError() const
+{
+	if(!moments_image_) return -1.f;
+	double sum = 0.0;
+	for(int y = 0; y < h_; ++y)
+	{
+		for(int x = 0; x < w_; ++x) sum += pixelRelativeVariance(x, y);
+	}
+	return std::sqrt(sum / ((double) w_ * h_));
 }
 
 void ImageFilm::addDensitySample(const Rgb &c, int x, int y, float dx, float dy, const RenderArea *a)
@@ -1416,7 +1544,6 @@ bool ImageFilm::imageFilmLoad(const std::string &filename)
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Number of render passes, expected=" << render_passes->extPassesSize() << ", in reused/loaded film=" << image_passes_size << YENDL;
 		return false;
 	}
-	else image_passes_.resize(image_passes_size);
 
 	int aux_image_passes_size;
 	file.read<int>(aux_image_passes_size);
@@ -1425,42 +1552,47 @@ bool ImageFilm::imageFilmLoad(const std::string &filename)
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Number of auxiliar render passes, expected=" << render_passes->auxPassesSize() << ", in reused/loaded film=" << aux_image_passes_size << YENDL;
 		return false;
 	}
-	else aux_image_passes_.resize(aux_image_passes_size);
 
-	for(auto &img : image_passes_)
+
+	for(auto img : image_passes_)
 	{
-		img = new Rgba2DImageWeighed_t(w_, h_);
+		img->clear();
 		for(int y = 0; y < h_; ++y)
 		{
 			for(int x = 0; x < w_; ++x)
 			{
-				Pixel &p = (*img)(x, y);
-				file.read<float>(p.col_.r_);
-				file.read<float>(p.col_.g_);
-				file.read<float>(p.col_.b_);
-				file.read<float>(p.col_.a_);
-				file.read<float>(p.weight_);
+				Rgba col;
+				float weight;
+				file.read<float>(col.r_);
+				file.read<float>(col.g_);
+				file.read<float>(col.b_);
+				file.read<float>(col.a_);
+				file.read<float>(weight);
+				img->addWeighted(x, y, col, weight);
 			}
 		}
 	}
 
-	for(auto &img : aux_image_passes_)
+	for(auto img : aux_image_passes_)
 	{
-		img = new Rgba2DImageWeighed_t(w_, h_);
+		img->clear();
 		for(int y = 0; y < h_; ++y)
 		{
 			for(int x = 0; x < w_; ++x)
 			{
-				Pixel &p = (*img)(x, y);
-				file.read<float>(p.col_.r_);
-				file.read<float>(p.col_.g_);
-				file.read<float>(p.col_.b_);
-				file.read<float>(p.col_.a_);
-				file.read<float>(p.weight_);
+				Rgba col;
+				float weight;
+				file.read<float>(col.r_);
+				file.read<float>(col.g_);
+				file.read<float>(col.b_);
+				file.read<float>(col.a_);
+				file.read<float>(weight);
+				img->addWeighted(x, y, col, weight);
 			}
 		}
 	}
 	file.close();
+	foldHalfFloatPasses();
 	return true;
 }
 
@@ -1519,30 +1651,30 @@ void ImageFilm::imageFilmLoadAllInFolder()
 
 		for(size_t idx = 0; idx < image_passes_.size(); ++idx)
 		{
-			Rgba2DImageWeighed_t *loaded_image_buffer = loaded_film->image_passes_[idx];
+			FilmPass *loaded_image_buffer = loaded_film->image_passes_[idx];
 			for(int i = 0; i < w_; ++i)
 			{
 				for(int j = 0; j < h_; ++j)
 				{
-					(*image_passes_[idx])(i, j).col_ += (*loaded_image_buffer)(i, j).col_;
-					(*image_passes_[idx])(i, j).weight_ += (*loaded_image_buffer)(i, j).weight_;
+					image_passes_[idx]->addWeighted(i, j, loaded_image_buffer->weightedColor(i, j), loaded_image_buffer->weight(i, j));
 				}
 			}
 		}
 
 		for(size_t idx = 0; idx < aux_image_passes_.size(); ++idx)
 		{
-			Rgba2DImageWeighed_t *loaded_image_buffer = loaded_film->aux_image_passes_[idx];
+			FilmPass *loaded_image_buffer = loaded_film->aux_image_passes_[idx];
 			for(int i = 0; i < w_; ++i)
 			{
 				for(int j = 0; j < h_; ++j)
 				{
-					(*aux_image_passes_[idx])(i, j).col_ += (*loaded_image_buffer)(i, j).col_;
-					(*aux_image_passes_[idx])(i, j).weight_ += (*loaded_image_buffer)(i, j).weight_;
+					aux_image_passes_[idx]->addWeighted(i, j, loaded_image_buffer->weightedColor(i, j), loaded_image_buffer->weight(i, j));
 				}
 			}
 		}
 
+		foldHalfFloatPasses();
+
 		if(sampling_offset_ < loaded_film->sampling_offset_) sampling_offset_ = loaded_film->sampling_offset_;
 		if(base_sampling_offset_ < loaded_film->base_sampling_offset_) base_sampling_offset_ = loaded_film->base_sampling_offset_;
 
@@ -1559,6 +1691,8 @@ void ImageFilm::imageFilmLoadAllInFolder()
 
 bool ImageFilm::imageFilmSave()
 {
+	TraceScope trace_scope("film file save", "film");
+	foldHalfFloatPasses();
 	bool result_ok = true;
 	std::stringstream pass_string;
 	pass_string << "Saving internal ImageFilm file";
@@ -1610,12 +1744,12 @@ bool ImageFilm::imageFilmSave()
 		{
 			for(int x = 0; x < w_; ++x)
 			{
-				const Pixel &p = (*img)(x, y);
-				file.append<float>(p.col_.r_);
-				file.append<float>(p.col_.g_);
-				file.append<float>(p.col_.b_);
-				file.append<float>(p.col_.a_);
-				file.append<float>(p.weight_);
+				const Rgba col = img->weightedColor(x, y);
+				file.append<float>(col.r_);
+				file.append<float>(col.g_);
+				file.append<float>(col.b_);
+				file.append<float>(col.a_);
+				file.append<float>(img->weight(x, y));
 			}
 		}
 	}
@@ -1641,12 +1775,12 @@ bool ImageFilm::imageFilmSave()
 		{
 			for(int x = 0; x < w_; ++x)
 			{
-				const Pixel &p = (*img)(x, y);
-				file.append<float>(p.col_.r_);
-				file.append<float>(p.col_.g_);
-				file.append<float>(p.col_.b_);
-				file.append<float>(p.col_.a_);
-				file.append<float>(p.weight_);
+				const Rgba col = img->weightedColor(x, y);
+				file.append<float>(col.r_);
+				file.append<float>(col.g_);
+				file.append<float>(col.b_);
+				file.append<float>(col.a_);
+				file.append<float>(img->weight(x, y));
 			}
 		}
 	}
@@ -1721,8 +1855,8 @@ void ImageFilm::generateDebugFacesEdges(int num_view, int idx_pass, int xstart,
 	const float faces_edge_threshold = render_passes->faces_edge_threshold_;
 	const float faces_edge_smoothness = render_passes->faces_edge_smoothness_;
 
-	Rgba2DImageWeighed_t *normal_image_pass = getImagePassFromIntPassType(PassIntNormalGeom);
-	Rgba2DImageWeighed_t *z_depth_image_pass = getImagePassFromIntPassType(PassIntZDepthNorm);
+	FilmPass *normal_image_pass = getImagePassFromIntPassType(PassIntNormalGeom);
+	FilmPass *z_depth_image_pass = getImagePassFromIntPassType(PassIntZDepthNorm);
 
 	if(normal_image_pass && z_depth_image_pass)
 	{
@@ -1733,8 +1867,8 @@ void ImageFilm::generateDebugFacesEdges(int num_view, int idx_pass, int xstart,
 		{
 			for(int i = xstart; i < width; ++i)
 			{
-				Rgb col_normal = (*normal_image_pass)(i, j).normalized();
-				float z_depth = (*z_depth_image_pass)(i, j).normalized().a_;
+				Rgb col_normal = normal_image_pass->normalized(i, j);
+				float z_depth = z_depth_image_pass->normalized(i, j).a_;
 
 				image_mat.at(0).at<float>(j, i) = col_normal.getR();
 				image_mat.at(1).at<float>(j, i) = col_normal.getG();
@@ -1771,8 +1905,8 @@ void ImageFilm::generateToonAndDebugObjectEdges(int num_view, int idx_pass, int
 	const float object_edge_threshold = render_passes->object_edge_threshold_;
 	const float object_edge_smoothness = render_passes->object_edge_smoothness_;
 
-	Rgba2DImageWeighed_t *normal_image_pass = getImagePassFromIntPassType(PassIntNormalSmooth);
-	Rgba2DImageWeighed_t *z_depth_image_pass = getImagePassFromIntPassType(PassIntZDepthNorm);
+	FilmPass *normal_image_pass = getImagePassFromIntPassType(PassIntNormalSmooth);
+	FilmPass *z_depth_image_pass = getImagePassFromIntPassType(PassIntZDepthNorm);
 
 	if(normal_image_pass && z_depth_image_pass)
 	{
@@ -1786,12 +1920,12 @@ void ImageFilm::generateToonAndDebugObjectEdges(int num_view, int idx_pass, int
 		{
 			for(int i = xstart; i < width; ++i)
 			{
-				col_normal = (*normal_image_pass)(i, j).normalized();
-				z_depth = (*z_depth_image_pass)(i, j).normalized().a_;
+				col_normal = normal_image_pass->normalized(i, j);
+				z_depth = z_depth_image_pass->normalized(i, j).a_;
 
-				image_mat_combined_vec(j, i)[0] = (*image_passes_[0])(i, j).normalized().b_;
-				image_mat_combined_vec(j, i)[1] = (*image_passes_[0])(i, j).normalized().g_;
-				image_mat_combined_vec(j, i)[2] = (*image_passes_[0])(i, j).normalized().r_;
+				image_mat_combined_vec(j, i)[0] = image_passes_[0]->normalized(i, j).b_;
+				image_mat_combined_vec(j, i)[1] = image_passes_[0]->normalized(i, j).g_;
+				image_mat_combined_vec(j, i)[2] = image_passes_[0]->normalized(i, j).r_;
 
 				image_mat.at(0).at<float>(j, i) = col_normal.getR();
 				image_mat.at(1).at<float>(j, i) = col_normal.getG();
@@ -1873,7 +2007,33 @@ void ImageFilm::generateDebugFacesEdges(int num_view, int idx_pass, int xstart,
 #endif
 
 
-Rgba2DImageWeighed_t *ImageFilm::getImagePassFromIntPassType(int int_pass_type)
+FilmPass *ImageFilm::createImagePass(int int_pass_type, bool half_float) const
+{
+	//The passes except the Combined and AA samples ones get the same filter weights as the Combined pass, which is always created and updated first
+	const RenderPasses *render_passes = env_->getRenderPasses();
+	const FilmPass *weights = nullptr;
+	if(render_passes->film_shared_weights_ && !image_passes_.empty() && int_pass_type != PassIntAaSamples) weights = image_passes_.front();
+
+	//The index, mask and debug passes keep their default color in most of the image
+	bool sparse = false;
+	if(render_passes->film_sparse_passes_)
+	{
+		sparse = (int_pass_type >= PassIntObjIndexAbs && int_pass_type <= PassIntMatIndexMaskAll) ||
+				 (int_pass_type >= PassIntDebugNu && int_pass_type <= PassIntDebugDsdv) ||
+				 (int_pass_type >= PassIntDebugLightEstimationLightDirac && int_pass_type <= PassIntDebugDudxyDvdxy);
+	}
+	return new FilmPass(w_, h_, half_float, weights, sparse, ColorPasses::initColor((IntPassTypes) int_pass_type));
+}
+
+size_t ImageFilm::imagePassesMemoryUsed() const
+{
+	size_t bytes = 0;
+	for(const auto &img : image_passes_) bytes += img->memoryUsed();
+	for(const auto &img : aux_image_passes_) bytes += img->memoryUsed();
+	return bytes;
+}
+
+FilmPass *ImageFilm::getImagePassFromIntPassType(int int_pass_type)
 {
 	for(size_t idx = 1; idx < image_passes_.size(); ++idx)
 	{
@@ -0,0 +1,291 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/imagefilm_pass.h"
+#include "utility/util_mcqmc.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+BEGIN_YAFARAY
+
+//! IEEE 754 half float conversion, rounding to the nearest even, with overflows to infinity (see "float->half variants", F. Giesen)
+static inline uint16_t floatToHalf__(float value)
+{
+	static constexpr uint32_t f32_infinity = 255u << 23;
+	static constexpr uint32_t f16_max = (127u + 16u) << 23;
+	static constexpr uint32_t denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+	uint32_t f;
+	std::memcpy(&f, &value, sizeof(f));
+	const uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+	uint16_t result;
+	if(f >= f16_max) result = (f > f32_infinity) ? 0x7e00 : 0x7c00;
+	else if(f < (113u << 23)) //subnormal half or zero, rounded by the float addition
+	{
+		float magic, shifted;
+		std::memcpy(&magic, &denormal_magic, sizeof(magic));
+		std::memcpy(&shifted, &f, sizeof(shifted));
+		shifted += magic;
+		std::memcpy(&f, &shifted, sizeof(f));
+		result = (uint16_t)(f - denormal_magic);
+	}
+	else
+	{
+		const uint32_t mantissa_odd = (f >> 13) & 1u;
+		f += ((uint32_t)(15 - 127) << 23) + 0xfffu + mantissa_odd;
+		result = (uint16_t)(f >> 13);
+	}
+	return result | (uint16_t)(sign >> 16);
+}
+
+static inline float halfToFloat__(uint16_t half)
+{
+	static constexpr uint32_t shifted_exponent = 0x7c00u << 13;
+	static constexpr uint32_t denormal_magic = 113u << 23;
+	uint32_t f = (half & 0x7fffu) << 13;
+	const uint32_t exponent = f & shifted_exponent;
+	f += (127u - 15u) << 23;
+	if(exponent == shifted_exponent) f += (128u - 16u) << 23; //infinity or NaN
+	else if(exponent == 0) //zero or subnormal, renormalized by the float subtraction
+	{
+		float magic, shifted;
+		std::memcpy(&magic, &denormal_magic, sizeof(magic));
+		f += 1u << 23;
+		std::memcpy(&shifted, &f, sizeof(shifted));
+		shifted -= magic;
+		std::memcpy(&f, &shifted, sizeof(f));
+	}
+	f |= (uint32_t)(half & 0x8000u) << 16;
+	float result;
+	std::memcpy(&result, &f, sizeof(result));
+	return result;
+}
+
+/*! Half float conversion rounding to one of the two nearest half floats with a probability proportional to its closeness, so that
+	the rounding error is zero on average. random is in [0, 1) */
+static inline uint16_t floatToHalfStochastic__(float value, float random)
+{
+	const uint16_t nearest = floatToHalf__(value);
+	const float nearest_value = halfToFloat__(nearest);
+	if(nearest_value == value || (nearest & 0x7c00u) == 0x7c00u) return nearest; //exact, infinity or NaN
+	//The other neighbour is one unit of the magnitude away, towards the value
+	const uint16_t other = (std::fabs(nearest_value) < std::fabs(value)) ? nearest + 1 : nearest - 1;
+	if((other & 0x7c00u) == 0x7c00u) return nearest;
+	const float other_value = halfToFloat__(other);
+	const float probability = (value - nearest_value) / (other_value - nearest_value);
+	return (random < probability) ? other : nearest;
+}
+
+FilmPass::FilmPass(int width, int height, bool half_float, const FilmPass *weights, bool sparse, const Rgba &background):
+		width_(width), height_(height), half_float_(half_float), sparse_(sparse && weights), means_(half_float_ || sparse_), weights_(weights), background_(sparse_ ? background : Rgba(0.f))
+{
+	blocks_x_ = (width_ + block_mask_) >> block_shift_;
+	num_blocks_ = blocks_x_ * ((height_ + block_mask_) >> block_shift_);
+	blocks_.reset(new std::atomic<Block *>[num_blocks_]);
+	for(int i = 0; i < num_blocks_; ++i) blocks_[i].store(nullptr, std::memory_order_relaxed);
+	if(!sparse_) clear();
+}
+
+FilmPass::~FilmPass()
+{
+	for(int i = 0; i < num_blocks_; ++i) delete blocks_[i].load(std::memory_order_relaxed);
+}
+
+void FilmPass::clear()
+{
+	static constexpr int block_pixels = block_size_ * block_size_;
+	for(int i = 0; i < num_blocks_; ++i)
+	{
+		Block *block = blocks_[i].load(std::memory_order_relaxed);
+		if(sparse_)
+		{
+			delete block;
+			blocks_[i].store(nullptr, std::memory_order_release);
+			continue;
+		}
+		if(!block)
+		{
+			block = new Block;
+			blocks_[i].store(block, std::memory_order_release);
+		}
+		if(half_float_) block->half_col_.assign(4 * block_pixels, 0);
+		else block->col_.assign(4 * block_pixels, 0.f);
+		if(!weights_) block->weight_.assign(block_pixels, 0.f);
+		std::vector<float>().swap(block->pending_);
+	}
+}
+
+FilmPass::Block *FilmPass::allocateBlock(int x, int y)
+{
+	//All the samples of the pixels of a new block so far had the background color, which is then their mean
+	Block *block = new Block;
+	if(half_float_) block->half_col_.resize(4 * block_size_ * block_size_);
+	else block->col_.resize(4 * block_size_ * block_size_);
+	for(int index = 0; index < block_size_ * block_size_; ++index) setColor(block, index, background_);
+	blocks_[(y >> block_shift_) * blocks_x_ + (x >> block_shift_)].store(block, std::memory_order_release);
+	return block;
+}
+
+Rgba FilmPass::getColor(const Block *block, int index) const
+{
+	if(half_float_)
+	{
+		const uint16_t *col = &block->half_col_[4 * index];
+		return Rgba(halfToFloat__(col[0]), halfToFloat__(col[1]), halfToFloat__(col[2]), halfToFloat__(col[3]));
+	}
+	const float *col = &block->col_[4 * index];
+	return Rgba(col[0], col[1], col[2], col[3]);
+}
+
+void FilmPass::setColor(Block *block, int index, const Rgba &col)
+{
+	if(half_float_)
+	{
+		uint16_t *dest = &block->half_col_[4 * index];
+		dest[0] = floatToHalf__(col.r_);
+		dest[1] = floatToHalf__(col.g_);
+		dest[2] = floatToHalf__(col.b_);
+		dest[3] = floatToHalf__(col.a_);
+	}
+	else
+	{
+		float *dest = &block->col_[4 * index];
+		dest[0] = col.r_;
+		dest[1] = col.g_;
+		dest[2] = col.b_;
+		dest[3] = col.a_;
+	}
+}
+
+void FilmPass::add(int x, int y, const Rgba &weighted_col, float weight, bool is_background)
+{
+	if(!means_)
+	{
+		addSum(x, y, weighted_col, weight);
+		return;
+	}
+	Block *block = getBlock(x, y);
+	if(!block)
+	{
+		if(is_background) return;
+		block = allocateBlock(x, y);
+	}
+	const int index = pixelIndex(x, y);
+	if(!weights_) block->weight_[index] += weight;
+	if(half_float_)
+	{
+		if(block->pending_.empty()) block->pending_.assign(5 * block_size_ * block_size_, 0.f);
+		float *pending = &block->pending_[5 * index];
+		pending[0] += weighted_col.r_;
+		pending[1] += weighted_col.g_;
+		pending[2] += weighted_col.b_;
+		pending[3] += weighted_col.a_;
+		pending[4] += weight;
+		return;
+	}
+	const float total_weight = weights_ ? weights_->weight(x, y) : block->weight_[index];
+	if(total_weight == 0.f) return;
+	const Rgba mean = getColor(block, index);
+	setColor(block, index, mean + (weighted_col - mean * weight) / total_weight);
+}
+
+void FilmPass::fold(int x_0, int x_1, int y_0, int y_1)
+{
+	if(!half_float_) return;
+	x_0 = std::max(x_0, 0);
+	y_0 = std::max(y_0, 0);
+	x_1 = std::min(x_1, width_);
+	y_1 = std::min(y_1, height_);
+	if(x_0 >= x_1 || y_0 >= y_1) return;
+	++folds_;
+	for(int block_y = y_0 >> block_shift_; block_y <= (y_1 - 1) >> block_shift_; ++block_y)
+	{
+		for(int block_x = x_0 >> block_shift_; block_x <= (x_1 - 1) >> block_shift_; ++block_x) foldBlock(block_y * blocks_x_ + block_x);
+	}
+}
+
+void FilmPass::foldBlock(int block_index)
+{
+	Block *block = blocks_[block_index].load(std::memory_order_relaxed);
+	if(!block || block->pending_.empty()) return;
+	const int block_x_0 = (block_index % blocks_x_) << block_shift_;
+	const int block_y_0 = (block_index / blocks_x_) << block_shift_;
+	for(int index = 0; index < block_size_ * block_size_; ++index)
+	{
+		const float *pending = &block->pending_[5 * index];
+		if(pending[0] == 0.f && pending[1] == 0.f && pending[2] == 0.f && pending[3] == 0.f && pending[4] == 0.f) continue;
+		const int x = block_x_0 + (index & block_mask_), y = block_y_0 + (index >> block_shift_);
+		const float total_weight = weights_ ? weights_->weight(x, y) : block->weight_[index];
+		if(total_weight == 0.f) continue;
+		const Rgba mean = getColor(block, index);
+		const Rgba sum(pending[0], pending[1], pending[2], pending[3]);
+		const Rgba new_mean = mean + (sum - mean * pending[4]) / total_weight;
+		const float new_mean_channels[4] = { new_mean.r_, new_mean.g_, new_mean.b_, new_mean.a_ };
+		uint16_t *dest = &block->half_col_[4 * index];
+		for(int channel = 0; channel < 4; ++channel)
+		{
+			const unsigned int hash = fnv32ABuf__((((unsigned int) (y * width_ + x) << 2) | channel) ^ (folds_ * 0x9e3779b9u));
+			dest[channel] = floatToHalfStochastic__(new_mean_channels[channel], (hash >> 8) * (1.f / 16777216.f));
+		}
+	}
+	std::vector<float>().swap(block->pending_);
+}
+
+void FilmPass::addWeight(int x, int y, float weight)
+{
+	if(weights_) return;
+	getBlock(x, y)->weight_[pixelIndex(x, y)] += weight;
+}
+
+float FilmPass::weight(int x, int y) const
+{
+	if(weights_) return weights_->weight(x, y);
+	return getBlock(x, y)->weight_[pixelIndex(x, y)];
+}
+
+Rgba FilmPass::normalized(int x, int y) const
+{
+	const float total_weight = weight(x, y);
+	if(total_weight == 0.f) return Rgba(0.f); //Negative weights are allowed, see Pixel::normalized()
+	const Block *block = getBlock(x, y);
+	if(!block) return background_;
+	if(means_) return getColor(block, pixelIndex(x, y));
+	return getColor(block, pixelIndex(x, y)) / total_weight;
+}
+
+Rgba FilmPass::weightedColor(int x, int y) const
+{
+	const Block *block = getBlock(x, y);
+	if(!block) return background_ * weight(x, y);
+	if(means_) return getColor(block, pixelIndex(x, y)) * weight(x, y);
+	return getColor(block, pixelIndex(x, y));
+}
+
+size_t FilmPass::memoryUsed() const
+{
+	size_t bytes = num_blocks_ * sizeof(std::atomic<Block *>);
+	for(int i = 0; i < num_blocks_; ++i)
+	{
+		const Block *block = blocks_[i].load(std::memory_order_relaxed);
+		if(block) bytes += sizeof(Block) + block->col_.size() * sizeof(float) + block->half_col_.size() * sizeof(uint16_t) + block->weight_.size() * sizeof(float) + block->pending_.size() * sizeof(float);
+	}
+	return bytes;
+}
+
+END_YAFARAY
@@ -0,0 +1,489 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/import_binary.h"
+#include "common/import_xml.h"
+#include "common/logging.h"
+#include "common/environment.h"
+#include "common/scene.h"
+#include "common/file.h"
+#include "common/color.h"
+#include "utility/util_math.h"
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+
+#if HAVE_XML
+#include <libxml/parser.h>
+#endif
+
+BEGIN_YAFARAY
+
+/*=============================================================
+/ binary format definitions and helpers
+=============================================================*/
+
+static constexpr uint32_t binary_format_version__ = 1;
+static constexpr char binary_tag_header__[4] = {'Y', 'A', 'F', 'B'};
+static constexpr char binary_tag_element_start__[4] = {'E', 'L', 'E', 'M'};
+static constexpr char binary_tag_element_end__[4] = {'E', 'N', 'D', 'E'};
+static constexpr char binary_tag_mesh__[4] = {'M', 'E', 'S', 'H'};
+static constexpr size_t binary_chunk_header_size__ = 16;
+
+enum BinaryMeshFlags : uint32_t
+{
+	BinaryMeshOrco = 1 << 0,
+	BinaryMeshUv = 1 << 1,
+	BinaryMeshNormals = 1 << 2,
+};
+
+static inline size_t binaryAlign__(size_t offset) { return (offset + 7) & ~((size_t) 7); }
+
+static inline bool isLittleEndian__()
+{
+	const uint16_t one = 1;
+	return *reinterpret_cast<const uint8_t *>(&one) == 1;
+}
+
+//! Converts a value between the host byte order and little-endian (the conversion is the same in both directions)
+template <typename T> static inline T swapLittleEndian__(T value)
+{
+	if(isLittleEndian__()) return value;
+	uint8_t bytes[sizeof(T)];
+	memcpy(bytes, &value, sizeof(T));
+	for(size_t i = 0; i < sizeof(T) / 2; ++i) std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+bool isBinarySceneFile__(const char *filename)
+{
+	FILE *fp = File::open(std::string(filename), "rb");
+	if(!fp) return false;
+	char tag[4];
+	const bool is_binary = (fread(tag, 1, sizeof(tag), fp) == sizeof(tag) && !memcmp(tag, binary_tag_header__, sizeof(tag)));
+	File::close(fp);
+	return is_binary;
+}
+
+/*=============================================================
+/ reader
+=============================================================*/
+
+//! Sequential reader over a block of memory, checking bounds on every access
+class BinaryReader final
+{
+	public:
+		BinaryReader(const char *data, size_t size) : begin_(data), pos_(data), end_(data + size) { }
+		size_t remaining() const { return end_ - pos_; }
+		size_t offset() const { return pos_ - begin_; }
+		template <typename T> bool read(T &value)
+		{
+			if(remaining() < sizeof(T)) return false;
+			memcpy(&value, pos_, sizeof(T));
+			value = swapLittleEndian__(value);
+			pos_ += sizeof(T);
+			return true;
+		}
+		bool readChars(size_t length, std::string &str)
+		{
+			if(remaining() < length) return false;
+			str.assign(pos_, length);
+			pos_ += length;
+			return true;
+		}
+		bool read(std::string &str)
+		{
+			uint32_t length;
+			return read(length) && readChars(length, str);
+		}
+		//! Reads n values into "values". Returns false if there is not enough data
+		template <typename T> bool readArray(size_t n, std::vector<T> &values)
+		{
+			if(n > remaining() / sizeof(T)) return false;
+			if(reinterpret_cast<uintptr_t>(pos_) % alignof(T) == 0) values.assign(reinterpret_cast<const T *>(pos_), reinterpret_cast<const T *>(pos_) + n);
+			else
+			{
+				values.resize(n);
+				if(n > 0) memcpy(values.data(), pos_, n * sizeof(T));
+			}
+			if(!isLittleEndian__()) for(auto &value : values) value = swapLittleEndian__(value);
+			pos_ += n * sizeof(T);
+			return true;
+		}
+		void align() { pos_ = begin_ + std::min(binaryAlign__(offset()), (size_t)(end_ - begin_)); }
+		BinaryReader subReader(size_t size) const { return BinaryReader(pos_, std::min(size, remaining())); }
+		void skip(size_t size) { pos_ += std::min(size, remaining()); }
+
+	private:
+		const char *begin_, *pos_, *end_;
+};
+
+/*=============================================================
+/ writer and XML converter
+=============================================================*/
+
+//! Writes the binary format chunks, see import_binary.h
+class BinarySceneWriter final
+{
+	public:
+		explicit BinarySceneWriter(const std::string &filename) : file_(filename, std::ios::binary | std::ios::trunc)
+		{
+			if(!file_.is_open()) return;
+			beginChunk(binary_tag_header__);
+			write(binary_format_version__);
+			endChunk();
+		}
+		bool isOk() const { return file_.good(); }
+		void writeElementStart(const char *name, const char **attrs)
+		{
+			beginChunk(binary_tag_element_start__);
+			write(std::string(name));
+			uint32_t num_attrs = 0;
+			for(int n = 0; attrs && attrs[n]; n += 2) ++num_attrs;
+			write(num_attrs);
+			for(int n = 0; attrs && attrs[n]; ++n) write(std::string(attrs[n]));
+			endChunk();
+		}
+		void writeElementEnd(const char *name)
+		{
+			beginChunk(binary_tag_element_end__);
+			write(std::string(name));
+			endChunk();
+		}
+		void beginChunk(const char *tag)
+		{
+			chunk_start_ = file_.tellp();
+			file_.write(tag, 4);
+			write((uint32_t) 0);
+			write((uint64_t) 0); //payload size, filled in by endChunk
+		}
+		void endChunk()
+		{
+			const std::streamoff payload_size = file_.tellp() - chunk_start_ - (std::streamoff) binary_chunk_header_size__;
+			pad();
+			const std::streampos chunk_end = file_.tellp();
+			file_.seekp(chunk_start_ + (std::streamoff) 8);
+			write((uint64_t) payload_size);
+			file_.seekp(chunk_end);
+		}
+		template <typename T> void write(const T &value)
+		{
+			const T little_endian_value = swapLittleEndian__(value);
+			file_.write(reinterpret_cast<const char *>(&little_endian_value), sizeof(T));
+		}
+		void write(const std::string &str)
+		{
+			write((uint32_t) str.size());
+			file_.write(str.data(), str.size());
+		}
+		template <typename T> void writeArray(const std::vector<T> &values)
+		{
+			if(isLittleEndian__()) file_.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+			else for(const auto &value : values) write(value);
+		}
+		//! Zero padding up to the next 8 byte boundary
+		void pad()
+		{
+			static const char zeros[8] = {0};
+			const size_t offset = (size_t) file_.tellp();
+			file_.write(zeros, binaryAlign__(offset) - offset);
+		}
+
+	private:
+		std::ofstream file_;
+		std::streampos chunk_start_;
+};
+
+#if HAVE_XML
+
+struct XmlToBinaryConverter
+{
+	XmlToBinaryConverter(const std::string &filename, XmlMeshLoader &mesh_loader) : writer_(filename), mesh_loader_(mesh_loader) { }
+	void writeMesh(const MeshData &mesh);
+	BinarySceneWriter writer_;
+	XmlMeshLoader &mesh_loader_;
+};
+
+void XmlToBinaryConverter::writeMesh(const MeshData &mesh)
+{
+	int32_t num_faces = 0;
+	for(const auto &group : mesh.face_groups_) num_faces += group.indices_.size() / 3;
+	uint32_t flags = 0;
+	if(mesh.has_orco_) flags |= BinaryMeshOrco;
+	if(mesh.has_uv_) flags |= BinaryMeshUv;
+	if(mesh.has_normals_) flags |= BinaryMeshNormals;
+
+	writer_.beginChunk(binary_tag_mesh__);
+	writer_.write((int32_t) mesh.id_);
+	writer_.write((int32_t)(mesh.points_.size() / 3));
+	writer_.write(num_faces);
+	writer_.write((int32_t) mesh.type_);
+	writer_.write((int32_t) mesh.obj_pass_index_);
+	writer_.write(flags);
+	writer_.write((int32_t)(mesh.uvs_.size() / 2));
+	writer_.write((int32_t) mesh.face_groups_.size());
+	writer_.writeArray(mesh.points_);
+	if(mesh.has_orco_) writer_.writeArray(mesh.orcos_);
+	if(mesh.has_normals_) writer_.writeArray(mesh.normals_);
+	writer_.writeArray(mesh.uvs_);
+	writer_.pad();
+	for(const auto &group : mesh.face_groups_)
+	{
+		writer_.write((uint32_t) group.material_.size());
+		writer_.write((int32_t)(group.indices_.size() / 3));
+		writer_.writeArray(std::vector<char>(group.material_.begin(), group.material_.end()));
+		writer_.pad();
+		writer_.writeArray(group.indices_);
+		if(mesh.has_uv_) writer_.writeArray(group.uv_indices_);
+		writer_.pad();
+	}
+	writer_.endChunk();
+}
+
+//! The meshes are decoded by the same XmlMeshLoader as when rendering the XML file, and written when their placeholder is reached
+static void converterStartElement__(void *user_data, const xmlChar *name, const xmlChar **attrs)
+{
+	XmlToBinaryConverter &converter = *((XmlToBinaryConverter *)user_data);
+	const char *element = (const char *)name;
+	const char **element_attrs = (const char **)attrs;
+	if(strcmp(element, "yafaray_mesh_block"))
+	{
+		converter.writer_.writeElementStart(element, element_attrs);
+		return;
+	}
+	int index = -1;
+	for(int n = 0; element_attrs && element_attrs[n]; n += 2)
+	{
+		if(!strcmp(element_attrs[n], "index")) index = atoi(element_attrs[n + 1]);
+	}
+	const MeshData *mesh = converter.mesh_loader_.getMesh(index);
+	if(!mesh) return;
+	converter.writeMesh(*mesh);
+	converter.mesh_loader_.releaseMesh(index);
+}
+
+static void converterEndElement__(void *user_data, const xmlChar *name)
+{
+	XmlToBinaryConverter &converter = *((XmlToBinaryConverter *)user_data);
+	if(strcmp((const char *)name, "yafaray_mesh_block")) converter.writer_.writeElementEnd((const char *)name);
+}
+
+static void converterError__(void *user_data, const char *msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+	const size_t message_size = 1000;
+	char message_buffer[message_size];
+	vsnprintf(message_buffer, message_size, msg, args);
+	Y_ERROR << "XMLParser error: " << message_buffer << YENDL;
+	va_end(args);
+}
+
+#endif // HAVE_XML
+
+bool convertXmlToBinary__(const char *xml_filename, const char *binary_filename)
+{
+#if HAVE_XML
+	const MappedFile file(xml_filename);
+	if(!file.isValid())
+	{
+		Y_ERROR << "XMLParser: Cannot open the file " << xml_filename << YENDL;
+		return false;
+	}
+	XmlMeshLoader mesh_loader(file.data(), file.size(), 0);
+	XmlToBinaryConverter converter(binary_filename, mesh_loader);
+	if(!converter.writer_.isOk())
+	{
+		Y_ERROR << "BinaryWriter: Cannot create the file " << binary_filename << YENDL;
+		return false;
+	}
+	xmlSAXHandler handler;
+	memset(&handler, 0, sizeof(handler));
+	handler.startElement = converterStartElement__;
+	handler.endElement = converterEndElement__;
+	handler.error = converterError__;
+	handler.fatalError = converterError__;
+	const std::string &skeleton = mesh_loader.getSkeleton();
+	if(xmlSAXUserParseMemory(&handler, &converter, skeleton.data(), (int) skeleton.size()) < 0 || !mesh_loader.isOk())
+	{
+		Y_ERROR << "XMLParser: Parsing the file " << xml_filename << YENDL;
+		return false;
+	}
+	if(!converter.writer_.isOk())
+	{
+		Y_ERROR << "BinaryWriter: Error writing the file " << binary_filename << YENDL;
+		return false;
+	}
+	Y_INFO << "BinaryWriter: Converted " << xml_filename << " into " << binary_filename << YENDL;
+	return true;
+#else
+	Y_WARNING << "XMLParser: yafray was compiled without XML support, cannot convert file." << YENDL;
+	return false;
+#endif
+}
+
+#if HAVE_XML
+
+static bool parseElementChunk__(BinaryReader &reader, XmlParser &parser, bool element_start)
+{
+	std::string name;
+	if(!reader.read(name)) return false;
+	if(!element_start)
+	{
+		parser.endElement(name.c_str());
+		return true;
+	}
+	uint32_t num_attrs;
+	if(!reader.read(num_attrs) || num_attrs > reader.remaining() / 8) return false;
+	std::vector<std::string> attr_strings(2 * num_attrs);
+	for(auto &str : attr_strings) if(!reader.read(str)) return false;
+	std::vector<const char *> attrs;
+	attrs.reserve(attr_strings.size() + 1);
+	for(const auto &str : attr_strings) attrs.push_back(str.c_str());
+	attrs.push_back(nullptr);
+	parser.startElement(name.c_str(), attrs.data());
+	return true;
+}
+
+//! The meshes are added to the scene in bulk without checking their indices, so every index read from the file must be checked here
+static bool indicesInRange__(const std::vector<int> &indices, int32_t size)
+{
+	for(const int index : indices) if(index < 0 || index >= size) return false;
+	return true;
+}
+
+static bool parseMeshChunk__(BinaryReader &reader, Scene *scene, RenderEnvironment *env)
+{
+	MeshData mesh;
+	int32_t id, num_vertices, num_faces, type, obj_pass_index, num_uvs, num_face_groups;
+	uint32_t flags;
+	if(!(reader.read(id) && reader.read(num_vertices) && reader.read(num_faces) && reader.read(type) && reader.read(obj_pass_index)
+			&& reader.read(flags) && reader.read(num_uvs) && reader.read(num_face_groups))) return false;
+	if(num_vertices < 0 || num_faces < 0 || num_uvs < 0 || num_face_groups < 0) return false;
+	mesh.id_ = id;
+	mesh.vertices_ = num_vertices;
+	mesh.faces_ = num_faces;
+	mesh.type_ = type;
+	mesh.obj_pass_index_ = obj_pass_index;
+	mesh.has_orco_ = flags & BinaryMeshOrco;
+	mesh.has_uv_ = flags & BinaryMeshUv;
+	mesh.has_normals_ = flags & BinaryMeshNormals;
+
+	if(!reader.readArray(3 * (size_t) num_vertices, mesh.points_)) return false;
+	if(mesh.has_orco_ && !reader.readArray(3 * (size_t) num_vertices, mesh.orcos_)) return false;
+	if(mesh.has_normals_ && !reader.readArray(3 * (size_t) num_vertices, mesh.normals_)) return false;
+	if(!reader.readArray(2 * (size_t) num_uvs, mesh.uvs_)) return false;
+	reader.align();
+
+	mesh.face_groups_.resize(num_face_groups);
+	for(auto &group : mesh.face_groups_)
+	{
+		uint32_t name_length;
+		int32_t num_group_faces;
+		if(!(reader.read(name_length) && reader.read(num_group_faces) && num_group_faces >= 0 && reader.readChars(name_length, group.material_))) return false;
+		reader.align();
+		if(!reader.readArray(3 * (size_t) num_group_faces, group.indices_) || !indicesInRange__(group.indices_, num_vertices)) return false;
+		if(mesh.has_uv_ && !(reader.readArray(3 * (size_t) num_group_faces, group.uv_indices_) && indicesInRange__(group.uv_indices_, num_uvs))) return false;
+		reader.align();
+	}
+	addMeshData__(scene, env, mesh, "BinaryParser");
+	return true;
+}
+
+#endif // HAVE_XML
+
+/*! Layout of the "MESH" chunk payload, decoded into a MeshData:
+		int32 id (-1 to get a new one), vertices, faces, type, obj_pass_index; uint32 flags (BinaryMeshFlags); int32 number of uvs, number of face groups
+		double points[3 * vertices], orcos[3 * vertices] (if BinaryMeshOrco), normals[3 * vertices] (if BinaryMeshNormals)
+		float uvs[2 * number of uvs], padded to 8 bytes
+		for each group of faces sharing a material:
+			uint32 material name length, int32 faces in the group, material name padded to 8 bytes (empty for no material)
+			int32 vertex indices[3 * faces], uv indices[3 * faces] (if BinaryMeshUv), padded to 8 bytes
+*/
+bool parseBinaryFile__(const char *filename, Scene *scene, RenderEnvironment *env, ParamMap &render, std::string color_space_string, float input_gamma)
+{
+#if HAVE_XML
+	ColorSpace input_color_space = RawManualGamma;
+
+	if(color_space_string == "sRGB") input_color_space = Srgb;
+	else if(color_space_string == "XYZ") input_color_space = XyzD65;
+	else if(color_space_string == "LinearRGB") input_color_space = LinearRgb;
+	else input_color_space = Srgb;
+
+	const MappedFile file(filename);
+	if(!file.isValid())
+	{
+		Y_ERROR << "BinaryParser: Cannot open the file " << filename << YENDL;
+		return false;
+	}
+	//Elements other than meshes are replayed through the XML parser states, so both formats are interpreted exactly the same way
+	XmlParser parser(env, scene, render, input_color_space, input_gamma);
+	BinaryReader reader(file.data(), file.size());
+	bool header_found = false;
+	while(reader.remaining() > 0)
+	{
+		std::string tag;
+		uint32_t reserved;
+		uint64_t payload_size;
+		if(!(reader.readChars(4, tag) && reader.read(reserved) && reader.read(payload_size)) || payload_size > reader.remaining())
+		{
+			Y_ERROR << "BinaryParser: Truncated chunk at offset " << reader.offset() << " of file " << filename << YENDL;
+			return false;
+		}
+		BinaryReader payload = reader.subReader((size_t) payload_size);
+		reader.skip((size_t) payload_size);
+		reader.align();
+
+		bool ok = true;
+		if(!header_found)
+		{
+			uint32_t version = 0;
+			ok = (tag == std::string(binary_tag_header__, 4)) && payload.read(version);
+			if(!ok)
+			{
+				Y_ERROR << "BinaryParser: " << filename << " is not a YafaRay binary scene file" << YENDL;
+				return false;
+			}
+			if(version > binary_format_version__)
+			{
+				Y_ERROR << "BinaryParser: " << filename << " uses binary format version " << version << ", only up to version " << binary_format_version__ << " is supported" << YENDL;
+				return false;
+			}
+			header_found = true;
+		}
+		else if(tag == std::string(binary_tag_element_start__, 4)) ok = parseElementChunk__(payload, parser, true);
+		else if(tag == std::string(binary_tag_element_end__, 4)) ok = parseElementChunk__(payload, parser, false);
+		else if(tag == std::string(binary_tag_mesh__, 4)) ok = parseMeshChunk__(payload, scene, env);
+		else Y_WARNING << "BinaryParser: Skipping unknown chunk '" << tag << "'" << YENDL;
+
+		if(!ok)
+		{
+			Y_ERROR << "BinaryParser: Corrupt '" << tag << "' chunk in file " << filename << YENDL;
+			return false;
+		}
+	}
+	return header_found;
+#else
+	Y_WARNING << "BinaryParser: yafray was compiled without XML support, cannot parse file." << YENDL;
+	return false;
+#endif
+}
+
+END_YAFARAY
@@ -24,8 +24,14 @@
 #include "common/scene.h"
 #include "common/color.h"
 #include "common/matrix4.h"
+#include "common/file.h"
 #include "utility/util_math.h"
 #include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
 
 #if HAVE_XML
 #include <libxml/parser.h>
@@ -147,9 +153,476 @@ static xmlSAXHandler my_handler__ =
 		myError__,
 		myFatalError__
 };
+
+/*=============================================================
+/ parallel mesh decoding
+=============================================================*/
+
+//! Attribute of a tag, pointing into the document text
+struct XmlTextAttr
+{
+	const char *name_, *name_end_;
+	const char *value_, *value_end_;
+	bool nameIs(const char *name) const { const size_t len = strlen(name); return (size_t)(name_end_ - name_) == len && !strncmp(name_, name, len); }
+};
+
+static inline bool isXmlSpace__(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+/*! Scans the tag whose name starts at "pos" (just after '<'), returning the position after its closing '>',
+	or nullptr if the tag is malformed. Attribute values are not decoded */
+static const char *scanXmlTag__(const char *pos, const char *end, const char *&name, size_t &name_length, std::vector<XmlTextAttr> &attrs, bool &self_closing)
+{
+	name = pos;
+	while(pos < end && !isXmlSpace__(*pos) && *pos != '>' && *pos != '/') ++pos;
+	name_length = pos - name;
+	attrs.clear();
+	self_closing = false;
+	while(pos < end)
+	{
+		while(pos < end && isXmlSpace__(*pos)) ++pos;
+		if(pos >= end) break;
+		if(*pos == '>') return pos + 1;
+		if(*pos == '/')
+		{
+			self_closing = true;
+			++pos;
+			continue;
+		}
+		XmlTextAttr attr;
+		attr.name_ = pos;
+		while(pos < end && *pos != '=' && !isXmlSpace__(*pos) && *pos != '>' && *pos != '/') ++pos;
+		attr.name_end_ = pos;
+		while(pos < end && isXmlSpace__(*pos)) ++pos;
+		if(pos >= end || *pos != '=') return nullptr;
+		++pos;
+		while(pos < end && isXmlSpace__(*pos)) ++pos;
+		if(pos >= end || (*pos != '"' && *pos != '\'')) return nullptr;
+		const char quote = *pos++;
+		attr.value_ = pos;
+		while(pos < end && *pos != quote) ++pos;
+		if(pos >= end) return nullptr;
+		attr.value_end_ = pos++;
+		attrs.push_back(attr);
+	}
+	return nullptr;
+}
+
+static const char *findText__(const char *pos, const char *end, const char *text)
+{
+	const size_t length = strlen(text);
+	for(; pos + length <= end; ++pos)
+	{
+		pos = (const char *) memchr(pos, text[0], end - pos);
+		if(!pos || pos + length > end) return nullptr;
+		if(!memcmp(pos, text, length)) return pos;
+	}
+	return nullptr;
+}
+
+//! Same result as atof() on the attribute value, using an exact fast path for the usual short decimal numbers
+static double parseXmlDouble__(const char *begin, const char *end)
+{
+	static const double powers_of_10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char *pos = begin;
+	while(pos < end && isXmlSpace__(*pos)) ++pos;
+	bool negative = false;
+	if(pos < end && (*pos == '-' || *pos == '+')) negative = (*pos++ == '-');
+	uint64_t mantissa = 0;
+	int significant_digits = 0, exponent = 0;
+	bool any_digit = false;
+	for(; pos < end && *pos >= '0' && *pos <= '9'; ++pos, any_digit = true)
+	{
+		if(significant_digits < 19)
+		{
+			mantissa = mantissa * 10 + (*pos - '0');
+			if(mantissa) ++significant_digits;
+		}
+		else ++exponent;
+	}
+	if(pos < end && *pos == '.')
+	{
+		for(++pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos, any_digit = true)
+		{
+			if(significant_digits < 19)
+			{
+				mantissa = mantissa * 10 + (*pos - '0');
+				if(mantissa) ++significant_digits;
+				--exponent;
+			}
+		}
+	}
+	if(any_digit && pos < end && (*pos == 'e' || *pos == 'E'))
+	{
+		const char *exponent_pos = pos + 1;
+		bool exponent_negative = false;
+		if(exponent_pos < end && (*exponent_pos == '-' || *exponent_pos == '+')) exponent_negative = (*exponent_pos++ == '-');
+		if(exponent_pos < end && *exponent_pos >= '0' && *exponent_pos <= '9')
+		{
+			int exponent_value = 0;
+			for(pos = exponent_pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos) if(exponent_value < 10000) exponent_value = exponent_value * 10 + (*pos - '0');
+			exponent += exponent_negative ? -exponent_value : exponent_value;
+		}
+	}
+	//Products and quotients of a mantissa below 2^53 by powers of ten up to 1e22 are correctly rounded, same as atof
+	if(any_digit && pos == end && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+	{
+		const double value = (exponent < 0) ? (double) mantissa / powers_of_10[-exponent] : (double) mantissa * powers_of_10[exponent];
+		return negative ? -value : value;
+	}
+	const std::string text(begin, end);
+	return atof(text.c_str());
+}
+
+//! Parses a decimal integer attribute value. Returns false for empty or non-numeric text and for values out of the int range
+static bool parseXmlInt__(const char *begin, const char *end, int &value)
+{
+	while(begin < end && isXmlSpace__(*begin)) ++begin;
+	while(end > begin && isXmlSpace__(end[-1])) --end;
+	bool negative = false;
+	if(begin < end && (*begin == '-' || *begin == '+')) negative = (*begin++ == '-');
+	if(begin == end) return false;
+	int64_t result = 0;
+	for(; begin < end; ++begin)
+	{
+		if(*begin < '0' || *begin > '9') return false;
+		result = result * 10 + (*begin - '0');
+		if(result > (int64_t) std::numeric_limits<int>::max() + 1) return false;
+	}
+	if(negative) result = -result;
+	if(result < std::numeric_limits<int>::min() || result > std::numeric_limits<int>::max()) return false;
+	value = (int) result;
+	return true;
+}
+
+//! Decodes the predefined XML entities and character references of an attribute value
+static std::string decodeXmlText__(const char *begin, const char *end)
+{
+	std::string result;
+	result.reserve(end - begin);
+	while(begin < end)
+	{
+		if(*begin != '&')
+		{
+			result += *begin++;
+			continue;
+		}
+		const char *semicolon = (const char *) memchr(begin, ';', end - begin);
+		if(!semicolon)
+		{
+			result.append(begin, end);
+			break;
+		}
+		const std::string entity(begin + 1, semicolon);
+		if(entity == "amp") result += '&';
+		else if(entity == "lt") result += '<';
+		else if(entity == "gt") result += '>';
+		else if(entity == "quot") result += '"';
+		else if(entity == "apos") result += '\'';
+		else if(entity.size() > 1 && entity[0] == '#')
+		{
+			const unsigned long code = (entity[1] == 'x') ? strtoul(entity.c_str() + 2, nullptr, 16) : strtoul(entity.c_str() + 1, nullptr, 10);
+			if(code < 0x80) result += (char) code;
+			else if(code < 0x800) { result += (char)(0xC0 | (code >> 6)); result += (char)(0x80 | (code & 0x3F)); }
+			else if(code < 0x10000) { result += (char)(0xE0 | (code >> 12)); result += (char)(0x80 | ((code >> 6) & 0x3F)); result += (char)(0x80 | (code & 0x3F)); }
+			else { result += (char)(0xF0 | (code >> 18)); result += (char)(0x80 | ((code >> 12) & 0x3F)); result += (char)(0x80 | ((code >> 6) & 0x3F)); result += (char)(0x80 | (code & 0x3F)); }
+		}
+		else result.append(begin, semicolon + 1);
+		begin = semicolon + 1;
+	}
+	return result;
+}
+
+XmlMeshLoader::XmlMeshLoader(const char *data, size_t size, int num_threads) : next_block_(0)
+{
+	const char *end = data + size;
+	const char *pos = data, *copied = data;
+	std::vector<XmlTextAttr> attrs;
+	std::vector<std::pair<const char *, const char *>> ranges;
+	while((pos = (const char *) memchr(pos, '<', end - pos)))
+	{
+		const size_t remaining = end - pos;
+		if(remaining >= 4 && !strncmp(pos, "<!--", 4))
+		{
+			pos = findText__(pos + 4, end, "-->");
+			if(!pos) break;
+			continue;
+		}
+		if(remaining >= 9 && !strncmp(pos, "<![CDATA[", 9))
+		{
+			pos = findText__(pos + 9, end, "]]>");
+			if(!pos) break;
+			continue;
+		}
+		if(remaining < 6 || strncmp(pos, "<mesh", 5) || !(isXmlSpace__(pos[5]) || pos[5] == '>' || pos[5] == '/'))
+		{
+			++pos;
+			continue;
+		}
+		const char *name;
+		size_t name_length;
+		bool self_closing;
+		const char *block_end = scanXmlTag__(pos + 1, end, name, name_length, attrs, self_closing);
+		if(block_end && !self_closing)
+		{
+			block_end = findText__(block_end, end, "</mesh");
+			if(block_end) block_end = (const char *) memchr(block_end, '>', end - block_end);
+			if(block_end) ++block_end;
+		}
+		if(!block_end) break; //Leave the rest of the document to libXML, which will report the error
+		skeleton_.append(copied, pos);
+		skeleton_ += "<yafaray_mesh_block index=\"" + std::to_string(ranges.size()) + "\"/>";
+		ranges.push_back({pos, block_end});
+		pos = copied = block_end;
+	}
+	skeleton_.append(copied, end);
+
+	blocks_ = std::vector<MeshBlock>(ranges.size());
+	for(size_t i = 0; i < ranges.size(); ++i)
+	{
+		blocks_[i].begin_ = ranges[i].first;
+		blocks_[i].end_ = ranges[i].second;
+	}
+	if(num_threads <= 0) num_threads = std::max(1U, std::thread::hardware_concurrency());
+	num_threads = std::min(num_threads, (int) blocks_.size());
+	window_ = 2 * (size_t) num_threads;
+	Y_VERBOSE << "XMLParser: Decoding " << blocks_.size() << " meshes with " << num_threads << " threads" << YENDL;
+	for(int i = 0; i < num_threads; ++i) threads_.push_back(std::thread(&XmlMeshLoader::decodeWorker, this));
+}
+
+XmlMeshLoader::~XmlMeshLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutx_);
+		stop_ = true;
+	}
+	window_moved_.notify_all();
+	for(auto &t : threads_) t.join();
+}
+
+void XmlMeshLoader::decodeWorker()
+{
+	size_t index;
+	while(!stop_ && (index = next_block_.fetch_add(1)) < blocks_.size())
+	{
+		{
+			//Blocks are claimed in file order, so the block the parser waits for is never held back by the window
+			std::unique_lock<std::mutex> lock(mutx_);
+			window_moved_.wait(lock, [this, index] { return stop_ || index < consumed_ + window_; });
+		}
+		if(stop_) break;
+		MeshBlock &block = blocks_[index];
+		const bool valid = decodeMesh(block);
+		std::lock_guard<std::mutex> lock(mutx_);
+		block.valid_ = valid;
+		block.decoded_ = true;
+		block_decoded_.notify_all();
+	}
+}
+
+bool XmlMeshLoader::decodeMesh(MeshBlock &block)
+{
+	std::vector<XmlTextAttr> attrs;
+	const char *name;
+	size_t name_length;
+	bool self_closing;
+	const char *end = block.end_;
+	const char *pos = scanXmlTag__(block.begin_ + 1, end, name, name_length, attrs, self_closing);
+	if(!pos) return false;
+	MeshData &mesh = block.mesh_;
+	for(const auto &attr : attrs)
+	{
+		if(attr.nameIs("has_orco")) mesh.has_orco_ = (attr.value_end_ - attr.value_ == 4 && !strncmp(attr.value_, "true", 4));
+		else if(attr.nameIs("has_uv")) mesh.has_uv_ = (attr.value_end_ - attr.value_ == 4 && !strncmp(attr.value_, "true", 4));
+		else if(attr.nameIs("vertices")) { if(!parseXmlInt__(attr.value_, attr.value_end_, mesh.vertices_)) return false; }
+		else if(attr.nameIs("faces")) { if(!parseXmlInt__(attr.value_, attr.value_end_, mesh.faces_)) return false; }
+		else if(attr.nameIs("type")) { if(!parseXmlInt__(attr.value_, attr.value_end_, mesh.type_)) return false; }
+		else if(attr.nameIs("id")) { if(!parseXmlInt__(attr.value_, attr.value_end_, mesh.id_)) return false; }
+		else if(attr.nameIs("obj_pass_index")) { if(!parseXmlInt__(attr.value_, attr.value_end_, mesh.obj_pass_index_)) return false; }
+	}
+	if(self_closing) return true;
+	mesh.points_.reserve(3 * std::max(mesh.vertices_, 0));
+	if(mesh.has_orco_) mesh.orcos_.reserve(3 * std::max(mesh.vertices_, 0));
+
+	while(true)
+	{
+		pos = (const char *) memchr(pos, '<', end - pos);
+		if(!pos) return false;
+		if(end - pos >= 4 && !strncmp(pos, "<!--", 4))
+		{
+			pos = findText__(pos + 4, end, "-->");
+			if(!pos) return false;
+			continue;
+		}
+		if(end - pos >= 2 && pos[1] == '/') //the closing </mesh> tag, as found by the document scan
+		{
+			//Points after the last normal get a zero normal
+			if(mesh.has_normals_) mesh.normals_.resize(mesh.points_.size(), 0.0);
+			return true;
+		}
+		pos = scanXmlTag__(pos + 1, end, name, name_length, attrs, self_closing);
+		if(!pos) return false;
+
+		if(name_length == 1 && name[0] == 'p')
+		{
+			double p[3] = {0.0, 0.0, 0.0}, op[3] = {0.0, 0.0, 0.0};
+			for(const auto &attr : attrs)
+			{
+				const size_t attr_length = attr.name_end_ - attr.name_;
+				const bool orco = (attr.name_[0] == 'o');
+				const char axis = orco ? attr.name_[1] : attr.name_[0];
+				if(attr_length != (orco ? 2U : 1U) || axis < 'x' || axis > 'z')
+				{
+					block.warnings_.push_back("XMLParser: Ignored wrong attribute " + std::string(attr.name_, attr.name_end_) + " in point");
+					continue;
+				}
+				(orco ? op : p)[axis - 'x'] = parseXmlDouble__(attr.value_, attr.value_end_);
+			}
+			mesh.points_.insert(mesh.points_.end(), p, p + 3);
+			if(mesh.has_orco_) mesh.orcos_.insert(mesh.orcos_.end(), op, op + 3);
+		}
+		else if(name_length == 1 && name[0] == 'n')
+		{
+			double n[3] = {0.0, 0.0, 0.0};
+			int components_read = 0;
+			for(const auto &attr : attrs)
+			{
+				if(attr.name_end_ - attr.name_ != 1 || attr.name_[0] < 'x' || attr.name_[0] > 'z')
+				{
+					block.warnings_.push_back("XMLParser: Ignored wrong attribute " + std::string(attr.name_, attr.name_end_) + " in normal");
+					continue;
+				}
+				n[attr.name_[0] - 'x'] = parseXmlDouble__(attr.value_, attr.value_end_);
+				++components_read;
+			}
+			if(components_read != 3 || mesh.points_.empty()) continue;
+			//The normal belongs to the last vertex added
+			mesh.has_normals_ = true;
+			mesh.normals_.resize(mesh.points_.size(), 0.0);
+			std::copy(n, n + 3, mesh.normals_.end() - 3);
+		}
+		else if(name_length == 1 && name[0] == 'f')
+		{
+			int abc[3] = {0, 0, 0}, uv_abc[3] = {0, 0, 0};
+			for(const auto &attr : attrs)
+			{
+				const size_t attr_length = attr.name_end_ - attr.name_;
+				if(attr_length == 1 && attr.name_[0] >= 'a' && attr.name_[0] <= 'c')
+				{
+					if(!parseXmlInt__(attr.value_, attr.value_end_, abc[attr.name_[0] - 'a'])) return false;
+				}
+				else if(attr_length == 4 && !strncmp(attr.name_, "uv_", 3) && attr.name_[3] >= 'a' && attr.name_[3] <= 'c')
+				{
+					if(!parseXmlInt__(attr.value_, attr.value_end_, uv_abc[attr.name_[3] - 'a'])) return false;
+				}
+				else if(attr_length == 1) block.warnings_.push_back("XMLParser: Ignored wrong attribute " + std::string(attr.name_, attr.name_end_) + " in face");
+			}
+			if(mesh.face_groups_.empty()) mesh.face_groups_.push_back(MeshData::FaceGroup());
+			MeshData::FaceGroup &group = mesh.face_groups_.back();
+			group.indices_.insert(group.indices_.end(), abc, abc + 3);
+			if(mesh.has_uv_) group.uv_indices_.insert(group.uv_indices_.end(), uv_abc, uv_abc + 3);
+		}
+		else if(name_length == 2 && !strncmp(name, "uv", 2))
+		{
+			float uv[2] = {0.f, 0.f};
+			for(const auto &attr : attrs)
+			{
+				if(attr.name_[0] != 'u' && attr.name_[0] != 'v')
+				{
+					block.warnings_.push_back("XMLParser: Ignored wrong attribute " + std::string(attr.name_, attr.name_end_) + " in uv");
+					continue;
+				}
+				float value = parseXmlDouble__(attr.value_, attr.value_end_);
+				if(!isValidFloat__(value))
+				{
+					block.warnings_.push_back("XMLParser: invalid value in \"uv\" xml entry: " + std::string(attr.name_, attr.name_end_) + "=" + std::string(attr.value_, attr.value_end_) + ". Replacing with 0.0.");
+					value = 0.f;
+				}
+				uv[attr.name_[0] == 'v' ? 1 : 0] = value;
+			}
+			mesh.uvs_.insert(mesh.uvs_.end(), uv, uv + 2);
+		}
+		else if(name_length == 12 && !strncmp(name, "set_material", 12) && !attrs.empty())
+		{
+			if(mesh.face_groups_.empty() || !mesh.face_groups_.back().indices_.empty()) mesh.face_groups_.push_back(MeshData::FaceGroup());
+			mesh.face_groups_.back().material_ = decodeXmlText__(attrs[0].value_, attrs[0].value_end_);
+		}
+	}
+}
+
+const MeshData *XmlMeshLoader::getMesh(int index)
+{
+	if(index < 0 || index >= (int) blocks_.size())
+	{
+		Y_ERROR << "XMLParser: Wrong mesh block index " << index << YENDL;
+		ok_ = false;
+		return nullptr;
+	}
+	MeshBlock &block = blocks_[index];
+	{
+		std::unique_lock<std::mutex> lock(mutx_);
+		block_decoded_.wait(lock, [&block] { return block.decoded_; });
+	}
+	for(const auto &warning : block.warnings_) Y_WARNING << warning << YENDL;
+	block.warnings_.clear();
+	if(!block.valid_)
+	{
+		Y_ERROR << "XMLParser: Malformed mesh element (mesh number " << index + 1 << " in the file)" << YENDL;
+		ok_ = false;
+		releaseMesh(index);
+		return nullptr;
+	}
+	return &block.mesh_;
+}
+
+void XmlMeshLoader::releaseMesh(int index)
+{
+	if(index < 0 || index >= (int) blocks_.size()) return;
+	blocks_[index].mesh_ = MeshData();
+	{
+		std::lock_guard<std::mutex> lock(mutx_);
+		consumed_ = std::max(consumed_, (size_t) index + 1);
+	}
+	window_moved_.notify_all();
+}
+
+bool XmlMeshLoader::addMesh(XmlParser &parser, int index)
+{
+	const MeshData *mesh = getMesh(index);
+	if(!mesh) return false;
+	addMeshData__(parser.scene_, parser.env_, *mesh, "XMLParser");
+	releaseMesh(index);
+	return true;
+}
+
+void addMeshData__(Scene *scene, RenderEnvironment *env, const MeshData &mesh, const char *parser_name)
+{
+	if(!scene->startGeometry()) Y_ERROR << parser_name << ": Invalid scene state on startGeometry()!" << YENDL;
+	// Get a new object ID if we did not get one
+	const ObjId_t id = (mesh.id_ == -1) ? scene->getNextFreeId() : (ObjId_t) mesh.id_;
+	if(!scene->startTriMesh(id, mesh.vertices_, mesh.faces_, mesh.has_orco_, mesh.has_uv_, mesh.type_, mesh.obj_pass_index_))
+	{
+		Y_ERROR << parser_name << ": Invalid scene state on startTriMesh()!" << YENDL;
+	}
+	const int num_vertices = mesh.points_.size() / 3;
+	if(num_vertices > 0) scene->addVertices(mesh.points_.data(), mesh.has_orco_ ? mesh.orcos_.data() : nullptr, num_vertices);
+	if(mesh.has_normals_ && num_vertices > 0) scene->addNormals(mesh.normals_.data(), num_vertices);
+	if(!mesh.uvs_.empty()) scene->addUvs(mesh.uvs_.data(), mesh.uvs_.size() / 2);
+	for(const auto &group : mesh.face_groups_)
+	{
+		const Material *mat = nullptr;
+		if(!group.material_.empty())
+		{
+			mat = env->getMaterial(group.material_);
+			if(!mat) Y_WARNING << parser_name << ": Unknown material!" << YENDL;
+		}
+		scene->addTriangles(group.indices_.data(), mesh.has_uv_ ? group.uv_indices_.data() : nullptr, group.indices_.size() / 3, mat);
+	}
+	if(!scene->endTriMesh()) Y_ERROR << parser_name << ": Invalid scene state on endTriMesh()!" << YENDL;
+	if(!scene->endGeometry()) Y_ERROR << parser_name << ": Invalid scene state on endGeometry()!" << YENDL;
+}
 #endif // HAVE_XML
 
-bool parseXmlFile__(const char *filename, Scene *scene, RenderEnvironment *env, ParamMap &render, std::string color_space_string, float input_gamma)
+bool parseXmlFile__(const char *filename, Scene *scene, RenderEnvironment *env, ParamMap &render, std::string color_space_string, float input_gamma, int parse_threads)
 {
 #if HAVE_XML
 
@@ -163,6 +636,25 @@ bool parseXmlFile__(const char *filename, Scene *scene, RenderEnvironment *env,
 
 	XmlParser parser(env, scene, render, input_color_space, input_gamma);
 
+	if(parse_threads != 1)
+	{
+		const MappedFile file(filename);
+		if(!file.isValid())
+		{
+			Y_ERROR << "XMLParser: Cannot open the file " << filename << YENDL;
+			return false;
+		}
+		XmlMeshLoader mesh_loader(file.data(), file.size(), parse_threads);
+		parser.mesh_loader_ = &mesh_loader;
+		const std::string &skeleton = mesh_loader.getSkeleton();
+		if(xmlSAXUserParseMemory(&my_handler__, &parser, skeleton.data(), (int) skeleton.size()) < 0 || !mesh_loader.isOk())
+		{
+			Y_ERROR << "XMLParser: Parsing the file " << filename << YENDL;
+			return false;
+		}
+		return true;
+	}
+
 	if(xmlSAXUserParseFile(&my_handler__, &parser, filename) < 0)
 	{
 		Y_ERROR << "XMLParser: Parsing the file " << filename << YENDL;
@@ -458,6 +950,16 @@ void startElScene__(XmlParser &parser, const char *element, const char **attrs)
 		}
 		parser.pushState(startElInstance__, endElInstance__, base_object_id);
 	}
+	else if(el == "yafaray_mesh_block" && parser.mesh_loader_)
+	{
+		int index = -1;
+		for(int n = 0; attrs[n]; ++n)
+		{
+			if(!strcmp(attrs[n], "index")) index = atoi(attrs[n + 1]);
+		}
+		parser.mesh_loader_->addMesh(parser, index);
+		parser.pushState(startElDummy__, endElDummy__);
+	}
 	else if(el == "curve")
 	{
 		CurveDat *cvd = new CurveDat();
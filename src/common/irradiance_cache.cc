@@ -0,0 +1,106 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/irradiance_cache.h"
+#include <cmath>
+
+BEGIN_YAFARAY
+
+IrradianceCache::IrradianceCache(float max_radius, float accuracy): accuracy_(accuracy), buckets_(new std::atomic<Record *>[num_buckets_]), num_records_(0)
+{
+	//a record can only be used closer than accuracy * radius, so looking in the neighbour cells is enough
+	inv_cell_size_ = 1.f / std::max(1.0e-6f, accuracy * max_radius);
+	for(unsigned int i = 0; i < num_buckets_; ++i) buckets_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+IrradianceCache::~IrradianceCache()
+{
+	for(unsigned int i = 0; i < num_buckets_; ++i)
+	{
+		Record *record = buckets_[i].load(std::memory_order_relaxed);
+		while(record)
+		{
+			Record *next = record->next_;
+			delete record;
+			record = next;
+		}
+	}
+}
+
+//! Cell coordinate clamped (NaN included) so that it and its neighbours fit in an int. The far away cells merged by the clamping only cost extra distance checks
+static inline int cellCoordinate__(float value)
+{
+	static constexpr int max_cell = 1 << 30;
+	const float cell = std::floor(value);
+	if(!(cell > (float) -max_cell)) return -max_cell;
+	if(cell >= (float) max_cell) return max_cell;
+	return (int) cell;
+}
+
+void IrradianceCache::cell(const Point3 &p, int &x, int &y, int &z) const
+{
+	x = cellCoordinate__(p.x_ * inv_cell_size_);
+	y = cellCoordinate__(p.y_ * inv_cell_size_);
+	z = cellCoordinate__(p.z_ * inv_cell_size_);
+}
+
+void IrradianceCache::insert(const Record &record)
+{
+	int x, y, z;
+	cell(record.p_, x, y, z);
+	std::atomic<Record *> &bucket = buckets_[hash(x, y, z)];
+	Record *new_record = new Record(record);
+	new_record->next_ = bucket.load(std::memory_order_relaxed);
+	while(!bucket.compare_exchange_weak(new_record->next_, new_record, std::memory_order_release, std::memory_order_relaxed));
+	num_records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool IrradianceCache::interpolate(const Point3 &p, const Vec3 &n, Rgb &irradiance) const
+{
+	int x, y, z;
+	cell(p, x, y, z);
+	float sum[3] = {0.f, 0.f, 0.f};
+	float weight_sum = 0.f;
+	for(int i = x - 1; i <= x + 1; ++i) for(int j = y - 1; j <= y + 1; ++j) for(int k = z - 1; k <= z + 1; ++k)
+	{
+		for(const Record *record = buckets_[hash(i, j, k)].load(std::memory_order_acquire); record; record = record->next_)
+		{
+			int rx, ry, rz;
+			cell(record->p_, rx, ry, rz);
+			if(rx != i || ry != j || rz != k) continue; //other cell in the same bucket
+			const Vec3 d = p - record->p_;
+			const float cos_n = n * record->n_;
+			if(cos_n <= 0.f) continue;
+			const float error = d.length() / record->radius_ + fSqrt__(std::max(0.f, 1.f - cos_n));
+			if(error >= accuracy_) continue;
+			//discard records in front of the point, as they may not see the same surroundings
+			if(d * (n + record->n_) < -0.1f * record->radius_) continue;
+			const float weight = 1.f / std::max(error, 1.0e-4f);
+			sum[0] += weight * (record->irradiance_.r_ + record->gradient_[0] * d);
+			sum[1] += weight * (record->irradiance_.g_ + record->gradient_[1] * d);
+			sum[2] += weight * (record->irradiance_.b_ + record->gradient_[2] * d);
+			weight_sum += weight;
+		}
+	}
+	if(weight_sum <= 0.f) return false;
+	const float inv_weight_sum = 1.f / weight_sum;
+	irradiance = Rgb(std::max(0.f, sum[0] * inv_weight_sum), std::max(0.f, sum[1] * inv_weight_sum), std::max(0.f, sum[2] * inv_weight_sum));
+	return true;
+}
+
+END_YAFARAY
@@ -728,6 +728,7 @@ bool KdTree<T>::intersect(const Ray &ray, float dist, T **tr, float &z, Intersec
 
 	if(!tree_bound_.cross(ray, a, b, dist))
 	{ return false; }
+	TraversalCounter traversal(RenderStats::thread());
 
 	IntersectData current_data, temp_data;
 	Vec3 inv_dir(1.0 / ray.dir_.x_, 1.0 / ray.dir_.y_, 1.0 / ray.dir_.z_); //was 1.f!
@@ -760,6 +761,7 @@ bool KdTree<T>::intersect(const Ray &ray, float dist, T **tr, float &z, Intersec
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			traversal.node();
 			int axis = curr_node->splitAxis();
 			float split_val = curr_node->splitPos();
 
@@ -812,6 +814,7 @@ bool KdTree<T>::intersect(const Ray &ray, float dist, T **tr, float &z, Intersec
 		}
 
 		uint32_t n_primitives = curr_node->nPrimitives();
+		traversal.leaf(n_primitives);
 		if(n_primitives == 1)
 		{
 			T *mp = curr_node->one_primitive_;
@@ -870,6 +873,7 @@ bool KdTree<T>::intersectS(const Ray &ray, float dist, T **tr, float shadow_bias
 
 	if(!tree_bound_.cross(ray, a, b, dist))
 		return false;
+	TraversalCounter traversal(RenderStats::thread());
 
 	IntersectData bary;
 	Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
@@ -900,6 +904,7 @@ bool KdTree<T>::intersectS(const Ray &ray, float dist, T **tr, float shadow_bias
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			traversal.node();
 			int axis = curr_node->splitAxis();
 			float split_val = curr_node->splitPos();
 
@@ -953,6 +958,7 @@ bool KdTree<T>::intersectS(const Ray &ray, float dist, T **tr, float shadow_bias
 
 		// Check for intersections inside leaf node
 		uint32_t n_primitives = curr_node->nPrimitives();
+		traversal.leaf(n_primitives);
 		if(n_primitives == 1)
 		{
 			T *mp = curr_node->one_primitive_;
@@ -1003,6 +1009,7 @@ bool KdTree<T>::intersectTs(RenderState &state, const Ray &ray, int max_depth, f
 
 	if(!tree_bound_.cross(ray, a, b, dist))
 		return false;
+	TraversalCounter traversal(*state.stats_);
 
 	IntersectData bary;
 	Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
@@ -1039,6 +1046,7 @@ bool KdTree<T>::intersectTs(RenderState &state, const Ray &ray, int max_depth, f
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			traversal.node();
 			int axis = curr_node->splitAxis();
 			float split_val = curr_node->splitPos();
 
@@ -1092,6 +1100,7 @@ bool KdTree<T>::intersectTs(RenderState &state, const Ray &ray, int max_depth, f
 
 		// Check for intersections inside leaf node
 		uint32_t n_primitives = curr_node->nPrimitives();
+		traversal.leaf(n_primitives);
 		if(n_primitives == 1)
 		{
 			T *mp = curr_node->one_primitive_;
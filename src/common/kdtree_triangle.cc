@@ -688,6 +688,7 @@ bool TriKdTree::intersect(const Ray &ray, float dist, Triangle **tr, float &z, I
 	float t_hit;
 
 	if(!tree_bound_.cross(ray, a, b, dist)) { return false; }
+	TraversalCounter traversal(RenderStats::thread());
 
 	IntersectData current_data, temp_data;
 	Vec3 inv_dir(1.0 / ray.dir_.x_, 1.0 / ray.dir_.y_, 1.0 / ray.dir_.z_); //was 1.f!
@@ -719,6 +720,7 @@ bool TriKdTree::intersect(const Ray &ray, float dist, Triangle **tr, float &z, I
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			traversal.node();
 			int axis = curr_node->splitAxis();
 			float split_val = curr_node->splitPos();
 
@@ -772,6 +774,7 @@ bool TriKdTree::intersect(const Ray &ray, float dist, Triangle **tr, float &z, I
 
 		// Check for intersections inside leaf node
 		uint32_t n_primitives = curr_node->nPrimitives();
+		traversal.leaf(n_primitives);
 
 		if(n_primitives == 1)
 		{
@@ -844,6 +847,7 @@ bool TriKdTree::intersectS(const Ray &ray, float dist, Triangle **tr, float shad
 
 	if(!tree_bound_.cross(ray, a, b, dist))
 		return false;
+	TraversalCounter traversal(RenderStats::thread());
 
 	IntersectData bary;
 	Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
@@ -875,6 +879,7 @@ bool TriKdTree::intersectS(const Ray &ray, float dist, Triangle **tr, float shad
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			traversal.node();
 			int axis = curr_node->splitAxis();
 			float split_val = curr_node->splitPos();
 
@@ -928,6 +933,7 @@ bool TriKdTree::intersectS(const Ray &ray, float dist, Triangle **tr, float shad
 
 		// Check for intersections inside leaf node
 		uint32_t n_primitives = curr_node->nPrimitives();
+		traversal.leaf(n_primitives);
 		if(n_primitives == 1)
 		{
 			Triangle *mp = curr_node->one_primitive_;
@@ -987,6 +993,7 @@ bool TriKdTree::intersectTs(RenderState &state, const Ray &ray, int max_depth, f
 
 	if(!tree_bound_.cross(ray, a, b, dist))
 		return false;
+	TraversalCounter traversal(*state.stats_);
 
 	IntersectData bary;
 
@@ -1037,6 +1044,7 @@ bool TriKdTree::intersectTs(RenderState &state, const Ray &ray, int max_depth, f
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			traversal.node();
 			int axis = curr_node->splitAxis();
 			float split_val = curr_node->splitPos();
 
@@ -1090,6 +1098,7 @@ bool TriKdTree::intersectTs(RenderState &state, const Ray &ray, int max_depth, f
 
 		// Check for intersections inside leaf node
 		uint32_t n_primitives = curr_node->nPrimitives();
+		traversal.leaf(n_primitives);
 
 		if(n_primitives == 1)
 		{
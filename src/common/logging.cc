@@ -28,9 +28,92 @@
 #include <iomanip>
 #include <fstream>
 #include <cmath>
+#include <chrono>
 
 BEGIN_YAFARAY
 
+//! Finished log record, as pushed by the logging threads in asynchronous mode
+struct LogRecord
+{
+	std::time_t datetime_ = 0;
+	int64_t time_stamp_ = 0; //!< steady clock time when the record was started, used to write the records in order
+	int verbosity_level_ = Logger::VlInfo;
+	bool continuation_ = false; //!< text following a YENDL in the same log statement, without its own header
+	std::string text_;
+};
+
+/*! Bounded lock-free queue with several producers, based on the sequence numbered ring of D. Vyukov. The logging
+	threads push their finished records and the writer thread pops them */
+class LogRecordQueue final
+{
+	public:
+		explicit LogRecordQueue(size_t capacity) : slots_(new Slot[capacity]), mask_(capacity - 1)
+		{
+			for(size_t i = 0; i < capacity; ++i) slots_[i].sequence_.store(i, std::memory_order_relaxed);
+		}
+		bool push(LogRecord &record)
+		{
+			size_t position = enqueue_position_.load(std::memory_order_relaxed);
+			Slot *slot;
+			while(true)
+			{
+				slot = &slots_[position & mask_];
+				const size_t sequence = slot->sequence_.load(std::memory_order_acquire);
+				const intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+				if(difference == 0)
+				{
+					if(enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+				}
+				else if(difference < 0) return false; //full
+				else position = enqueue_position_.load(std::memory_order_relaxed);
+			}
+			slot->record_ = std::move(record);
+			slot->sequence_.store(position + 1, std::memory_order_release);
+			return true;
+		}
+		bool pop(LogRecord &record)
+		{
+			Slot &slot = slots_[dequeue_position_ & mask_];
+			if(slot.sequence_.load(std::memory_order_acquire) != dequeue_position_ + 1) return false;
+			record = std::move(slot.record_);
+			slot.sequence_.store(dequeue_position_ + mask_ + 1, std::memory_order_release);
+			++dequeue_position_;
+			return true;
+		}
+
+	private:
+		struct Slot
+		{
+			std::atomic<size_t> sequence_;
+			LogRecord record_;
+		};
+		std::unique_ptr<Slot[]> slots_;
+		const size_t mask_;
+		char padding_1_[64]; //keeps the producer and consumer positions in different cache lines
+		std::atomic<size_t> enqueue_position_ {0};
+		char padding_2_[64];
+		size_t dequeue_position_ = 0; //only used by the writer thread
+};
+
+//! Log record being built by the current thread in asynchronous mode
+struct Logger::AsyncRecord
+{
+	~AsyncRecord() { if(pending_ && logger__.getAsyncLogging()) logger__.asyncRecordCommit(*this); }
+	std::ostringstream stream_;
+	std::time_t datetime_ = 0;
+	int64_t time_stamp_ = 0;
+	int verbosity_level_ = VlInfo;
+	bool filtered_ = true; //!< below both the console and log verbosity levels, so nothing is formatted
+	bool continuation_ = false;
+	bool pending_ = false;
+};
+
+Logger::AsyncRecord &Logger::threadAsyncRecord()
+{
+	static thread_local AsyncRecord record;
+	return record;
+}
+
 Logger::Logger()
 {
 }
@@ -41,6 +124,151 @@ Logger::Logger(const Logger &)	//We need to redefine the copy constructor to avo
 
 Logger::~Logger()
 {
+	std::lock_guard<std::mutex> lock(async_state_mutex_);
+	stopAsyncWriter();
+}
+
+void Logger::setAsyncLogging(bool async_logging)
+{
+	std::lock_guard<std::mutex> lock(async_state_mutex_);
+	if(async_logging == getAsyncLogging()) return;
+	if(async_logging)
+	{
+		async_queue_ = std::unique_ptr<LogRecordQueue>(new LogRecordQueue(4096));
+		async_stop_ = false;
+		async_writer_ = std::thread(&Logger::asyncWriterThread, this);
+		async_logging_ = true;
+	}
+	else
+	{
+		flush();
+		stopAsyncWriter();
+	}
+}
+
+/*! Must be called with async_state_mutex_ locked, or from the destructor. It does not commit the record of the calling thread,
+	as the destructor of the global logger can run after the thread_local records of the main thread have been destroyed */
+void Logger::stopAsyncWriter()
+{
+	if(!getAsyncLogging()) return;
+	waitAsyncWritten();
+	//The threads committing a record after this point write it synchronously. The queue is only destroyed once the
+	//threads that were already pushing to it are done, see asyncRecordCommit()
+	async_logging_.store(false);
+	while(async_producers_.load() > 0) std::this_thread::yield();
+	async_stop_ = true;
+	async_wake_.notify_one();
+	async_writer_.join();
+	async_queue_.reset();
+}
+
+void Logger::flush()
+{
+	if(!getAsyncLogging()) return;
+	AsyncRecord &record = threadAsyncRecord();
+	if(record.pending_) asyncRecordCommit(record);
+	waitAsyncWritten();
+}
+
+void Logger::waitAsyncWritten()
+{
+	const uint64_t pushed = async_pushed_.load();
+	async_wake_.notify_one();
+	std::unique_lock<std::mutex> lock(async_wake_mutex_);
+	async_written_cond_.wait(lock, [this, pushed] { return async_written_.load() >= pushed; });
+}
+
+std::ostream *Logger::asyncRecordStream()
+{
+	AsyncRecord &record = threadAsyncRecord();
+	if(record.filtered_) return nullptr;
+	record.pending_ = true;
+	return &record.stream_;
+}
+
+void Logger::asyncRecordManipulator(std::ostream & (manipulator)(std::ostream &))
+{
+	AsyncRecord &record = threadAsyncRecord();
+	if(record.filtered_) return;
+	if(manipulator == static_cast<std::ostream & (*)(std::ostream &)>(std::endl))
+	{
+		record.stream_ << '\n';
+		asyncRecordCommit(record);
+		record.continuation_ = true;
+	}
+	else
+	{
+		record.stream_ << manipulator;
+		record.pending_ = true;
+	}
+}
+
+void Logger::asyncRecordCommit(AsyncRecord &record)
+{
+	LogRecord log_record;
+	log_record.datetime_ = record.datetime_;
+	log_record.time_stamp_ = record.time_stamp_;
+	log_record.verbosity_level_ = record.verbosity_level_;
+	log_record.continuation_ = record.continuation_;
+	log_record.text_ = record.stream_.str();
+	record.stream_.str("");
+	record.pending_ = false;
+	//async_producers_ keeps the queue alive while it is used, in case another thread is switching asynchronous logging off
+	++async_producers_;
+	if(!async_logging_.load())
+	{
+		--async_producers_;
+		std::lock_guard<std::mutex> lock(mutx_);
+		writeLogRecord(log_record);
+		return;
+	}
+	while(!async_queue_->push(log_record))
+	{
+		async_wake_.notify_one();
+		std::this_thread::yield();
+	}
+	++async_pushed_;
+	--async_producers_;
+	if(log_record.verbosity_level_ <= VlWarning) async_wake_.notify_one();
+}
+
+void Logger::writeLogRecord(const LogRecord &log_record)
+{
+	if(!log_record.continuation_)
+	{
+		if(log_record.verbosity_level_ <= log_master_verbosity_level_) addMemoryLogEntry(log_record.verbosity_level_, log_record.datetime_, log_record.text_);
+		if(log_record.verbosity_level_ <= console_master_verbosity_level_) printConsoleHeader(log_record.verbosity_level_, log_record.datetime_);
+	}
+	else if(log_record.verbosity_level_ <= log_master_verbosity_level_ && !memory_log_.empty()) memory_log_.back().event_description_ += log_record.text_;
+	if(log_record.verbosity_level_ <= console_master_verbosity_level_) std::cout << log_record.text_;
+}
+
+void Logger::asyncWriterThread()
+{
+	std::vector<LogRecord> batch;
+	LogRecord record;
+	while(true)
+	{
+		batch.clear();
+		while(async_queue_->pop(record)) batch.push_back(std::move(record));
+		if(batch.empty())
+		{
+			if(async_stop_) break;
+			std::unique_lock<std::mutex> lock(async_wake_mutex_);
+			async_wake_.wait_for(lock, std::chrono::milliseconds(10));
+			continue;
+		}
+		std::stable_sort(batch.begin(), batch.end(), [](const LogRecord & a, const LogRecord & b) { return a.time_stamp_ < b.time_stamp_; });
+		mutx_.lock();
+		for(const auto &log_record : batch) writeLogRecord(log_record);
+		mutx_.unlock();
+		std::cout.flush();
+		{
+			std::lock_guard<std::mutex> lock(async_wake_mutex_);
+			async_written_ += batch.size();
+		}
+		async_written_cond_.notify_all();
+	}
 }
 
 
@@ -49,6 +277,7 @@ Logger::~Logger()
 void Logger::saveTxtLog(const std::string &name)
 {
 	if(!save_log_) return;
+	flush();
 
 	std::stringstream ss;
 
@@ -93,6 +322,7 @@ void Logger::saveTxtLog(const std::string &name)
 
 void Logger::saveHtmlLog(const std::string &name)
 {
+	flush();
 	if(!save_html_) return;
 
 	std::stringstream ss;
@@ -191,6 +421,7 @@ void Logger::saveHtmlLog(const std::string &name)
 
 void Logger::clearMemoryLog()
 {
+	flush();
 	memory_log_.clear();
 }
 
@@ -210,6 +441,21 @@ void Logger::clearAll()
 
 Logger &Logger::out(int verbosity_level)
 {
+	if(getAsyncLogging())
+	{
+		AsyncRecord &record = threadAsyncRecord();
+		if(record.pending_) asyncRecordCommit(record);
+		record.verbosity_level_ = verbosity_level;
+		record.filtered_ = (verbosity_level > console_master_verbosity_level_ && verbosity_level > log_master_verbosity_level_);
+		record.continuation_ = false;
+		if(!record.filtered_)
+		{
+			record.datetime_ = std::time(nullptr);
+			record.time_stamp_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+		return *this;
+	}
+
 #if !defined(_WIN32) || defined(__MINGW32__)
 	mutx_.lock();	//Don't lock if building with Visual Studio because it cause hangs when executing YafaRay in Windows 7 for some weird reason!
 #else
@@ -219,59 +465,62 @@ Logger &Logger::out(int verbosity_level)
 
 	std::time_t current_datetime = std::time(nullptr);
 
-	if(verbosity_level_ <= log_master_verbosity_level_)
-	{
-		if(previous_log_event_date_time_ == 0) previous_log_event_date_time_ = current_datetime;
-		double duration = std::difftime(current_datetime, previous_log_event_date_time_);
+	if(verbosity_level_ <= log_master_verbosity_level_) addMemoryLogEntry(verbosity_level_, current_datetime, "");
+	if(verbosity_level_ <= console_master_verbosity_level_) printConsoleHeader(verbosity_level_, current_datetime);
+
+	mutx_.unlock();
 
-		memory_log_.push_back(LogEntry(current_datetime, duration, verbosity_level_, ""));
+	return *this;
+}
 
-		previous_log_event_date_time_ = current_datetime;
-	}
+void Logger::addMemoryLogEntry(int verbosity_level, std::time_t datetime, const std::string &description)
+{
+	if(previous_log_event_date_time_ == 0) previous_log_event_date_time_ = datetime;
+	double duration = std::difftime(datetime, previous_log_event_date_time_);
 
-	if(verbosity_level_ <= console_master_verbosity_level_)
-	{
-		if(previous_console_event_date_time_ == 0) previous_console_event_date_time_ = current_datetime;
-		double duration = std::difftime(current_datetime, previous_console_event_date_time_);
+	memory_log_.push_back(LogEntry(datetime, duration, verbosity_level, description));
 
-		if(console_log_colors_enabled_)
+	previous_log_event_date_time_ = datetime;
+}
+
+void Logger::printConsoleHeader(int verbosity_level, std::time_t datetime)
+{
+	if(previous_console_event_date_time_ == 0) previous_console_event_date_time_ = datetime;
+	double duration = std::difftime(datetime, previous_console_event_date_time_);
+
+	if(console_log_colors_enabled_)
+	{
+		switch(verbosity_level)
 		{
-			switch(verbosity_level_)
-			{
-				case VlDebug:		std::cout << SetColor(Magenta) << "[" << printTime(current_datetime) << "] DEBUG"; break;
-				case VlVerbose:	std::cout << SetColor(Green) << "[" << printTime(current_datetime) << "] VERB"; break;
-				case VlInfo:		std::cout << SetColor(Green) << "[" << printTime(current_datetime) << "] INFO"; break;
-				case VlParams:		std::cout << SetColor(Cyan) << "[" << printTime(current_datetime) << "] PARM"; break;
-				case VlWarning:	std::cout << SetColor(Yellow) << "[" << printTime(current_datetime) << "] WARNING"; break;
-				case VlError:		std::cout << SetColor(Red) << "[" << printTime(current_datetime) << "] ERROR"; break;
-				default:			std::cout << SetColor(White) << "[" << printTime(current_datetime) << "] LOG"; break;
-			}
+			case VlDebug:		std::cout << SetColor(Magenta) << "[" << printTime(datetime) << "] DEBUG"; break;
+			case VlVerbose:	std::cout << SetColor(Green) << "[" << printTime(datetime) << "] VERB"; break;
+			case VlInfo:		std::cout << SetColor(Green) << "[" << printTime(datetime) << "] INFO"; break;
+			case VlParams:		std::cout << SetColor(Cyan) << "[" << printTime(datetime) << "] PARM"; break;
+			case VlWarning:	std::cout << SetColor(Yellow) << "[" << printTime(datetime) << "] WARNING"; break;
+			case VlError:		std::cout << SetColor(Red) << "[" << printTime(datetime) << "] ERROR"; break;
+			default:			std::cout << SetColor(White) << "[" << printTime(datetime) << "] LOG"; break;
 		}
-		else
+	}
+	else
+	{
+		switch(verbosity_level)
 		{
-			switch(verbosity_level_)
-			{
-				case VlDebug:		std::cout << "[" << printTime(current_datetime) << "] DEBUG"; break;
-				case VlVerbose:	std::cout << "[" << printTime(current_datetime) << "] VERB"; break;
-				case VlInfo:		std::cout << "[" << printTime(current_datetime) << "] INFO"; break;
-				case VlParams:		std::cout << "[" << printTime(current_datetime) << "] PARM"; break;
-				case VlWarning:	std::cout << "[" << printTime(current_datetime) << "] WARNING"; break;
-				case VlError:		std::cout << "[" << printTime(current_datetime) << "] ERROR"; break;
-				default:			std::cout << "[" << printTime(current_datetime) << "] LOG"; break;
-			}
+			case VlDebug:		std::cout << "[" << printTime(datetime) << "] DEBUG"; break;
+			case VlVerbose:	std::cout << "[" << printTime(datetime) << "] VERB"; break;
+			case VlInfo:		std::cout << "[" << printTime(datetime) << "] INFO"; break;
+			case VlParams:		std::cout << "[" << printTime(datetime) << "] PARM"; break;
+			case VlWarning:	std::cout << "[" << printTime(datetime) << "] WARNING"; break;
+			case VlError:		std::cout << "[" << printTime(datetime) << "] ERROR"; break;
+			default:			std::cout << "[" << printTime(datetime) << "] LOG"; break;
 		}
-
-		if(duration == 0) std::cout << ": ";
-		else std::cout << " (" << printDurationSimpleFormat(duration) << "): ";
-
-		if(console_log_colors_enabled_) std::cout << SetColor();
-
-		previous_console_event_date_time_ = current_datetime;
 	}
 
-	mutx_.unlock();
+	if(duration == 0) std::cout << ": ";
+	else std::cout << " (" << printDurationSimpleFormat(duration) << "): ";
 
-	return *this;
+	if(console_log_colors_enabled_) std::cout << SetColor();
+
+	previous_console_event_date_time_ = datetime;
 }
 
 int Logger::vlevelFromString(std::string str_v_level) const
@@ -18,6 +18,8 @@
 
 #include "common/photon.h"
 #include "common/file.h"
+#include "common/render_stats.h"
+#include "common/trace.h"
 
 BEGIN_YAFARAY
 
@@ -133,8 +135,19 @@ bool PhotonMap::save(const std::string &filename) const
 	return true;
 }
 
+void PhotonMap::swap(PhotonMap &map)
+{
+	photons_.swap(map.photons_);
+	std::swap(paths_, map.paths_);
+	std::swap(updated_, map.updated_);
+	std::swap(search_radius_, map.search_radius_);
+	std::swap(tree_, map.tree_);
+}
+
 void PhotonMap::updateTree()
 {
+	TraceScope trace_scope("photon kd-tree build", "photons");
+	trace_scope.arg("map", name_).arg("photons", photons_.size());
 	if(tree_) delete tree_;
 	if(photons_.size() > 0)
 	{
@@ -146,6 +159,7 @@ void PhotonMap::updateTree()
 
 int PhotonMap::gather(const Point3 &p, FoundPhoton *found, unsigned int k, float &sq_radius) const
 {
+	RenderStats::thread().add(RenderStats::PhotonLookups);
 	PhotonGather proc(k, p);
 	proc.photons_ = found;
 	tree_->lookup(p, proc, sq_radius);
@@ -154,6 +168,7 @@ int PhotonMap::gather(const Point3 &p, FoundPhoton *found, unsigned int k, float
 
 const Photon *PhotonMap::findNearest(const Point3 &p, const Vec3 &n, float dist) const
 {
+	RenderStats::thread().add(RenderStats::PhotonLookups);
 	NearestPhoton proc(p, n);
 	//float dist=std::numeric_limits<float>::infinity(); //really bad idea...
 	tree_->lookup(p, proc, dist);
@@ -0,0 +1,159 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/render_stats.h"
+#include "common/file.h"
+#include "common/logging.h"
+#include "utility/util_thread.h"
+#include <algorithm>
+#include <sstream>
+
+BEGIN_YAFARAY
+
+static std::mutex finished_threads_mutex__;
+static std::vector<RenderStats> finished_threads__; //!< Counters of the threads finished since the last RenderStats::collect()
+
+ThreadRenderStats::~ThreadRenderStats()
+{
+	if(empty()) return;
+	std::lock_guard<std::mutex> lock(finished_threads_mutex__);
+	finished_threads__.push_back(*this);
+}
+
+RenderStats RenderStats::collect(std::vector<RenderStats> *per_thread)
+{
+	RenderStats totals;
+	std::vector<RenderStats> threads;
+	{
+		std::lock_guard<std::mutex> lock(finished_threads_mutex__);
+		threads.swap(finished_threads__);
+	}
+	RenderStats &own = thread();
+	if(!own.empty())
+	{
+		threads.push_back(own);
+		own.reset();
+	}
+	for(const auto &stats : threads) totals.merge(stats);
+	if(per_thread) per_thread->swap(threads);
+	return totals;
+}
+
+const char *RenderStats::counterName(int counter)
+{
+	switch(counter)
+	{
+		case CameraRays: return "camera_rays";
+		case ShadowRays: return "shadow_rays";
+		case BsdfSamples: return "bsdf_samples";
+		case TracedRays: return "traced_rays";
+		case TraversalSteps: return "traversal_steps";
+		case TriangleTests: return "triangle_tests";
+		case PhotonLookups: return "photon_lookups";
+		case TextureFetches: return "texture_fetches";
+		default: return "unknown";
+	}
+}
+
+bool RenderStats::empty() const
+{
+	for(int i = 0; i < NumCounters; ++i) if(counters_[i] != 0) return false;
+	return true;
+}
+
+std::string RenderStats::print() const
+{
+	std::stringstream ss;
+	for(int i = 0; i < NumCounters; ++i)
+	{
+		if(counters_[i] == 0) continue;
+		if(ss.tellp() > 0) ss << ", ";
+		ss << counterName(i) << "=" << counters_[i];
+	}
+	return ss.str();
+}
+
+std::string RenderStats::toJson() const
+{
+	std::stringstream ss;
+	ss << "{";
+	for(int i = 0; i < NumCounters; ++i)
+	{
+		if(i > 0) ss << ", ";
+		ss << "\"" << counterName(i) << "\": " << counters_[i];
+	}
+	ss << "}";
+	return ss.str();
+}
+
+void RenderStatsReport::clear()
+{
+	passes_.clear();
+	totals_.reset();
+	pass_start_ = std::chrono::steady_clock::now();
+}
+
+void RenderStatsReport::endPass(const std::string &pass_name)
+{
+	const auto pass_end = std::chrono::steady_clock::now();
+	Pass pass;
+	pass.name_ = pass_name;
+	pass.seconds_ = std::chrono::duration<double>(pass_end - pass_start_).count();
+	pass_start_ = pass_end;
+	pass.totals_ = RenderStats::collect(&pass.threads_);
+	totals_.merge(pass.totals_);
+	Y_VERBOSE << "Render stats: " << pass_name << ": " << pass.seconds_ << "s, " << pass.totals_.print() << YENDL;
+	if(pass.threads_.size() > 1)
+	{
+		uint64_t min_steps = pass.threads_[0].get(RenderStats::TraversalSteps), max_steps = min_steps;
+		for(const auto &thread : pass.threads_)
+		{
+			min_steps = std::min(min_steps, thread.get(RenderStats::TraversalSteps));
+			max_steps = std::max(max_steps, thread.get(RenderStats::TraversalSteps));
+		}
+		Y_VERBOSE << "Render stats: " << pass_name << ": " << pass.threads_.size() << " threads, traversal steps per thread between " << min_steps << " and " << max_steps << YENDL;
+	}
+	passes_.push_back(std::move(pass));
+}
+
+std::string RenderStatsReport::toJson() const
+{
+	std::stringstream ss;
+	ss << "{" << std::endl << "  \"totals\": " << totals_.toJson() << "," << std::endl << "  \"passes\": [";
+	for(size_t i = 0; i < passes_.size(); ++i)
+	{
+		const Pass &pass = passes_[i];
+		ss << (i > 0 ? "," : "") << std::endl << "    {" << std::endl;
+		ss << "      \"name\": \"" << pass.name_ << "\"," << std::endl;
+		ss << "      \"seconds\": " << pass.seconds_ << "," << std::endl;
+		ss << "      \"totals\": " << pass.totals_.toJson() << "," << std::endl;
+		ss << "      \"threads\": [";
+		for(size_t j = 0; j < pass.threads_.size(); ++j) ss << (j > 0 ? "," : "") << std::endl << "        " << pass.threads_[j].toJson();
+		ss << std::endl << "      ]" << std::endl << "    }";
+	}
+	ss << std::endl << "  ]" << std::endl << "}" << std::endl;
+	return ss.str();
+}
+
+bool RenderStatsReport::saveJson(const std::string &file_path) const
+{
+	File file(file_path);
+	return file.save(toJson(), true);
+}
+
+END_YAFARAY
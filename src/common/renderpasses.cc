@@ -278,6 +278,13 @@ void RenderPasses::auxPassesGenerate()
 {
 	auxPassAdd(PassIntDebugSamplingFactor);	//This auxiliary pass will always be needed for material-specific number of samples calculation
 
+	if(feature_denoise_)	//The features guiding the denoiser
+	{
+		auxPassAdd(PassIntNormalSmooth);
+		auxPassAdd(PassIntZDepthNorm);
+		auxPassAdd(PassIntDiffuseColor);
+	}
+
 	for(size_t idx = 1; idx < int_passes_.size(); ++idx)
 	{
 		//If any internal pass needs an auxiliary internal pass and/or auxiliary Render pass, enable also the auxiliary passes.
@@ -370,6 +377,10 @@ IntPassTypes RenderPasses::intPassTypeFromString(std::string int_pass_type_strin
 
 ExternalPassTileTypes RenderPasses::tileType(int ext_pass_index) const { return ext_passes_.at(ext_pass_index).tile_type_; }
 
+bool RenderPasses::extPassHalfFloat(int ext_pass_index) const { return ext_passes_.at(ext_pass_index).half_float_; }
+
+void RenderPasses::setExtPassHalfFloat(int ext_pass_index, bool half_float) { ext_passes_.at(ext_pass_index).half_float_ = half_float; }
+
 IntPassTypes RenderPasses::intPassTypeFromExtPassIndex(int ext_pass_index) const
 {
 	if(extPassesSize() > ext_pass_index) return ext_passes_.at(ext_pass_index).int_pass_type_;
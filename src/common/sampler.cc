@@ -0,0 +1,90 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/sampler.h"
+#include "common/logging.h"
+
+BEGIN_YAFARAY
+
+Sampler *Sampler::factory(const std::string &name)
+{
+	if(name == "sobol") return new OwenSobolSampler();
+	if(name != "halton") Y_WARNING << "Sampler: unknown sampler \"" << name << "\", using \"halton\"" << YENDL;
+	return nullptr;
+}
+
+// the first dimension is the van der Corput sequence, the others use the primitive polynomials and initial direction numbers of Joe and Kuo
+const uint32_t OwenSobolSampler::directions_[4][32] =
+{
+	{ 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000, 0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000, 0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100, 0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+	{ 0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000, 0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000, 0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00, 0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff },
+	{ 0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000, 0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000, 0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500, 0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555 },
+	{ 0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000, 0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000, 0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00, 0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093 },
+};
+
+static inline uint32_t reverseBits__(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+uint32_t OwenSobolSampler::sobol(uint32_t index, int dimension)
+{
+	uint32_t x = 0;
+	for(int bit = 0; index; index >>= 1, ++bit)
+	{
+		if(index & 1) x ^= directions_[dimension][bit];
+	}
+	return x;
+}
+
+uint32_t OwenSobolSampler::nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+	// Laine-Karras style permutation, which only lets each bit be changed by the bits below it, applied to the reversed bits
+	x = reverseBits__(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits__(x);
+}
+
+uint32_t OwenSobolSampler::hashCombine(uint32_t seed, uint32_t value)
+{
+	seed ^= value + 0x9e3779b9u + (seed << 6) + (seed >> 2);
+	// final mix of MurmurHash3, so that close seeds give unrelated scrambles
+	seed ^= seed >> 16;
+	seed *= 0x85ebca6bu;
+	seed ^= seed >> 13;
+	seed *= 0xc2b2ae35u;
+	return seed ^ (seed >> 16);
+}
+
+float OwenSobolSampler::get(uint32_t index, int dimension, uint32_t seed) const
+{
+	const uint32_t group_seed = hashCombine(seed, dimension / 4);
+	const uint32_t shuffled_index = nestedUniformScramble(index, group_seed);
+	const uint32_t x = nestedUniformScramble(sobol(shuffled_index, dimension % 4), hashCombine(group_seed, dimension % 4));
+	return (x >> 8) * (1.f / 16777216.f); //24 bits, so that the result is always below 1
+}
+
+END_YAFARAY
@@ -29,6 +29,8 @@
 #include "common/sysinfo.h"
 #include "common/triangle.h"
 #include "common/kdtree_generic.h"
+#include "common/trace.h"
+#include <atomic>
 #include <iostream>
 #include <limits>
 #include <sstream>
@@ -685,6 +687,118 @@ int Scene::addUv(float u, float v)
 	return -1;
 }
 
+//! Grows the capacity of v geometrically so it can take "extra" more elements without reallocating
+template <typename T> static void reserveExtra__(std::vector<T> &v, size_t extra)
+{
+	const size_t needed = v.size() + extra;
+	if(needed > v.capacity()) v.reserve(std::max(needed, 2 * v.capacity()));
+}
+
+int Scene::addVertices(const double *vertices, const double *orcos, int num_vertices)
+{
+	if(state_.stack_.front() != Object || num_vertices <= 0) return -1;
+	if(state_.cur_obj_->type_ != TRIM)
+	{
+		int first_id = -1;
+		for(int i = 0; i < num_vertices; ++i)
+		{
+			const double *v = vertices + 3 * i;
+			int id;
+			if(orcos) id = addVertex(Point3(v[0], v[1], v[2]), Point3(orcos[3 * i], orcos[3 * i + 1], orcos[3 * i + 2]));
+			else id = addVertex(Point3(v[0], v[1], v[2]));
+			if(i == 0) first_id = id;
+		}
+		return first_id;
+	}
+
+	std::vector<Point3> &points = state_.cur_obj_->obj_->points_;
+	const int stride = orcos ? 2 : 1;
+	reserveExtra__(points, stride * num_vertices);
+	for(int i = 0; i < num_vertices; ++i)
+	{
+		const double *v = vertices + 3 * i;
+		points.push_back(Point3(v[0], v[1], v[2]));
+		if(orcos) points.push_back(Point3(orcos[3 * i], orcos[3 * i + 1], orcos[3 * i + 2]));
+	}
+	state_.cur_obj_->last_vert_id_ = points.size() / stride - 1;
+	return (int)state_.cur_obj_->last_vert_id_ - num_vertices + 1;
+}
+
+void Scene::addNormals(const double *normals, int num_normals)
+{
+	if(mode_ != 0)
+	{
+		Y_WARNING << "Normal exporting is only supported for triangle mode" << YENDL;
+		return;
+	}
+	if(state_.stack_.front() != Object || num_normals <= 0) return;
+	TriangleObject *obj = state_.cur_obj_->obj_;
+	const int first_id = (int)state_.cur_obj_->last_vert_id_ - num_normals + 1;
+	if(first_id < 0 || state_.cur_obj_->last_vert_id_ >= obj->points_.size())
+	{
+		Y_WARNING << "Scene: more vertex normals (" << num_normals << ") than vertices in the mesh, ignoring them" << YENDL;
+		return;
+	}
+	if(obj->normals_.size() < obj->points_.size()) obj->normals_.resize(obj->points_.size());
+	for(int i = 0; i < num_normals; ++i)
+	{
+		const double *n = normals + 3 * i;
+		obj->normals_[first_id + i] = Normal(n[0], n[1], n[2]);
+	}
+	obj->normals_exported_ = true;
+}
+
+bool Scene::addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat)
+{
+	if(state_.stack_.front() != Object) return false;
+	if(state_.cur_obj_->type_ != TRIM)
+	{
+		for(int i = 0; i < num_triangles; ++i)
+		{
+			const int *t = indices + 3 * i;
+			if(uv_indices)
+			{
+				const int *uv = uv_indices + 3 * i;
+				if(!addTriangle(t[0], t[1], t[2], uv[0], uv[1], uv[2], mat)) return false;
+			}
+			else if(!addTriangle(t[0], t[1], t[2], mat)) return false;
+		}
+		return true;
+	}
+	if(num_triangles <= 0) return true;
+
+	TriangleObject *obj = state_.cur_obj_->obj_;
+	//With orco the vertex indices are duplicated, but the normal indices are not
+	const int point_index_scale = state_.orco_ ? 2 : 1;
+	reserveExtra__(obj->triangles_, num_triangles);
+	for(int i = 0; i < num_triangles; ++i)
+	{
+		const int *t = indices + 3 * i;
+		Triangle tri(t[0] * point_index_scale, t[1] * point_index_scale, t[2] * point_index_scale, obj);
+		tri.setMaterial(mat);
+		if(obj->normals_exported_)
+		{
+			tri.na_ = t[0];
+			tri.nb_ = t[1];
+			tri.nc_ = t[2];
+		}
+		obj->addTriangle(tri);
+	}
+	state_.cur_tri_ = &obj->triangles_.back();
+	if(uv_indices) obj->uv_offsets_.insert(obj->uv_offsets_.end(), uv_indices, uv_indices + 3 * num_triangles);
+	return true;
+}
+
+int Scene::addUvs(const float *uvs, int num_uvs)
+{
+	if(state_.stack_.front() != Object || num_uvs <= 0) return -1;
+	std::vector<Uv> &uv_values = (state_.cur_obj_->type_ == TRIM) ? state_.cur_obj_->obj_->uv_values_ : state_.cur_obj_->mobj_->uv_values_;
+	const int first_id = (int)uv_values.size();
+	reserveExtra__(uv_values, num_uvs);
+	for(int i = 0; i < num_uvs; ++i) uv_values.push_back(Uv(uvs[2 * i], uvs[2 * i + 1]));
+	return first_id;
+}
+
 bool Scene::addLight(Light *l)
 {
 	if(l != 0)
@@ -699,16 +813,19 @@ bool Scene::addLight(Light *l)
 
 void Scene::setCamera(Camera *cam)
 {
+	if(cam != camera_) state_.changes_ |= CCamera;
 	camera_ = cam;
 }
 
 void Scene::setImageFilm(ImageFilm *film)
 {
+	if(film != image_film_) state_.changes_ |= CFilm;
 	image_film_ = film;
 }
 
 void Scene::setBackground(Background *bg)
 {
+	if(bg != background_) state_.changes_ |= CMaterial;
 	background_ = bg;
 }
 
@@ -716,14 +833,14 @@ void Scene::setSurfIntegrator(SurfaceIntegrator *s)
 {
 	surf_integrator_ = s;
 	surf_integrator_->setScene(this);
-	state_.changes_ |= COther;
+	state_.changes_ |= CIntegrator;
 }
 
 void Scene::setVolIntegrator(VolumeIntegrator *v)
 {
 	vol_integrator_ = v;
 	vol_integrator_->setScene(this);
-	state_.changes_ |= COther;
+	state_.changes_ |= CIntegrator;
 }
 
 Background *Scene::getBackground() const
@@ -783,6 +900,7 @@ void Scene::setAntialiasing(int num_samples, int num_passes, int inc_samples, do
 */
 bool Scene::update()
 {
+	TraceScope trace_scope("scene update", "scene");
 	Y_VERBOSE << "Scene: Mode \"" << ((mode_ == 0) ? "Triangle" : "Universal") << "\"" << YENDL;
 	if(!camera_ || !image_film_) return false;
 	if(state_.changes_ & CGeom)
@@ -815,7 +933,11 @@ bool Scene::update()
 
 					if(dat.type_ == TRIM) insert += dat.obj_->getPrimitives(insert);
 				}
-				tree_ = new TriKdTree(tris, nprims, -1, 1, 0.8, 0.33 /* -1, 1.2, 0.40 */);
+				{
+					TraceScope trace_tree("kd-tree build", "scene");
+					trace_tree.arg("primitives", nprims);
+					tree_ = new TriKdTree(tris, nprims, -1, 1, 0.8, 0.33 /* -1, 1.2, 0.40 */);
+				}
 				delete [] tris;
 				scene_bound_ = tree_->getBound();
 				Y_VERBOSE << "Scene: New scene bound is:" <<
@@ -854,7 +976,11 @@ bool Scene::update()
 				{
 					insert += i->second->getPrimitives(insert);
 				}
-				vtree_ = new KdTree<Primitive>(tris, nprims, -1, 1, 0.8, 0.33 /* -1, 1.2, 0.40 */);
+				{
+					TraceScope trace_tree("kd-tree build", "scene");
+					trace_tree.arg("primitives", nprims);
+					vtree_ = new KdTree<Primitive>(tris, nprims, -1, 1, 0.8, 0.33 /* -1, 1.2, 0.40 */);
+				}
 				delete [] tris;
 				scene_bound_ = vtree_->getBound();
 				Y_VERBOSE << "Scene: New scene bound is:" << YENDL <<
@@ -871,7 +997,14 @@ bool Scene::update()
 		}
 	}
 
-	for(unsigned int i = 0; i < lights_.size(); ++i) lights_[i]->init(*this);
+	// the light distributions and anything else computed from the scene contents are kept while they do not change
+	if(state_.changes_ & CContent)
+	{
+		static std::atomic<unsigned int> last_content_revision(0);
+		content_revision_ = ++last_content_revision;
+		for(unsigned int i = 0; i < lights_.size(); ++i) lights_[i]->init(*this);
+	}
+	else Y_VERBOSE << "Scene: Geometry, lights and materials unchanged since the last render, reusing the kd-tree and light distributions" << YENDL;
 
 	if(!surf_integrator_)
 	{
@@ -879,10 +1012,11 @@ bool Scene::update()
 		return false;
 	}
 
-	if(state_.changes_ != CNone)
+	if(state_.changes_ != CNone) //the integrators may keep data depending on the camera, the photon maps are reused by their scene content revision
 	{
 		std::stringstream inte_settings;
 
+		TraceScope trace_preprocess("integrator preprocess", "scene");
 		bool success = (surf_integrator_->preprocess() && vol_integrator_->preprocess());
 
 		if(!success) return false;
@@ -968,6 +1102,7 @@ bool Scene::isShadowed(RenderState &state, const Ray &ray, float &obj_index, flo
 	float dis;
 	if(ray.tmax_ < 0) dis = std::numeric_limits<float>::infinity();
 	else  dis = sray.tmax_ - 2 * sray.tmin_;
+	state.stats_->add(RenderStats::ShadowRays);
 	if(mode_ == 0)
 	{
 		Triangle *hitt = nullptr;
@@ -1000,10 +1135,11 @@ bool Scene::isShadowed(RenderState &state, const Ray &ray, int max_depth, Rgb &f
 	float dis;
 	if(ray.tmax_ < 0) dis = std::numeric_limits<float>::infinity();
 	else  dis = sray.tmax_ - 2 * sray.tmin_;
+	state.stats_->add(RenderStats::ShadowRays);
 	filt = Rgb(1.0);
 	void *odat = state.userdata_;
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(((size_t)&userdata[7]) & (~7));  // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(getUserDataSize());
 	bool isect = false;
 	if(mode_ == 0)
 	{
@@ -1034,6 +1170,11 @@ bool Scene::isShadowed(RenderState &state, const Ray &ray, int max_depth, Rgb &f
 	return isect;
 }
 
+double Scene::getRenderTime() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start_).count();
+}
+
 bool Scene::render()
 {
 	sig_mutex_.lock();
@@ -1042,6 +1183,9 @@ bool Scene::render()
 
 	bool success = false;
 
+	render_stats_.clear();
+	RenderStats::collect(); //discards anything counted by this thread before the render
+
 	const std::map<std::string, Camera *> *camera_table = env_->getCameraTable();
 
 	if(camera_table->size() == 0)
@@ -1055,7 +1199,9 @@ bool Scene::render()
 		int num_view = distance(camera_table->begin(), cam_table_entry);
 		Camera *cam = cam_table_entry->second;
 		setCamera(cam);
+		render_start_ = std::chrono::steady_clock::now();
 		if(!update()) return false;
+		render_stats_.endPass("setup");
 
 		success = surf_integrator_->render(num_view, image_film_);
 
@@ -1063,6 +1209,8 @@ bool Scene::render()
 		image_film_->flush(num_view);
 	}
 
+	Y_INFO << "Render stats: " << render_stats_.getTotals().print() << YENDL;
+
 	return success;
 }
 
@@ -1094,6 +1242,7 @@ bool Scene::addObject(ObjectGeometric *obj, ObjId_t &id)
 	{
 		//create new triangle object:
 		objects_[id] = obj;
+		state_.changes_ |= CGeom;
 		return true;
 	}
 	else
@@ -1120,6 +1269,7 @@ bool Scene::addInstance(ObjId_t base_object_id, const Matrix4 &obj_to_world)
 		ObjData &base = meshes_[base_object_id];
 
 		od.obj_ = new TriangleObjectInstance(base.obj_, obj_to_world);
+		state_.changes_ |= CGeom;
 
 		return true;
 	}
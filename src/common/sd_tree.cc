@@ -0,0 +1,252 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/sd_tree.h"
+#include "utility/util_math_optimizations.h"
+#include <algorithm>
+#include <cmath>
+
+BEGIN_YAFARAY
+
+static constexpr float inv_4_pi__ = 0.25f * M_1_PI;
+static constexpr float one_minus_epsilon__ = 0.99999994f;
+
+static inline void dirToSquare__(const Vec3 &dir, float &x, float &y)
+{
+	x = std::min(std::max(0.5f * (dir.z_ + 1.f), 0.f), one_minus_epsilon__);
+	float phi = std::atan2(dir.y_, dir.x_);
+	if(phi < 0.f) phi += M_2PI;
+	y = std::min(std::max(phi * (float) M_1_2PI, 0.f), one_minus_epsilon__);
+}
+
+static inline Vec3 squareToDir__(float x, float y)
+{
+	const float cos_theta = 2.f * x - 1.f;
+	const float sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+	const float phi = M_2PI * y;
+	return Vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+}
+
+int DirectionalQuadTree::quadrant(float &x, float &y)
+{
+	int q = 0;
+	x *= 2.f;
+	y *= 2.f;
+	if(x >= 1.f) { x -= 1.f; q |= 1; }
+	if(y >= 1.f) { y -= 1.f; q |= 2; }
+	return q;
+}
+
+void DirectionalQuadTree::record(const Vec3 &dir, float value)
+{
+	if(!(value > 0.f) || !std::isfinite(value)) return;
+	float x, y;
+	dirToSquare__(dir, x, y);
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const int q = quadrant(x, y);
+		Node &node = nodes_[node_id];
+		if(node.children_[q] == 0)
+		{
+			node.sums_[q].add(value);
+			return;
+		}
+		node_id = node.children_[q];
+	}
+}
+
+void DirectionalQuadTree::propagate()
+{
+	// children are always stored after their parents, so going backwards visits the children first
+	for(size_t i = nodes_.size(); i-- > 0;)
+	{
+		Node &node = nodes_[i];
+		for(int q = 0; q < 4; ++q)
+		{
+			if(node.children_[q] != 0) node.sums_[q] = nodes_[node.children_[q]].energy();
+		}
+	}
+}
+
+float DirectionalQuadTree::getEnergy() const
+{
+	return nodes_[0].energy();
+}
+
+float DirectionalQuadTree::pdf(const Vec3 &dir) const
+{
+	if(!(getEnergy() > 0.f)) return inv_4_pi__;
+	float x, y;
+	dirToSquare__(dir, x, y);
+	float density = inv_4_pi__;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const int q = quadrant(x, y);
+		const Node &node = nodes_[node_id];
+		const float sum = node.sums_[q].get();
+		if(!(sum > 0.f)) return 0.f;
+		density *= 4.f * sum / node.energy();
+		if(node.children_[q] == 0) return density;
+		node_id = node.children_[q];
+	}
+}
+
+Vec3 DirectionalQuadTree::sample(float s_1, float s_2) const
+{
+	if(!(getEnergy() > 0.f)) return squareToDir__(s_1, s_2);
+	float x = 0.f, y = 0.f, size = 1.f;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		// choose the column with s_1 and the quadrant in that column with s_2, reusing the remainders of both
+		const float left = node.sums_[0].get() + node.sums_[2].get();
+		const float prob_left = left / node.energy();
+		int q = 0;
+		if(s_1 < prob_left) s_1 /= prob_left;
+		else
+		{
+			s_1 = (s_1 - prob_left) / (1.f - prob_left);
+			q |= 1;
+		}
+		const float bottom = node.sums_[q].get(), top = node.sums_[q | 2].get();
+		const float prob_bottom = bottom / (bottom + top);
+		if(s_2 < prob_bottom) s_2 /= prob_bottom;
+		else
+		{
+			s_2 = (s_2 - prob_bottom) / (1.f - prob_bottom);
+			q |= 2;
+		}
+		s_1 = std::min(s_1, one_minus_epsilon__);
+		s_2 = std::min(s_2, one_minus_epsilon__);
+		size *= 0.5f;
+		if(q & 1) x += size;
+		if(q & 2) y += size;
+		if(node.children_[q] == 0) break;
+		node_id = node.children_[q];
+	}
+	return squareToDir__(x + size * s_1, y + size * s_2);
+}
+
+void DirectionalQuadTree::rebuild(const DirectionalQuadTree &recorded, float threshold, int max_depth)
+{
+	// built apart and swapped at the end, as the recorded tree can be this same tree
+	std::vector<Node> nodes(1);
+	const Node &root = recorded.nodes_[0];
+	const float sums[4] = { root.sums_[0].get(), root.sums_[1].get(), root.sums_[2].get(), root.sums_[3].get() };
+	const float total = root.energy();
+	if(total > 0.f) rebuildNode(nodes, 0, recorded, 0, sums, total, threshold, 1, max_depth);
+	nodes_.swap(nodes);
+}
+
+void DirectionalQuadTree::rebuildNode(std::vector<Node> &nodes, uint32_t node_id, const DirectionalQuadTree &recorded, int recorded_id, const float sums[4], float total, float threshold, int depth, int max_depth)
+{
+	for(int q = 0; q < 4; ++q)
+	{
+		if(depth >= max_depth || sums[q] <= threshold * total) continue;
+		// the quadrants holding more than the threshold energy get children; below the leaves of the recorded tree the energy is assumed evenly spread
+		float child_sums[4];
+		int recorded_child = -1;
+		if(recorded_id >= 0 && recorded.nodes_[recorded_id].children_[q] != 0)
+		{
+			recorded_child = recorded.nodes_[recorded_id].children_[q];
+			for(int c = 0; c < 4; ++c) child_sums[c] = recorded.nodes_[recorded_child].sums_[c].get();
+		}
+		else std::fill(child_sums, child_sums + 4, 0.25f * sums[q]);
+		const uint32_t child_id = nodes.size();
+		nodes.emplace_back();
+		nodes[node_id].children_[q] = child_id;
+		rebuildNode(nodes, child_id, recorded, recorded_child, child_sums, total, threshold, depth + 1, max_depth);
+	}
+}
+
+SdTree::SdTree(const Bound &bound) : nodes_(1), leaves_(1)
+{
+	Point3 a, g;
+	bound.get(a, g);
+	// slightly enlarged, so that no surface lies exactly on the boundary
+	const Vec3 margin = 0.01f * (g - a) + Vec3(1e-4f);
+	origin_ = a - margin;
+	const Vec3 size = (g - a) + 2.f * margin;
+	inv_size_ = Vec3(1.f / size.x_, 1.f / size.y_, 1.f / size.z_);
+}
+
+SdTree::Leaf &SdTree::lookup(const Point3 &p)
+{
+	float coords[3] = { (p.x_ - origin_.x_) * inv_size_.x_, (p.y_ - origin_.y_) * inv_size_.y_, (p.z_ - origin_.z_) * inv_size_.z_ };
+	for(float &c : coords) c = std::min(std::max(c, 0.f), one_minus_epsilon__);
+	uint32_t node_id = 0;
+	while(nodes_[node_id].children_[0] != 0)
+	{
+		const Node &node = nodes_[node_id];
+		float &c = coords[node.axis_];
+		c *= 2.f;
+		if(c < 1.f) node_id = node.children_[0];
+		else
+		{
+			c -= 1.f;
+			node_id = node.children_[1];
+		}
+	}
+	return leaves_[nodes_[node_id].leaf_];
+}
+
+void SdTree::split(uint32_t node_id, uint32_t max_samples, int depth)
+{
+	static constexpr int max_spatial_depth = 48;
+	const uint32_t leaf_id = nodes_[node_id].leaf_;
+	const uint32_t samples = leaves_[leaf_id].samples_.load(std::memory_order_relaxed);
+	if(samples <= max_samples || depth >= max_spatial_depth) return;
+
+	// both halves start with the distributions of the parent and half of its samples
+	leaves_[leaf_id].samples_.store(samples / 2, std::memory_order_relaxed);
+	leaves_.push_back(leaves_[leaf_id]);
+	const int child_axis = (nodes_[node_id].axis_ + 1) % 3;
+	const uint32_t child_ids[2] = { (uint32_t) nodes_.size(), (uint32_t) nodes_.size() + 1 };
+	nodes_.resize(nodes_.size() + 2);
+	nodes_[child_ids[0]].leaf_ = leaf_id;
+	nodes_[child_ids[1]].leaf_ = leaves_.size() - 1;
+	for(const uint32_t child_id : child_ids) nodes_[child_id].axis_ = child_axis;
+	nodes_[node_id].children_[0] = child_ids[0];
+	nodes_[node_id].children_[1] = child_ids[1];
+	for(const uint32_t child_id : child_ids) split(child_id, max_samples, depth + 1);
+}
+
+void SdTree::update(int pass_samples)
+{
+	static constexpr float spatial_threshold = 12000.f;
+	static constexpr float directional_threshold = 0.01f;
+	static constexpr int max_directional_depth = 20;
+	const uint32_t max_samples = spatial_threshold * std::sqrt((float) pass_samples);
+	const size_t n_nodes = nodes_.size();
+	for(size_t i = 0; i < n_nodes; ++i)
+	{
+		if(nodes_[i].children_[0] == 0) split(i, max_samples, 0);
+	}
+	for(Leaf &leaf : leaves_)
+	{
+		leaf.recording_.propagate();
+		if(leaf.recording_.getEnergy() > 0.f) leaf.sampling_ = leaf.recording_;
+		leaf.recording_.rebuild(leaf.recording_, directional_threshold, max_directional_depth);
+		leaf.samples_.store(0, std::memory_order_relaxed);
+	}
+}
+
+END_YAFARAY
@@ -0,0 +1,121 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/trace.h"
+#include "common/file.h"
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+BEGIN_YAFARAY
+
+TraceRecorder trace_recorder__;
+
+void TraceRecorder::setEnabled(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if(enabled)
+	{
+		events_.clear();
+		origin_.store(clockMicroseconds(), std::memory_order_relaxed);
+	}
+	enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t TraceRecorder::clockMicroseconds()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t TraceRecorder::now() const
+{
+	return clockMicroseconds() - origin_.load(std::memory_order_relaxed);
+}
+
+int TraceRecorder::threadIndex()
+{
+	static std::atomic<int> next_index { 0 };
+	static thread_local const int index = next_index++;
+	return index;
+}
+
+void TraceRecorder::addEvent(const char *name, const char *category, int64_t start, int64_t end, std::string &&args, int worker_thread)
+{
+	const int thread = (worker_thread >= 0) ? worker_thread_tid_base_ + worker_thread : threadIndex();
+	std::lock_guard<std::mutex> lock(mutex_);
+	events_.push_back({name, category, start, end - start, thread, std::move(args)});
+}
+
+void TraceRecorder::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	events_.clear();
+}
+
+std::string TraceRecorder::toJson() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::stringstream ss;
+	ss << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	std::set<int> threads;
+	for(size_t i = 0; i < events_.size(); ++i)
+	{
+		const Event &event = events_[i];
+		threads.insert(event.thread_);
+		ss << (i > 0 ? "," : "") << std::endl;
+		ss << "{\"name\": \"" << event.name_ << "\", \"cat\": \"" << event.category_ << "\", \"ph\": \"X\", \"ts\": " << event.start_ << ", \"dur\": " << event.duration_;
+		ss << ", \"pid\": 1, \"tid\": " << event.thread_ << ", \"args\": {" << event.args_ << "}}";
+	}
+	for(const int thread : threads)
+	{
+		ss << "," << std::endl << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread << ", \"args\": {\"name\": \"";
+		if(thread >= worker_thread_tid_base_) ss << "worker thread " << thread - worker_thread_tid_base_ << "\"}}";
+		else ss << "thread " << thread << "\"}}";
+	}
+	ss << std::endl << "]}" << std::endl;
+	return ss.str();
+}
+
+std::string TraceRecorder::jsonString(const std::string &value)
+{
+	std::string result = "\"";
+	for(const char c : value)
+	{
+		if(c == '"' || c == '\\')
+		{
+			result += '\\';
+			result += c;
+		}
+		else if((unsigned char) c < 0x20)
+		{
+			char escaped[8];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int) c);
+			result += escaped;
+		}
+		else result += c;
+	}
+	return result + "\"";
+}
+
+bool TraceRecorder::saveJson(const std::string &file_path) const
+{
+	File file(file_path);
+	return file.save(toJson(), true);
+}
+
+END_YAFARAY
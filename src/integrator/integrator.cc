@@ -21,6 +21,7 @@
 #include "integrator/integrator_bidirectional.h"
 #include "integrator/integrator_direct_light.h"
 #include "integrator/integrator_path_tracer.h"
+#include "integrator/integrator_path_tracer_wavefront.h"
 #include "integrator/integrator_photon_mapping.h"
 #include "integrator/integrator_sppm.h"
 #include "integrator/integrator_debug.h"
@@ -45,6 +46,7 @@ Integrator *Integrator::factory(ParamMap &params, RenderEnvironment &render)
 	else if(type == "DebugIntegrator") return DebugIntegrator::factory(params, render);
 	else if(type == "directlighting") return DirectLightIntegrator::factory(params, render);
 	else if(type == "pathtracing") return PathIntegrator::factory(params, render);
+	else if(type == "wavefront_pathtracing") return WavefrontPathIntegrator::factory(params, render);
 	else if(type == "photonmapping") return PhotonIntegrator::factory(params, render);
 	else if(type == "SPPM") return SppmIntegrator::factory(params, render);
 	else if(type == "none") return EmptyVolumeIntegrator::factory(params, render);
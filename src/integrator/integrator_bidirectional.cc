@@ -162,8 +162,8 @@ bool BidirectionalIntegrator::preprocess()
 		path_data.eye_path_.resize(MAX_PATH_LENGTH);
 		path_data.light_path_.resize(MAX_PATH_LENGTH);
 		path_data.path_.resize(MAX_PATH_LENGTH * 2 + 1);
-		for(int i = 0; i < MAX_PATH_LENGTH; ++i) path_data.light_path_[i].userdata_ = malloc(USER_DATA_SIZE);
-		for(int i = 0; i < MAX_PATH_LENGTH; ++i) path_data.eye_path_[i].userdata_ = malloc(USER_DATA_SIZE);
+		for(int i = 0; i < MAX_PATH_LENGTH; ++i) path_data.light_path_[i].userdata_ = malloc(scene_->getUserDataSize());
+		for(int i = 0; i < MAX_PATH_LENGTH; ++i) path_data.eye_path_[i].userdata_ = malloc(scene_->getUserDataSize());
 		path_data.n_paths_ = 0;
 	}
 	// initialize userdata (todo!)
@@ -171,7 +171,7 @@ bool BidirectionalIntegrator::preprocess()
 	f_num_lights_ = 1.f / (float) num_lights;
 	float *energies = new float[num_lights];
 	for(int i = 0; i < num_lights; ++i) energies[i] = lights_[i]->totalEnergy().energy();
-	light_power_d_ = new Pdf1D(energies, num_lights);
+	light_power_d_ = new AliasPdf1D(energies, num_lights);
 
 	for(int i = 0; i < num_lights; ++i) inv_light_power_d_[lights_[i]] = light_power_d_->func_[i] * light_power_d_->inv_integral_;
 
@@ -180,7 +180,6 @@ bool BidirectionalIntegrator::preprocess()
 
 	delete[] energies;
 
-	cam_ = scene_->getCamera();
 	//nPaths = 0;
 	light_image_ = scene_->getImageFilm();// new imageFilm_t(cam->resX(), cam->resY(), 0, 0, *lightOut, 1.5f);
 	light_image_->setDensityEstimation(true);
@@ -281,7 +280,7 @@ Rgba BidirectionalIntegrator::integrate(RenderState &state, DiffRay &ray, ColorP
 		// temporary!
 		float cu, cv;
 		float cam_pdf = 0.0;
-		cam_->project(ray, 0, 0, cu, cv, cam_pdf);
+		state.cam_->project(ray, 0, 0, cu, cv, cam_pdf);
 		if(cam_pdf == 0.f) cam_pdf = 1.f; //FIXME: this is a horrible hack to fix the -nan problems when using bidirectional integrator with Architecture, Angular or Orto cameras. The fundamental problem is that the code for those 3 cameras LACK the member function project() and therefore leave the camPdf=0.f causing -nan results. So, for now I'm forcing camPdf = 1.f if such 0.f result comes from the non-existing member function. This is BAD, but at least will allow people to work with the different cameras in bidirectional, and bidirectional integrator still needs a LOT of work to make it a decent integrator anyway.
 		ve.pdf_wo_ = cam_pdf;
 		ve.f_s_ = Rgb(cam_pdf);
@@ -482,6 +481,7 @@ int BidirectionalIntegrator::createPath(RenderState &state, Ray &start, std::vec
 		// create tentative sample for next path segment
 		Sample s(prng(), prng(), BsdfAll, true);
 		float w = 0.f;
+		state.stats_->add(RenderStats::BsdfSamples);
 		v.f_s_ = mat->sample(state, v.sp_, v.wi_, ray.dir_, s, w);
 		if(v.f_s_.isBlack()) break;
 		v.pdf_wo_ = s.pdf_;
@@ -712,7 +712,7 @@ inline bool BidirectionalIntegrator::connectPathE(RenderState &state, int s, Pat
 	float cos_y = std::fabs(y.sp_.n_ * vec);
 
 	Ray wo(z.sp_.p_, -vec);
-	if(! cam_->project(wo, 0, 0, pd.u_, pd.v_, x_e.pdf_b_)) return false;
+	if(! state.cam_->project(wo, 0, 0, pd.u_, pd.v_, x_e.pdf_b_)) return false;
 
 	x_e.specular_ = false; // cannot query yet...
 
@@ -1013,6 +1013,7 @@ Rgb BidirectionalIntegrator::sampleAmbientOcclusionPass(RenderState &state, cons
 		float w = 0.f;
 
 		Sample s(s_1, s_2, BsdfGlossy | BsdfDiffuse | BsdfReflect);
+		state.stats_->add(RenderStats::BsdfSamples);
 		surf_col = material->sample(state, sp, wo, light_ray.dir_, s, w);
 
 		if(material->getFlags() & BsdfEmit)
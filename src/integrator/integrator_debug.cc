@@ -86,9 +86,9 @@ Rgba DebugIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &c
 		if(show_pn_)
 		{
 			// Normals perturbed by materials
-			unsigned char userdata[USER_DATA_SIZE + 7];
-			userdata[0] = 0;
-			state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+			const ScratchArena::Scope userdata_scope(state.arena_);
+			state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
+			static_cast<unsigned char *>(state.userdata_)[0] = 0;
 
 			Bsdf_t bsdfs;
 			const Material *material = sp.material_;
@@ -109,11 +109,11 @@ Rgba DirectLightIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPas
 
 	if(scene_->intersect(ray, sp)) // If it hits
 	{
-		unsigned char userdata[USER_DATA_SIZE];
+		const ScratchArena::Scope userdata_scope(state.arena_);
 		const Material *material = sp.material_;
 		Bsdf_t bsdfs;
 
-		state.userdata_ = (void *) userdata;
+		state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
 		Vec3 wo = -ray.dir_;
 		if(state.raylevel_ == 0) state.include_lights_ = true;
 
@@ -34,6 +34,8 @@
 #include "common/monitor.h"
 #include "common/photon.h"
 #include "utility/util_sample.h"
+#include "common/trace.h"
+#include <sstream>
 
 #ifdef __clang__
 #define inline  // aka inline removal
@@ -298,6 +300,7 @@ inline Rgb MonteCarloIntegrator::doLightEstimation(RenderState &state, Light *li
 				float W = 0.f;
 
 				Sample s(s_1, s_2, BsdfGlossy | BsdfDiffuse | BsdfDispersive | BsdfReflect | BsdfTransmit);
+				state.stats_->add(RenderStats::BsdfSamples);
 				Rgb surf_col = material->sample(state, sp, wo, b_ray.dir_, s, W);
 				if(s.pdf_ > 1e-6f && light->intersect(b_ray, b_ray.tmax_, lcol, light_pdf))
 				{
@@ -316,6 +319,7 @@ inline Rgb MonteCarloIntegrator::doLightEstimation(RenderState &state, Light *li
 
 						if(color_passes.enabled(PassIntDiffuse) || color_passes.enabled(PassIntDiffuseNoShadow))
 						{
+							state.stats_->add(RenderStats::BsdfSamples);
 							Rgb tmp_col = material->sample(state, sp, wo, b_ray.dir_, s, W) * lcol * w * W;
 							col_diff_no_shadow += tmp_col;
 							if((!shadowed && light_pdf > 1e-6f) && ((s.sampled_flags_ & BsdfDiffuse) == BsdfDiffuse)) col_diff_dir += tmp_col;
@@ -323,6 +327,7 @@ inline Rgb MonteCarloIntegrator::doLightEstimation(RenderState &state, Light *li
 
 						if(color_passes.enabled(PassIntGlossy) && state.raylevel_ == 0)
 						{
+							state.stats_->add(RenderStats::BsdfSamples);
 							Rgb tmp_col = material->sample(state, sp, wo, b_ray.dir_, s, W) * lcol * w * W;
 							if((!shadowed && light_pdf > 1e-6f) && ((s.sampled_flags_ & BsdfGlossy) == BsdfGlossy)) col_glossy_dir += tmp_col;
 						}
@@ -344,8 +349,9 @@ inline Rgb MonteCarloIntegrator::doLightEstimation(RenderState &state, Light *li
 	return col;
 }
 
-void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, Pdf1D *light_power_d, int num_lights, const std::string &integrator_name, const std::vector<Light *> &caus_lights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot)
+void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, AliasPdf1D *light_power_d, int num_lights, const std::string &integrator_name, const std::vector<Light *> &caus_lights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot)
 {
+	TraceScope trace_scope("caustic photon shooting", "photons", thread_id);
 	bool done = false;
 	float s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
 	float f_num_lights = (float)num_lights;
@@ -362,8 +368,8 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 
 	RenderState state;
 	state.cam_ = scene->getCamera();
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(scene->getUserDataSize());
 
 	local_caustic_photons.clear();
 	local_caustic_photons.reserve(n_caus_photons_thread);
@@ -498,8 +504,17 @@ bool MonteCarloIntegrator::createCausticMap()
 	if(intpb_) pb = intpb_;
 	else pb = new ConsoleProgressBar(80);
 
+	const std::string maps_key = photonMapsKey();
+	if(photon_map_processing_ == PhotonsGenerateOnly && session__.photon_maps_key_ == maps_key)
+	{
+		Y_INFO << integrator_name_ << ": Scene contents and photon settings unchanged, reusing the caustic photon map from memory" << YENDL;
+		if(!intpb_) delete pb;
+		return true;
+	}
+
 	if(photon_map_processing_ == PhotonsLoad)
 	{
+		session__.photon_maps_key_.clear();
 		pb->setTag("Loading caustic photon map from file...");
 		const std::string filename = session__.getPathImageOutput() + "_caustic.photonmap";
 		Y_INFO << integrator_name_ << ": Loading caustic photon map from: " << filename << ". If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
@@ -526,6 +541,7 @@ bool MonteCarloIntegrator::createCausticMap()
 		else return true;
 	}
 
+	session__.photon_maps_key_.clear();
 	session__.caustic_map_->clear();
 	session__.caustic_map_->setNumPaths(0);
 	session__.caustic_map_->reserveMemory(n_caus_photons_);
@@ -550,7 +566,7 @@ bool MonteCarloIntegrator::createCausticMap()
 		float f_num_lights = (float)num_lights;
 		float *energies = new float[num_lights];
 		for(int i = 0; i < num_lights; ++i) energies[i] = caus_lights[i]->totalEnergy().energy();
-		Pdf1D *light_power_d = new Pdf1D(energies, num_lights);
+		AliasPdf1D *light_power_d = new AliasPdf1D(energies, num_lights);
 
 		Y_VERBOSE << integrator_name_ << ": Light(s) photon color testing for caustics map:" << YENDL;
 		Rgb pcol(0.f);
@@ -575,7 +591,7 @@ bool MonteCarloIntegrator::createCausticMap()
 
 		int n_threads = scene_->getNumThreadsPhotons();
 
-		n_caus_photons_ = std::max((unsigned int) n_threads, (n_caus_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
+		n_caus_photons_ = roundPhotonsToThreads(n_caus_photons_, n_threads);
 
 		Y_PARAMS << integrator_name_ << ": Shooting " << n_caus_photons_ << " photons across " << n_threads << " threads (" << (n_caus_photons_ / n_threads) << " photons/thread)" << YENDL;
 
@@ -587,6 +603,7 @@ bool MonteCarloIntegrator::createCausticMap()
 		}
 		else
 		{
+			TraceScope trace_scope("caustic photon shooting", "photons", 0);
 			bool done = false;
 			float s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
 			SurfacePoint sp_1, sp_2;
@@ -594,8 +611,8 @@ bool MonteCarloIntegrator::createCausticMap()
 
 			RenderState state;
 			state.cam_ = scene_->getCamera();
-			unsigned char userdata[USER_DATA_SIZE + 7];
-			state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+			const ScratchArena::Scope userdata_scope(state.arena_);
+			state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
 
 			while(!done)
 			{
@@ -739,9 +756,18 @@ bool MonteCarloIntegrator::createCausticMap()
 		Y_VERBOSE << integrator_name_ << ": No caustic source lights found, skiping caustic map building..." << YENDL;
 	}
 
+	if(!(scene_->getSignals() & Y_SIG_ABORT)) session__.photon_maps_key_ = maps_key;
+
 	return true;
 }
 
+std::string MonteCarloIntegrator::photonMapsKey() const
+{
+	std::stringstream key;
+	key << "caustics scene=" << scene_->getContentRevision() << " photons=" << roundPhotonsToThreads(n_caus_photons_, scene_->getNumThreadsPhotons()) << " depth=" << caus_depth_;
+	return key.str();
+}
+
 inline Rgb MonteCarloIntegrator::estimateCausticPhotons(RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	if(!session__.caustic_map_->ready()) return Rgb(0.f);
@@ -823,6 +849,7 @@ inline void MonteCarloIntegrator::recursiveRaytrace(RenderState &state, DiffRay
 				state.ray_offset_ = branch;
 				++branch;
 				Sample s(0.5f, 0.5f, BsdfReflect | BsdfTransmit | BsdfDispersive);
+				state.stats_->add(RenderStats::BsdfSamples);
 				Rgb mcol = material->sample(state, sp, wo, wi, s, w);
 
 				if(s.pdf_ > 1.0e-6f && (s.sampled_flags_ & BsdfDispersive))
@@ -899,6 +926,7 @@ inline void MonteCarloIntegrator::recursiveRaytrace(RenderState &state, DiffRay
 						float w = 0.f;
 
 						Sample s(s_1, s_2, BsdfGlossy | BsdfReflect);
+						state.stats_->add(RenderStats::BsdfSamples);
 						Rgb mcol = material->sample(state, sp, wo, wi, s, w);
 						Rgba integ = 0.f;
 						ref_ray = DiffRay(sp.p_, wi, scene_->ray_min_dist_);
@@ -923,6 +951,7 @@ inline void MonteCarloIntegrator::recursiveRaytrace(RenderState &state, DiffRay
 						float w[2];
 						Vec3 dir[2];
 
+						state.stats_->add(RenderStats::BsdfSamples);
 						mcol[0] = material->sample(state, sp, wo, dir, mcol[1], s, w);
 						Rgba integ = 0.f;
 
@@ -1067,6 +1096,7 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusion(RenderState &state, const Surfa
 		float w = 0.f;
 
 		Sample s(s_1, s_2, BsdfGlossy | BsdfDiffuse | BsdfReflect);
+		state.stats_->add(RenderStats::BsdfSamples);
 		surf_col = material->sample(state, sp, wo, light_ray.dir_, s, w);
 
 		if(material->getFlags() & BsdfEmit)
@@ -1127,6 +1157,7 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusionPass(RenderState &state, const S
 		float w = 0.f;
 
 		Sample s(s_1, s_2, BsdfGlossy | BsdfDiffuse | BsdfReflect);
+		state.stats_->add(RenderStats::BsdfSamples);
 		surf_col = material->sample(state, sp, wo, light_ray.dir_, s, w);
 
 		if(material->getFlags() & BsdfEmit)
@@ -24,6 +24,7 @@
 #include "common/param.h"
 #include "common/scene.h"
 #include "common/imagesplitter.h"
+#include "common/trace.h"
 #include "utility/util_sample.h"
 
 BEGIN_YAFARAY
@@ -84,6 +85,8 @@ bool PathIntegrator::preprocess()
 
 	if(caustic_type_ == Both || caustic_type_ == Path) trace_caustics_ = true;
 
+	if(guiding_) set << "\nPath guiding: training passes=" << guiding_training_passes_ << " bsdf fraction=" << guiding_bsdf_fraction_ << "  ";
+
 	if(caustic_type_ == Both || caustic_type_ == Photon)
 	{
 		if(photon_map_processing_ == PhotonsLoad)
@@ -109,6 +112,249 @@ bool PathIntegrator::preprocess()
 	return success;
 }
 
+void PathIntegrator::preRender()
+{
+	sd_tree_.reset();
+	guiding_pass_ = 0;
+	guiding_record_ = guiding_sample_ = false;
+	if(!guiding_) return;
+	if(aa_passes_ < 2) Y_WARNING << integrator_name_ << ": path guiding learns during the first AA passes, but there is only 1 AA pass: the render will not be guided" << YENDL;
+	sd_tree_ = std::unique_ptr<SdTree>(new SdTree(scene_->getSceneBound()));
+}
+
+void PathIntegrator::prePass(int samples, int offset, bool adaptive)
+{
+	if(!sd_tree_) return;
+	// the tree is updated between the passes, when no render thread is using it
+	if(guiding_record_)
+	{
+		TraceScope trace_scope("guiding tree update", "integrator");
+		sd_tree_->update(guiding_pass_samples_);
+		trace_scope.arg("spatial_leaves", (int64_t) sd_tree_->numLeaves());
+		Y_VERBOSE << integrator_name_ << ": Path guiding: SD-tree updated after training pass " << guiding_pass_ << ", " << sd_tree_->numLeaves() << " spatial leaves" << YENDL;
+	}
+	++guiding_pass_;
+	guiding_record_ = guiding_pass_ <= guiding_training_passes_ && guiding_pass_ < aa_passes_;
+	guiding_sample_ = guiding_pass_ > 1;
+	guiding_pass_samples_ = samples;
+}
+
+Rgb PathIntegrator::sampleDirection(RenderState &state, const SurfacePoint &sp, Bsdf_t bsdfs, const Vec3 &wo, Vec3 &wi, Sample &s, SdTree::Leaf *&guiding_leaf, float &pdf) const
+{
+	const Material *material = sp.material_;
+	float w = 0.f;
+	state.stats_->add(RenderStats::BsdfSamples);
+	if(!sd_tree_ || !material->hasExactPdf() || material->isTransparent() || (bsdfs & (BsdfSpecular | BsdfGlossy | BsdfFilter | BsdfDispersive)))
+	{
+		guiding_leaf = nullptr;
+		Rgb scol = material->sample(state, sp, wo, wi, s, w);
+		return scol * w;
+	}
+
+	guiding_leaf = &sd_tree_->lookup(sp.p_);
+	const DirectionalQuadTree &guide = guiding_leaf->sampling_;
+	// the learned distribution is only sampled once it has recorded some light
+	const float guide_fraction = (guiding_sample_ && guide.getEnergy() > 0.f) ? 1.f - guiding_bsdf_fraction_ : 0.f;
+	Rgb f;
+	float bsdf_pdf;
+	if(guide_fraction > 0.f && (*state.prng_)() < guide_fraction)
+	{
+		wi = guide.sample(s.s_1_, s.s_2_);
+		f = material->eval(state, sp, wo, wi, s.flags_);
+		bsdf_pdf = material->pdf(state, sp, wo, wi, s.flags_);
+		s.sampled_flags_ = ((sp.ng_ * wo) * (sp.ng_ * wi) < 0.f) ? (BsdfDiffuse | BsdfTransmit) : (BsdfDiffuse | BsdfReflect);
+	}
+	else
+	{
+		f = material->sample(state, sp, wo, wi, s, w);
+		bsdf_pdf = (s.sampled_flags_ == BsdfNone) ? 0.f : s.pdf_;
+	}
+	// the material pdfs are pi times the solid angle densities, as their colors are pi times the BSDF
+	pdf = guide_fraction * guide.pdf(wi) + (1.f - guide_fraction) * bsdf_pdf * (float) M_1_PI;
+	if(!(pdf > 0.f)) return Rgb(0.f);
+	return f * (std::fabs(wi * sp.n_) * (float) M_1_PI / pdf);
+}
+
+void PathIntegrator::addGuidingRadiance(GuidingVertex *vertices, int n_vertices, const Rgb &contribution)
+{
+	for(int i = 0; i < n_vertices; ++i) vertices[i].radiance_ += contribution * vertices[i].inv_throughput_;
+}
+
+void PathIntegrator::recordGuidingVertices(const GuidingVertex *vertices, int n_vertices)
+{
+	for(int i = 0; i < n_vertices; ++i) vertices[i].leaf_->record(vertices[i].wi_, vertices[i].radiance_.energy() / vertices[i].pdf_);
+}
+
+static inline Rgb inverseThroughput__(const Rgb &throughput)
+{
+	return Rgb(throughput.r_ > 0.f ? 1.f / throughput.r_ : 0.f, throughput.g_ > 0.f ? 1.f / throughput.g_ : 0.f, throughput.b_ > 0.f ? 1.f / throughput.b_ : 0.f);
+}
+
+void PathIntegrator::bounceSamples(const RenderState &state, unsigned int offs, int depth, float &s_1, float &s_2) const
+{
+	const Sampler *sampler = scene_->getSampler();
+	if(sampler)
+	{
+		const int dimension = Sampler::bounceDimension(depth);
+		s_1 = sampler->get(offs - state.sampling_offs_, dimension, state.sampling_offs_);
+		s_2 = sampler->get(offs - state.sampling_offs_, dimension + 1, state.sampling_offs_);
+	}
+	else if(depth == 0)
+	{
+		s_1 = riVdC__(offs);
+		s_2 = scrHalton__(2, offs);
+	}
+	else
+	{
+		s_1 = scrHalton__(4 * depth + 3, offs);
+		s_2 = scrHalton__(4 * depth + 4, offs);
+	}
+}
+
+float PathIntegrator::wavelengthSample(const RenderState &state, unsigned int offs) const
+{
+	const Sampler *sampler = scene_->getSampler();
+	// a spare dimension of the first bounce
+	if(sampler) return sampler->get(offs - state.sampling_offs_, Sampler::bounceDimension(0) + 2, state.sampling_offs_);
+	else return riS__(offs);
+}
+
+Rgb PathIntegrator::samplePaths(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t path_flags, ColorPasses &color_passes, ColorPasses &tmp_color_passes) const
+{
+	const Material *material = sp.material_;
+	const bool was_chromatic = state.chromatic_;
+	Random &prng = *(state.prng_);
+	const VolumeHandler *vol;
+	Rgb vcol(0.f);
+	Rgb path_col(0.0), wl_col;
+	int n_samples = std::max(1, n_paths_ / state.ray_division_);
+	for(int i = 0; i < n_samples; ++i)
+	{
+		void *first_udat = state.userdata_;
+		const ScratchArena::Scope userdata_scope(state.arena_);
+		void *n_udat = state.arena_.alloc(scene_->getUserDataSize());
+		GuidingVertex *guiding_vertices = guiding_record_ ? static_cast<GuidingVertex *>(state.arena_.alloc(max_bounces_ * sizeof(GuidingVertex))) : nullptr;
+		int n_guiding_vertices = 0;
+		SdTree::Leaf *guiding_leaf;
+		float guiding_pdf;
+		unsigned int offs = n_paths_ * state.pixel_sample_ + state.sampling_offs_ + i; // some redunancy here...
+		Rgb throughput(1.0);
+		Rgb lcol, scol;
+		SurfacePoint sp_1 = sp, sp_2;
+		SurfacePoint *hit = &sp_1, *hit_2 = &sp_2;
+		Vec3 pwo = wo;
+		Ray p_ray;
+
+		state.chromatic_ = was_chromatic;
+		if(was_chromatic) state.wavelength_ = wavelengthSample(state, offs);
+		//this mat already is initialized, just sample (diffuse...non-specular?)
+		float s_1, s_2;
+		bounceSamples(state, offs, 0, s_1, s_2);
+		if(state.ray_division_ > 1)
+		{
+			s_1 = addMod1__(s_1, state.dc_1_);
+			s_2 = addMod1__(s_2, state.dc_2_);
+		}
+		// do proper sampling now...
+		Sample s(s_1, s_2, path_flags);
+		scol = sampleDirection(state, sp, material->getFlags(), pwo, p_ray.dir_, s, guiding_leaf, guiding_pdf);
+
+		throughput = scol;
+		state.include_lights_ = false;
+		if(guiding_vertices && guiding_leaf && !scol.isBlack()) guiding_vertices[n_guiding_vertices++] = { guiding_leaf, p_ray.dir_, inverseThroughput__(throughput), Rgb(0.f), guiding_pdf };
+
+		p_ray.tmin_ = scene_->ray_min_dist_;
+		p_ray.tmax_ = -1.0;
+		p_ray.from_ = sp.p_;
+
+		if(!scene_->intersect(p_ray, *hit)) //hit background
+		{
+			recordGuidingVertices(guiding_vertices, n_guiding_vertices);
+			continue;
+		}
+
+		state.userdata_ = n_udat;
+		const Material *p_mat = hit->material_;
+		Bsdf_t mat_bsd_fs;
+		p_mat->initBsdf(state, *hit, mat_bsd_fs);
+		if(s.sampled_flags_ != BsdfNone) pwo = -p_ray.dir_; //Fix for white dots in path tracing with shiny diffuse with transparent PNG texture and transparent shadows, especially in Win32, (precision?). Sometimes the first sampling does not take place and pRay.dir is not initialized, so before this change when that happened pwo = -pRay.dir was getting a random non-initialized value! This fix makes that, if the first sample fails for some reason, pwo is not modified and the rest of the sampling continues with the same pwo value. FIXME: Question: if the first sample fails, should we continue as now or should we exit the loop with the "continue" command?
+		lcol = estimateOneDirectLight(state, *hit, pwo, offs, tmp_color_passes);
+		if(mat_bsd_fs & BsdfEmit) lcol += color_passes.probeAdd(PassIntEmit, p_mat->emit(state, *hit, pwo), state.raylevel_ == 0);
+
+		path_col += lcol * throughput;
+		addGuidingRadiance(guiding_vertices, n_guiding_vertices, lcol * throughput);
+
+		bool caustic = false;
+
+		for(int depth = 1; depth < max_bounces_; ++depth)
+		{
+			bounceSamples(state, offs, depth, s.s_1_, s.s_2_);
+
+			if(state.ray_division_ > 1)
+			{
+				s_1 = addMod1__(s_1, state.dc_1_);
+				s_2 = addMod1__(s_2, state.dc_2_);
+			}
+
+			s.flags_ = BsdfAll;
+
+			scol = sampleDirection(state, *hit, mat_bsd_fs, pwo, p_ray.dir_, s, guiding_leaf, guiding_pdf);
+
+			if(scol.isBlack()) break;
+
+			throughput *= scol;
+			if(guiding_vertices && guiding_leaf) guiding_vertices[n_guiding_vertices++] = { guiding_leaf, p_ray.dir_, inverseThroughput__(throughput), Rgb(0.f), guiding_pdf };
+			caustic = trace_caustics_ && (s.sampled_flags_ & (BsdfSpecular | BsdfGlossy | BsdfFilter));
+			state.include_lights_ = caustic;
+
+			p_ray.tmin_ = scene_->ray_min_dist_;
+			p_ray.tmax_ = -1.0;
+			p_ray.from_ = hit->p_;
+
+			if(!scene_->intersect(p_ray, *hit_2)) //hit background
+			{
+				if((caustic && background_ && background_->hasIbl() && background_->shootsCaustic()))
+				{
+					const Rgb bg_col = throughput * (*background_)(p_ray, state, true);
+					path_col += bg_col;
+					addGuidingRadiance(guiding_vertices, n_guiding_vertices, bg_col);
+				}
+				break;
+			}
+
+			std::swap(hit, hit_2);
+			p_mat = hit->material_;
+			p_mat->initBsdf(state, *hit, mat_bsd_fs);
+			pwo = -p_ray.dir_;
+
+			if(mat_bsd_fs & BsdfDiffuse) lcol = estimateOneDirectLight(state, *hit, pwo, offs, tmp_color_passes);
+			else lcol = Rgb(0.f);
+
+			if((mat_bsd_fs & BsdfVolumetric) && (vol = p_mat->getVolumeHandler(hit->n_ * pwo < 0)))
+			{
+				if(vol->transmittance(state, p_ray, vcol)) throughput *= vcol;
+			}
+
+			// Russian roulette for terminating paths with low probability
+			if(depth > russian_roulette_min_bounces_)
+			{
+				float random_value = prng();
+				float probability = std::min(1.f, throughput.maximum());
+				if(probability <= 0.f || probability < random_value) break;
+				throughput *= 1.f / probability;
+			}
+
+			if((mat_bsd_fs & BsdfEmit) && caustic) lcol += color_passes.probeAdd(PassIntEmit, p_mat->emit(state, *hit, pwo), state.raylevel_ == 0);
+
+			path_col += lcol * throughput;
+			addGuidingRadiance(guiding_vertices, n_guiding_vertices, lcol * throughput);
+		}
+		recordGuidingVertices(guiding_vertices, n_guiding_vertices);
+		state.userdata_ = first_udat;
+	}
+	return path_col / n_samples;
+}
+
 Rgba PathIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &color_passes, int additional_depth /*=0*/) const
 {
 	static int calls = 0;
@@ -117,7 +363,6 @@ Rgba PathIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &co
 	float alpha;
 	SurfacePoint sp;
 	void *o_udat = state.userdata_;
-	float w = 0.f;
 
 	if(transp_background_) alpha = 0.0;
 	else alpha = 1.0;
@@ -133,18 +378,14 @@ Rgba PathIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &co
 			state.include_lights_ = true;
 			//...
 		}
-		unsigned char userdata[USER_DATA_SIZE + 7];
-		userdata[0] = 0;
-		state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+		const ScratchArena::Scope userdata_scope(state.arena_);
+		state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
+		static_cast<unsigned char *>(state.userdata_)[0] = 0;
 		Bsdf_t bsdfs;
 
 		const Material *material = sp.material_;
 		material->initBsdf(state, sp, bsdfs);
 		Vec3 wo = -ray.dir_;
-		const VolumeHandler *vol;
-		Rgb vcol(0.f);
-
-		Random &prng = *(state.prng_);
 
 		if(additional_depth < material->getAdditionalDepth()) additional_depth = material->getAdditionalDepth();
 
@@ -177,124 +418,8 @@ Rgba PathIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &co
 
 		if(bsdfs & path_flags)
 		{
-			Rgb path_col(0.0), wl_col;
 			path_flags |= (BsdfDiffuse | BsdfReflect | BsdfTransmit);
-			int n_samples = std::max(1, n_paths_ / state.ray_division_);
-			for(int i = 0; i < n_samples; ++i)
-			{
-				void *first_udat = state.userdata_;
-				unsigned char userdata[USER_DATA_SIZE + 7];
-				void *n_udat = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
-				unsigned int offs = n_paths_ * state.pixel_sample_ + state.sampling_offs_ + i; // some redunancy here...
-				Rgb throughput(1.0);
-				Rgb lcol, scol;
-				SurfacePoint sp_1 = sp, sp_2;
-				SurfacePoint *hit = &sp_1, *hit_2 = &sp_2;
-				Vec3 pwo = wo;
-				Ray p_ray;
-
-				state.chromatic_ = was_chromatic;
-				if(was_chromatic) state.wavelength_ = riS__(offs);
-				//this mat already is initialized, just sample (diffuse...non-specular?)
-				float s_1 = riVdC__(offs);
-				float s_2 = scrHalton__(2, offs);
-				if(state.ray_division_ > 1)
-				{
-					s_1 = addMod1__(s_1, state.dc_1_);
-					s_2 = addMod1__(s_2, state.dc_2_);
-				}
-				// do proper sampling now...
-				Sample s(s_1, s_2, path_flags);
-				scol = material->sample(state, sp, pwo, p_ray.dir_, s, w);
-
-				scol *= w;
-				throughput = scol;
-				state.include_lights_ = false;
-
-				p_ray.tmin_ = scene_->ray_min_dist_;
-				p_ray.tmax_ = -1.0;
-				p_ray.from_ = sp.p_;
-
-				if(!scene_->intersect(p_ray, *hit)) continue; //hit background
-
-				state.userdata_ = n_udat;
-				const Material *p_mat = hit->material_;
-				Bsdf_t mat_bsd_fs;
-				p_mat->initBsdf(state, *hit, mat_bsd_fs);
-				if(s.sampled_flags_ != BsdfNone) pwo = -p_ray.dir_; //Fix for white dots in path tracing with shiny diffuse with transparent PNG texture and transparent shadows, especially in Win32, (precision?). Sometimes the first sampling does not take place and pRay.dir is not initialized, so before this change when that happened pwo = -pRay.dir was getting a random non-initialized value! This fix makes that, if the first sample fails for some reason, pwo is not modified and the rest of the sampling continues with the same pwo value. FIXME: Question: if the first sample fails, should we continue as now or should we exit the loop with the "continue" command?
-				lcol = estimateOneDirectLight(state, *hit, pwo, offs, tmp_color_passes);
-				if(mat_bsd_fs & BsdfEmit) lcol += color_passes.probeAdd(PassIntEmit, p_mat->emit(state, *hit, pwo), state.raylevel_ == 0);
-
-				path_col += lcol * throughput;
-
-				bool caustic = false;
-
-				for(int depth = 1; depth < max_bounces_; ++depth)
-				{
-					int d_4 = 4 * depth;
-					s.s_1_ = scrHalton__(d_4 + 3, offs); //ourRandom();//
-					s.s_2_ = scrHalton__(d_4 + 4, offs); //ourRandom();//
-
-					if(state.ray_division_ > 1)
-					{
-						s_1 = addMod1__(s_1, state.dc_1_);
-						s_2 = addMod1__(s_2, state.dc_2_);
-					}
-
-					s.flags_ = BsdfAll;
-
-					scol = p_mat->sample(state, *hit, pwo, p_ray.dir_, s, w);
-					scol *= w;
-
-					if(scol.isBlack()) break;
-
-					throughput *= scol;
-					caustic = trace_caustics_ && (s.sampled_flags_ & (BsdfSpecular | BsdfGlossy | BsdfFilter));
-					state.include_lights_ = caustic;
-
-					p_ray.tmin_ = scene_->ray_min_dist_;
-					p_ray.tmax_ = -1.0;
-					p_ray.from_ = hit->p_;
-
-					if(!scene_->intersect(p_ray, *hit_2)) //hit background
-					{
-						if((caustic && background_ && background_->hasIbl() && background_->shootsCaustic()))
-						{
-							path_col += throughput * (*background_)(p_ray, state, true);
-						}
-						break;
-					}
-
-					std::swap(hit, hit_2);
-					p_mat = hit->material_;
-					p_mat->initBsdf(state, *hit, mat_bsd_fs);
-					pwo = -p_ray.dir_;
-
-					if(mat_bsd_fs & BsdfDiffuse) lcol = estimateOneDirectLight(state, *hit, pwo, offs, tmp_color_passes);
-					else lcol = Rgb(0.f);
-
-					if((mat_bsd_fs & BsdfVolumetric) && (vol = p_mat->getVolumeHandler(hit->n_ * pwo < 0)))
-					{
-						if(vol->transmittance(state, p_ray, vcol)) throughput *= vcol;
-					}
-
-					// Russian roulette for terminating paths with low probability
-					if(depth > russian_roulette_min_bounces_)
-					{
-						float random_value = prng();
-						float probability = throughput.maximum();
-						if(probability <= 0.f || probability < random_value) break;
-						throughput *= 1.f / probability;
-					}
-
-					if((mat_bsd_fs & BsdfEmit) && caustic) lcol += color_passes.probeAdd(PassIntEmit, p_mat->emit(state, *hit, pwo), state.raylevel_ == 0);
-
-					path_col += lcol * throughput;
-				}
-				state.userdata_ = first_udat;
-
-			}
-			col += path_col / n_samples;
+			col += samplePaths(state, sp, wo, path_flags, color_passes, tmp_color_passes);
 		}
 		//reset chromatic state:
 		state.chromatic_ = was_chromatic;
@@ -335,6 +460,7 @@ Rgba PathIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &co
 
 	Rgb col_vol_transmittance = scene_->vol_integrator_->transmittance(state, ray);
 	Rgb col_vol_integration = scene_->vol_integrator_->integrate(state, ray, color_passes);
+	if(state.raylevel_ == 0) cameraRayTransmittance(state, col_vol_transmittance);
 
 	if(transp_background_) alpha = std::max(alpha, 1.f - col_vol_transmittance.r_);
 
@@ -346,7 +472,7 @@ Rgba PathIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &co
 	return Rgba(col, alpha);
 }
 
-Integrator *PathIntegrator::factory(ParamMap &params, RenderEnvironment &render)
+void PathIntegrator::setParams(ParamMap &params)
 {
 	bool transp_shad = false, no_rec = false;
 	int shadow_depth = 5;
@@ -377,14 +503,18 @@ Integrator *PathIntegrator::factory(ParamMap &params, RenderEnvironment &render)
 	params.getParam("AO_distance", ao_dist);
 	params.getParam("AO_color", ao_col);
 	params.getParam("photon_maps_processing", photon_maps_processing_str);
+	params.getParam("guiding", guiding_);
+	params.getParam("guiding_training_passes", guiding_training_passes_);
+	params.getParam("guiding_bsdf_fraction", guiding_bsdf_fraction_);
 
-	PathIntegrator *inte = new PathIntegrator(transp_shad, shadow_depth);
+	tr_shad_ = transp_shad;
+	s_depth_ = shadow_depth;
 	if(params.getParam("caustic_type", c_method))
 	{
 		bool use_photons = false;
-		if(c_method == "photon") { inte->caustic_type_ = Photon; use_photons = true; }
-		else if(c_method == "both") { inte->caustic_type_ = Both; use_photons = true; }
-		else if(c_method == "none") inte->caustic_type_ = None;
+		if(c_method == "photon") { caustic_type_ = Photon; use_photons = true; }
+		else if(c_method == "both") { caustic_type_ = Both; use_photons = true; }
+		else if(c_method == "none") caustic_type_ = None;
 		if(use_photons)
 		{
 			double c_rad = 0.25;
@@ -393,32 +523,39 @@ Integrator *PathIntegrator::factory(ParamMap &params, RenderEnvironment &render)
 			params.getParam("caustic_mix", search);
 			params.getParam("caustic_depth", c_depth);
 			params.getParam("caustic_radius", c_rad);
-			inte->n_caus_photons_ = photons;
-			inte->n_caus_search_ = search;
-			inte->caus_depth_ = c_depth;
-			inte->caus_radius_ = c_rad;
+			n_caus_photons_ = photons;
+			n_caus_search_ = search;
+			caus_depth_ = c_depth;
+			caus_radius_ = c_rad;
 		}
 	}
-	inte->r_depth_ = raydepth;
-	inte->n_paths_ = path_samples;
-	inte->inv_n_paths_ = 1.f / (float)path_samples;
-	inte->max_bounces_ = bounces;
-	inte->russian_roulette_min_bounces_ = russian_roulette_min_bounces;
-	inte->no_recursive_ = no_rec;
+	r_depth_ = raydepth;
+	n_paths_ = path_samples;
+	inv_n_paths_ = 1.f / (float)path_samples;
+	max_bounces_ = bounces;
+	russian_roulette_min_bounces_ = russian_roulette_min_bounces;
+	no_recursive_ = no_rec;
+	guiding_training_passes_ = std::max(1, guiding_training_passes_);
+	guiding_bsdf_fraction_ = std::min(1.f, std::max(0.f, guiding_bsdf_fraction_));
 	// Background settings
-	inte->transp_background_ = bg_transp;
-	inte->transp_refracted_background_ = bg_transp_refract;
+	transp_background_ = bg_transp;
+	transp_refracted_background_ = bg_transp_refract;
 	// AO settings
-	inte->use_ambient_occlusion_ = do_ao;
-	inte->ao_samples_ = ao_samples;
-	inte->ao_dist_ = ao_dist;
-	inte->ao_col_ = ao_col;
-
-	if(photon_maps_processing_str == "generate-save") inte->photon_map_processing_ = PhotonsGenerateAndSave;
-	else if(photon_maps_processing_str == "load") inte->photon_map_processing_ = PhotonsLoad;
-	else if(photon_maps_processing_str == "reuse-previous") inte->photon_map_processing_ = PhotonsReuse;
-	else inte->photon_map_processing_ = PhotonsGenerateOnly;
+	use_ambient_occlusion_ = do_ao;
+	ao_samples_ = ao_samples;
+	ao_dist_ = ao_dist;
+	ao_col_ = ao_col;
+
+	if(photon_maps_processing_str == "generate-save") photon_map_processing_ = PhotonsGenerateAndSave;
+	else if(photon_maps_processing_str == "load") photon_map_processing_ = PhotonsLoad;
+	else if(photon_maps_processing_str == "reuse-previous") photon_map_processing_ = PhotonsReuse;
+	else photon_map_processing_ = PhotonsGenerateOnly;
+}
 
+Integrator *PathIntegrator::factory(ParamMap &params, RenderEnvironment &render)
+{
+	PathIntegrator *inte = new PathIntegrator();
+	inte->setParams(params);
 	return inte;
 }
 
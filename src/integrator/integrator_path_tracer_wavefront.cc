@@ -0,0 +1,343 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "integrator/integrator_path_tracer_wavefront.h"
+#include "common/surface.h"
+#include "common/param.h"
+#include "common/scene.h"
+#include "common/imagesplitter.h"
+#include "utility/util_sample.h"
+#include <algorithm>
+#include <new>
+#include <type_traits>
+
+BEGIN_YAFARAY
+
+WavefrontPathIntegrator::WavefrontPathIntegrator()
+{
+	integrator_name_ = "WavefrontPathTracer";
+	integrator_short_name_ = "WPT";
+}
+
+void WavefrontPathIntegrator::prePass(int samples, int offset, bool adaptive)
+{
+	PathIntegrator::prePass(samples, offset, adaptive);
+	while(static_cast<int>(tile_batches_.size()) < std::max(1, scene_->getNumThreads())) tile_batches_.emplace_back(new TileBatch());
+}
+
+void WavefrontPathIntegrator::loadPathState(RenderState &state, const Path &path)
+{
+	state.userdata_ = path.userdata_;
+	state.chromatic_ = path.chromatic_;
+	state.wavelength_ = path.wavelength_;
+	state.include_lights_ = path.caustic_;
+	state.sampling_offs_ = path.sampling_offs_;
+	state.pixel_sample_ = path.pixel_sample_;
+	state.time_ = path.time_;
+}
+
+void WavefrontPathIntegrator::storePathState(const RenderState &state, Path &path)
+{
+	path.chromatic_ = state.chromatic_;
+	path.wavelength_ = state.wavelength_;
+}
+
+//! Samples the first bounce of the path number i at the camera hit sp, whose BSDF is already initialized in first_udat
+void WavefrontPathIntegrator::startPath(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t path_flags, void *first_udat, bool was_chromatic, int i, Path &path) const
+{
+	path.offs_ = n_paths_ * state.pixel_sample_ + state.sampling_offs_ + i; // some redunancy here...
+	path.sampling_offs_ = state.sampling_offs_;
+	path.pixel_sample_ = state.pixel_sample_;
+	path.time_ = state.time_;
+	path.chromatic_ = was_chromatic;
+	path.wavelength_ = was_chromatic ? wavelengthSample(state, path.offs_) : state.wavelength_;
+	path.caustic_ = false;
+	path.pwo_ = wo;
+	loadPathState(state, path);
+	state.userdata_ = first_udat;
+
+	float s_1, s_2;
+	bounceSamples(state, path.offs_, 0, s_1, s_2);
+	if(state.ray_division_ > 1)
+	{
+		s_1 = addMod1__(s_1, state.dc_1_);
+		s_2 = addMod1__(s_2, state.dc_2_);
+	}
+	Sample s(s_1, s_2, path_flags);
+	float w = 0.f;
+	state.stats_->add(RenderStats::BsdfSamples);
+	path.throughput_ = sp.material_->sample(state, sp, wo, path.ray_.dir_, s, w);
+	path.throughput_ *= w;
+	path.sampled_ = (s.sampled_flags_ != BsdfNone);
+	path.ray_.tmin_ = scene_->ray_min_dist_;
+	path.ray_.tmax_ = -1.0;
+	path.ray_.from_ = sp.p_;
+	storePathState(state, path);
+}
+
+Rgb WavefrontPathIntegrator::samplePaths(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t path_flags, ColorPasses &color_passes, ColorPasses &tmp_color_passes) const
+{
+	static_assert(std::is_trivially_destructible<Path>::value, "the paths are allocated in the scratch arena and never destroyed");
+
+	const bool was_chromatic = state.chromatic_;
+	void *first_udat = state.userdata_;
+	const int n_samples = std::max(1, n_paths_ / state.ray_division_);
+	const size_t userdata_size = scene_->getUserDataSize();
+
+	// the paths of the camera hits join the batch of the tile, their light is added to the camera sample when the batch is traced
+	if(state.raylevel_ == 0)
+	{
+		TileBatch &batch = *tile_batches_[state.thread_id_];
+		batch.samples_.push_back({ color_passes, CameraSample(), Rgb(0.f), Rgb(1.f), n_samples });
+		batch.sample_open_ = true;
+		DeferredSample &sample = batch.samples_.back();
+		const uint32_t aligned_userdata_size = (userdata_size + 15) & (~15); //keeps the userdata 16 byte aligned, as in the scratch arena
+		for(int i = 0; i < n_samples; ++i)
+		{
+			batch.paths_.emplace_back();
+			Path &path = batch.paths_.back();
+			path.userdata_ = batch.userdata_arena_.alloc(aligned_userdata_size);
+			path.col_ = &sample.col_;
+			path.color_passes_ = &sample.color_passes_;
+			startPath(state, sp, wo, path_flags, first_udat, was_chromatic, i, path);
+		}
+		state.userdata_ = first_udat;
+		return Rgb(0.f);
+	}
+
+	const ScratchArena::Scope paths_scope(state.arena_);
+	Path *paths = static_cast<Path *>(state.arena_.alloc(n_samples * sizeof(Path)));
+	int *queue = static_cast<int *>(state.arena_.alloc(n_samples * sizeof(int)));
+	Rgb path_col(0.f);
+
+	for(int i = 0; i < n_samples; ++i)
+	{
+		Path &path = *new (&paths[i]) Path();
+		path.userdata_ = state.arena_.alloc(userdata_size);
+		path.col_ = &path_col;
+		path.color_passes_ = &color_passes;
+		startPath(state, sp, wo, path_flags, first_udat, was_chromatic, i, path);
+		queue[i] = i;
+	}
+	tracePaths(state, paths, queue, n_samples, tmp_color_passes);
+	state.userdata_ = first_udat;
+	return path_col / n_samples;
+}
+
+void WavefrontPathIntegrator::cameraRayTransmittance(RenderState &state, const Rgb &transmittance) const
+{
+	TileBatch &batch = *tile_batches_[state.thread_id_];
+	if(batch.sample_open_) batch.samples_.back().transmittance_ = transmittance;
+}
+
+void WavefrontPathIntegrator::addCameraSample(RenderState &state, ColorPasses &color_passes, const CameraSample &camera_sample, const SamplePassesProcessing &sample_passes_processing) const
+{
+	TileBatch &batch = *tile_batches_[state.thread_id_];
+	if(!batch.sample_open_)
+	{
+		PathIntegrator::addCameraSample(state, color_passes, camera_sample, sample_passes_processing);
+		return;
+	}
+	DeferredSample &sample = batch.samples_.back();
+	sample.color_passes_ = color_passes;
+	sample.camera_sample_ = camera_sample;
+	batch.sample_open_ = false;
+	if(batch.paths_.size() >= max_batch_paths_) traceBatch(state, batch, sample_passes_processing);
+}
+
+void WavefrontPathIntegrator::flushCameraSamples(RenderState &state, const SamplePassesProcessing &sample_passes_processing) const
+{
+	TileBatch &batch = *tile_batches_[state.thread_id_];
+	if(!batch.samples_.empty()) traceBatch(state, batch, sample_passes_processing);
+}
+
+//! Traces the paths of the batch and adds its camera samples to the film
+void WavefrontPathIntegrator::traceBatch(RenderState &state, TileBatch &batch, const SamplePassesProcessing &sample_passes_processing) const
+{
+	// the state of the camera sample being rendered, changed by the paths
+	void *const userdata = state.userdata_;
+	const bool chromatic = state.chromatic_;
+	const float wavelength = state.wavelength_;
+	const bool include_lights = state.include_lights_;
+	const unsigned int sampling_offs = state.sampling_offs_;
+	const int pixel_sample = state.pixel_sample_;
+	const float time = state.time_;
+
+	ColorPasses tmp_color_passes = batch.samples_.front().color_passes_;
+	std::vector<int> queue(batch.paths_.size());
+	for(size_t i = 0; i < queue.size(); ++i) queue[i] = static_cast<int>(i);
+	tracePaths(state, batch.paths_.data(), queue.data(), static_cast<int>(queue.size()), tmp_color_passes);
+
+	for(DeferredSample &sample : batch.samples_)
+	{
+		sample.color_passes_(PassIntCombined) += Rgba(sample.col_ * sample.transmittance_ / sample.n_paths_, 0.f);
+		PathIntegrator::addCameraSample(state, sample.color_passes_, sample.camera_sample_, sample_passes_processing);
+	}
+	batch.samples_.clear();
+	batch.paths_.clear();
+	batch.userdata_arena_.freeAll();
+
+	state.userdata_ = userdata;
+	state.chromatic_ = chromatic;
+	state.wavelength_ = wavelength;
+	state.include_lights_ = include_lights;
+	state.sampling_offs_ = sampling_offs;
+	state.pixel_sample_ = pixel_sample;
+	state.time_ = time;
+}
+
+//! Runs the stages over the queued paths until all of them are terminated
+void WavefrontPathIntegrator::tracePaths(RenderState &state, Path *paths, int *queue, int n_queue, ColorPasses &tmp_color_passes) const
+{
+	for(int depth = 0; n_queue > 0; ++depth)
+	{
+		n_queue = extend(state, paths, queue, n_queue, depth);
+		// sorting the hits by material makes the shading and light connection stages run the same material code for many paths in a row
+		std::sort(queue, queue + n_queue, [paths](int a, int b) { return paths[a].hit_.material_ < paths[b].hit_.material_; });
+		n_queue = shade(state, paths, queue, n_queue, depth);
+		connect(state, paths, queue, n_queue, depth, tmp_color_passes);
+		if(depth + 1 >= max_bounces_) break;
+		n_queue = sampleBounce(state, paths, queue, n_queue, depth + 1);
+	}
+}
+
+//! Intersects the rays of the queued paths, removing from the queue the ones escaping the scene
+int WavefrontPathIntegrator::extend(RenderState &state, Path *paths, int *queue, int n_queue, int depth) const
+{
+	int n_hits = 0;
+	for(int q = 0; q < n_queue; ++q)
+	{
+		Path &path = paths[queue[q]];
+		if(scene_->intersect(path.ray_, path.hit_))
+		{
+			queue[n_hits++] = queue[q];
+			continue;
+		}
+		if(depth > 0 && path.caustic_ && background_ && background_->hasIbl() && background_->shootsCaustic())
+		{
+			loadPathState(state, path);
+			*path.col_ += path.throughput_ * (*background_)(path.ray_, state, true);
+		}
+	}
+	return n_hits;
+}
+
+//! Initializes the BSDFs at the hits and applies the volume transmittance, russian roulette and emission, removing the terminated paths
+int WavefrontPathIntegrator::shade(RenderState &state, Path *paths, int *queue, int n_queue, int depth) const
+{
+	Random &prng = *(state.prng_);
+	int n_alive = 0;
+	for(int q = 0; q < n_queue; ++q)
+	{
+		Path &path = paths[queue[q]];
+		const Material *p_mat = path.hit_.material_;
+		loadPathState(state, path);
+		p_mat->initBsdf(state, path.hit_, path.bsdfs_);
+		path.lcol_ = Rgb(0.f);
+		if(depth == 0)
+		{
+			if(path.sampled_) path.pwo_ = -path.ray_.dir_; //see the comment about the white dots in PathIntegrator::samplePaths
+			if(path.bsdfs_ & BsdfEmit) path.lcol_ += path.color_passes_->probeAdd(PassIntEmit, p_mat->emit(state, path.hit_, path.pwo_), state.raylevel_ == 0);
+		}
+		else
+		{
+			path.pwo_ = -path.ray_.dir_;
+			const VolumeHandler *vol;
+			Rgb vcol(0.f);
+			if((path.bsdfs_ & BsdfVolumetric) && (vol = p_mat->getVolumeHandler(path.hit_.n_ * path.pwo_ < 0)))
+			{
+				if(vol->transmittance(state, path.ray_, vcol)) path.throughput_ *= vcol;
+			}
+
+			// Russian roulette for terminating paths with low probability
+			if(depth > russian_roulette_min_bounces_)
+			{
+				float random_value = prng();
+				float probability = std::min(1.f, path.throughput_.maximum());
+				if(probability <= 0.f || probability < random_value)
+				{
+					storePathState(state, path);
+					continue;
+				}
+				path.throughput_ *= 1.f / probability;
+			}
+
+			if((path.bsdfs_ & BsdfEmit) && path.caustic_) path.lcol_ += path.color_passes_->probeAdd(PassIntEmit, p_mat->emit(state, path.hit_, path.pwo_), state.raylevel_ == 0);
+		}
+		storePathState(state, path);
+		queue[n_alive++] = queue[q];
+	}
+	return n_alive;
+}
+
+//! Samples one light for each of the queued hits (shadow rays included) and accumulates the light gathered by the paths
+void WavefrontPathIntegrator::connect(RenderState &state, Path *paths, const int *queue, int n_queue, int depth, ColorPasses &tmp_color_passes) const
+{
+	for(int q = 0; q < n_queue; ++q)
+	{
+		Path &path = paths[queue[q]];
+		if(depth == 0 || (path.bsdfs_ & BsdfDiffuse))
+		{
+			loadPathState(state, path);
+			path.lcol_ += estimateOneDirectLight(state, path.hit_, path.pwo_, path.offs_, tmp_color_passes);
+			storePathState(state, path);
+		}
+		*path.col_ += path.lcol_ * path.throughput_;
+	}
+}
+
+//! Samples the direction of the next bounce of the queued paths, removing the ones whose sample is black
+int WavefrontPathIntegrator::sampleBounce(RenderState &state, Path *paths, int *queue, int n_queue, int depth) const
+{
+	int n_alive = 0;
+	for(int q = 0; q < n_queue; ++q)
+	{
+		Path &path = paths[queue[q]];
+		loadPathState(state, path);
+		Sample s(0.f, 0.f, BsdfAll);
+		bounceSamples(state, path.offs_, depth, s.s_1_, s.s_2_);
+		float w = 0.f;
+		state.stats_->add(RenderStats::BsdfSamples);
+		Rgb scol = path.hit_.material_->sample(state, path.hit_, path.pwo_, path.ray_.dir_, s, w);
+		scol *= w;
+		storePathState(state, path);
+		if(scol.isBlack()) continue;
+
+		path.throughput_ *= scol;
+		path.caustic_ = trace_caustics_ && (s.sampled_flags_ & (BsdfSpecular | BsdfGlossy | BsdfFilter));
+		path.ray_.tmin_ = scene_->ray_min_dist_;
+		path.ray_.tmax_ = -1.0;
+		path.ray_.from_ = path.hit_.p_;
+		queue[n_alive++] = queue[q];
+	}
+	return n_alive;
+}
+
+Integrator *WavefrontPathIntegrator::factory(ParamMap &params, RenderEnvironment &render)
+{
+	WavefrontPathIntegrator *inte = new WavefrontPathIntegrator();
+	inte->setParams(params);
+	if(inte->guiding_)
+	{
+		Y_WARNING << inte->integrator_name_ << ": path guiding is not supported by the wavefront path tracer, disabling it" << YENDL;
+		inte->guiding_ = false;
+	}
+	return inte;
+}
+
+END_YAFARAY
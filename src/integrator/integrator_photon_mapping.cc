@@ -26,32 +26,42 @@
 #include "volume/volume.h"
 #include "common/param.h"
 #include "common/scene.h"
+#include "common/trace.h"
 
 BEGIN_YAFARAY
 
 void PhotonIntegrator::preGatherWorker(PreGatherData *gdata, float ds_rad, int n_search)
 {
-	unsigned int start, end, total;
+	TraceScope trace_scope("photon pre-gather", "photons");
+	//Guided scheduling: chunks are claimed without locking and shrink as the remaining work gets smaller, so all threads finish at about the same time
+	constexpr unsigned int min_chunk = 32;
+	const unsigned int total = gdata->rad_points_.size();
+	const unsigned int chunk_divisor = 4 * std::max(1, gdata->n_threads_);
+	const unsigned int progress_step = std::max(min_chunk, total / 100);
+	unsigned int progress = 0;
 	float ds_radius_2 = ds_rad * ds_rad;
 
-	gdata->mutx_.lock();
-	start = gdata->fetched_;
-	total = gdata->rad_points_.size();
-	end = gdata->fetched_ = std::min(total, start + 32);
-	gdata->mutx_.unlock();
-
-	FoundPhoton *gathered = new FoundPhoton[n_search];
+	std::vector<FoundPhoton> gathered(n_search);
 
 	float radius = 0.f;
 	float i_scale = 1.f / ((float)gdata->diffuse_map_->nPaths() * M_PI);
 	float scale = 0.f;
 
-	while(start < total)
+	while(true)
 	{
+		unsigned int start = gdata->fetched_.load(std::memory_order_relaxed);
+		unsigned int end = total;
+		while(start < total)
+		{
+			end = std::min(total, start + std::max(min_chunk, (total - start) / chunk_divisor));
+			if(gdata->fetched_.compare_exchange_weak(start, end, std::memory_order_relaxed)) break;
+		}
+		if(start >= total) break;
+
 		for(unsigned int n = start; n < end; ++n)
 		{
 			radius = ds_radius_2;//actually the square radius...
-			int n_gathered = gdata->diffuse_map_->gather(gdata->rad_points_[n].pos_, gathered, n_search, radius);
+			int n_gathered = gdata->diffuse_map_->gather(gdata->rad_points_[n].pos_, gathered.data(), n_search, radius);
 
 			Vec3 rnorm = gdata->rad_points_[n].normal_;
 
@@ -72,13 +82,21 @@ void PhotonIntegrator::preGatherWorker(PreGatherData *gdata, float ds_rad, int n
 
 			gdata->radiance_vec_[n] = Photon(rnorm, gdata->rad_points_[n].pos_, sum);
 		}
-		gdata->mutx_.lock();
-		start = gdata->fetched_;
-		end = gdata->fetched_ = std::min(total, start + 32);
-		gdata->pbar_->update(32);
-		gdata->mutx_.unlock();
+		progress += end - start;
+		if(progress >= progress_step)
+		{
+			gdata->pbar_->mutx_.lock();
+			gdata->pbar_->update(progress);
+			gdata->pbar_->mutx_.unlock();
+			progress = 0;
+		}
+	}
+	if(progress > 0)
+	{
+		gdata->pbar_->mutx_.lock();
+		gdata->pbar_->update(progress);
+		gdata->pbar_->mutx_.unlock();
 	}
-	delete[] gathered;
 }
 
 PhotonIntegrator::PhotonIntegrator(unsigned int d_photons, unsigned int c_photons, bool transp_shad, int shadow_depth, float ds_rad, float c_rad)
@@ -105,8 +123,9 @@ PhotonIntegrator::~PhotonIntegrator()
 }
 
 
-void PhotonIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, const Pdf1D *light_power_d, int num_c_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces)
+void PhotonIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_caus_photons, const AliasPdf1D *light_power_d, int num_c_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces)
 {
+	TraceScope trace_scope("caustic photon shooting", "photons", thread_id);
 	Ray ray;
 	float light_num_pdf, light_pdf, s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
 	Rgb pcol;
@@ -117,8 +136,8 @@ void PhotonIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, cons
 
 	SurfacePoint sp;
 	RenderState state;
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(scene->getUserDataSize());
 	state.cam_ = scene->getCamera();
 
 	float f_num_lights = (float)num_c_lights;
@@ -254,8 +273,9 @@ void PhotonIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, cons
 	caustic_map->mutx_.unlock();
 }
 
-void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, const Scene *scene, unsigned int n_diffuse_photons, const Pdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, bool final_gather, PreGatherData &pgdat)
+void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, const Scene *scene, unsigned int n_diffuse_photons, const AliasPdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, bool final_gather, PreGatherData &pgdat)
 {
+	TraceScope trace_scope("diffuse photon shooting", "photons", thread_id);
 	Ray ray;
 	float light_num_pdf, light_pdf, s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
 	Rgb pcol;
@@ -266,8 +286,8 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 
 	SurfacePoint sp;
 	RenderState state;
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(scene->getUserDataSize());
 	state.cam_ = scene->getCamera();
 
 	float f_num_lights = (float)num_d_lights;
@@ -457,8 +477,24 @@ bool PhotonIntegrator::preprocess()
 		set << " FG paths=" << n_paths_ << " bounces=" << gather_bounces_ << "  ";
 	}
 
+	irradiance_cache_.reset();
+	if(use_photon_diffuse_ && final_gather_ && use_irradiance_cache_)
+	{
+		//records are not smaller than the diffuse photon search radius, below it the radiance map has no detail anyway
+		min_record_radius_ = ds_radius_;
+		max_record_radius_ = 10.f * ds_radius_;
+		irradiance_cache_ = std::unique_ptr<IrradianceCache>(new IrradianceCache(max_record_radius_, irradiance_cache_accuracy_));
+		set << " IrrCache accuracy=" << irradiance_cache_accuracy_ << "  ";
+	}
+
+	//the photon maps generated for the same scene contents with the same settings are reused without asking
+	const std::string maps_key = photonMapsKey();
+	const bool maps_unchanged = (photon_map_processing_ == PhotonsGenerateOnly && session__.photon_maps_key_ == maps_key);
+	if(maps_unchanged) Y_INFO << integrator_name_ << ": Scene contents and photon settings unchanged, reusing the photon maps from memory" << YENDL;
+
 	if(photon_map_processing_ == PhotonsLoad)
 	{
+		session__.photon_maps_key_.clear();
 		bool caustic_map_failed_load = false;
 		bool diffuse_map_failed_load = false;
 		bool fg_radiance_map_failed_load = false;
@@ -534,13 +570,13 @@ bool PhotonIntegrator::preprocess()
 	{
 		set << " (loading photon maps from file)";
 	}
-	else if(photon_map_processing_ == PhotonsReuse)
+	else if(photon_map_processing_ == PhotonsReuse || maps_unchanged)
 	{
 		set << " (reusing photon maps from memory)";
 	}
 	else if(photon_map_processing_ == PhotonsGenerateAndSave) set << " (saving photon maps to file)";
 
-	if(photon_map_processing_ == PhotonsLoad || photon_map_processing_ == PhotonsReuse)
+	if(photon_map_processing_ == PhotonsLoad || photon_map_processing_ == PhotonsReuse || maps_unchanged)
 	{
 		g_timer__.stop("prepass");
 		Y_INFO << integrator_name_ << ": Photonmap building time: " << std::fixed << std::setprecision(1) << g_timer__.getTime("prepass") << "s" << YENDL;
@@ -554,6 +590,7 @@ bool PhotonIntegrator::preprocess()
 		return true;
 	}
 
+	session__.photon_maps_key_.clear();
 	session__.diffuse_map_->clear();
 	session__.diffuse_map_->setNumPaths(0);
 	session__.diffuse_map_->reserveMemory(n_diffuse_photons_);
@@ -583,8 +620,8 @@ bool PhotonIntegrator::preprocess()
 
 	SurfacePoint sp;
 	RenderState state;
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
 	state.cam_ = scene_->getCamera();
 	int pb_step;
 
@@ -612,7 +649,7 @@ bool PhotonIntegrator::preprocess()
 
 		for(int i = 0; i < num_d_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy();
 
-		light_power_d_ = new Pdf1D(energies, num_d_lights);
+		light_power_d_ = new AliasPdf1D(energies, num_d_lights);
 
 		Y_VERBOSE << integrator_name_ << ": Light(s) photon color testing for diffuse map:" << YENDL;
 		for(int i = 0; i < num_d_lights; ++i)
@@ -637,7 +674,7 @@ bool PhotonIntegrator::preprocess()
 
 		int n_threads = scene_->getNumThreadsPhotons();
 
-		n_diffuse_photons_ = std::max((unsigned int) n_threads, (n_diffuse_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
+		n_diffuse_photons_ = roundPhotonsToThreads(n_diffuse_photons_, n_threads);
 
 		Y_PARAMS << integrator_name_ << ": Shooting " << n_diffuse_photons_ << " photons across " << n_threads << " threads (" << (n_diffuse_photons_ / n_threads) << " photons/thread)" << YENDL;
 
@@ -649,6 +686,7 @@ bool PhotonIntegrator::preprocess()
 		}
 		else
 		{
+			TraceScope trace_scope("diffuse photon shooting", "photons", 0);
 			bool done = false;
 
 			float inv_diff_photons = 1.f / (float)n_diffuse_photons_;
@@ -831,7 +869,7 @@ bool PhotonIntegrator::preprocess()
 
 		for(int i = 0; i < num_c_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy();
 
-		light_power_d_ = new Pdf1D(energies, num_c_lights);
+		light_power_d_ = new AliasPdf1D(energies, num_c_lights);
 
 		Y_VERBOSE << integrator_name_ << ": Light(s) photon color testing for caustics map:" << YENDL;
 		for(int i = 0; i < num_c_lights; ++i)
@@ -852,7 +890,7 @@ bool PhotonIntegrator::preprocess()
 
 		int n_threads = scene_->getNumThreadsPhotons();
 
-		n_caus_photons_ = std::max((unsigned int) n_threads, (n_caus_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
+		n_caus_photons_ = roundPhotonsToThreads(n_caus_photons_, n_threads);
 
 		Y_PARAMS << integrator_name_ << ": Shooting " << n_caus_photons_ << " photons across " << n_threads << " threads (" << (n_caus_photons_ / n_threads) << " photons/thread)" << YENDL;
 
@@ -865,6 +903,7 @@ bool PhotonIntegrator::preprocess()
 		}
 		else
 		{
+			TraceScope trace_scope("caustic photon shooting", "photons", 0);
 			bool done = false;
 			float inv_caust_photons = 1.f / (float)n_caus_photons_;
 			float s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
@@ -1049,6 +1088,8 @@ bool PhotonIntegrator::preprocess()
 		pgdat.pbar_->init(pgdat.rad_points_.size());
 		pgdat.pbar_->setTag("Pregathering radiance data for final gathering...");
 
+		pgdat.n_threads_ = n_threads;
+
 		std::vector<std::thread> threads;
 		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&PhotonIntegrator::preGatherWorker, this, &pgdat, ds_radius_, n_diffuse_search_));
 		for(auto &t : threads) t.join();
@@ -1074,6 +1115,8 @@ bool PhotonIntegrator::preprocess()
 		Y_VERBOSE << integrator_name_ << ": Caustic photon map: done." << YENDL;
 	}
 
+	if(!(scene_->getSignals() & Y_SIG_ABORT)) session__.photon_maps_key_ = maps_key;
+
 	if(photon_map_processing_ == PhotonsGenerateAndSave)
 	{
 		if(use_photon_diffuse_)
@@ -1116,31 +1159,134 @@ bool PhotonIntegrator::preprocess()
 // final gathering: this is basically a full path tracer only that it uses the radiance map only
 // at the path end. I.e. paths longer than 1 are only generated to overcome lack of local radiance detail.
 // precondition: initBSDF of current spot has been called!
-Rgb PhotonIntegrator::finalGathering(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, ColorPasses &color_passes) const
+Rgb PhotonIntegrator::traceGatherPath(RenderState &state, Ray &p_ray, Rgb throughput, unsigned int offs, ColorPasses &tmp_color_passes, SurfacePoint &hit, bool &did_hit) const
 {
 	Rgb path_col(0.0);
-	void *first_udat = state.userdata_;
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	void *n_udat = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
 	const VolumeHandler *vol;
 	Rgb vcol(0.f);
 	float w = 0.f;
+	Rgb lcol, scol;
+	float s_1, s_2;
+
+	if(!(did_hit = scene_->intersect(p_ray, hit))) return path_col;   //hit background
+
+	const Material *p_mat = hit.material_;
+	float length = p_ray.tmax_;
+	Bsdf_t mat_bsd_fs = p_mat->getFlags();
+	bool has_spec = mat_bsd_fs & BsdfSpecular;
+	bool caustic = false;
+	bool close = length < gather_dist_;
+	bool do_bounce = close || has_spec;
+	bool path_hit = true;
+	// further bounces construct a path just as with path tracing:
+	for(int depth = 0; depth < gather_bounces_ && do_bounce; ++depth)
+	{
+		int d_4 = 4 * depth;
+		Vec3 pwo = -p_ray.dir_;
+		p_mat->initBsdf(state, hit, mat_bsd_fs);
+
+		if((mat_bsd_fs & BsdfVolumetric) && (vol = p_mat->getVolumeHandler(hit.n_ * pwo < 0)))
+		{
+			if(vol->transmittance(state, p_ray, vcol)) throughput *= vcol;
+		}
+
+		if(mat_bsd_fs & (BsdfDiffuse))
+		{
+			if(close)
+			{
+				lcol = estimateOneDirectLight(state, hit, pwo, offs, tmp_color_passes);
+			}
+			else if(caustic)
+			{
+				Vec3 sf = FACE_FORWARD(hit.ng_, hit.n_, pwo);
+				const Photon *nearest = session__.radiance_map_->findNearest(hit.p_, sf, lookup_rad_);
+				if(nearest) lcol = nearest->color();
+			}
+
+			if(close || caustic)
+			{
+				if(mat_bsd_fs & BsdfEmit) lcol += p_mat->emit(state, hit, pwo);
+				path_col += lcol * throughput;
+			}
+		}
+
+		s_1 = scrHalton__(d_4 + 3, offs);
+		s_2 = scrHalton__(d_4 + 4, offs);
+
+		if(state.ray_division_ > 1)
+		{
+			s_1 = addMod1__(s_1, state.dc_1_);
+			s_2 = addMod1__(s_2, state.dc_2_);
+		}
+
+		Sample sb(s_1, s_2, (close) ? BsdfAll : BsdfAllSpecular | BsdfFilter);
+		state.stats_->add(RenderStats::BsdfSamples);
+		scol = p_mat->sample(state, hit, pwo, p_ray.dir_, sb, w);
+
+		if(sb.pdf_ <= 1.0e-6f)
+		{
+			path_hit = false;
+			break;
+		}
+
+		scol *= w;
+
+		p_ray.tmin_ = scene_->ray_min_dist_;
+		p_ray.tmax_ = -1.0;
+		p_ray.from_ = hit.p_;
+		throughput *= scol;
+		path_hit = scene_->intersect(p_ray, hit);
+
+		if(!path_hit) //hit background
+		{
+			if(caustic && background_ && background_->hasIbl() && background_->shootsCaustic())
+			{
+				path_col += throughput * (*background_)(p_ray, state, true);
+			}
+			break;
+		}
+
+		p_mat = hit.material_;
+		length += p_ray.tmax_;
+		caustic = (caustic || !depth) && (sb.sampled_flags_ & (BsdfSpecular | BsdfFilter));
+		close = length < gather_dist_;
+		do_bounce = caustic || close;
+	}
+
+	if(path_hit)
+	{
+		p_mat->initBsdf(state, hit, mat_bsd_fs);
+		if(mat_bsd_fs & (BsdfDiffuse | BsdfGlossy))
+		{
+			Vec3 sf = FACE_FORWARD(hit.ng_, hit.n_, -p_ray.dir_);
+			const Photon *nearest = session__.radiance_map_->findNearest(hit.p_, sf, lookup_rad_);
+			if(nearest) lcol = nearest->color();
+			if(mat_bsd_fs & BsdfEmit) lcol += p_mat->emit(state, hit, -p_ray.dir_);
+			path_col += lcol * throughput;
+		}
+	}
+	return path_col;
+}
+
+Rgb PhotonIntegrator::finalGathering(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, ColorPasses &color_passes) const
+{
+	Rgb path_col(0.0);
+	void *first_udat = state.userdata_;
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	void *n_udat = state.arena_.alloc(scene_->getUserDataSize());
+	float w = 0.f;
 
 	ColorPasses tmp_color_passes(scene_->getRenderPasses());
 
 	int n_sampl = (int) ceilf(std::max(1, n_paths_ / state.ray_division_) * aa_indirect_sample_multiplier_);
 	for(int i = 0; i < n_sampl; ++i)
 	{
-		Rgb throughput(1.0);
-		float length = 0;
 		SurfacePoint hit = sp;
 		Vec3 pwo = wo;
 		Ray pRay;
-		Bsdf_t mat_bsd_fs;
-		bool did_hit;
 		const Material *p_mat = sp.material_;
 		unsigned int offs = n_paths_ * state.pixel_sample_ + state.sampling_offs_ + i; // some redundancy here...
-		Rgb lcol, scol;
+		Rgb scol;
 		// "zero'th" FG bounce:
 		float s_1 = riVdC__(offs);
 		float s_2 = scrHalton__(2, offs);
@@ -1151,6 +1297,7 @@ Rgb PhotonIntegrator::finalGathering(RenderState &state, const SurfacePoint &sp,
 		}
 
 		Sample s(s_1, s_2, BsdfDiffuse | BsdfReflect | BsdfTransmit); // glossy/dispersion/specular done via recursive raytracing
+		state.stats_->add(RenderStats::BsdfSamples);
 		scol = p_mat->sample(state, hit, pwo, pRay.dir_, s, w);
 
 		scol *= w;
@@ -1159,107 +1306,101 @@ Rgb PhotonIntegrator::finalGathering(RenderState &state, const SurfacePoint &sp,
 		pRay.tmin_ = scene_->ray_min_dist_;
 		pRay.tmax_ = -1.0;
 		pRay.from_ = hit.p_;
-		throughput = scol;
 
-		if(!(did_hit = scene_->intersect(pRay, hit))) continue;   //hit background
-
-		p_mat = hit.material_;
-		length = pRay.tmax_;
+		bool did_hit;
 		state.userdata_ = n_udat;
-		mat_bsd_fs = p_mat->getFlags();
-		bool has_spec = mat_bsd_fs & BsdfSpecular;
-		bool caustic = false;
-		bool close = length < gather_dist_;
-		bool do_bounce = close || has_spec;
-		// further bounces construct a path just as with path tracing:
-		for(int depth = 0; depth < gather_bounces_ && do_bounce; ++depth)
-		{
-			int d_4 = 4 * depth;
-			pwo = -pRay.dir_;
-			p_mat->initBsdf(state, hit, mat_bsd_fs);
-
-			if((mat_bsd_fs & BsdfVolumetric) && (vol = p_mat->getVolumeHandler(hit.n_ * pwo < 0)))
-			{
-				if(vol->transmittance(state, pRay, vcol)) throughput *= vcol;
-			}
-
-			if(mat_bsd_fs & (BsdfDiffuse))
-			{
-				if(close)
-				{
-					lcol = estimateOneDirectLight(state, hit, pwo, offs, tmp_color_passes);
-				}
-				else if(caustic)
-				{
-					Vec3 sf = FACE_FORWARD(hit.ng_, hit.n_, pwo);
-					const Photon *nearest = session__.radiance_map_->findNearest(hit.p_, sf, lookup_rad_);
-					if(nearest) lcol = nearest->color();
-				}
-
-				if(close || caustic)
-				{
-					if(mat_bsd_fs & BsdfEmit) lcol += p_mat->emit(state, hit, pwo);
-					path_col += lcol * throughput;
-				}
-			}
-
-			s_1 = scrHalton__(d_4 + 3, offs);
-			s_2 = scrHalton__(d_4 + 4, offs);
-
-			if(state.ray_division_ > 1)
-			{
-				s_1 = addMod1__(s_1, state.dc_1_);
-				s_2 = addMod1__(s_2, state.dc_2_);
-			}
-
-			Sample sb(s_1, s_2, (close) ? BsdfAll : BsdfAllSpecular | BsdfFilter);
-			scol = p_mat->sample(state, hit, pwo, pRay.dir_, sb, w);
-
-			if(sb.pdf_ <= 1.0e-6f)
-			{
-				did_hit = false;
-				break;
-			}
-
-			scol *= w;
+		path_col += traceGatherPath(state, pRay, scol, offs, tmp_color_passes, hit, did_hit);
+		state.userdata_ = first_udat;
+	}
+	return path_col / (float)n_sampl;
+}
 
-			pRay.tmin_ = scene_->ray_min_dist_;
-			pRay.tmax_ = -1.0;
-			pRay.from_ = hit.p_;
-			throughput *= scol;
-			did_hit = scene_->intersect(pRay, hit);
+Rgb PhotonIntegrator::finalGatheringCached(RenderState &state, const SurfacePoint &sp, const Vec3 &wo, Bsdf_t bsdfs, ColorPasses &color_passes) const
+{
+	//the cache only holds the incoming light, so it can only be used when the diffuse reflection does not depend on the direction of the light
+	if(!irradiance_cache_ || (bsdfs & BsdfTransmit)) return finalGathering(state, sp, wo, color_passes);
 
-			if(!did_hit) //hit background
-			{
-				if(caustic && background_ && background_->hasIbl() && background_->shootsCaustic())
-				{
-					path_col += throughput * (*background_)(pRay, state, true);
-				}
-				break;
-			}
+	const Vec3 n = FACE_FORWARD(sp.ng_, sp.n_, wo);
+	Rgb irradiance;
+	if(!irradiance_cache_->interpolate(sp.p_, n, irradiance))
+	{
+		//records are only added during the first AA pass, later passes just refine the pixels where the cache could not be used
+		if(state.pixel_sample_ >= aa_samples_) return finalGathering(state, sp, wo, color_passes);
+		irradiance = irradianceRecord(state, sp, n);
+	}
+	return irradiance * sp.material_->eval(state, sp, wo, n, BsdfDiffuse);
+}
 
-			p_mat = hit.material_;
-			length += pRay.tmax_;
-			caustic = (caustic || !depth) && (sb.sampled_flags_ & (BsdfSpecular | BsdfFilter));
-			close = length < gather_dist_;
-			do_bounce = caustic || close;
-		}
+Rgb PhotonIntegrator::irradianceRecord(RenderState &state, const SurfacePoint &sp, const Vec3 &n) const
+{
+	void *first_udat = state.userdata_;
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	void *n_udat = state.arena_.alloc(scene_->getUserDataSize());
+	ColorPasses tmp_color_passes(scene_->getRenderPasses());
 
-		if(did_hit)
+	Vec3 ru, rv;
+	createCs__(n, ru, rv);
+	IrradianceCache::Record record;
+	record.p_ = sp.p_;
+	record.n_ = n;
+	Rgb irradiance(0.f);
+	Vec3 gradient[3];
+	float inv_dist_sum = 0.f;
+
+	//records are shared by many pixels, so they use more paths than a single final gather to avoid blotches
+	const int n_sampl = std::max(1, 4 * n_paths_ / state.ray_division_);
+	for(int i = 0; i < n_sampl; ++i)
+	{
+		unsigned int offs = n_sampl * state.pixel_sample_ + state.sampling_offs_ + i;
+		float s_1 = riVdC__(offs);
+		float s_2 = scrHalton__(2, offs);
+		if(state.ray_division_ > 1)
 		{
-			p_mat->initBsdf(state, hit, mat_bsd_fs);
-			if(mat_bsd_fs & (BsdfDiffuse | BsdfGlossy))
-			{
-				Vec3 sf = FACE_FORWARD(hit.ng_, hit.n_, -pRay.dir_);
-				const Photon *nearest = session__.radiance_map_->findNearest(hit.p_, sf, lookup_rad_);
-				if(nearest) lcol = nearest->color();
-				if(mat_bsd_fs & BsdfEmit) lcol += p_mat->emit(state, hit, -pRay.dir_);
-				path_col += lcol * throughput;
-			}
+			s_1 = addMod1__(s_1, state.dc_1_);
+			s_2 = addMod1__(s_2, state.dc_2_);
 		}
+		Ray p_ray;
+		p_ray.dir_ = sampleCosHemisphere__(n, ru, rv, s_1, s_2);
+		p_ray.tmin_ = scene_->ray_min_dist_;
+		p_ray.tmax_ = -1.0;
+		p_ray.from_ = sp.p_;
+		const Vec3 dir = p_ray.dir_;
+
+		SurfacePoint hit;
+		bool did_hit;
+		state.userdata_ = n_udat;
+		const Rgb radiance = traceGatherPath(state, p_ray, Rgb(1.f), offs, tmp_color_passes, hit, did_hit);
 		state.userdata_ = first_udat;
+		if(!did_hit) continue;
+
+		irradiance += radiance;
+		const Vec3 d = hit.p_ - sp.p_;
+		const float dist_2 = std::max(d * d, 1.0e-8f);
+		const float dist = fSqrt__(dist_2);
+		inv_dist_sum += 1.f / dist;
+		//derivative of the form factor to the first hit point when moving along the surface, ignoring visibility changes
+		const float cos_hit = hit.ng_ * dir;
+		const float cos_hit_clamped = (cos_hit < 0.f) ? std::min(cos_hit, -0.1f) : std::max(cos_hit, 0.1f);
+		Vec3 g = hit.ng_ * (-1.f / (cos_hit_clamped * dist)) + d * (4.f / dist_2);
+		g -= n * (g * n);
+		gradient[0] += g * radiance.r_;
+		gradient[1] += g * radiance.g_;
+		gradient[2] += g * radiance.b_;
 	}
-	return path_col / (float)n_sampl;
+	const float inv_n_sampl = 1.f / (float)n_sampl;
+	record.irradiance_ = irradiance * inv_n_sampl;
+	const float harmonic_dist = (inv_dist_sum > 0.f) ? (float)n_sampl / inv_dist_sum : max_record_radius_;
+	record.radius_ = std::max(min_record_radius_, std::min(harmonic_dist, max_record_radius_));
+	const float max_gradient[3] = { record.irradiance_.r_ / record.radius_, record.irradiance_.g_ / record.radius_, record.irradiance_.b_ / record.radius_ };
+	for(int c = 0; c < 3; ++c)
+	{
+		record.gradient_[c] = gradient[c] * inv_n_sampl;
+		//the gradient estimate is noisy, so do not let it extrapolate the irradiance to negative values inside the record
+		const float length = record.gradient_[c].length();
+		if(length > max_gradient[c]) record.gradient_[c] *= max_gradient[c] / length;
+	}
+	irradiance_cache_->insert(record);
+	return record.irradiance_;
 }
 
 Rgba PhotonIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &color_passes, int additional_depth /*=0*/) const
@@ -1279,8 +1420,8 @@ Rgba PhotonIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &
 
 	if(scene_->intersect(ray, sp))
 	{
-		unsigned char userdata[USER_DATA_SIZE + 7];
-		state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+		const ScratchArena::Scope userdata_scope(state.arena_);
+		state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
 
 		if(state.raylevel_ == 0)
 		{
@@ -1326,11 +1467,11 @@ Rgba PhotonIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &
 
 					if(aa_clamp_indirect_ > 0.f)
 					{
-						Rgb tmp_col = finalGathering(state, sp, wo, color_passes);
+						Rgb tmp_col = finalGatheringCached(state, sp, wo, bsdfs, color_passes);
 						tmp_col.clampProportionalRgb(aa_clamp_indirect_);
 						col += color_passes.probeSet(PassIntDiffuseIndirect, tmp_col, state.raylevel_ == 0);
 					}
-					else col += color_passes.probeSet(PassIntDiffuseIndirect, finalGathering(state, sp, wo, color_passes), state.raylevel_ == 0);
+					else col += color_passes.probeSet(PassIntDiffuseIndirect, finalGatheringCached(state, sp, wo, bsdfs, color_passes), state.raylevel_ == 0);
 				}
 			}
 		}
@@ -1441,6 +1582,17 @@ Rgba PhotonIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &
 	return Rgba(col, alpha);
 }
 
+std::string PhotonIntegrator::photonMapsKey() const
+{
+	const int n_threads = scene_->getNumThreadsPhotons();
+	std::stringstream key;
+	key << "photons scene=" << scene_->getContentRevision() << " bounces=" << max_bounces_;
+	if(use_photon_diffuse_) key << " diffuse=" << roundPhotonsToThreads(n_diffuse_photons_, n_threads);
+	if(use_photon_diffuse_ && final_gather_) key << " radiance=" << ds_radius_ << "," << n_diffuse_search_;
+	if(use_photon_caustics_) key << " caustic=" << roundPhotonsToThreads(n_caus_photons_, n_threads) << "," << caus_depth_;
+	return key.str();
+}
+
 Integrator *PhotonIntegrator::factory(ParamMap &params, RenderEnvironment &render)
 {
 	bool transp_shad = false;
@@ -1467,6 +1619,8 @@ Integrator *PhotonIntegrator::factory(ParamMap &params, RenderEnvironment &rende
 	bool caustics = true;
 	bool diffuse = true;
 	std::string photon_maps_processing_str = "generate";
+	bool irradiance_cache = false;
+	float irradiance_cache_accuracy = 0.25f;
 
 	params.getParam("caustics", caustics);
 	params.getParam("diffuse", diffuse);
@@ -1495,6 +1649,8 @@ Integrator *PhotonIntegrator::factory(ParamMap &params, RenderEnvironment &rende
 	params.getParam("AO_distance", ao_dist);
 	params.getParam("AO_color", ao_col);
 	params.getParam("photon_maps_processing", photon_maps_processing_str);
+	params.getParam("fg_irradiance_cache", irradiance_cache);
+	params.getParam("fg_irradiance_cache_accuracy", irradiance_cache_accuracy);
 
 	PhotonIntegrator *ite = new PhotonIntegrator(num_photons, num_c_photons, transp_shad, shadow_depth, ds_rad, c_rad);
 
@@ -1511,6 +1667,8 @@ Integrator *PhotonIntegrator::factory(ParamMap &params, RenderEnvironment &rende
 	ite->gather_bounces_ = fg_bounces;
 	ite->show_map_ = show_map;
 	ite->gather_dist_ = gather_dist;
+	ite->use_irradiance_cache_ = irradiance_cache;
+	ite->irradiance_cache_accuracy_ = irradiance_cache_accuracy;
 	// Background settings
 	ite->transp_background_ = bg_transp;
 	ite->transp_refracted_background_ = bg_transp_refract;
@@ -25,6 +25,7 @@
 #include "volume/volume.h"
 #include "common/param.h"
 #include "common/scene.h"
+#include "common/trace.h"
 
 BEGIN_YAFARAY
 
@@ -43,6 +44,9 @@ SppmIntegrator::SppmIntegrator(unsigned int d_photons, int passnum, bool transp_
 	s_depth_ = shadow_depth;
 	tr_shad_ = transp_shad;
 	b_hashgrid_ = false;
+	pipelined_ = true;
+	diffuse_map_.setName("Diffuse Photon Map");
+	caustic_map_.setName("Caustic Photon Map");
 
 	hal_1_.setBase(2);
 	hal_2_.setBase(3);
@@ -57,7 +61,7 @@ SppmIntegrator::SppmIntegrator(unsigned int d_photons, int passnum, bool transp_
 
 SppmIntegrator::~SppmIntegrator()
 {
-
+	if(photon_thread_.joinable()) photon_thread_.join();
 }
 
 bool SppmIntegrator::preprocess()
@@ -136,8 +140,15 @@ bool SppmIntegrator::render(int num_view, yafaray4::ImageFilm *image_film)
 	if(scene_->passEnabled(PassIntZDepthNorm) || scene_->passEnabled(PassIntMist)) precalcDepths();
 
 	int acum_aa_samples = 1;
+	double pass_start = scene_->getRenderTime();
+
+	n_photons_ = roundPhotonsToThreads(n_photons_, scene_->getNumThreadsPhotons()); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
+	background_ = scene_->getBackground();
+	lights_ = scene_->lights_;
+	session__.photon_maps_key_.clear(); // the session photon maps are replaced every pass
 
 	initializePpm(); // seems could integrate into the preRender
+	trace_next_photons_ = pipelined_ && pass_num_ > 1;
 	if(session__.renderResumed())
 	{
 		acum_aa_samples = image_film_->getSamplingOffset();
@@ -150,18 +161,33 @@ bool SppmIntegrator::render(int num_view, yafaray4::ImageFilm *image_film)
 
 	pm_ire_ = false;
 
+	float time_budget = 0.f, noise_target = 0.f;
+	scene_->getRenderBudget(time_budget, noise_target);
+	if(noise_target > 0.f) Y_WARNING << integrator_name_ << ": the noise target is not supported, as the passes refine the same biased estimate. Only the time budget is used" << YENDL;
+	double pass_seconds = scene_->getRenderTime() - pass_start;
+
 	int hp_num = camera->resX() * camera->resY();
 	int pass_info = 1;
 	for(int i = 1; i < pass_num_; ++i) //progress pass, the offset start from 1 as it is 0 based.
 	{
 		if(scene_->getSignals() & Y_SIG_ABORT) break;
+		//all the passes cost about the same, so no pass is started if the last one would not fit in the time left
+		pass_start = scene_->getRenderTime();
+		if(time_budget > 0.f && pass_start + pass_seconds > time_budget)
+		{
+			Y_INFO << integrator_name_ << ": Render time budget reached after " << i << " passes, stopping the render" << YENDL;
+			break;
+		}
 		pass_info = i + 1;
 		image_film_->nextPass(num_view, false, integrator_name_);
 		n_refined_ = 0;
+		trace_next_photons_ = pipelined_ && i + 1 < pass_num_ && (time_budget <= 0.f || pass_start + 2.f * pass_seconds <= time_budget);
 		renderPass(num_view, 1, acum_aa_samples, false, i); // offset are only related to the passNum, since we alway have only one sample.
+		pass_seconds = scene_->getRenderTime() - pass_start;
 		acum_aa_samples += 1;
 		Y_INFO << integrator_name_ << ": This pass refined " << n_refined_ << " of " << hp_num << " pixels." << YENDL;
 	}
+	if(photon_thread_.joinable()) photon_thread_.join(); // photons of a pass not rendered after an abort or with the time budget reached
 	max_depth_ = 0.f;
 	g_timer__.stop("rendert");
 	g_timer__.stop("imagesAutoSaveTimer");
@@ -216,6 +242,7 @@ bool SppmIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 	ColorPasses color_passes(scene_->getRenderPasses());
 
 	ColorPasses tmp_passes_zero(scene_->getRenderPasses());
+	const SamplePassesProcessing sample_passes_processing(color_passes);
 
 	for(int i = a.y_; i < end_y; ++i)
 	{
@@ -246,6 +273,7 @@ bool SppmIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 					lens_v = scrHalton__(4, rstate.pixel_sample_ + rstate.sampling_offs_);
 				}
 				c_ray = camera->shootRay(j + dx, i + dy, lens_u, lens_v, wt); // wt need to be considered
+				rstate.stats_->add(RenderStats::CameraRays);
 				if(wt == 0.0)
 				{
 					image_film_->addSample(tmp_passes_zero, j, i, dx, dy, &a); //maybe not need
@@ -267,28 +295,20 @@ bool SppmIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 				c_ray.time_ = rstate.time_;
 
 				//for sppm progressive
-				int index = ((i - y_start_film) * camera->resX()) + (j - x_start_film);
-				HitPoint_t &hp = hit_points_[index];
+				const size_t hp = hit_points_.index(j - x_start_film, i - y_start_film);
 
 				GatherInfo_t g_info = traceGatherRay(rstate, c_ray, hp, color_passes);
-				hp.constant_randiance_ += g_info.constant_randiance_; // accumulate the constant radiance for later usage.
 
 				// progressive refinement
-				const float alpha = 0.7f; // another common choice is 0.8, seems not changed much.
-
-				// The author's refine formular
 				if(g_info.photon_count_ > 0)
 				{
-					float g = std::min((hp.acc_photon_count_ + alpha * g_info.photon_count_) / (hp.acc_photon_count_ + g_info.photon_count_), 1.0f);
-					hp.radius_2_ *= g;
-					hp.acc_photon_count_ += g_info.photon_count_ * alpha;
-					hp.acc_photon_flux_ = (hp.acc_photon_flux_ + g_info.photon_flux_) * g;
+					hit_points_.refine(hp, g_info.photon_count_, g_info.photon_flux_);
 					n_refined_++; // record the pixel that has refined.
 				}
 
 				//radiance estimate
 				//colorPasses.probe_mult(PASS_INT_DIFFUSE_INDIRECT, 1.f / (hp.radius2 * M_PI * totalnPhotons));
-				Rgba color = color_passes.probeSet(PassIntIndirect, hp.acc_photon_flux_ / (hp.radius_2_ * M_PI * totaln_photons_));
+				Rgba color = color_passes.probeSet(PassIntIndirect, hit_points_.accPhotonFlux(hp) / (hit_points_.radius_2_[hp] * M_PI * totaln_photons_));
 				color += g_info.constant_randiance_;
 				color.a_ = g_info.constant_randiance_.a_; //the alpha value is hold in the constantRadiance variable
 				if(color_passes.enabled(PassIntIndirect)) color_passes(PassIntIndirect).a_ = g_info.constant_randiance_.a_;
@@ -320,64 +340,7 @@ bool SppmIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 					}
 				}
 
-				for(int idx = 0; idx < color_passes.size(); ++idx)
-				{
-					if(color_passes(idx).a_ > 1.f) color_passes(idx).a_ = 1.f;
-
-					int int_pass_type = color_passes.intPassTypeFromIndex(idx);
-
-					switch(int_pass_type)
-					{
-						case PassIntZDepthNorm: break;
-						case PassIntZDepthAbs: break;
-						case PassIntMist: break;
-						case PassIntNormalSmooth: break;
-						case PassIntNormalGeom: break;
-						case PassIntAo: break;
-						case PassIntAoClay: break;
-						case PassIntUv: break;
-						case PassIntDebugNu: break;
-						case PassIntDebugNv: break;
-						case PassIntDebugDpdu: break;
-						case PassIntDebugDpdv: break;
-						case PassIntDebugDsdu: break;
-						case PassIntDebugDsdv: break;
-						case PassIntObjIndexAbs: break;
-						case PassIntObjIndexNorm: break;
-						case PassIntObjIndexAuto: break;
-						case PassIntObjIndexAutoAbs: break;
-						case PassIntMatIndexAbs: break;
-						case PassIntMatIndexNorm: break;
-						case PassIntMatIndexAuto: break;
-						case PassIntMatIndexAutoAbs: break;
-						case PassIntAaSamples: break;
-
-						//Processing of mask render passes:
-						case PassIntObjIndexMask:
-						case PassIntObjIndexMaskShadow:
-						case PassIntObjIndexMaskAll:
-						case PassIntMatIndexMask:
-						case PassIntMatIndexMaskShadow:
-						case PassIntMatIndexMaskAll:
-
-							color_passes(idx).clampRgb01();
-
-							if(color_passes.getPassMaskInvert())
-							{
-								color_passes(idx) = Rgba(1.f) - color_passes(idx);
-							}
-
-							if(!color_passes.getPassMaskOnly())
-							{
-								Rgba col_combined = color_passes(PassIntCombined);
-								col_combined.a_ = 1.f;
-								color_passes(idx) *= col_combined;
-							}
-							break;
-
-						default: color_passes(idx) *= wt; break;
-					}
-				}
+				sample_passes_processing.apply(color_passes, wt);
 
 				image_film_->addSample(color_passes, j, i, dx, dy, &a, sample, aa_pass_number, inv_aa_max_possible_samples);
 			}
@@ -386,8 +349,9 @@ bool SppmIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 	return true;
 }
 
-void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_photons, const Pdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, Random &prng)
+void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map, int thread_id, const Scene *scene, unsigned int n_photons, const AliasPdf1D *light_power_d, int num_d_lights, const std::string &integrator_name, const std::vector<Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, Random &prng, int trace_thread)
 {
+	TraceScope trace_scope("photon shooting", "photons", trace_thread);
 	Ray ray;
 	float light_num_pdf, light_pdf, s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
 	Rgb pcol;
@@ -398,8 +362,8 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 
 	SurfacePoint sp;
 	RenderState state(&prng);
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(scene->getUserDataSize());
 	state.cam_ = scene->getCamera();
 
 	float f_num_lights = (float)num_d_lights;
@@ -548,9 +512,12 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 		++curr;
 		if(curr % pb_step == 0)
 		{
-			pb->mutx_.lock();
-			pb->update();
-			pb->mutx_.unlock();
+			if(pb)
+			{
+				pb->mutx_.lock();
+				pb->update();
+				pb->mutx_.unlock();
+			}
 			if(scene->getSignals() & Y_SIG_ABORT) { return; }
 		}
 		done = (curr >= n_photons_thread);
@@ -565,30 +532,50 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 }
 
 
-//photon pass, scatter photon
 void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 {
 	g_timer__.addEvent("prepass");
 	g_timer__.start("prepass");
 
+	if(photon_thread_.joinable())
+	{
+		// the photons of this pass were traced in the background while the last pass was rendered
+		photon_thread_.join();
+		session__.diffuse_map_->swap(diffuse_map_);
+		session__.caustic_map_->swap(caustic_map_);
+	}
+	else photonPass(session__.diffuse_map_, session__.caustic_map_, offset, true);
+	totaln_photons_ +=  n_photons_;	// accumulate the total photon number, not using nPath for the case of hashgrid.
+
+	// the hashgrid has no second buffer, so its photons are always traced between the passes
+	if(trace_next_photons_ && !b_hashgrid_) photon_thread_ = std::thread(&SppmIntegrator::photonPass, this, &diffuse_map_, &caustic_map_, offset + samples, false);
+
+	g_timer__.stop("prepass");
+}
+
+//photon pass, scatter photon
+void SppmIntegrator::photonPass(PhotonMap *diffuse_map, PhotonMap *caustic_map, int offset, bool show_progress)
+{
+	Timer timer;
+	timer.addEvent("photonpass");
+	timer.start("photonpass");
+
 	Y_INFO << integrator_name_ << ": Starting Photon tracing pass..." << YENDL;
 
 	if(b_hashgrid_) photon_grid_.clear();
 	else
 	{
-		session__.diffuse_map_->clear();
-		session__.diffuse_map_->setNumPaths(0);
-		session__.diffuse_map_->reserveMemory(n_photons_);
-		session__.diffuse_map_->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
-
-		session__.caustic_map_->clear();
-		session__.caustic_map_->setNumPaths(0);
-		session__.caustic_map_->reserveMemory(n_photons_);
-		session__.caustic_map_->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+		diffuse_map->clear();
+		diffuse_map->setNumPaths(0);
+		diffuse_map->reserveMemory(n_photons_);
+		diffuse_map->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+
+		caustic_map->clear();
+		caustic_map->setNumPaths(0);
+		caustic_map->reserveMemory(n_photons_);
+		caustic_map->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
 	}
 
-	background_ = scene_->getBackground();
-	lights_ = scene_->lights_;
 	std::vector<Light *> tmplights;
 
 	//background do not emit photons, or it is merged into normal light?
@@ -613,7 +600,7 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 
 	for(int i = 0; i < num_d_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy();
 
-	light_power_d_ = new Pdf1D(energies, num_d_lights);
+	light_power_d_ = new AliasPdf1D(energies, num_d_lights);
 
 	Y_VERBOSE << integrator_name_ << ": Light(s) photon color testing for photon map:" << YENDL;
 
@@ -633,43 +620,47 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 	SurfacePoint sp;
 	Random prng(rand() + offset * (4517) + 123);
 	RenderState state(&prng);
-	unsigned char userdata[USER_DATA_SIZE + 7];
-	state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+	const ScratchArena::Scope userdata_scope(state.arena_);
+	state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
 	state.cam_ = scene_->getCamera();
 
-	ProgressBar *pb;
+	// the photons traced in the background leave the progress bar to the pass being rendered
+	ProgressBar *pb = nullptr;
 	std::string previous_progress_tag;
 	int previous_progress_total_steps = 0;
-	int pb_step;
-	if(intpb_)
+	int pb_step = std::max(1U, n_photons_ / 128);
+	if(show_progress)
 	{
-		pb = intpb_;
-		previous_progress_tag = pb->getTag();
-		previous_progress_total_steps = pb->getTotalSteps();
+		if(intpb_)
+		{
+			pb = intpb_;
+			previous_progress_tag = pb->getTag();
+			previous_progress_total_steps = pb->getTotalSteps();
+		}
+		else pb = new ConsoleProgressBar(80);
+		pb->init(128);
+		pb->setTag(previous_progress_tag + " - building photon map...");
 	}
-	else pb = new ConsoleProgressBar(80);
 
 	if(b_hashgrid_) Y_INFO << integrator_name_ << ": Building photon hashgrid..." << YENDL;
 	else Y_INFO << integrator_name_ << ": Building photon map..." << YENDL;
 
-	pb->init(128);
-	pb_step = std::max(1U, n_photons_ / 128);
-	pb->setTag(previous_progress_tag + " - building photon map...");
-
 	int n_threads = scene_->getNumThreadsPhotons();
 
-	n_photons_ = std::max((unsigned int) n_threads, (n_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
-
 	Y_PARAMS << integrator_name_ << ": Shooting " << n_photons_ << " photons across " << n_threads << " threads (" << (n_photons_ / n_threads) << " photons/thread)" << YENDL;
 
+	//The photon passes shot in the background while rendering are traced after the render worker threads
+	const int trace_thread_base = show_progress ? 0 : scene_->getNumThreads();
+
 	if(n_threads >= 2)
 	{
 		std::vector<std::thread> threads;
-		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&SppmIntegrator::photonWorker, this, session__.diffuse_map_, session__.caustic_map_, i, scene_, n_photons_, light_power_d_, num_d_lights, std::ref(integrator_name_), tmplights, pb, pb_step, std::ref(curr), max_bounces_, std::ref(prng)));
+		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&SppmIntegrator::photonWorker, this, diffuse_map, caustic_map, i, scene_, n_photons_, light_power_d_, num_d_lights, std::ref(integrator_name_), tmplights, pb, pb_step, std::ref(curr), max_bounces_, std::ref(prng), trace_thread_base + i));
 		for(auto &t : threads) t.join();
 	}
 	else
 	{
+		TraceScope trace_scope("photon shooting", "photons", trace_thread_base);
 		bool done = false;
 
 		//Pregather  photons
@@ -680,7 +671,12 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 
 		while(!done)
 		{
-			if(scene_->getSignals() & Y_SIG_ABORT) {  pb->done(); if(!intpb_) delete pb; return; }
+			if(scene_->getSignals() & Y_SIG_ABORT)
+			{
+				if(pb) pb->done();
+				if(pb && !intpb_) delete pb;
+				return;
+			}
 			state.chromatic_ = true;
 			state.wavelength_ = scrHalton__(5, curr);
 
@@ -741,8 +737,8 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 					if(b_hashgrid_) photon_grid_.pushPhoton(np);
 					else
 					{
-						session__.diffuse_map_->pushPhoton(np);
-						session__.diffuse_map_->setNumPaths(curr);
+						diffuse_map->pushPhoton(np);
+						diffuse_map->setNumPaths(curr);
 					}
 					nd_photon_stored++;
 				}
@@ -754,8 +750,8 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 					if(b_hashgrid_) photon_grid_.pushPhoton(np);
 					else
 					{
-						session__.caustic_map_->pushPhoton(np);
-						session__.caustic_map_->setNumPaths(curr);
+						caustic_map->pushPhoton(np);
+						caustic_map->setNumPaths(curr);
 					}
 					nd_photon_stored++;
 				}
@@ -795,20 +791,21 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 
 			}
 			++curr;
-			if(curr % pb_step == 0) pb->update();
+			if(pb && curr % pb_step == 0) pb->update();
 			done = (curr >= n_photons_);
 		}
 	}
 
-	pb->done();
-	pb->setTag(previous_progress_tag + " - photon map built.");
+	if(pb)
+	{
+		pb->done();
+		pb->setTag(previous_progress_tag + " - photon map built.");
+	}
 	Y_VERBOSE << integrator_name_ << ":Photon map built." << YENDL;
 	Y_INFO << integrator_name_ << ": Shot " << curr << " photons from " << num_d_lights << " light(s)" << YENDL;
 	delete light_power_d_;
 
-	totaln_photons_ +=  n_photons_;	// accumulate the total photon number, not using nPath for the case of hashgrid.
-
-	Y_VERBOSE << integrator_name_ << ": Stored photons: " << session__.diffuse_map_->nPhotons() + session__.caustic_map_->nPhotons() << YENDL;
+	Y_VERBOSE << integrator_name_ << ": Stored photons: " << diffuse_map->nPhotons() + caustic_map->nPhotons() << YENDL;
 
 	if(b_hashgrid_)
 	{
@@ -818,19 +815,19 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 	}
 	else
 	{
-		if(session__.diffuse_map_->nPhotons() > 0)
+		if(diffuse_map->nPhotons() > 0)
 		{
 			Y_INFO << integrator_name_ << ": Building diffuse photons kd-tree:" << YENDL;
-			session__.diffuse_map_->updateTree();
+			diffuse_map->updateTree();
 			Y_VERBOSE << integrator_name_ << ": Done." << YENDL;
 		}
-		if(session__.caustic_map_->nPhotons() > 0)
+		if(caustic_map->nPhotons() > 0)
 		{
 			Y_INFO << integrator_name_ << ": Building caustic photons kd-tree:" << YENDL;
-			session__.caustic_map_->updateTree();
+			caustic_map->updateTree();
 			Y_VERBOSE << integrator_name_ << ": Done." << YENDL;
 		}
-		if(session__.diffuse_map_->nPhotons() < 50)
+		if(diffuse_map->nPhotons() < 50)
 		{
 			Y_ERROR << integrator_name_ << ": Too few photons, stopping now." << YENDL;
 			return;
@@ -839,16 +836,16 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive)
 
 	tmplights.clear();
 
-	if(!intpb_) delete pb;
+	if(pb && !intpb_) delete pb;
 
-	g_timer__.stop("prepass");
+	timer.stop("photonpass");
 
 	if(b_hashgrid_)
-		Y_INFO << integrator_name_ << ": PhotonGrid building time: " << g_timer__.getTime("prepass") << YENDL;
+		Y_INFO << integrator_name_ << ": PhotonGrid building time: " << timer.getTime("photonpass") << YENDL;
 	else
-		Y_INFO << integrator_name_ << ": PhotonMap building time: " << g_timer__.getTime("prepass") << YENDL;
+		Y_INFO << integrator_name_ << ": PhotonMap building time: " << timer.getTime("photonpass") << YENDL;
 
-	if(intpb_)
+	if(pb && intpb_)
 	{
 		intpb_->setTag(previous_progress_tag);
 		intpb_->init(previous_progress_total_steps);
@@ -864,7 +861,7 @@ Rgba SppmIntegrator::integrate(RenderState &state, DiffRay &ray, ColorPasses &co
 }
 
 
-GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafaray4::DiffRay &ray, yafaray4::HitPoint_t &hp, ColorPasses &color_passes)
+GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafaray4::DiffRay &ray, size_t hp_index, ColorPasses &color_passes)
 {
 	static int n_max = 0;
 	static int calls = 0;
@@ -883,8 +880,8 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 
 	if(scene_->intersect(ray, sp))
 	{
-		unsigned char userdata[USER_DATA_SIZE + 7];
-		state.userdata_ = (void *)(&userdata[7] - (((size_t)&userdata[7]) & 7));   // pad userdata to 8 bytes
+		const ScratchArena::Scope userdata_scope(state.arena_);
+		state.userdata_ = state.arena_.alloc(scene_->getUserDataSize());
 		if(state.raylevel_ == 0)
 		{
 			state.chromatic_ = true;
@@ -915,7 +912,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 		FoundPhoton *gathered = new FoundPhoton[n_max_gather__];
 
 		//if PM_IRE is on. we should estimate the initial radius using the photonMaps. (PM_IRE is only for the first pass, so not consume much time)
-		if(pm_ire_ && !hp.radius_setted_) // "waste" two gather here as it has two maps now. This make the logic simple.
+		if(pm_ire_ && !hit_points_.radius_setted_[hp_index]) // "waste" two gather here as it has two maps now. This make the logic simple.
 		{
 			float radius_1 = ds_radius_ * ds_radius_;
 			float radius_2 = radius_1;
@@ -928,16 +925,16 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 			if(n_gathered_1 > 0 || n_gathered_2 > 0) // it none photon gathered, we just skip.
 			{
 				if(radius_1 < radius_2) // we choose the smaller one to be the initial radius.
-					hp.radius_2_ = radius_1;
+					hit_points_.radius_2_[hp_index] = radius_1;
 				else
-					hp.radius_2_ = radius_2;
+					hit_points_.radius_2_[hp_index] = radius_2;
 
-				hp.radius_setted_ = true;
+				hit_points_.radius_setted_[hp_index] = true;
 			}
 		}
 
 		int n_gathered = 0;
-		float radius_2 = hp.radius_2_;
+		float radius_2 = hit_points_.radius_2_[hp_index];
 
 		if(b_hashgrid_)
 			n_gathered = photon_grid_.gather(sp.p_, gathered, n_max_gather__, radius_2); // disable now
@@ -988,7 +985,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 			if(bsdfs & BsdfDiffuse && session__.caustic_map_->ready())
 			{
 
-				radius_2 = hp.radius_2_; //reset radius2 & nGathered
+				radius_2 = hit_points_.radius_2_[hp_index]; //reset radius2 & nGathered
 				n_gathered = session__.caustic_map_->gather(sp.p_, gathered, n_max_gather__, radius_2);
 				if(n_gathered > 0)
 				{
@@ -1047,6 +1044,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 					state.ray_offset_ = branch;
 					++branch;
 					Sample s(0.5f, 0.5f, BsdfReflect | BsdfTransmit | BsdfDispersive);
+					state.stats_->add(RenderStats::BsdfSamples);
 					Rgb mcol = material->sample(state, sp, wo, wi, s, w);
 
 					if(s.pdf_ > 1.0e-6f && (s.sampled_flags_ & BsdfDispersive))
@@ -1055,7 +1053,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 						Rgb wl_col;
 						wl2Rgb__(state.wavelength_, wl_col);
 						ref_ray = DiffRay(sp.p_, wi, scene_->ray_min_dist_);
-						t_cing = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+						t_cing = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 						t_cing.photon_flux_ *= mcol * wl_col * w;
 						t_cing.constant_randiance_ *= mcol * wl_col * w;
 
@@ -1127,6 +1125,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 					float W = 0.f;
 
 					Sample s(s_1, s_2, BsdfAllGlossy);
+					state.stats_->add(RenderStats::BsdfSamples);
 					Rgb mcol = material->sample(state, sp, wo, wi, s, W);
 
 					if((material->getFlags() & BsdfReflect) && !(material->getFlags() & BsdfTransmit))
@@ -1134,6 +1133,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 						float w = 0.f;
 
 						Sample s(s_1, s_2, BsdfGlossy | BsdfReflect);
+						state.stats_->add(RenderStats::BsdfSamples);
 						Rgb mcol = material->sample(state, sp, wo, wi, s, w);
 						Rgba integ = 0.f;
 						ref_ray = DiffRay(sp.p_, wi, scene_->ray_min_dist_);
@@ -1147,7 +1147,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 						}
 
 						//gcol += tmpColorPasses.probe_add(PASS_INT_GLOSSY_INDIRECT, (Rgb)integ * mcol * W, state.raylevel == 1);
-						t_ging = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+						t_ging = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 						t_ging.photon_flux_ *= mcol * w;
 						t_ging.constant_randiance_ *= mcol * w;
 						ging += t_ging;
@@ -1159,6 +1159,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 						float w[2];
 						Vec3 dir[2];
 
+						state.stats_->add(RenderStats::BsdfSamples);
 						mcol[0] = material->sample(state, sp, wo, dir, mcol[1], s, w);
 						Rgba integ = 0.f;
 
@@ -1173,7 +1174,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 							}
 							Rgb col_reflect_factor = mcol[0] * w[0];
 
-							t_ging = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+							t_ging = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 							t_ging.photon_flux_ *= col_reflect_factor;
 							t_ging.constant_randiance_ *= col_reflect_factor;
 
@@ -1193,7 +1194,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 
 							Rgb col_transmit_factor = mcol[1] * w[1];
 							alpha = integ.a_;
-							t_ging = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+							t_ging = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 							t_ging.photon_flux_ *= col_transmit_factor;
 							t_ging.constant_randiance_ *= col_transmit_factor;
 							tmp_color_passes.probeAdd(PassIntGlossyIndirect, (Rgb) t_ging.constant_randiance_, state.raylevel_ == 1);
@@ -1210,7 +1211,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 							else if(s.sampled_flags_ & BsdfTransmit) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
 						}
 
-						t_ging = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+						t_ging = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 						t_ging.photon_flux_ *= mcol * W;
 						t_ging.constant_randiance_ *= mcol * W;
 						tmp_color_passes.probeAdd(PassIntGlossyIndirect, t_ging.constant_randiance_, state.raylevel_ == 1);
@@ -1259,7 +1260,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 				{
 					DiffRay ref_ray(sp.p_, dir[0], scene_->ray_min_dist_);
 					if(diff_rays_enabled_) sp_diff.reflectedRay(ray, ref_ray); // compute the ray differentaitl
-					GatherInfo_t refg = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+					GatherInfo_t refg = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 					if((bsdfs & BsdfVolumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 					{
 						if(vol->transmittance(state, ref_ray, vcol))
@@ -1276,7 +1277,7 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 				{
 					DiffRay ref_ray(sp.p_, dir[1], scene_->ray_min_dist_);
 					if(diff_rays_enabled_) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
-					GatherInfo_t refg = traceGatherRay(state, ref_ray, hp, tmp_color_passes);
+					GatherInfo_t refg = traceGatherRay(state, ref_ray, hp_index, tmp_color_passes);
 					if((bsdfs & BsdfVolumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 					{
 						if(vol->transmittance(state, ref_ray, vcol))
@@ -1346,34 +1347,39 @@ GatherInfo_t SppmIntegrator::traceGatherRay(yafaray4::RenderState &state, yafara
 void SppmIntegrator::initializePpm()
 {
 	const Camera *camera = scene_->getCamera();
-	unsigned int resolution = camera->resX() * camera->resY();
-
-	hit_points_.reserve(resolution);
 	Bound b_box = scene_->getSceneBound(); // Now using Scene Bound, this could get a bigger initial radius, and need more tests
 
 	// initialize SPPM statistics
 	float initial_radius = ((b_box.longX() + b_box.longY() + b_box.longZ()) / 3.f) / ((camera->resX() + camera->resY()) / 2.0f) * 2.f ;
 	initial_radius = std::min(initial_radius, 1.f); //Fix the overflow bug
-	for(unsigned int i = 0; i < resolution; i++)
-	{
-		HitPoint_t hp;
-		hp.acc_photon_flux_  = Rgba(0.f);
-		hp.acc_photon_count_ = 0;
-		hp.radius_2_ = (initial_radius * initial_factor_) * (initial_radius * initial_factor_);
-		hp.constant_randiance_ = Rgba(0.f);
-		hp.radius_setted_ = false;	   // the flag used for IRE
-
-		hit_points_.push_back(hp);
-	}
+	hit_points_.init(image_film_->getWidth(), image_film_->getHeight(), image_film_->getTileSize(), (initial_radius * initial_factor_) * (initial_radius * initial_factor_), pm_ire_);
+	Y_VERBOSE << integrator_name_ << ": Hit points: " << hit_points_.radius_2_.size() << " (" << hit_points_.bytesPerPixel() << " bytes each)" << YENDL;
 
 	if(b_hashgrid_) photon_grid_.setParm(initial_radius * 2.f, n_photons_, b_box);
 
 }
 
+void HitPoints::init(int width, int height, int block_size, float radius_2, bool radius_estimate)
+{
+	block_size_ = std::max(1, block_size);
+	blocks_x_ = (width + block_size_ - 1) / block_size_;
+	const int blocks_y = (height + block_size_ - 1) / block_size_;
+	// the blocks at the right and bottom borders are allocated whole, so that all the blocks have the same layout
+	const size_t size = (size_t) blocks_x_ * blocks_y * block_size_ * block_size_;
+	radius_2_.assign(size, radius_2);
+	acc_photon_count_.assign(size, 0);
+	acc_photon_flux_r_.assign(size, 0.f);
+	acc_photon_flux_g_.assign(size, 0.f);
+	acc_photon_flux_b_.assign(size, 0.f);
+	if(radius_estimate) radius_setted_.assign(size, false);
+	else radius_setted_.clear();
+}
+
 Integrator *SppmIntegrator::factory(ParamMap &params, RenderEnvironment &render)
 {
 	bool transp_shad = false;
 	bool pm_ire = false;
+	bool pipelined = true;
 	int shadow_depth = 5; //may used when integrate Direct Light
 	int raydepth = 5;
 	int pass_num = 1000;
@@ -1400,6 +1406,7 @@ Integrator *SppmIntegrator::factory(ParamMap &params, RenderEnvironment &render)
 	params.getParam("photonRadius", ds_rad);
 	params.getParam("searchNum", search_num);
 	params.getParam("pmIRE", pm_ire);
+	params.getParam("pipelinePhotons", pipelined);
 
 	params.getParam("bg_transp", bg_transp);
 	params.getParam("bg_transp_refract", bg_transp_refract);
@@ -1416,6 +1423,7 @@ Integrator *SppmIntegrator::factory(ParamMap &params, RenderEnvironment &render)
 	ite->ds_radius_ = ds_rad; // under tests enable now
 	ite->n_search_ = search_num;
 	ite->pm_ire_ = pm_ire;
+	ite->pipelined_ = pipelined;
 	// Background settings
 	ite->transp_background_ = bg_transp;
 	ite->transp_refracted_background_ = bg_transp_refract;
@@ -38,6 +38,7 @@
 #include "common/monitor.h"
 #include "utility/util_mcqmc.h"
 #include "utility/util_sample.h"
+#include "common/trace.h"
 #include <sstream>
 
 BEGIN_YAFARAY
@@ -52,8 +53,12 @@ void TiledIntegrator::renderWorker(int m_num_view, TiledIntegrator *integrator,
 	while(image_film->nextArea(m_num_view, a))
 	{
 		if(scene->getSignals() & Y_SIG_ABORT) break;
-		integrator->preTile(a, samples, offset, adaptive, thread_id);
-		integrator->renderTile(m_num_view, a, samples, offset, adaptive, thread_id, aa_pass);
+		{
+			TraceScope trace_scope("tile", "render", thread_id);
+			trace_scope.arg("x", a.x_).arg("y", a.y_).arg("w", a.w_).arg("h", a.h_).arg("pass", aa_pass + 1);
+			integrator->preTile(a, samples, offset, adaptive, thread_id);
+			integrator->renderTile(m_num_view, a, samples, offset, adaptive, thread_id, aa_pass);
+		}
 
 		std::unique_lock<std::mutex> lk(control->m_);
 		control->areas_.push_back(a);
@@ -160,6 +165,11 @@ bool TiledIntegrator::render(int num_view, ImageFilm *image_film)
 	Y_VERBOSE << "AA_clamp_indirect: " << aa_clamp_indirect_ << YENDL;
 	Y_PARAMS << "Max. " << aa_samples_ + std::max(0, aa_passes_ - 1) * aa_inc_samples_ << " total samples" << YENDL;
 
+	float time_budget = 0.f, noise_target = 0.f;
+	scene_->getRenderBudget(time_budget, noise_target);
+	if(time_budget > 0.f) Y_PARAMS << "Render time budget: " << time_budget << "s, no new passes are started after it" << YENDL;
+	if(noise_target > 0.f) Y_PARAMS << "Noise target: " << noise_target << " relative error, resampling the pixels above it" << YENDL;
+
 	pass_string << "Rendering pass 1 of " << std::max(1, aa_passes_) << "...";
 
 	Y_INFO << pass_string.str() << YENDL;
@@ -168,6 +178,7 @@ bool TiledIntegrator::render(int num_view, ImageFilm *image_film)
 	g_timer__.addEvent("rendert");
 	g_timer__.start("rendert");
 
+	image_film_->setAaNoiseTarget(noise_target);
 	image_film_->init(aa_passes_);
 	image_film_->setAaNoiseParams(aa_detect_color_noise_, aa_dark_detection_type_, aa_dark_threshold_factor_, aa_variance_edge_size_, aa_variance_pixels_, aa_clamp_samples_);
 
@@ -194,6 +205,7 @@ bool TiledIntegrator::render(int num_view, ImageFilm *image_film)
 	std::fill(correlative_sample_number_.begin(), correlative_sample_number_.end(), 0);
 
 	int acum_aa_samples = aa_samples_;
+	double pass_start = scene_->getRenderTime();
 
 	if(session__.renderResumed())
 	{
@@ -204,11 +216,24 @@ bool TiledIntegrator::render(int num_view, ImageFilm *image_film)
 
 	bool aa_threshold_changed = true;
 	int resampled_pixels = 0;
+	//Seconds per pixel sample of the last pass, for fitting the next passes in the time budget
+	double sample_cost = (scene_->getRenderTime() - pass_start) / ((double) std::max(1, aa_samples_) * image_film_->getTotalPixels());
 
 	for(int i = 1; i < aa_passes_; ++i)
 	{
 		if(scene_->getSignals() & Y_SIG_ABORT) break;
 
+		const float relative_error = image_film_->getRelativeError();
+		if(noise_target > 0.f)
+		{
+			Y_VERBOSE << integrator_name_ << ": Estimated relative error after " << i << " passes: " << relative_error << YENDL;
+			if(relative_error <= noise_target)
+			{
+				Y_INFO << integrator_name_ << ": Noise target reached after " << i << " passes (relative error " << relative_error << "), stopping the render" << YENDL;
+				break;
+			}
+		}
+
 		//scene->getSurfIntegrator()->setSampleMultiplier(scene->getSurfIntegrator()->getSampleMultiplier() * AA_sample_multiplier_factor);
 
 		aa_sample_multiplier_ *= aa_sample_multiplier_factor_;
@@ -233,9 +258,32 @@ bool TiledIntegrator::render(int num_view, ImageFilm *image_film)
 
 		int aa_samples_mult = (int) ceilf(aa_inc_samples_ * aa_sample_multiplier_);
 
+		if(noise_target > 0.f)
+		{
+			//The error decreases with the square root of the samples: the pass gets the samples estimated to reach the target, up to doubling the samples so far
+			const float samples_needed = acum_aa_samples * ((relative_error * relative_error) / (noise_target * noise_target) - 1.f);
+			aa_samples_mult = std::max(1, std::min((int) ceilf(samples_needed), std::max(aa_samples_mult, acum_aa_samples)));
+		}
+		if(time_budget > 0.f && resampled_pixels > 0)
+		{
+			const double time_left = time_budget - scene_->getRenderTime();
+			const int samples_fitting = (int) std::min(1e9, time_left / (sample_cost * resampled_pixels));
+			if(samples_fitting < 1)
+			{
+				Y_INFO << integrator_name_ << ": Render time budget reached after " << i << " passes (" << time_left << "s left, next pass estimated in " << sample_cost * resampled_pixels << "s per sample), stopping the render" << YENDL;
+				break;
+			}
+			aa_samples_mult = std::min(aa_samples_mult, samples_fitting);
+		}
+
 		Y_DEBUG << "acumAASamples=" << acum_aa_samples << " AA_samples=" << aa_samples_ << " AA_samples_mult=" << aa_samples_mult << YENDL;
 
-		if(resampled_pixels > 0) renderPass(num_view, aa_samples_mult, acum_aa_samples, true, i);
+		if(resampled_pixels > 0)
+		{
+			pass_start = scene_->getRenderTime();
+			renderPass(num_view, aa_samples_mult, acum_aa_samples, true, i);
+			sample_cost = (scene_->getRenderTime() - pass_start) / ((double) aa_samples_mult * resampled_pixels);
+		}
 
 		acum_aa_samples += aa_samples_mult;
 
@@ -261,6 +309,8 @@ bool TiledIntegrator::render(int num_view, ImageFilm *image_film)
 bool TiledIntegrator::renderPass(int num_view, int samples, int offset, bool adaptive, int aa_pass_number)
 {
 	Y_DEBUG << "Sampling: samples=" << samples << " Offset=" << offset << " Base Offset=" << + image_film_->getBaseSamplingOffset() << "  AA_pass_number=" << aa_pass_number << YENDL;
+	TraceScope trace_scope("render pass", "render");
+	trace_scope.arg("pass", aa_pass_number + 1).arg("samples", samples);
 	prePass(samples, (offset + image_film_->getBaseSamplingOffset()), adaptive);
 
 	int nthreads = scene_->getNumThreads();
@@ -297,12 +347,18 @@ bool TiledIntegrator::renderPass(int num_view, int samples, int offset, bool ada
 		while(image_film_->nextArea(num_view, a))
 		{
 			if(scene_->getSignals() & Y_SIG_ABORT) break;
-			preTile(a, samples, (offset + image_film_->getBaseSamplingOffset()), adaptive, 0);
-			renderTile(num_view, a, samples, (offset + image_film_->getBaseSamplingOffset()), adaptive, 0);
+			{
+				TraceScope trace_tile("tile", "render", 0);
+				trace_tile.arg("x", a.x_).arg("y", a.y_).arg("w", a.w_).arg("h", a.h_).arg("pass", aa_pass_number + 1);
+				preTile(a, samples, (offset + image_film_->getBaseSamplingOffset()), adaptive, 0);
+				renderTile(num_view, a, samples, (offset + image_film_->getBaseSamplingOffset()), adaptive, 0);
+			}
 			image_film_->finishArea(num_view, a);
 		}
 	}
 
+	scene_->getRenderStats().endPass("pass " + std::to_string(aa_pass_number + 1));
+
 	return true; //hm...quite useless the return value :)
 }
 
@@ -316,12 +372,13 @@ bool TiledIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 	float dx = 0.5, dy = 0.5, d_1 = 1.0 / (float)n_samples;
 	float lens_u = 0.5f, lens_v = 0.5f;
 	float wt, wt_dummy;
-	Random prng(rand() + offset * (x * a.y_ + a.x_) + 123);
+	Random prng(fnv32ABuf__(offset ^ fnv32ABuf__(x * a.y_ + a.x_))); //seeded from the pass and tile only, as rand() is serialized by a global lock
 	RenderState rstate(&prng);
 	rstate.thread_id_ = thread_id;
 	rstate.cam_ = camera;
 	bool sample_lns = camera->sampleLense();
 	int pass_offs = offset, end_x = a.x_ + a.w_, end_y = a.y_ + a.h_;
+	const Sampler *sampler = scene_->getSampler();
 
 	int aa_max_possible_samples = aa_samples_;
 
@@ -338,8 +395,9 @@ bool TiledIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 	const RenderPasses *render_passes = scene_->getRenderPasses();
 	ColorPasses color_passes(render_passes);
 	ColorPasses tmp_passes_zero(render_passes);
+	const SamplePassesProcessing sample_passes_processing(color_passes);
 
-	Rgba2DImageWeighed_t *sampling_factor_image_pass = image_film_->getImagePassFromIntPassType(PassIntDebugSamplingFactor);
+	FilmPass *sampling_factor_image_pass = image_film_->getImagePassFromIntPassType(PassIntDebugSamplingFactor);
 
 	int film_cx_0 = image_film_->getCx0();
 	int film_cy_0 = image_film_->getCy0();
@@ -359,7 +417,7 @@ bool TiledIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 
 				if(sampling_factor_image_pass)
 				{
-					mat_sample_factor = (*sampling_factor_image_pass)(j - film_cx_0, i - film_cy_0).normalized().r_;
+					mat_sample_factor = sampling_factor_image_pass->normalized(j - film_cx_0, i - film_cy_0).r_;
 
 					if(image_film_->getBackgroundResampling()) mat_sample_factor = std::max(mat_sample_factor, 1.f); //If the background is set to be resampled, make sure the matSampleFactor is always >= 1.f
 
@@ -389,9 +447,15 @@ bool TiledIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 				rstate.pixel_sample_ = pass_offs + sample;
 				rstate.time_ = addMod1__((float) sample * d_1, toff); //(0.5+(float)sample)*d1;
 
+				if(sampler)
+				{
+					dx = sampler->get(rstate.pixel_sample_, Sampler::DimPixelX, rstate.sampling_offs_);
+					dy = sampler->get(rstate.pixel_sample_, Sampler::DimPixelY, rstate.sampling_offs_);
+					rstate.time_ = sampler->get(rstate.pixel_sample_, Sampler::DimTime, rstate.sampling_offs_);
+				}
 				// the (1/n, Larcher&Pillichshammer-Seq.) only gives good coverage when total sample count is known
 				// hence we use scrambled (Sobol, van-der-Corput) for multipass AA
-				if(aa_passes_ > 1)
+				else if(aa_passes_ > 1)
 				{
 					dx = riVdC__(rstate.pixel_sample_, rstate.sampling_offs_);
 					dy = riS__(rstate.pixel_sample_, rstate.sampling_offs_);
@@ -402,12 +466,18 @@ bool TiledIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 					dy = riLp__(sample + rstate.sampling_offs_);
 				}
 
-				if(sample_lns)
+				if(sample_lns && sampler)
+				{
+					lens_u = sampler->get(rstate.pixel_sample_, Sampler::DimLensU, rstate.sampling_offs_);
+					lens_v = sampler->get(rstate.pixel_sample_, Sampler::DimLensV, rstate.sampling_offs_);
+				}
+				else if(sample_lns)
 				{
 					lens_u = hal_u.getNext();
 					lens_v = hal_v.getNext();
 				}
 				c_ray = camera->shootRay(j + dx, i + dy, lens_u, lens_v, wt);
+				rstate.stats_->add(RenderStats::CameraRays);
 
 				if(wt == 0.0)
 				{
@@ -430,94 +500,114 @@ bool TiledIntegrator::renderTile(int num_view, RenderArea &a, int n_samples, int
 
 				color_passes(PassIntCombined) = integrate(rstate, c_ray, color_passes);
 
-				if(color_passes.enabled(PassIntZDepthNorm) || color_passes.enabled(PassIntZDepthAbs) || color_passes.enabled(PassIntMist))
-				{
-					float depth_abs = 0.f, depth_norm = 0.f;
-
-					if(color_passes.enabled(PassIntZDepthNorm) || color_passes.enabled(PassIntMist))
-					{
-						if(c_ray.tmax_ > 0.f)
-						{
-							depth_norm = 1.f - (c_ray.tmax_ - min_depth_) * max_depth_; // Distance normalization
-						}
-						color_passes.probeSet(PassIntZDepthNorm, Rgba(depth_norm));
-						color_passes.probeSet(PassIntMist, Rgba(1.f - depth_norm));
-					}
-					if(color_passes.enabled(PassIntZDepthAbs))
-					{
-						depth_abs = c_ray.tmax_;
-						if(depth_abs <= 0.f)
-						{
-							depth_abs = 99999997952.f;
-						}
-						color_passes.probeSet(PassIntZDepthAbs, Rgba(depth_abs));
-					}
-				}
+				addCameraSample(rstate, color_passes, { j, i, dx, dy, sample, wt, c_ray.tmax_, &a, aa_pass_number, inv_aa_max_possible_samples }, sample_passes_processing);
+			}
+		}
+	}
+	flushCameraSamples(rstate, sample_passes_processing);
+	return true;
+}
 
-				for(int idx = 0; idx < color_passes.size(); ++idx)
-				{
-					if(color_passes(idx).a_ > 1.f) color_passes(idx).a_ = 1.f;
-
-					IntPassTypes int_pass_type = color_passes.intPassTypeFromIndex(idx);
-
-					switch(int_pass_type)
-					{
-						case PassIntZDepthNorm: break;
-						case PassIntZDepthAbs: break;
-						case PassIntMist: break;
-						case PassIntNormalSmooth: break;
-						case PassIntNormalGeom: break;
-						case PassIntAo: break;
-						case PassIntAoClay: break;
-						case PassIntUv: break;
-						case PassIntDebugNu: break;
-						case PassIntDebugNv: break;
-						case PassIntDebugDpdu: break;
-						case PassIntDebugDpdv: break;
-						case PassIntDebugDsdu: break;
-						case PassIntDebugDsdv: break;
-						case PassIntObjIndexAbs: break;
-						case PassIntObjIndexNorm: break;
-						case PassIntObjIndexAuto: break;
-						case PassIntObjIndexAutoAbs: break;
-						case PassIntMatIndexAbs: break;
-						case PassIntMatIndexNorm: break;
-						case PassIntMatIndexAuto: break;
-						case PassIntMatIndexAutoAbs: break;
-						case PassIntAaSamples: break;
-
-						//Processing of mask render passes:
-						case PassIntObjIndexMask:
-						case PassIntObjIndexMaskShadow:
-						case PassIntObjIndexMaskAll:
-						case PassIntMatIndexMask:
-						case PassIntMatIndexMaskShadow:
-						case PassIntMatIndexMaskAll:
-
-							color_passes(idx).clampRgb01();
-
-							if(color_passes.getPassMaskInvert())
-							{
-								color_passes(idx) = Rgba(1.f) - color_passes(idx);
-							}
-
-							if(!color_passes.getPassMaskOnly())
-							{
-								Rgba col_combined = color_passes(PassIntCombined);
-								col_combined.a_ = 1.f;
-								color_passes(idx) *= col_combined;
-							}
-							break;
-
-						default: color_passes(idx) *= wt; break;
-					}
-				}
+void TiledIntegrator::addCameraSample(RenderState &state, ColorPasses &color_passes, const CameraSample &camera_sample, const SamplePassesProcessing &sample_passes_processing) const
+{
+	if(color_passes.enabled(PassIntZDepthNorm) || color_passes.enabled(PassIntZDepthAbs) || color_passes.enabled(PassIntMist))
+	{
+		float depth_abs = 0.f, depth_norm = 0.f;
 
-				image_film_->addSample(color_passes, j, i, dx, dy, &a, sample, aa_pass_number, inv_aa_max_possible_samples);
+		if(color_passes.enabled(PassIntZDepthNorm) || color_passes.enabled(PassIntMist))
+		{
+			if(camera_sample.depth_ > 0.f)
+			{
+				depth_norm = 1.f - (camera_sample.depth_ - min_depth_) * max_depth_; // Distance normalization
 			}
+			color_passes.probeSet(PassIntZDepthNorm, Rgba(depth_norm));
+			color_passes.probeSet(PassIntMist, Rgba(1.f - depth_norm));
+		}
+		if(color_passes.enabled(PassIntZDepthAbs))
+		{
+			depth_abs = camera_sample.depth_;
+			if(depth_abs <= 0.f)
+			{
+				depth_abs = 99999997952.f;
+			}
+			color_passes.probeSet(PassIntZDepthAbs, Rgba(depth_abs));
+		}
+	}
+
+	sample_passes_processing.apply(color_passes, camera_sample.wt_);
+
+	image_film_->addSample(color_passes, camera_sample.x_, camera_sample.y_, camera_sample.dx_, camera_sample.dy_, camera_sample.area_, camera_sample.sample_, camera_sample.aa_pass_number_, camera_sample.inv_aa_max_possible_samples_);
+}
+
+SamplePassesProcessing::SamplePassesProcessing(const ColorPasses &color_passes)
+{
+	for(int idx = 0; idx < color_passes.size(); ++idx)
+	{
+		switch(color_passes.intPassTypeFromIndex(idx))
+		{
+			case PassIntZDepthNorm: break;
+			case PassIntZDepthAbs: break;
+			case PassIntMist: break;
+			case PassIntNormalSmooth: break;
+			case PassIntNormalGeom: break;
+			case PassIntAo: break;
+			case PassIntAoClay: break;
+			case PassIntUv: break;
+			case PassIntDebugNu: break;
+			case PassIntDebugNv: break;
+			case PassIntDebugDpdu: break;
+			case PassIntDebugDpdv: break;
+			case PassIntDebugDsdu: break;
+			case PassIntDebugDsdv: break;
+			case PassIntObjIndexAbs: break;
+			case PassIntObjIndexNorm: break;
+			case PassIntObjIndexAuto: break;
+			case PassIntObjIndexAutoAbs: break;
+			case PassIntMatIndexAbs: break;
+			case PassIntMatIndexNorm: break;
+			case PassIntMatIndexAuto: break;
+			case PassIntMatIndexAutoAbs: break;
+			case PassIntAaSamples: break;
+
+			case PassIntObjIndexMask:
+			case PassIntObjIndexMaskShadow:
+			case PassIntObjIndexMaskAll:
+			case PassIntMatIndexMask:
+			case PassIntMatIndexMaskShadow:
+			case PassIntMatIndexMaskAll: mask_passes_.push_back(idx); break;
+
+			default: weighted_passes_.push_back(idx); break;
+		}
+	}
+}
+
+void SamplePassesProcessing::apply(ColorPasses &color_passes, float wt) const
+{
+	for(int idx = 0; idx < color_passes.size(); ++idx)
+	{
+		if(color_passes(idx).a_ > 1.f) color_passes(idx).a_ = 1.f;
+	}
+
+	//The Combined pass is scaled before the masks, which are multiplied by it
+	for(const int idx : weighted_passes_) color_passes(idx) *= wt;
+
+	//Processing of mask render passes:
+	for(const int idx : mask_passes_)
+	{
+		color_passes(idx).clampRgb01();
+
+		if(color_passes.getPassMaskInvert())
+		{
+			color_passes(idx) = Rgba(1.f) - color_passes(idx);
+		}
+
+		if(!color_passes.getPassMaskOnly())
+		{
+			Rgba col_combined = color_passes(PassIntCombined);
+			col_combined.a_ = 1.f;
+			color_passes(idx) *= col_combined;
 		}
 	}
-	return true;
 }
 
 #ifndef __clang__
@@ -550,10 +640,11 @@ void TiledIntegrator::generateCommonRenderPasses(ColorPasses &color_passes, Rend
 		color_passes(PassIntIndirectAll) = color_passes(PassIntIndirect) + color_passes(PassIntDiffuseIndirect);
 	}
 
-	color_passes.probeSet(PassIntDiffuseColor, sp.material_->getDiffuseColor(state));
-	color_passes.probeSet(PassIntGlossyColor, sp.material_->getGlossyColor(state));
-	color_passes.probeSet(PassIntTransColor, sp.material_->getTransColor(state));
-	color_passes.probeSet(PassIntSubsurfaceColor, sp.material_->getSubSurfaceColor(state));
+	//The material colors are only evaluated for the enabled passes, as they can involve textures
+	if(color_passes.enabled(PassIntDiffuseColor)) color_passes(PassIntDiffuseColor) = sp.material_->getDiffuseColor(state);
+	if(color_passes.enabled(PassIntGlossyColor)) color_passes(PassIntGlossyColor) = sp.material_->getGlossyColor(state);
+	if(color_passes.enabled(PassIntTransColor)) color_passes(PassIntTransColor) = sp.material_->getTransColor(state);
+	if(color_passes.enabled(PassIntSubsurfaceColor)) color_passes(PassIntSubsurfaceColor) = sp.material_->getSubSurfaceColor(state);
 
 	color_passes.probeSet(PassIntObjIndexAbs, sp.object_->getAbsObjectIndexColor());
 	color_passes.probeSet(PassIntObjIndexNorm, sp.object_->getNormObjectIndexColor());
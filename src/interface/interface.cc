@@ -25,6 +25,7 @@
 #include "common/matrix4.h"
 #include "common/imagefilm.h"
 #include "common/param.h"
+#include "common/trace.h"
 #include <signal.h>
 
 #ifdef WIN32
@@ -211,6 +212,27 @@ bool Interface::addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, c
 
 int Interface::addUv(float u, float v) { return scene_->addUv(u, v); }
 
+int Interface::addVertices(const double *vertices, int num_vertices) { return scene_->addVertices(vertices, nullptr, num_vertices); }
+
+int Interface::addVertices(const double *vertices, const double *orcos, int num_vertices)
+{
+	return scene_->addVertices(vertices, orcos, num_vertices);
+}
+
+void Interface::addNormals(const double *normals, int num_normals) { scene_->addNormals(normals, num_normals); }
+
+bool Interface::addTriangles(const int *indices, int num_triangles, const Material *mat)
+{
+	return scene_->addTriangles(indices, nullptr, num_triangles, mat);
+}
+
+bool Interface::addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat)
+{
+	return scene_->addTriangles(indices, uv_indices, num_triangles, mat);
+}
+
+int Interface::addUvs(const float *uvs, int num_uvs) { return scene_->addUvs(uvs, num_uvs); }
+
 bool Interface::smoothMesh(unsigned int id, double angle) { return scene_->smoothMesh(id, angle); }
 
 bool Interface::addInstance(unsigned int base_object_id, Matrix4 obj_to_world)
@@ -331,14 +353,29 @@ Light *Interface::createLight(const char *name)
 	return light;
 }
 
-Texture 		*Interface::createTexture(const char *name) { return env_->createTexture(name, *params_); }
-Material 	*Interface::createMaterial(const char *name) { return env_->createMaterial(name, *params_, *eparams_); }
+Texture *Interface::createTexture(const char *name)
+{
+	Texture *texture = env_->createTexture(name, *params_);
+	if(texture && scene_) scene_->addChanges(Scene::CMaterial);
+	return texture;
+}
+Material *Interface::createMaterial(const char *name)
+{
+	Material *material = env_->createMaterial(name, *params_, *eparams_);
+	if(material && scene_) scene_->addChanges(Scene::CMaterial);
+	return material;
+}
 Camera 		*Interface::createCamera(const char *name)
 {
 	Camera *camera = env_->createCamera(name, *params_);
 	return camera;
 }
-Background 	*Interface::createBackground(const char *name) { return env_->createBackground(name, *params_); }
+Background *Interface::createBackground(const char *name)
+{
+	Background *background = env_->createBackground(name, *params_);
+	if(background && scene_) scene_->addChanges(Scene::CMaterial);
+	return background;
+}
 Integrator 	*Interface::createIntegrator(const char *name) { return env_->createIntegrator(name, *params_); }
 ImageHandler *Interface::createImageHandler(const char *name, bool add_to_table) { return env_->createImageHandler(name, *params_); }
 
@@ -373,6 +410,28 @@ bool Interface::getRenderedImage(int num_view, ColorOutput &output)
 	return true;
 }
 
+std::string Interface::getRenderStats() const
+{
+	if(!scene_) return "";
+	return scene_->getRenderStats().toJson();
+}
+
+bool Interface::saveRenderStats(const std::string &file_path) const
+{
+	if(!scene_) return false;
+	return scene_->getRenderStats().saveJson(file_path);
+}
+
+void Interface::enableTrace(bool enable)
+{
+	trace_recorder__.setEnabled(enable);
+}
+
+bool Interface::saveTrace(const std::string &file_path) const
+{
+	return trace_recorder__.saveJson(file_path);
+}
+
 std::string Interface::getVersion() const
 {
 	return YAFARAY_BUILD_VERSION;
@@ -446,6 +505,11 @@ void Interface::setLogVerbosityLevel(const std::string &str_v_level)
 	logger__.setLogMasterVerbosity(str_v_level);
 }
 
+void Interface::setAsyncLogging(bool async_logging)
+{
+	logger__.setAsyncLogging(async_logging);
+}
+
 // export "factory"...
 
 extern "C"
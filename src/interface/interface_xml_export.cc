@@ -125,12 +125,14 @@ bool XmlInterface::startTriMeshPtr(unsigned int *id, int vertices, int triangles
 
 bool XmlInterface::endTriMesh()
 {
+	writePendingVertices();
 	xml_file_ << "</mesh>\n";
 	return true;
 }
 
 bool XmlInterface::endCurveMesh(const Material *mat, float strand_start, float strand_end, float strand_shape)
 {
+	writePendingVertices();
 	auto i = materials_.find(mat);
 	if(i == materials_.end()) return false;
 	xml_file_ << "\t\t\t<set_material sval=\"" << i->second << "\"/>\n"
@@ -143,12 +145,14 @@ bool XmlInterface::endCurveMesh(const Material *mat, float strand_start, float s
 
 int  XmlInterface::addVertex(double x, double y, double z)
 {
+	writePendingVertices();
 	xml_file_ << "\t\t\t<p x=\"" << x << "\" y=\"" << y << "\" z=\"" << z << "\"/>\n";
 	return 0;
 }
 
 int  XmlInterface::addVertex(double x, double y, double z, double ox, double oy, double oz)
 {
+	writePendingVertices();
 	xml_file_ << "\t\t\t<p x=\"" << x << "\" y=\"" << y << "\" z=\"" << z
 			  << "\" ox=\"" << ox << "\" oy=\"" << oy << "\" oz=\"" << oz << "\"/>\n";
 	return 0;
@@ -156,10 +160,11 @@ int  XmlInterface::addVertex(double x, double y, double z, double ox, double oy,
 
 void XmlInterface::addNormal(double x, double y, double z)
 {
+	writePendingVertices();
 	xml_file_ << "\t\t\t<n x=\"" << x << "\" y=\"" << y << "\" z=\"" << z << "\"/>\n";
 }
 
-bool XmlInterface::addTriangle(int a, int b, int c, const Material *mat)
+bool XmlInterface::setMaterial(const Material *mat)
 {
 	if(mat != last_mat_) //need to set current material
 	{
@@ -168,19 +173,21 @@ bool XmlInterface::addTriangle(int a, int b, int c, const Material *mat)
 		xml_file_ << "\t\t\t<set_material sval=\"" << i->second << "\"/>\n";
 		last_mat_ = mat;
 	}
+	return true;
+}
+
+bool XmlInterface::addTriangle(int a, int b, int c, const Material *mat)
+{
+	writePendingVertices();
+	if(!setMaterial(mat)) return false;
 	xml_file_ << "\t\t\t<f a=\"" << a << "\" b=\"" << b << "\" c=\"" << c << "\"/>\n";
 	return true;
 }
 
 bool XmlInterface::addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c, const Material *mat)
 {
-	if(mat != last_mat_) //need to set current material
-	{
-		auto i = materials_.find(mat);
-		if(i == materials_.end()) return false;
-		xml_file_ << "\t\t\t<set_material sval=\"" << i->second << "\"/>\n";
-		last_mat_ = mat;
-	}
+	writePendingVertices();
+	if(!setMaterial(mat)) return false;
 	xml_file_ << "\t\t\t<f a=\"" << a << "\" b=\"" << b << "\" c=\"" << c
 			  << "\" uv_a=\"" << uv_a << "\" uv_b=\"" << uv_b << "\" uv_c=\"" << uv_c << "\"/>\n";
 	return true;
@@ -188,10 +195,90 @@ bool XmlInterface::addTriangle(int a, int b, int c, int uv_a, int uv_b, int uv_c
 
 int XmlInterface::addUv(float u, float v)
 {
+	writePendingVertices();
 	xml_file_ << "\t\t\t<uv u=\"" << u << "\" v=\"" << v << "\"/>\n";
 	return n_uvs_++;
 }
 
+void XmlInterface::writePendingVertices(const double *normals)
+{
+	const bool has_orco = !pending_orcos_.empty();
+	const size_t num_vertices = pending_vertices_.size() / 3;
+	for(size_t i = 0; i < num_vertices; ++i)
+	{
+		const double *v = &pending_vertices_[3 * i];
+		xml_file_ << "\t\t\t<p x=\"" << v[0] << "\" y=\"" << v[1] << "\" z=\"" << v[2];
+		if(has_orco)
+		{
+			const double *o = &pending_orcos_[3 * i];
+			xml_file_ << "\" ox=\"" << o[0] << "\" oy=\"" << o[1] << "\" oz=\"" << o[2];
+		}
+		xml_file_ << "\"/>\n";
+		if(normals) xml_file_ << "\t\t\t<n x=\"" << normals[3 * i] << "\" y=\"" << normals[3 * i + 1] << "\" z=\"" << normals[3 * i + 2] << "\"/>\n";
+	}
+	pending_vertices_.clear();
+	pending_orcos_.clear();
+}
+
+int XmlInterface::addVertices(const double *vertices, int num_vertices)
+{
+	return addVertices(vertices, nullptr, num_vertices);
+}
+
+int XmlInterface::addVertices(const double *vertices, const double *orcos, int num_vertices)
+{
+	writePendingVertices();
+	if(num_vertices <= 0) return 0;
+	pending_vertices_.assign(vertices, vertices + 3 * num_vertices);
+	if(orcos) pending_orcos_.assign(orcos, orcos + 3 * num_vertices);
+	return 0;
+}
+
+void XmlInterface::addNormals(const double *normals, int num_normals)
+{
+	if(num_normals > 0 && (size_t) num_normals * 3 == pending_vertices_.size())
+	{
+		writePendingVertices(normals);
+		return;
+	}
+	//Normals not matching the last block of vertices: they can only be written for the last vertex, as in addNormal
+	writePendingVertices();
+	if(num_normals == 1) addNormal(normals[0], normals[1], normals[2]);
+	else if(num_normals > 1) Y_WARNING << "XmlExport: vertex normals must be given together with the block of vertices they belong to, ignoring them" << YENDL;
+}
+
+bool XmlInterface::addTriangles(const int *indices, int num_triangles, const Material *mat)
+{
+	return addTriangles(indices, nullptr, num_triangles, mat);
+}
+
+bool XmlInterface::addTriangles(const int *indices, const int *uv_indices, int num_triangles, const Material *mat)
+{
+	writePendingVertices();
+	if(!setMaterial(mat)) return false;
+	for(int i = 0; i < num_triangles; ++i)
+	{
+		const int *t = indices + 3 * i;
+		xml_file_ << "\t\t\t<f a=\"" << t[0] << "\" b=\"" << t[1] << "\" c=\"" << t[2];
+		if(uv_indices)
+		{
+			const int *uv = uv_indices + 3 * i;
+			xml_file_ << "\" uv_a=\"" << uv[0] << "\" uv_b=\"" << uv[1] << "\" uv_c=\"" << uv[2];
+		}
+		xml_file_ << "\"/>\n";
+	}
+	return true;
+}
+
+int XmlInterface::addUvs(const float *uvs, int num_uvs)
+{
+	writePendingVertices();
+	const int first_id = n_uvs_;
+	for(int i = 0; i < num_uvs; ++i) xml_file_ << "\t\t\t<uv u=\"" << uvs[2 * i] << "\" v=\"" << uvs[2 * i + 1] << "\"/>\n";
+	n_uvs_ += std::max(num_uvs, 0);
+	return first_id;
+}
+
 bool XmlInterface::smoothMesh(unsigned int id, double angle)
 {
 	xml_file_ << "<smooth ID=\"" << id << "\" angle=\"" << angle << "\"/>\n";
@@ -87,7 +87,7 @@ void BackgroundLight::init(Scene &scene)
 	Ray ray;
 	ray.from_ = Point3(0.f);
 	inv = 1.f / (float)nv;
-	u_dist_ = new Pdf1D *[nv];
+	u_dist_ = new AliasPdf1D *[nv];
 	for(int y = 0; y < nv; y++)
 	{
 		fy = ((float)y + 0.5f) * inv;
@@ -102,11 +102,11 @@ void BackgroundLight::init(Scene &scene)
 			fu[x] = background_->eval(ray, true).energy() * sintheta;
 		}
 
-		u_dist_[y] = new Pdf1D(fu, nu);
+		u_dist_[y] = new AliasPdf1D(fu, nu);
 		fv[y] = u_dist_[y]->integral_;
 	}
 
-	v_dist_ = new Pdf1D(fv, nv);
+	v_dist_ = new AliasPdf1D(fv, nv);
 
 	delete[] fv;
 	delete[] fu;
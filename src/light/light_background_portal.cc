@@ -67,7 +67,7 @@ void BackgroundPortalLight::initIs()
 		areas[i] = tris_[i]->surfaceArea();
 		total_area += areas[i];
 	}
-	area_dist_ = new Pdf1D(areas, n_tris_);
+	area_dist_ = new AliasPdf1D(areas, n_tris_);
 	area_ = (float)total_area;
 	inv_area_ = (float)(1.0 / total_area);
 	//delete[] tris;
@@ -97,20 +97,13 @@ void BackgroundPortalLight::init(Scene &scene)
 
 void BackgroundPortalLight::sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const
 {
-	float prim_pdf;
-	int prim_num = area_dist_->dSample(s_1, &prim_pdf);
+	float prim_pdf, ss_1;
+	const int prim_num = area_dist_->dSample(s_1, &prim_pdf, ss_1);
 	if(prim_num >= area_dist_->count_)
 	{
 		Y_WARNING << "bgPortalLight: Sampling error!" << YENDL;
 		return;
 	}
-	float ss_1, delta = area_dist_->cdf_[prim_num + 1];
-	if(prim_num > 0)
-	{
-		delta -= area_dist_->cdf_[prim_num];
-		ss_1 = (s_1 - area_dist_->cdf_[prim_num]) / delta;
-	}
-	else ss_1 = s_1 / delta;
 	tris_[prim_num]->sample(ss_1, s_2, p, n);
 }
 
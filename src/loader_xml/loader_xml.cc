@@ -25,6 +25,8 @@
 #include "common/environment.h"
 #include "common/imagefilm.h"
 #include "common/import_xml.h"
+#include "common/import_binary.h"
+#include "common/trace.h"
 #include "utility/util_console.h"
 #include "output/output_image.h"
 #include <signal.h>
@@ -91,12 +93,13 @@ int main(int argc, char *argv[])
 	CliParser parse(argc, argv, 2, 1, "You need to set at least a yafaray's valid XML file.");
 
 	parse.setAppName("YafaRay XML loader",
-	                 "[OPTIONS]... <input xml file> [output filename]\n<input xml file> : A valid yafaray XML file\n[output filename] : The filename of the rendered image without extension.\n*Note: If output filename is ommited the name \"yafaray\" will be used instead.");
+	                 "[OPTIONS]... <input xml file> [output filename]\n<input xml file> : A valid yafaray XML file, or a scene file in the yafaray binary format\n[output filename] : The filename of the rendered image without extension.\n*Note: If output filename is ommited the name \"yafaray\" will be used instead.");
 
 	parse.setOption("pp", "plugin-path", false, "Path to load plugins.");
 	parse.setOption("vl", "verbosity-level", false, "Set console verbosity level, options are:\n                                       \"mute\" (Prints nothing)\n                                       \"error\" (Prints only errors)\n                                       \"warning\" (Prints also warnings)\n                                       \"params\" (Prints also render param messages)\n                                       \"info\" (Prints also basi info messages)\n                                       \"verbose\" (Prints additional info messages)\n                                       \"debug\" (Prints debug messages if any)\n");
 	parse.setOption("lvl", "log-verbosity-level", false, "Set log/HTML files verbosity level, options are:\n                                       \"mute\" (Prints nothing)\n                                       \"error\" (Prints only errors)\n                                       \"warning\" (Prints also warnings)\n                                       \"params\" (Prints also render param messages)\n                                       \"info\" (Prints also basic info messages)\n                                       \"verbose\" (Prints additional info messages)\n                                       \"debug\" (Prints debug messages if any)\n");
 	parse.setOption("ccd", "console-colors-disabled", true, "If specified, disables the Console colors ANSI codes, useful for some 3rd party software that cannot handle ANSI codes well.");
+	parse.setOption("al", "async-logging", true, "If specified, log messages are written by a background thread instead of by the threads logging them.");
 
 	parse.parseCommandLine();
 
@@ -105,6 +108,8 @@ int main(int argc, char *argv[])
 	if(console_colors_disabled) logger__.setConsoleLogColorsEnabled(false);
 	else logger__.setConsoleLogColorsEnabled(true);
 
+	if(parse.getFlag("al")) logger__.setAsyncLogging(true);
+
 	RenderEnvironment *env = new RenderEnvironment();
 
 	// Plugin load
@@ -139,6 +144,10 @@ int main(int argc, char *argv[])
 	parse.setOption("l", "log-file-output", false, "Enable log file output(s): \"none\", \"txt\", \"html\" or \"txt+html\". Log file name will be same as selected image name,");
 	parse.setOption("z", "z-buffer", true, "Enables the rendering of the depth map (Z-Buffer) (this flag overrides XML setting).");
 	parse.setOption("nz", "no-z-buffer", true, "Disables the rendering of the depth map (Z-Buffer) (this flag overrides XML setting).");
+	parse.setOption("xt", "xml-threads", false, "Decodes the meshes of the XML file in parallel using <value> threads, for auto\n                                       selection use 0. Default: 1 (serial parsing).");
+	parse.setOption("rs", "render-stats", false, "Saves the render work counters (rays, kd-tree traversal steps, etc.) per pass and thread\n                                       to the file <value> in JSON format.");
+	parse.setOption("tr", "trace", false, "Records a timeline of the render phases (scene parsing and update, tree builds, photon\n                                       shooting, tiles, film flushes) per thread, saving it to the file <value> in Chrome\n                                       trace JSON format, to be opened in chrome://tracing or https://ui.perfetto.dev");
+	parse.setOption("cb", "convert-binary", false, "Converts the input XML file into the yafaray binary scene format, saving it\n                                       as <value>, and exits without rendering.");
 
 	bool parse_ok = parse.parseCommandLine();
 
@@ -170,6 +179,8 @@ int main(int argc, char *argv[])
 	if(input_color_space_string.empty()) input_color_space_string = "LinearRGB";
 	float input_gamma = 1.f;	//TODO: there is no parse.getOptionFloat available for now, so no way to have the additional option of entering an arbitrary manual input gamma yet. Maybe in the future...
 	int threads = parse.getOptionInteger("t");
+	int xml_threads = parse.getOptionInteger("xt");
+	if(xml_threads == -65535) xml_threads = 1;
 	bool zbuf = parse.getFlag("z");
 	bool nozbuf = parse.getFlag("nz");
 
@@ -200,6 +211,9 @@ int main(int argc, char *argv[])
 
 	std::string xml_file = files[0];
 
+	const std::string convert_binary_file = parse.getOptionString("cb");
+	if(!convert_binary_file.empty()) return convertXmlToBinary__(xml_file.c_str(), convert_binary_file.c_str()) ? 0 : 1;
+
 	// Set the full output path with filename
 	if(output_path.empty())
 	{
@@ -221,7 +235,15 @@ int main(int argc, char *argv[])
 	env->setScene(scene);
 	ParamMap render;
 
-	bool success = parseXmlFile__(xml_file.c_str(), scene, env, render, input_color_space_string, input_gamma);
+	const std::string trace_file = parse.getOptionString("tr");
+	if(!trace_file.empty()) trace_recorder__.setEnabled(true);
+
+	bool success;
+	{
+		TraceScope trace_scope("scene parse", "scene");
+		if(isBinarySceneFile__(xml_file.c_str())) success = parseBinaryFile__(xml_file.c_str(), scene, env, render, input_color_space_string, input_gamma);
+		else success = parseXmlFile__(xml_file.c_str(), scene, env, render, input_color_space_string, input_gamma, xml_threads);
+	}
 	if(!success) exit(1);
 
 	int width = 320, height = 240;
@@ -307,6 +329,10 @@ int main(int argc, char *argv[])
 	session__.setStatusRenderStarted();
 	scene->render();
 
+	const std::string render_stats_file = parse.getOptionString("rs");
+	if(!render_stats_file.empty() && !scene->getRenderStats().saveJson(render_stats_file)) Y_ERROR << "Could not save the render stats to " << render_stats_file << YENDL;
+	if(!trace_file.empty() && !trace_recorder__.saveJson(trace_file)) Y_ERROR << "Could not save the trace to " << trace_file << YENDL;
+
 	env->clearAll();
 
 	delete film;
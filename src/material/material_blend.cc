@@ -62,7 +62,7 @@ inline void BlendMaterial::getBlendVal(const RenderState &state, const SurfacePo
 		void *old_dat = state.userdata_;
 
 		NodeStack stack(state.userdata_);
-		evalNodes(state, sp, all_sorted_, stack);
+		evalNodes(state, sp, all_sorted_program_, stack);
 		val = blend_s_->getScalar(stack);
 		state.userdata_ = old_dat;
 	}
@@ -87,7 +87,7 @@ void BlendMaterial::initBsdf(const RenderState &state, SurfacePoint &sp, Bsdf_t
 
 	SurfacePoint sp_0 = sp;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	mat_1_->initBsdf(state, sp_0, mat_1_flags_);
 
 	SurfacePoint sp_1 = sp;
@@ -113,7 +113,7 @@ Rgb BlendMaterial::eval(const RenderState &state, const SurfacePoint &sp, const
 	Rgb col_1(1.f), col_2(1.f);
 	void *old_udat = state.userdata_;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	col_1 = mat_1_->eval(state, sp, wo, wl, bsdfs);
 
 	state.userdata_ = PTR_ADD(state.userdata_, mmem_1_);
@@ -146,7 +146,7 @@ Rgb BlendMaterial::sample(const RenderState &state, const SurfacePoint &sp, cons
 
 	s2.pdf_ = s1.pdf_ = s.pdf_ = 0.f;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	if(s.flags_ & mat_1_flags_)
 	{
 		col1 = mat_1_->sample(state, sp, wo, wi_1, s1, w_1);
@@ -244,7 +244,7 @@ float BlendMaterial::pdf(const RenderState &state, const SurfacePoint &sp, const
 	float pdf_1 = 0.f, pdf_2 = 0.f;
 	void *old_udat = state.userdata_;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	pdf_1 = mat_1_->pdf(state, sp, wo, wi, bsdfs);
 
 	state.userdata_ = PTR_ADD(state.userdata_, mmem_1_);
@@ -279,7 +279,7 @@ void BlendMaterial::getSpecular(const RenderState &state, const SurfacePoint &sp
 	m_1_dir[0] = Vec3(0.f);
 	m_1_dir[1] = Vec3(0.f);
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	mat_1_->getSpecular(state, sp, wo, m_1_reflect, m_1_refract, m_1_dir, m_1_col);
 
 	state.userdata_ = PTR_ADD(state.userdata_, mmem_1_);
@@ -345,7 +345,7 @@ Rgb BlendMaterial::getTransparency(const RenderState &state, const SurfacePoint
 
 	void *old_udat = state.userdata_;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	col_1 = mat_1_->getTransparency(state, sp, wo);
 
 	state.userdata_ = PTR_ADD(state.userdata_, mmem_1_);
@@ -373,7 +373,7 @@ float BlendMaterial::getAlpha(const RenderState &state, const SurfacePoint &sp,
 
 		void *old_udat = state.userdata_;
 
-		state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+		state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 		al_1 = mat_1_->getAlpha(state, sp, wo);
 
 		state.userdata_ = PTR_ADD(state.userdata_, mmem_1_);
@@ -404,7 +404,7 @@ Rgb BlendMaterial::emit(const RenderState &state, const SurfacePoint &sp, const
 	Rgb col_1(0.0), col_2(0.0);
 	void *old_udat = state.userdata_;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	col_1 = mat_1_->emit(state, sp, wo);
 
 	state.userdata_ = PTR_ADD(state.userdata_, mmem_1_);
@@ -430,7 +430,7 @@ bool BlendMaterial::scatterPhoton(const RenderState &state, const SurfacePoint &
 	Rgb col_1(0.f), col_2(0.f);
 	float pdf_1 = 0.f, pdf_2 = 0.f;
 
-	state.userdata_ = PTR_ADD(state.userdata_, req_mem_);
+	state.userdata_ = PTR_ADD(state.userdata_, blend_mem_);
 	ret = ret || mat_1_->scatterPhoton(state, sp, wi, wo, s);
 	col_1 = s.color_;
 	pdf_1 = s.pdf_;
@@ -539,7 +539,8 @@ Material *BlendMaterial::factory(ParamMap &params, std::list<ParamMap> &eparams,
 		return nullptr;
 	}
 	mat->solveNodesOrder(roots);
-	mat->req_mem_ = sizeof(bool) + mat->req_node_mem_;
+	mat->blend_mem_ = sizeof(bool) + mat->req_node_mem_;
+	mat->req_mem_ = mat->blend_mem_ + mat->mmem_1_ + mat->mat_2_->getReqMem();
 	return mat;
 }
 
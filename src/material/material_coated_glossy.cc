@@ -71,8 +71,7 @@ void CoatedGlossyMaterial::initBsdf(const RenderState &state, SurfacePoint &sp,
 	NodeStack stack(dat->stack_);
 	if(bump_shader_) evalBump(stack, state, sp, bump_shader_);
 
-	auto end = all_viewindep_.end();
-	for(auto iter = all_viewindep_.begin(); iter != end; ++iter)(*iter)->eval(stack, state, sp);
+	evalNodes(state, sp, viewindep_program_, stack);
 	bsdf_types = bsdf_flags_;
 	dat->m_diffuse_ = diffuse_;
 	dat->m_glossy_ = glossy_reflection_shader_ ? glossy_reflection_shader_->getScalar(stack) : reflectivity_;
@@ -585,6 +584,12 @@ Material *CoatedGlossyMaterial::factory(ParamMap &params, std::list< ParamMap >
 	if(!roots.empty())
 	{
 		mat->solveNodesOrder(roots);
+		//the nodes only read by a disabled diffuse component are dead, so they are left out of the compiled program
+		if(!mat->with_diffuse_)
+		{
+			mat->sigma_oren_shader_ = nullptr;
+			if(!mat->as_diffuse_) mat->diffuse_shader_ = mat->diffuse_reflection_shader_ = nullptr;
+		}
 		std::vector<ShaderNode *> color_nodes;
 		if(mat->diffuse_shader_) mat->getNodeList(mat->diffuse_shader_, color_nodes);
 		if(mat->glossy_shader_) mat->getNodeList(mat->glossy_shader_, color_nodes);
@@ -598,6 +603,7 @@ Material *CoatedGlossyMaterial::factory(ParamMap &params, std::list< ParamMap >
 		if(mat->mirror_color_shader_)  mat->getNodeList(mat->mirror_color_shader_, color_nodes);
 		mat->filterNodes(color_nodes, mat->all_viewdep_, ViewDep);
 		mat->filterNodes(color_nodes, mat->all_viewindep_, ViewIndep);
+		mat->compileNodes(mat->all_viewindep_, mat->viewindep_program_);
 		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
 	}
 	mat->req_mem_ = mat->req_node_mem_ + sizeof(MDatT);
@@ -40,7 +40,7 @@ MaskMaterial::MaskMaterial(const Material *m_1, const Material *m_2, float thres
 void MaskMaterial::initBsdf(const RenderState &state, SurfacePoint &sp, Bsdf_t &bsdf_types) const
 {
 	NodeStack stack(state.userdata_);
-	evalNodes(state, sp, all_nodes_, stack);
+	evalNodes(state, sp, all_sorted_program_, stack);
 	float val = mask_->getScalar(stack); //mask->getFloat(sp.P);
 	bool mv = val > threshold_;
 	*(bool *)state.userdata_ = mv;
@@ -91,7 +91,7 @@ bool MaskMaterial::isTransparent() const
 Rgb MaskMaterial::getTransparency(const RenderState &state, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	NodeStack stack(state.userdata_);
-	evalNodes(state, sp, all_nodes_, stack);
+	evalNodes(state, sp, all_sorted_program_, stack);
 	float val = mask_->getScalar(stack);
 	bool mv = val > 0.5;
 	if(mv) return mat_2_->getTransparency(state, sp, wo);
@@ -20,6 +20,7 @@
 #include "common/environment.h"
 #include "common/logging.h"
 #include "common/param.h"
+#include "common/surface.h"
 #include "shader/shader_node.h"
 #include <set>
 
@@ -78,11 +79,6 @@ NodeMaterial::~NodeMaterial()
 	m_shaders_table_.clear();
 }
 
-void NodeMaterial::evalNodes(const RenderState &state, const SurfacePoint &sp, const std::vector<ShaderNode *> &nodes, NodeStack &stack) const {
-	auto end = nodes.end();
-	for(auto iter = nodes.begin(); iter != end; ++iter)(*iter)->eval(stack, state, sp);
-}
-
 void NodeMaterial::solveNodesOrder(const std::vector<ShaderNode *> &roots)
 {
 	//set all IDs = 0 to indicate "not tested yet"
@@ -101,6 +97,58 @@ void NodeMaterial::solveNodesOrder(const std::vector<ShaderNode *> &roots)
 		//else allViewindep.push_back(n);
 	}
 	req_node_mem_ = all_sorted_.size() * sizeof(NodeResult);
+	root_nodes_ = roots;
+	compileNodes(all_sorted_, all_sorted_program_);
+}
+
+void NodeMaterial::compileNodes(const std::vector<ShaderNode *> &nodes, NodeProgram &program) const
+{
+	program.clear();
+	std::vector<NodeResult> results(all_sorted_.size());
+	NodeStack stack(results.data());
+	const RenderState state;
+	const SurfacePoint sp {};
+	std::set<const ShaderNode *> folded, read;
+	//inputs folded into constants become immediate operands, so their results do not need to be on the stack
+	auto mix_operand = [&](const ShaderNode *input, const NodeResult &value) -> NodeProgram::Operand
+	{
+		if(!input) return {-1, value};
+		if(folded.find(input) != folded.end()) return {-1, results[input->id_]};
+		read.insert(input);
+		return {(int) input->id_, value};
+	};
+	for(const auto &node : nodes)
+	{
+		std::vector<const ShaderNode *> deps;
+		node->getDependencies(deps);
+		bool constant = node->isSurfaceIndependent();
+		for(const auto &dep : deps) if(folded.find(dep) == folded.end()) constant = false;
+		NodeMixOperation mix;
+		if(constant)
+		{
+			//surface independent nodes never look at state or sp, so dummy ones are enough to get their result
+			node->eval(stack, state, sp);
+			folded.insert(node);
+		}
+		else if(node->getMixOperation(mix))
+		{
+			const NodeProgram::Operand input_1 = mix_operand(mix.input_1_, mix.value_1_);
+			const NodeProgram::Operand input_2 = mix_operand(mix.input_2_, mix.value_2_);
+			const NodeProgram::Operand factor = mix_operand(mix.factor_, NodeResult(Rgba(0.f), mix.factor_value_));
+			program.addMix(node->id_, mix.mode_, input_1, input_2, factor);
+		}
+		else
+		{
+			program.addNode(node);
+			read.insert(deps.begin(), deps.end());
+		}
+	}
+	read.insert(root_nodes_.begin(), root_nodes_.end());
+	for(const auto &node : nodes)
+	{
+		if(folded.find(node) != folded.end() && read.find(node) != read.end()) program.addConstant(node->id_, results[node->id_]);
+	}
+	Y_VERBOSE << "NodeMaterial: Compiled " << nodes.size() << " nodes into " << program.numInstructions() << " instructions: " << program.numConstants() << " constants, " << program.numMixInstructions() << " inline mix operations" << YENDL;
 }
 
 /*! get a list of all nodes that are in the tree given by root
@@ -53,8 +53,7 @@ void RoughGlassMaterial::initBsdf(const RenderState &state, SurfacePoint &sp, Bs
 	if(bump_shader_) evalBump(stack, state, sp, bump_shader_);
 
 	//eval viewindependent nodes
-	auto end = all_viewindep_.end();
-	for(auto iter = all_viewindep_.begin(); iter != end; ++iter)(*iter)->eval(stack, state, sp);
+	evalNodes(state, sp, viewindep_program_, stack);
 	bsdf_types = bsdf_flags_;
 }
 
@@ -447,6 +446,7 @@ Material *RoughGlassMaterial::factory(ParamMap &params, std::list< ParamMap > &p
 		if(mat->filter_col_shader_) mat->getNodeList(mat->filter_col_shader_, color_nodes);
 		mat->filterNodes(color_nodes, mat->all_viewdep_, ViewDep);
 		mat->filterNodes(color_nodes, mat->all_viewindep_, ViewIndep);
+		mat->compileNodes(mat->all_viewindep_, mat->viewindep_program_);
 		if(mat->bump_shader_)
 		{
 			mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
@@ -163,7 +163,7 @@ static inline void accumulate__(const float *component, float *accum, float kr)
 void ShinyDiffuseMaterial::initBsdf(const RenderState &state, SurfacePoint &sp, Bsdf_t &bsdf_types) const
 {
 	SdDat *dat = (SdDat *)state.userdata_;
-	memset(dat, 0, 8 * sizeof(float));
+	memset(dat, 0, sizeof(SdDat));
 	dat->node_stack_ = (char *)state.userdata_ + sizeof(SdDat);
 	//create our "stack" to save node results
 	NodeStack stack(dat->node_stack_);
@@ -175,8 +175,7 @@ void ShinyDiffuseMaterial::initBsdf(const RenderState &state, SurfacePoint &sp,
 	}
 
 	//eval viewindependent nodes
-	auto end = all_viewindep_.end();
-	for(auto iter = all_viewindep_.begin(); iter != end; ++iter)(*iter)->eval(stack, state, sp);
+	evalNodes(state, sp, viewindep_program_, stack);
 	bsdf_types = bsdf_flags_;
 
 	getComponents(vi_nodes_, stack, dat->component_);
@@ -532,8 +531,7 @@ Rgb ShinyDiffuseMaterial::getTransparency(const RenderState &state, const Surfac
 	if(!m_is_transparent_) return Rgb(0.f);
 
 	NodeStack stack(state.userdata_);
-	auto end = all_sorted_.end();
-	for(auto iter = all_sorted_.begin(); iter != end; ++iter)(*iter)->eval(stack, state, sp);
+	evalNodes(state, sp, transparency_program_, stack);
 	float accum = 1.f;
 	float kr;
 	Vec3 n = FACE_FORWARD(sp.ng_, sp.n_, wo);
@@ -724,9 +722,15 @@ Material *ShinyDiffuseMaterial::factory(ParamMap &params, std::list<ParamMap> &p
 	mat->wireframe_shader_    = node_list["wireframe_shader"];
 
 	// solve nodes order
+	if(!roots.empty()) mat->solveNodesOrder(roots);
+
+	mat->config();
+
 	if(!roots.empty())
 	{
-		mat->solveNodesOrder(roots);
+		//the nodes only read by disabled BSDF components are dead, so they are left out of the compiled programs
+		if(!mat->is_mirror_) mat->mirror_color_shader_ = nullptr;
+		if(!mat->is_diffuse_) mat->sigma_oren_shader_ = mat->diffuse_refl_shader_ = nullptr;
 
 		std::vector<ShaderNode *> color_nodes;
 
@@ -742,13 +746,22 @@ Material *ShinyDiffuseMaterial::factory(ParamMap &params, std::list<ParamMap> &p
 
 		mat->filterNodes(color_nodes, mat->all_viewdep_, ViewDep);
 		mat->filterNodes(color_nodes, mat->all_viewindep_, ViewIndep);
+		mat->compileNodes(mat->all_viewindep_, mat->viewindep_program_);
+
+		//shadow rays only need the nodes read by getTransparency()
+		std::vector<ShaderNode *> transparency_nodes;
+		if(mat->m_is_transparent_)
+		{
+			for(ShaderNode *shader : {mat->diffuse_shader_, mat->mirror_shader_, mat->transparency_shader_, mat->ior_s_, mat->wireframe_shader_})
+			{
+				if(shader) mat->getNodeList(shader, transparency_nodes);
+			}
+		}
+		mat->compileNodes(transparency_nodes, mat->transparency_program_);
 
 		if(mat->bump_shader_)         mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
 	}
 
-
-	mat->config();
-
 	//===!!!=== test <<< This test should go, is useless, DT
 	/*if(params.getParam("name", name))
 	{
@@ -120,7 +120,7 @@ TriangleObjectInstance::TriangleObjectInstance(TriangleObject *base, Matrix4 obj
 	}
 }
 
-int TriangleObjectInstance::getPrimitives(const Triangle **prims)
+int TriangleObjectInstance::getPrimitives(const Triangle **prims) const
 {
 	for(size_t i = 0; i < triangles_.size(); i++)
 	{
@@ -36,4 +36,36 @@ ShaderNode *ShaderNode::factory(const ParamMap &params, RenderEnvironment &rende
 	else return nullptr;
 }
 
+void NodeProgram::addConstant(unsigned int id, const NodeResult &result)
+{
+	Instruction instruction {};
+	instruction.opcode_ = LoadConstant;
+	instruction.id_ = id;
+	instruction.input_1_ = {-1, result};
+	instructions_.insert(instructions_.begin() + num_constants_, instruction);
+	++num_constants_;
+}
+
+void NodeProgram::addNode(const ShaderNode *node)
+{
+	Instruction instruction {};
+	instruction.opcode_ = EvalNode;
+	instruction.id_ = node->id_;
+	instruction.node_ = node;
+	instructions_.push_back(instruction);
+}
+
+void NodeProgram::addMix(unsigned int id, MixModes mode, const Operand &input_1, const Operand &input_2, const Operand &factor)
+{
+	Instruction instruction {};
+	instruction.opcode_ = EvalMix;
+	instruction.mode_ = mode;
+	instruction.id_ = id;
+	instruction.input_1_ = input_1;
+	instruction.input_2_ = input_2;
+	instruction.factor_ = factor;
+	instructions_.push_back(instruction);
+	++num_mix_;
+}
+
 END_YAFARAY
@@ -180,6 +180,7 @@ void TextureMapperNode::getCoords(Point3 &texpt, Vec3 &ng, const SurfacePoint &s
 
 void TextureMapperNode::eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
 {
+	state.stats_->add(RenderStats::TextureFetches);
 	Point3 texpt(0.f);
 	Vec3 ng(0.f);
 	MipMapParams *mip_map_params = nullptr;
@@ -235,6 +236,7 @@ void TextureMapperNode::evalDerivative(NodeStack &stack, const RenderState &stat
 	Vec3 ng(0.f);
 	float du = 0.0f, dv = 0.0f;
 
+	state.stats_->add(RenderStats::TextureFetches);
 	getCoords(texpt, ng, sp, state);
 
 	if(tex_->discrete() && sp.has_uv_ && coords_ == Uv)
@@ -437,41 +439,15 @@ ShaderNode *ValueNode::factory(const ParamMap &params, RenderEnvironment &render
 /  A simple mix node, could be used to derive other math nodes
 / ========================================== */
 
-MixNode::MixNode(): cfactor_(0.f), input_1_(0), input_2_(0), factor_(0)
-{}
-
-MixNode::MixNode(float val): cfactor_(val), input_1_(0), input_2_(0), factor_(0)
+MixNode::MixNode(float val, MixModes mode): cfactor_(val), input_1_(0), input_2_(0), factor_(0), mode_(mode)
 {}
 
 void MixNode::eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
 {
-	float f_2 = (factor_) ? factor_->getScalar(stack) : cfactor_;
-	float f_1 = 1.f - f_2, fin_1, fin_2;
+	float f_2, fin_1, fin_2;
 	Rgba cin_1, cin_2;
-	if(input_1_)
-	{
-		cin_1 = input_1_->getColor(stack);
-		fin_1 = input_1_->getScalar(stack);
-	}
-	else
-	{
-		cin_1 = col_1_;
-		fin_1 = val_1_;
-	}
-	if(input_2_)
-	{
-		cin_2 = input_2_->getColor(stack);
-		fin_2 = input_2_->getScalar(stack);
-	}
-	else
-	{
-		cin_2 = col_2_;
-		fin_2 = val_2_;
-	}
-
-	Rgba color = f_1 * cin_1 + f_2 * cin_2;
-	float   scalar = f_1 * fin_1 + f_2 * fin_2;
-	stack[this->id_] = NodeResult(color, scalar);
+	getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
+	stack[this->id_] = mixNodeResults__(mode_, cin_1, fin_1, cin_2, fin_2, f_2);
 }
 
 void MixNode::eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi) const
@@ -538,147 +514,17 @@ bool MixNode::getDependencies(std::vector<const ShaderNode *> &dep) const
 	return !dep.empty();
 }
 
-class AddNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-
-			cin_1 += f_2 * cin_2;
-			fin_1 += f_2 * fin_2;
-			stack[this->id_] = NodeResult(cin_1, fin_1);
-		}
-};
-
-class MultNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_1, f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-			f_1 = 1.f - f_2;
-
-			cin_1 *= Rgba(f_1) + f_2 * cin_2;
-			fin_2 *= f_1 + f_2 * fin_2;
-			stack[this->id_] = NodeResult(cin_1, fin_1);
-		}
-};
-
-class SubNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-
-			cin_1 -= f_2 * cin_2;
-			fin_1 -= f_2 * fin_2;
-			stack[this->id_] = NodeResult(cin_1, fin_1);
-		}
-};
-
-class ScreenNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_1, f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-			f_1 = 1.f - f_2;
-
-			Rgba color = Rgba(1.f) - (Rgba(f_1) + f_2 * (1.f - cin_2)) * (1.f - cin_1);
-			float scalar   = 1.0 - (f_1 + f_2 * (1.f - fin_2)) * (1.f - fin_1);
-			stack[this->id_] = NodeResult(color, scalar);
-		}
-};
-
-class DiffNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_1, f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-			f_1 = 1.f - f_2;
-
-			cin_1.r_ = f_1 * cin_1.r_ + f_2 * std::fabs(cin_1.r_ - cin_2.r_);
-			cin_1.g_ = f_1 * cin_1.g_ + f_2 * std::fabs(cin_1.g_ - cin_2.g_);
-			cin_1.b_ = f_1 * cin_1.b_ + f_2 * std::fabs(cin_1.b_ - cin_2.b_);
-			cin_1.a_ = f_1 * cin_1.a_ + f_2 * std::fabs(cin_1.a_ - cin_2.a_);
-			fin_1   = f_1 * fin_1 + f_2 * std::fabs(fin_1 - fin_2);
-			stack[this->id_] = NodeResult(cin_1, fin_1);
-		}
-};
-
-class DarkNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-
-			cin_2 *= f_2;
-			if(cin_2.r_ < cin_1.r_) cin_1.r_ = cin_2.r_;
-			if(cin_2.g_ < cin_1.g_) cin_1.g_ = cin_2.g_;
-			if(cin_2.b_ < cin_1.b_) cin_1.b_ = cin_2.b_;
-			if(cin_2.a_ < cin_1.a_) cin_1.a_ = cin_2.a_;
-			fin_2 *= f_2;
-			if(fin_2 < fin_1) fin_1 = fin_2;
-			stack[this->id_] = NodeResult(cin_1, fin_1);
-		}
-};
-
-class LightNode: public MixNode
-{
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-
-			cin_2 *= f_2;
-			if(cin_2.r_ > cin_1.r_) cin_1.r_ = cin_2.r_;
-			if(cin_2.g_ > cin_1.g_) cin_1.g_ = cin_2.g_;
-			if(cin_2.b_ > cin_1.b_) cin_1.b_ = cin_2.b_;
-			if(cin_2.a_ > cin_1.a_) cin_1.a_ = cin_2.a_;
-			fin_2 *= f_2;
-			if(fin_2 > fin_1) fin_1 = fin_2;
-			stack[this->id_] = NodeResult(cin_1, fin_1);
-		}
-};
-
-class OverlayNode: public MixNode
+bool MixNode::getMixOperation(NodeMixOperation &operation) const
 {
-	public:
-		virtual void eval(NodeStack &stack, const RenderState &state, const SurfacePoint &sp) const
-		{
-			float f_1, f_2, fin_1, fin_2;
-			Rgba cin_1, cin_2;
-			getInputs(stack, cin_1, cin_2, fin_1, fin_2, f_2);
-			f_1 = 1.f - f_2;
-
-			Rgba color;
-			color.r_ = (cin_1.r_ < 0.5f) ? cin_1.r_ * (f_1 + 2.0f * f_2 * cin_2.r_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.r_)) * (1.0 - cin_1.r_);
-			color.g_ = (cin_1.g_ < 0.5f) ? cin_1.g_ * (f_1 + 2.0f * f_2 * cin_2.g_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.g_)) * (1.0 - cin_1.g_);
-			color.b_ = (cin_1.b_ < 0.5f) ? cin_1.b_ * (f_1 + 2.0f * f_2 * cin_2.b_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.b_)) * (1.0 - cin_1.b_);
-			color.a_ = (cin_1.a_ < 0.5f) ? cin_1.a_ * (f_1 + 2.0f * f_2 * cin_2.a_) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - cin_2.a_)) * (1.0 - cin_1.a_);
-			float scalar = (fin_1 < 0.5f) ? fin_1 * (f_1 + 2.0f * f_2 * fin_2) : 1.0 - (f_1 + 2.0f * f_2 * (1.0 - fin_2)) * (1.0 - fin_1);
-			stack[this->id_] = NodeResult(color, scalar);
-		}
-};
-
+	operation.mode_ = mode_;
+	operation.input_1_ = input_1_;
+	operation.input_2_ = input_2_;
+	operation.factor_ = factor_;
+	operation.value_1_ = NodeResult(col_1_, val_1_);
+	operation.value_2_ = NodeResult(col_2_, val_2_);
+	operation.factor_value_ = cfactor_;
+	return true;
+}
 
 ShaderNode *MixNode::factory(const ParamMap &params, RenderEnvironment &render)
 {
@@ -689,17 +535,16 @@ ShaderNode *MixNode::factory(const ParamMap &params, RenderEnvironment &render)
 
 	switch(mode)
 	{
-		case MnMix: 		return new MixNode(val);
-		case MnAdd: 		return new AddNode();
-		case MnMult: 		return new MultNode();
-		case MnSub: 		return new SubNode();
-		case MnScreen:		return new ScreenNode();
-		case MnDiff:		return new DiffNode();
-		case MnDark:		return new DarkNode();
-		case MnLight:		return new LightNode();
-		case MnOverlay:	return new OverlayNode();
+		case MnAdd:
+		case MnMult:
+		case MnSub:
+		case MnScreen:
+		case MnDiff:
+		case MnDark:
+		case MnLight:
+		case MnOverlay: return new MixNode(0.f, (MixModes) mode);
+		default: return new MixNode(val, MnMix);
 	}
-	return new MixNode(val);
 }
 
 END_YAFARAY
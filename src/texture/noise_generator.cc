@@ -176,33 +176,79 @@ static float hashvectf__[768] =
 
 #define LERP(t, a, b) ((a)+(t)*((b)-(a)))
 
+//! maximum amount of points evaluated together by the batched noise kernels, and of octaves by the fractal functions
+static constexpr int noise_batch__ = 8;
+
+void NoiseGenerator::evalBatch(const Point3 *pts, float *values, int n) const
+{
+	for(int i = 0; i < n; ++i) values[i] = (*this)(pts[i]);
+}
+
+//! evaluates the noise at count (up to noise_batch__) successive octaves starting at tp, leaving tp scaled for the octave after them
+static void octaveNoise__(const NoiseGenerator *n_gen, Point3 &tp, float lacunarity, int count, float *values)
+{
+	Point3 pts[noise_batch__];
+	for(int i = 0; i < count; ++i)
+	{
+		pts[i] = tp;
+		tp *= lacunarity;
+	}
+	n_gen->evalBatch(pts, values, count);
+}
+
 //------------------------------------------------------------------------------------
 // New Perlin noise
 
-float NewPerlinNoiseGenerator::operator()(const Point3 &pt) const
+inline void NewPerlinNoiseGenerator::cornerHashes(const Point3 &pt, int hashes[8], float &x, float &y, float &z) const
 {
-	float x = pt.x_, y = pt.y_, z = pt.z_;
+	x = pt.x_, y = pt.y_, z = pt.z_;
 	float u = floor(x), v = floor(y), w = floor(z);
 	int X = ((int)u) & 255, Y = ((int)v) & 255, Z = ((int)w) & 255; // FIND UNIT CUBE THAT CONTAINS POINT
 	x -= u;  // FIND RELATIVE X,Y,Z
 	y -= v;  // OF POINT IN CUBE.
 	z -= w;
-	u = fade(x);  // COMPUTE FADE CURVES
-	v = fade(y);  // FOR EACH OF X,Y,Z.
-	w = fade(z);
 	int a = hash__[X  ] + Y, aa = hash__[a] + Z, ab = hash__[a + 1] + Z, // HASH COORDINATES OF
-	    b = hash__[X + 1] + Y, ba = hash__[b] + Z, bb = hash__[b + 1] + Z; // THE 8 CUBE CORNERS,
-	float nv = LERP(w, LERP(v, LERP(u, grad(hash__[aa  ], x, y, z),         // AND ADD
-	                                grad(hash__[ba  ], x - 1, y, z)),     // BLENDED
-	                        LERP(u, grad(hash__[ab  ], x, y - 1, z),      // RESULTS
-	                             grad(hash__[bb  ], x - 1, y - 1, z))), // FROM  8
-	                LERP(v, LERP(u, grad(hash__[aa + 1], x, y, z - 1),    // CORNERS
-	                             grad(hash__[ba + 1], x - 1, y, z - 1)), // OF CUBE
-	                     LERP(u, grad(hash__[ab + 1], x, y - 1, z - 1),
-							  grad(hash__[bb + 1], x - 1, y - 1, z - 1))));
+	    b = hash__[X + 1] + Y, ba = hash__[b] + Z, bb = hash__[b + 1] + Z; // THE 8 CUBE CORNERS
+	hashes[0] = hash__[aa  ], hashes[1] = hash__[ba  ], hashes[2] = hash__[ab  ], hashes[3] = hash__[bb  ];
+	hashes[4] = hash__[aa + 1], hashes[5] = hash__[ba + 1], hashes[6] = hash__[ab + 1], hashes[7] = hash__[bb + 1];
+}
+
+inline float NewPerlinNoiseGenerator::blendCorners(const int hashes[8], float x, float y, float z) const
+{
+	float u = fade(x);  // COMPUTE FADE CURVES
+	float v = fade(y);  // FOR EACH OF X,Y,Z.
+	float w = fade(z);
+	float nv = LERP(w, LERP(v, LERP(u, grad(hashes[0], x, y, z),         // AND ADD
+	                                grad(hashes[1], x - 1, y, z)),     // BLENDED
+	                        LERP(u, grad(hashes[2], x, y - 1, z),      // RESULTS
+	                             grad(hashes[3], x - 1, y - 1, z))), // FROM  8
+	                LERP(v, LERP(u, grad(hashes[4], x, y, z - 1),    // CORNERS
+	                             grad(hashes[5], x - 1, y, z - 1)), // OF CUBE
+	                     LERP(u, grad(hashes[6], x, y - 1, z - 1),
+							  grad(hashes[7], x - 1, y - 1, z - 1))));
 	return (0.5 + 0.5 * nv);
 }
 
+float NewPerlinNoiseGenerator::operator()(const Point3 &pt) const
+{
+	int hashes[8];
+	float x, y, z;
+	cornerHashes(pt, hashes, x, y, z);
+	return blendCorners(hashes, x, y, z);
+}
+
+void NewPerlinNoiseGenerator::evalBatch(const Point3 *pts, float *values, int n) const
+{
+	int hashes[noise_batch__][8];
+	float x[noise_batch__], y[noise_batch__], z[noise_batch__];
+	for(int start = 0; start < n; start += noise_batch__)
+	{
+		const int count = std::min(noise_batch__, n - start);
+		for(int i = 0; i < count; ++i) cornerHashes(pts[start + i], hashes[i], x[i], y[i], z[i]);
+		for(int i = 0; i < count; ++i) values[start + i] = blendCorners(hashes[i], x[i], y[i], z[i]);
+	}
+}
+
 //------------------------------------------------------------------------------------
 // Standard (old) Perlin noise
 
@@ -576,11 +622,72 @@ void VoronoiNoiseGenerator::getFeatures(const Point3 &pt, float da[4], Point3 pa
 	}
 }
 
+//! computes the distance metric over arrays of coordinate differences, with the metric inlined so that the loop can be vectorized
+template <float (*Distance)(float, float, float, float)>
+static void distances__(const float *xd, const float *yd, const float *zd, float *d, int n, float e)
+{
+	for(int i = 0; i < n; ++i) d[i] = Distance(xd[i], yd[i], zd[i], e);
+}
+
+void VoronoiNoiseGenerator::evalBatch(const Point3 *pts, float *values, int n) const
+{
+	constexpr int num_cells = 27;
+	float xd[noise_batch__ * num_cells], yd[noise_batch__ * num_cells], zd[noise_batch__ * num_cells], d[noise_batch__ * num_cells];
+	for(int start = 0; start < n; start += noise_batch__)
+	{
+		const int count = std::min(noise_batch__, n - start);
+		const int num_distances = count * num_cells;
+		// same cell order and differences as getFeatures()
+		for(int i = 0, cell = 0; i < count; ++i)
+		{
+			const float x = pts[start + i].x_, y = pts[start + i].y_, z = pts[start + i].z_;
+			const int xi = (int)(floor(x)), yi = (int)(floor(y)), zi = (int)(floor(z));
+			for(int xx = xi - 1; xx <= xi + 1; xx++)
+			{
+				for(int yy = yi - 1; yy <= yi + 1; yy++)
+				{
+					for(int zz = zi - 1; zz <= zi + 1; zz++, cell++)
+					{
+						const float *p = HASHPNT(xx, yy, zz);
+						xd[cell] = x - (p[0] + xx);
+						yd[cell] = y - (p[1] + yy);
+						zd[cell] = z - (p[2] + zz);
+					}
+				}
+			}
+		}
+		if(distfunc_2_ == distRealF__) distances__<distRealF__>(xd, yd, zd, d, num_distances, mk_exp_);
+		else if(distfunc_2_ == distSquaredF__) distances__<distSquaredF__>(xd, yd, zd, d, num_distances, mk_exp_);
+		else if(distfunc_2_ == distChebychevF__) distances__<distChebychevF__>(xd, yd, zd, d, num_distances, mk_exp_);
+		else if(distfunc_2_ == distMinkovskyHf__) distances__<distMinkovskyHf__>(xd, yd, zd, d, num_distances, mk_exp_);
+		else if(distfunc_2_ == distMinkovsky4F__) distances__<distMinkovsky4F__>(xd, yd, zd, d, num_distances, mk_exp_);
+		else for(int i = 0; i < num_distances; ++i) d[i] = distfunc_2_(xd[i], yd[i], zd[i], mk_exp_);
+		for(int i = 0; i < count; ++i)
+		{
+			float da[4] = {1e10f, 1e10f, 1e10f, 1e10f};
+			for(int cell = i * num_cells; cell < (i + 1) * num_cells; ++cell)
+			{
+				const float dist = d[cell];
+				if(dist < da[0]) { da[3] = da[2];  da[2] = da[1];  da[1] = da[0];  da[0] = dist; }
+				else if(dist < da[1]) { da[3] = da[2];  da[2] = da[1];  da[1] = dist; }
+				else if(dist < da[2]) { da[3] = da[2];  da[2] = dist; }
+				else if(dist < da[3]) da[3] = dist;
+			}
+			values[start + i] = featureValue(da);
+		}
+	}
+}
+
 float VoronoiNoiseGenerator::operator()(const Point3 &pt) const
 {
 	float da[4];
 	Point3 pa[4];
 	getFeatures(pt, da, pa);
+	return featureValue(da);
+}
+
+float VoronoiNoiseGenerator::featureValue(const float da[4]) const
+{
 	switch(v_type_)
 	{
 		case Vf2:
@@ -632,11 +739,16 @@ float FBmMusgrave::operator()(const Point3 &pt) const
 {
 	float value = 0, pwr = 1, pw_hl = fPow__(lacunarity_, -h_);
 	Point3 tp(pt);
-	for(int i = 0; i < (int)octaves_; i++)
+	float noise[noise_batch__];
+	for(int i = 0; i < (int)octaves_; i += noise_batch__)
 	{
-		value += getSignedNoise__(n_gen_, tp) * pwr;
-		pwr *= pw_hl;
-		tp *= lacunarity_;
+		const int count = std::min(noise_batch__, (int)octaves_ - i);
+		octaveNoise__(n_gen_, tp, lacunarity_, count, noise);
+		for(int j = 0; j < count; ++j)
+		{
+			value += getSignedNoise__(noise[j]) * pwr;
+			pwr *= pw_hl;
+		}
 	}
 	float rmd = octaves_ - floor(octaves_);
 	if(rmd != 0.f) value += rmd * getSignedNoise__(n_gen_, tp) * pwr;
@@ -661,11 +773,16 @@ float MFractalMusgrave::operator()(const Point3 &pt) const
 {
 	float value = 1, pwr = 1, pw_hl = fPow__(lacunarity_, -h_);
 	Point3 tp(pt);
-	for(int i = 0; i < (int)octaves_; i++)
+	float noise[noise_batch__];
+	for(int i = 0; i < (int)octaves_; i += noise_batch__)
 	{
-		value *= (pwr * getSignedNoise__(n_gen_, tp) + (float)1.0);
-		pwr *= pw_hl;
-		tp *= lacunarity_;
+		const int count = std::min(noise_batch__, (int)octaves_ - i);
+		octaveNoise__(n_gen_, tp, lacunarity_, count, noise);
+		for(int j = 0; j < count; ++j)
+		{
+			value *= (pwr * getSignedNoise__(noise[j]) + (float)1.0);
+			pwr *= pw_hl;
+		}
 	}
 	float rmd = octaves_ - floor(octaves_);
 	if(rmd != (float)0.0) value *= (rmd * getSignedNoise__(n_gen_, tp) * pwr + (float)1.0);
@@ -693,12 +810,17 @@ float HeteroTerrainMusgrave::operator()(const Point3 &pt) const
 	float value = offset_ + getSignedNoise__(n_gen_, tp);
 	tp *= lacunarity_;
 	float increment;
-	for(int i = 1; i < (int)octaves_; i++)
+	float noise[noise_batch__];
+	for(int i = 1; i < (int)octaves_; i += noise_batch__)
 	{
-		increment = (getSignedNoise__(n_gen_, tp) + offset_) * pwr * value;
-		value += increment;
-		pwr *= pw_hl;
-		tp *= lacunarity_;
+		const int count = std::min(noise_batch__, (int)octaves_ - i);
+		octaveNoise__(n_gen_, tp, lacunarity_, count, noise);
+		for(int j = 0; j < count; ++j)
+		{
+			increment = (getSignedNoise__(noise[j]) + offset_) * pwr * value;
+			value += increment;
+			pwr *= pw_hl;
+		}
 	}
 
 	float rmd = octaves_ - floor(octaves_);
@@ -766,16 +888,22 @@ float RidgedMFractalMusgrave::operator()(const Point3 &pt) const
 	float result = signal;
 	float weight = 1.0;
 
-	for(int i = 1; i < (int)octaves_; i++)
+	tp *= lacunarity_;
+	float noise[noise_batch__];
+	for(int i = 1; i < (int)octaves_; i += noise_batch__)
 	{
-		tp *= lacunarity_;
-		weight = signal * gain_;
-		if(weight > (float)1.0) weight = (float)1.0; else if(weight < (float)0.0) weight = (float)0.0;
-		signal = offset_ - std::fabs(getSignedNoise__(n_gen_, tp));
-		signal *= signal;
-		signal *= weight;
-		result += signal * pwr;
-		pwr *= pw_hl;
+		const int count = std::min(noise_batch__, (int)octaves_ - i);
+		octaveNoise__(n_gen_, tp, lacunarity_, count, noise);
+		for(int j = 0; j < count; ++j)
+		{
+			weight = signal * gain_;
+			if(weight > (float)1.0) weight = (float)1.0; else if(weight < (float)0.0) weight = (float)0.0;
+			signal = offset_ - std::fabs(getSignedNoise__(noise[j]));
+			signal *= signal;
+			signal *= weight;
+			result += signal * pwr;
+			pwr *= pw_hl;
+		}
 	}
 
 	return result;
@@ -800,11 +928,17 @@ float turbulence__(const NoiseGenerator *ngen, const Point3 &pt, int oct, float
 {
 	float val, amp = 1, sum = 0;
 	Point3 tp = ngen->offset(pt) * size;	// only blendernoise adds offset
-	for(int i = 0; i <= oct; i++, amp *= 0.5, tp *= 2.0)
+	float noise[noise_batch__];
+	for(int i = 0; i <= oct; i += noise_batch__)
 	{
-		val = (*ngen)(tp);
-		if(hard) val = std::fabs(2.0 * val - 1.0);
-		sum += amp * val;
+		const int count = std::min(noise_batch__, oct + 1 - i);
+		octaveNoise__(ngen, tp, 2.0, count, noise);
+		for(int j = 0; j < count; ++j, amp *= 0.5)
+		{
+			val = noise[j];
+			if(hard) val = std::fabs(2.0 * val - 1.0);
+			sum += amp * val;
+		}
 	}
 
 	return sum * ((float)(1 << oct) / (float)((1 << (oct + 1)) - 1));